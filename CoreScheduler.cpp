@@ -0,0 +1,108 @@
+//
+//  CoreScheduler.cpp
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#include "CoreScheduler.h"
+#include "ProjectDefs.h"
+
+#include <itkMultiThreader.h>
+#include <itkMutexLockHolder.h>
+
+#include <log4cplus/loggingmacros.h>
+
+#include <algorithm>
+
+typedef itk::MutexLockHolder<itk::SimpleFastMutexLock> LockHolder;
+
+CoreScheduler& CoreScheduler::GetInstance()
+{
+    static CoreScheduler instance;
+    return instance;
+}
+
+CoreScheduler::CoreScheduler()
+    : numCores_(itk::MultiThreader::GetGlobalDefaultNumberOfThreads()),
+      activeJobs_(0), threadsInUse_(0)
+{
+    std::string name = std::string(LOGGER_NAME) + ".CoreScheduler";
+    logger_ = log4cplus::Logger::getInstance(name);
+}
+
+void CoreScheduler::SetNumberOfCores(unsigned numCores)
+{
+    LockHolder lock(mutex_);
+
+    numCores_ = std::max(numCores, 1u);
+
+    LOG4CPLUS_INFO(logger_, "Core budget set to " << numCores_);
+}
+
+unsigned CoreScheduler::GetNumberOfConcurrentJobs(unsigned requested,
+                                                  unsigned minThreadsPerJob) const
+{
+    unsigned jobs = numCores_ / std::max(minThreadsPerJob, 1u);
+    if (requested > 0)
+        jobs = std::min(requested, numCores_);
+
+    return std::max(jobs, 1u);
+}
+
+void CoreScheduler::JobStarted()
+{
+    LockHolder lock(mutex_);
+
+    ++activeJobs_;
+}
+
+void CoreScheduler::JobFinished()
+{
+    LockHolder lock(mutex_);
+
+    if (activeJobs_ > 0)
+        --activeJobs_;
+}
+
+unsigned CoreScheduler::GetFairShare() const
+{
+    LockHolder lock(mutex_);
+
+    return std::max(numCores_ / std::max(activeJobs_, 1u), 1u);
+}
+
+unsigned CoreScheduler::AcquireThreads(unsigned heldThreads, unsigned level, unsigned numLevels)
+{
+    LockHolder lock(mutex_);
+
+    threadsInUse_ -= std::min(heldThreads, threadsInUse_);
+
+    unsigned share = numCores_ / std::max(activeJobs_, 1u);
+    unsigned idle = numCores_ > threadsInUse_ ? numCores_ - threadsInUse_ : 0;
+
+    // Each coarser level has roughly 1/2^dim the pixels of the next finer one.
+    // Halving the threads per level keeps the work per thread reasonable.
+    unsigned threads = share;
+    for (unsigned lvl = level + 1; lvl < numLevels; ++lvl)
+        threads /= 2;
+
+    // Never more than the other jobs leave idle, so that the allocations of the
+    // running jobs stay within the budget.
+    threads = std::max(std::min(threads, idle), 1u);
+    threadsInUse_ += threads;
+
+    LOG4CPLUS_DEBUG(logger_, "Level " << level << " of " << numLevels << ": " << threads
+                    << " threads (" << activeJobs_ << " jobs, " << threadsInUse_ << " in use).");
+
+    return threads;
+}
+
+void CoreScheduler::ReleaseThreads(unsigned heldThreads)
+{
+    LockHolder lock(mutex_);
+
+    threadsInUse_ -= std::min(heldThreads, threadsInUse_);
+}
+
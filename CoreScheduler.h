@@ -0,0 +1,113 @@
+//
+//  CoreScheduler.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__CoreScheduler__
+#define __DCEFit__CoreScheduler__
+
+#include <itkSimpleFastMutexLock.h>
+
+#include <log4cplus/logger.h>
+
+/**
+ * Owns the machine's core budget. It decides how many registrations (jobs)
+ * may run at once and how many ITK threads each running job gets.
+ *
+ * A job registers itself with JobStarted() and JobFinished(). At each change of
+ * resolution level it calls AcquireThreads() which gives back the threads it held
+ * and returns its new allocation. Coarse levels have few pixels and scale poorly
+ * so they are given a fraction of the fair share. No allocation is larger than the
+ * cores the other jobs leave idle, so together they stay within the budget.
+ *
+ * The filters a job creates outside the levels take the fair share from
+ * GetFairShare(). The ITK global default thread count is never changed as other
+ * threads read it while they construct filters.
+ *
+ * There is one instance per process.
+ */
+class CoreScheduler
+{
+public:
+    /**
+     * Get the process wide instance.
+     * @return The scheduler.
+     */
+    static CoreScheduler& GetInstance();
+
+    /**
+     * Set the number of cores that the registrations may use.
+     * @param numCores The core budget. Must be > 0.
+     */
+    void SetNumberOfCores(unsigned numCores);
+
+    /**
+     * @return The core budget.
+     */
+    unsigned GetNumberOfCores() const
+    {
+        return numCores_;
+    }
+
+    /**
+     * Decide how many jobs to run at once.
+     * @param requested The number requested by the user. 0 lets the scheduler decide.
+     * @param minThreadsPerJob The fewest threads a job should have in its finest level.
+     * Use 1 for small (2D) jobs and more for jobs which scale well.
+     * @return The number of jobs to run at once. Always > 0.
+     */
+    unsigned GetNumberOfConcurrentJobs(unsigned requested, unsigned minThreadsPerJob) const;
+
+    /**
+     * Tell the scheduler that a job has started.
+     */
+    void JobStarted();
+
+    /**
+     * Tell the scheduler that a job has finished. Threads still held by the
+     * job must have been released first.
+     */
+    void JobFinished();
+
+    /**
+     * @return The cores divided among the running jobs. Always > 0.
+     */
+    unsigned GetFairShare() const;
+
+    /**
+     * Get the number of threads a job should use for a level. The threads held
+     * from the previous level are given back first.
+     * @param heldThreads The number of threads the job holds now (0 at the start).
+     * @param level The resolution level about to start, 0 being the coarsest.
+     * @param numLevels The number of levels in the registration.
+     * @return The new allocation. Always > 0.
+     */
+    unsigned AcquireThreads(unsigned heldThreads, unsigned level, unsigned numLevels);
+
+    /**
+     * Give back threads.
+     * @param heldThreads The number of threads to give back.
+     */
+    void ReleaseThreads(unsigned heldThreads);
+
+private:
+    /**
+     * Constructor. Use GetInstance().
+     */
+    CoreScheduler();
+
+    // Not implemented
+    CoreScheduler(const CoreScheduler&);
+    CoreScheduler& operator=(const CoreScheduler&);
+
+    log4cplus::Logger logger_;         ///< The logger.
+    mutable itk::SimpleFastMutexLock mutex_; ///< Guards the counts below.
+    unsigned numCores_;                ///< The core budget.
+    unsigned activeJobs_;              ///< Number of jobs running.
+    unsigned threadsInUse_;            ///< Sum of the allocations of the running jobs.
+};
+
+#endif /* defined(__DCEFit__CoreScheduler__) */
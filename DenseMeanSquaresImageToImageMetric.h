@@ -0,0 +1,519 @@
+//
+//  DenseMeanSquaresImageToImageMetric.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__DenseMeanSquaresImageToImageMetric__
+#define __DCEFit__DenseMeanSquaresImageToImageMetric__
+
+#include "ItkTypedefs.h"
+#include "FixedImageMask.h"
+
+#include <itkImageToImageMetric.h>
+#include <itkMatrixOffsetTransformBase.h>
+#include <itkImageLinearConstIteratorWithIndex.h>
+#include <itkMultiThreader.h>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * The mean squares metric over every pixel of the fixed region, for the transforms
+ * of the rigid stages. Those are all matrix and offset transforms, so along a row of
+ * the fixed image the mapped point moves by the same step from one pixel to the
+ * next. The metric walks the region a row at a time, stepping the continuous index
+ * in the moving image rather than mapping each pixel through the transform, and
+ * interpolates the moving image and its gradient linearly with the same weights
+ * straight from the buffers. The interpolator set on the metric is not used.
+ *
+ * The Jacobian of such a transform is affine in the point, so along a row it too
+ * changes by a constant step. The derivative sums the residual times the gradient,
+ * and that times the position along the row, and applies the Jacobian once at each
+ * end of the row instead of at every pixel.
+ *
+ * With a raster mask only the runs of pixels inside the ROI are walked.
+ *
+ * The pixels are float, so the arithmetic along a row may be done in single
+ * precision too, which halves the size of the values the loop works on. Each row
+ * starts from a point mapped in double and its totals are added to double sums, so
+ * the error does not build up beyond a row. The validation setting runs both and
+ * logs the largest differences.
+ */
+template <class TFixedImage, class TMovingImage>
+class DenseMeanSquaresImageToImageMetric
+    : public itk::ImageToImageMetric<TFixedImage, TMovingImage>
+{
+public:
+    typedef DenseMeanSquaresImageToImageMetric Self;
+    typedef itk::ImageToImageMetric<TFixedImage, TMovingImage> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(DenseMeanSquaresImageToImageMetric, ImageToImageMetric);
+
+    itkStaticConstMacro(ImageDimension, unsigned, TFixedImage::ImageDimension);
+
+    typedef typename Superclass::MeasureType MeasureType;
+    typedef typename Superclass::DerivativeType DerivativeType;
+    typedef typename Superclass::ParametersType ParametersType;
+    typedef typename Superclass::TransformJacobianType TransformJacobianType;
+    typedef typename Superclass::GradientImageType GradientImageType;
+    typedef typename Superclass::GradientPixelType GradientPixelType;
+    typedef itk::MatrixOffsetTransformBase<double, TFixedImage::ImageDimension,
+                                           TMovingImage::ImageDimension> LinearTransformType;
+    typedef FixedImageMask<TFixedImage> MaskType;
+    typedef typename MaskType::Run RunType;
+
+    /**
+     * Set the ROI. Only the pixels of the region inside it are used.
+     * @param mask The ROI. May be null.
+     */
+    void SetRasterMask(typename MaskType::Pointer mask)
+    {
+        mask_ = mask;
+    }
+
+    /**
+     * Set the precision of the arithmetic along the rows.
+     * @param precision The precision. ValidatePrecision returns the double results.
+     */
+    void SetPrecision(MetricPrecisionType precision)
+    {
+        precision_ = precision;
+    }
+
+    MetricPrecisionType GetPrecision() const
+    {
+        return precision_;
+    }
+
+    /**
+     * Set up the rows of the fixed region and the gradient of the moving image.
+     * Unlike the base class no samples are drawn.
+     */
+    virtual void Initialize() throw (itk::ExceptionObject)
+    {
+        if (this->m_Transform.IsNull())
+        {
+            itkExceptionMacro(<< "Transform is not present");
+        }
+        if (dynamic_cast<const LinearTransformType*>(this->m_Transform.GetPointer()) == 0)
+        {
+            itkExceptionMacro(<< "The dense mean squares metric needs a matrix and offset transform.");
+        }
+        if (this->m_FixedImage.IsNull())
+        {
+            itkExceptionMacro(<< "FixedImage is not present");
+        }
+        if (this->m_MovingImage.IsNull())
+        {
+            itkExceptionMacro(<< "MovingImage is not present");
+        }
+        if (this->m_FixedImageRegion.GetNumberOfPixels() == 0)
+        {
+            itkExceptionMacro(<< "FixedImageRegion is empty");
+        }
+
+        // A new level. Report the one before.
+        LogDifferences();
+
+        this->m_NumberOfParameters = this->m_Transform->GetNumberOfParameters();
+        this->m_Threader->SetNumberOfThreads(this->m_NumberOfThreads);
+        this->ComputeGradient();
+
+        if (this->m_GradientImage->GetBufferedRegion() != this->m_MovingImage->GetBufferedRegion())
+        {
+            itkExceptionMacro(<< "The moving image gradient is not on the grid of the moving image.");
+        }
+
+        runs_.clear();
+        if (mask_.IsNotNull())
+        {
+            runs_ = mask_->GetRaster(this->m_FixedImage, this->m_FixedImageRegion).GetRuns();
+        }
+        else
+        {
+            itk::ImageLinearConstIteratorWithIndex<TFixedImage> iter(this->m_FixedImage,
+                                                                    this->m_FixedImageRegion);
+            iter.SetDirection(0);
+            for (iter.GoToBegin(); !iter.IsAtEnd(); iter.NextLine())
+            {
+                RunType run;
+                run.start = iter.GetIndex();
+                run.length = this->m_FixedImageRegion.GetSize(0);
+                runs_.push_back(run);
+            }
+        }
+
+        if (runs_.empty())
+        {
+            itkExceptionMacro(<< "The ROI holds none of the pixels of the registration region.");
+        }
+
+        const itk::ThreadIdType numThreads = this->m_Threader->GetNumberOfThreads();
+        threadSums_.assign(numThreads, 0.0);
+        threadCounts_.assign(numThreads, 0);
+        threadDerivatives_.assign(numThreads, std::vector<double>(this->m_NumberOfParameters, 0.0));
+        threadJacobians_.assign(2 * numThreads, TransformJacobianType(ImageDimension,
+                                                                     this->m_NumberOfParameters));
+    }
+
+    virtual MeasureType GetValue(const ParametersType& parameters) const
+    {
+        this->m_Transform->SetParameters(parameters);
+        return Compute(false, 0);
+    }
+
+    virtual void GetDerivative(const ParametersType& parameters, DerivativeType& derivative) const
+    {
+        MeasureType value;
+        GetValueAndDerivative(parameters, value, derivative);
+    }
+
+    virtual void GetValueAndDerivative(const ParametersType& parameters, MeasureType& value,
+                                       DerivativeType& derivative) const
+    {
+        this->m_Transform->SetParameters(parameters);
+        value = Compute(true, &derivative);
+    }
+
+protected:
+    DenseMeanSquaresImageToImageMetric()
+    : precision_(DoublePrecision), numPixels_(0), withDerivative_(false), singlePrecision_(false),
+      numCompared_(0), maxValueDifference_(0.0), maxDerivativeDifference_(0.0)
+    {
+        std::string name = std::string(LOGGER_NAME) + ".DenseMeanSquaresImageToImageMetric";
+        logger_ = log4cplus::Logger::getInstance(name);
+
+        this->SetComputeGradient(true);
+    }
+
+    virtual ~DenseMeanSquaresImageToImageMetric()
+    {
+        LogDifferences();
+    }
+
+private:
+    DenseMeanSquaresImageToImageMetric(const Self&);    // Not implemented.
+    void operator=(const Self&);                        // Not implemented.
+
+    /**
+     * Work out the value, and the derivative if wanted, at the precision set.
+     * @param withDerivative Compute the derivative if true.
+     * @param derivative Set to the derivative. May be 0 without one.
+     */
+    MeasureType Compute(bool withDerivative, DerivativeType* derivative) const
+    {
+        if (precision_ != ValidatePrecision)
+            return Compute(withDerivative, precision_ == SinglePrecision, derivative);
+
+        DerivativeType singleDerivative;
+        MeasureType singleValue = Compute(withDerivative, true, &singleDerivative);
+        MeasureType value = Compute(withDerivative, false, derivative);
+        CompareResults(value, singleValue, withDerivative ? derivative : 0, singleDerivative);
+
+        return value;
+    }
+
+    /**
+     * Run the threads over the rows and total their sums.
+     */
+    MeasureType Compute(bool withDerivative, bool singlePrecision, DerivativeType* derivative) const
+    {
+        withDerivative_ = withDerivative;
+        singlePrecision_ = singlePrecision;
+        this->m_Threader->SetSingleMethod(ThreaderCallback, const_cast<Self*>(this));
+        this->m_Threader->SingleMethodExecute();
+
+        double sum = 0.0;
+        numPixels_ = 0;
+        for (unsigned thread = 0; thread < threadSums_.size(); ++thread)
+        {
+            sum += threadSums_[thread];
+            numPixels_ += threadCounts_[thread];
+        }
+
+        if (numPixels_ == 0)
+        {
+            itkExceptionMacro(<< "All the points mapped to outside of the moving image");
+        }
+
+        if (withDerivative && (derivative != 0))
+        {
+            derivative->SetSize(this->m_NumberOfParameters);
+            derivative->Fill(0.0);
+            const double factor = 2.0 / numPixels_;
+            for (unsigned thread = 0; thread < threadDerivatives_.size(); ++thread)
+                for (unsigned param = 0; param < this->m_NumberOfParameters; ++param)
+                    (*derivative)[param] += factor * threadDerivatives_[thread][param];
+        }
+
+        return static_cast<MeasureType>(sum / numPixels_);
+    }
+
+    /**
+     * Keep the largest differences of the single precision results from the
+     * double ones, relative to the size of the double ones.
+     */
+    void CompareResults(MeasureType value, MeasureType singleValue, const DerivativeType* derivative,
+                        const DerivativeType& singleDerivative) const
+    {
+        const double tiny = 1e-30;
+        double valueDifference = std::abs(singleValue - value) / std::max(std::abs(value), tiny);
+        maxValueDifference_ = std::max(maxValueDifference_, valueDifference);
+
+        double derivativeDifference = 0.0;
+        if (derivative != 0)
+        {
+            double norm = 0.0;
+            double differenceNorm = 0.0;
+            for (unsigned param = 0; param < derivative->GetSize(); ++param)
+            {
+                double difference = singleDerivative[param] - (*derivative)[param];
+                norm += (*derivative)[param] * (*derivative)[param];
+                differenceNorm += difference * difference;
+            }
+            derivativeDifference = std::sqrt(differenceNorm / std::max(norm, tiny));
+            maxDerivativeDifference_ = std::max(maxDerivativeDifference_, derivativeDifference);
+        }
+        ++numCompared_;
+
+        LOG4CPLUS_DEBUG(logger_, "Single precision differences: value " << valueDifference
+                        << ", derivative " << derivativeDifference);
+    }
+
+    /**
+     * Report the largest differences found since the last report.
+     */
+    void LogDifferences()
+    {
+        if (numCompared_ == 0)
+            return;
+
+        LOG4CPLUS_INFO(logger_, "Single precision over " << numCompared_
+                       << " evaluations: largest relative difference of value " << maxValueDifference_
+                       << ", of derivative " << maxDerivativeDifference_);
+        numCompared_ = 0;
+        maxValueDifference_ = 0.0;
+        maxDerivativeDifference_ = 0.0;
+    }
+
+    static ITK_THREAD_RETURN_TYPE ThreaderCallback(void* arg)
+    {
+        itk::MultiThreader::ThreadInfoStruct* info = static_cast<itk::MultiThreader::ThreadInfoStruct*>(arg);
+        const Self* self = static_cast<const Self*>(info->UserData);
+        if (self->singlePrecision_)
+            self->template ThreadedCompute<float>(info->ThreadID, info->NumberOfThreads);
+        else
+            self->template ThreadedCompute<double>(info->ThreadID, info->NumberOfThreads);
+
+        return ITK_THREAD_RETURN_VALUE;
+    }
+
+    /**
+     * One thread's share of the rows.
+     * @param TReal The type of the arithmetic along a row.
+     */
+    template <class TReal>
+    void ThreadedCompute(itk::ThreadIdType threadId, itk::ThreadIdType numThreads) const
+    {
+        typedef typename TFixedImage::IndexType IndexType;
+        typedef typename TFixedImage::PointType PointType;
+        typedef typename TMovingImage::OffsetValueType OffsetValueType;
+
+        double& sum = threadSums_[threadId];
+        itk::SizeValueType& count = threadCounts_[threadId];
+        std::vector<double>& derivative = threadDerivatives_[threadId];
+        TransformJacobianType& jacobianStart = threadJacobians_[2 * threadId];
+        TransformJacobianType& jacobianNext = threadJacobians_[2 * threadId + 1];
+        sum = 0.0;
+        count = 0;
+        std::fill(derivative.begin(), derivative.end(), 0.0);
+
+        const std::size_t chunk = (runs_.size() + numThreads - 1) / numThreads;
+        const std::size_t firstRun = std::min(runs_.size(), threadId * chunk);
+        const std::size_t lastRun = std::min(runs_.size(), firstRun + chunk);
+        if (firstRun == lastRun)
+            return;
+
+        // Fixed index -> moving continuous index is c = Q i + q.
+        const LinearTransformType* transform = static_cast<const LinearTransformType*>(
+                                                            this->m_Transform.GetPointer());
+        const TFixedImage* fixedImage = this->m_FixedImage;
+        const TMovingImage* movingImage = this->m_MovingImage;
+        itk::Matrix<double, ImageDimension, ImageDimension> indexToPoint =
+                                                    fixedImage->GetIndexToPhysicalPoint();
+        itk::Matrix<double, ImageDimension, ImageDimension> pointToIndex =
+                                                    movingImage->GetPhysicalPointToIndex();
+        itk::Matrix<double, ImageDimension, ImageDimension> Q =
+                                    pointToIndex * transform->GetMatrix() * indexToPoint;
+
+        // The steps along a row in the fixed points and moving indices.
+        itk::Vector<double, ImageDimension> pointStep;
+        TReal indexStep[ImageDimension];
+        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+        {
+            pointStep[dim] = indexToPoint[dim][0];
+            indexStep[dim] = static_cast<TReal>(Q[dim][0]);
+        }
+
+        const typename TMovingImage::RegionType& movingRegion = movingImage->GetBufferedRegion();
+        const typename TMovingImage::PixelType* movingBuffer = movingImage->GetBufferPointer();
+        const GradientPixelType* gradientBuffer = this->m_GradientImage->GetBufferPointer();
+        const typename TFixedImage::PixelType* fixedBuffer = fixedImage->GetBufferPointer();
+        const OffsetValueType* movingStrides = movingImage->GetOffsetTable();
+
+        TReal lower[ImageDimension];
+        TReal upper[ImageDimension];
+        OffsetValueType neighbour[ImageDimension];
+        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+        {
+            lower[dim] = static_cast<TReal>(movingRegion.GetIndex(dim));
+            upper[dim] = static_cast<TReal>(movingRegion.GetIndex(dim)
+                                            + static_cast<double>(movingRegion.GetSize(dim)) - 1.0);
+            neighbour[dim] = (movingRegion.GetSize(dim) > 1) ? movingStrides[dim] : 0;
+        }
+
+        const unsigned numCorners = 1u << ImageDimension;
+        const unsigned numParams = this->m_NumberOfParameters;
+
+        for (std::size_t runIdx = firstRun; runIdx < lastRun; ++runIdx)
+        {
+            const RunType& run = runs_[runIdx];
+            const IndexType& start = run.start;
+
+            PointType fixedPoint;
+            fixedImage->TransformIndexToPhysicalPoint(start, fixedPoint);
+            PointType mappedPoint = transform->TransformPoint(fixedPoint);
+            typename TMovingImage::PointType::VectorType fromOrigin = mappedPoint - movingImage->GetOrigin();
+
+            // The row starts from a point mapped in double. Along it the index is
+            // the start plus a multiple of the step rather than a running sum so
+            // that single precision does not drift.
+            TReal rowStart[ImageDimension];
+            for (unsigned row = 0; row < ImageDimension; ++row)
+            {
+                double index = 0.0;
+                for (unsigned col = 0; col < ImageDimension; ++col)
+                    index += pointToIndex[row][col] * fromOrigin[col];
+                rowStart[row] = static_cast<TReal>(index);
+            }
+
+            const typename TFixedImage::PixelType* fixedPtr =
+                                        fixedBuffer + fixedImage->ComputeOffset(start);
+
+            // Sums of r g and k r g along the row, for the Jacobian at its ends.
+            TReal rowSquares = 0;
+            TReal rowSum[ImageDimension];
+            TReal rowMoment[ImageDimension];
+            std::fill(rowSum, rowSum + ImageDimension, TReal(0));
+            std::fill(rowMoment, rowMoment + ImageDimension, TReal(0));
+
+            for (itk::SizeValueType step = 0; step < run.length; ++step)
+            {
+                bool inside = true;
+                OffsetValueType offset = 0;
+                TReal fraction[ImageDimension];
+                OffsetValueType corner[ImageDimension];
+                for (unsigned dim = 0; dim < ImageDimension; ++dim)
+                {
+                    TReal value = rowStart[dim] + static_cast<TReal>(step) * indexStep[dim];
+                    inside = inside && (value >= lower[dim]) && (value <= upper[dim]);
+                    TReal base = std::min(std::floor(value), std::max(upper[dim] - TReal(1), lower[dim]));
+                    fraction[dim] = value - base;
+                    offset += static_cast<OffsetValueType>(base - lower[dim]) * movingStrides[dim];
+                    corner[dim] = neighbour[dim];
+                }
+
+                if (inside)
+                {
+                    TReal movingValue = 0;
+                    TReal gradient[ImageDimension];
+                    std::fill(gradient, gradient + ImageDimension, TReal(0));
+                    for (unsigned bits = 0; bits < numCorners; ++bits)
+                    {
+                        TReal weight = 1;
+                        OffsetValueType cornerOffset = offset;
+                        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+                        {
+                            bool up = (bits >> dim) & 1u;
+                            weight *= up ? fraction[dim] : TReal(1) - fraction[dim];
+                            cornerOffset += up ? corner[dim] : 0;
+                        }
+                        movingValue += weight * movingBuffer[cornerOffset];
+                        if (withDerivative_)
+                        {
+                            const GradientPixelType& cornerGradient = gradientBuffer[cornerOffset];
+                            for (unsigned dim = 0; dim < ImageDimension; ++dim)
+                                gradient[dim] += weight * static_cast<TReal>(cornerGradient[dim]);
+                        }
+                    }
+
+                    TReal residual = movingValue - static_cast<TReal>(fixedPtr[step]);
+                    rowSquares += residual * residual;
+                    ++count;
+
+                    if (withDerivative_)
+                    {
+                        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+                        {
+                            TReal term = residual * gradient[dim];
+                            rowSum[dim] += term;
+                            rowMoment[dim] += static_cast<TReal>(step) * term;
+                        }
+                    }
+                }
+            }
+            sum += rowSquares;
+
+            if (withDerivative_)
+            {
+                // J(k) = J(0) + k (J(1) - J(0)) along the row.
+                transform->ComputeJacobianWithRespectToParameters(fixedPoint, jacobianStart);
+                transform->ComputeJacobianWithRespectToParameters(fixedPoint + pointStep, jacobianNext);
+                for (unsigned param = 0; param < numParams; ++param)
+                {
+                    double total = 0.0;
+                    for (unsigned dim = 0; dim < ImageDimension; ++dim)
+                    {
+                        double first = jacobianStart[dim][param];
+                        total += rowSum[dim] * first
+                                 + rowMoment[dim] * (jacobianNext[dim][param] - first);
+                    }
+                    derivative[param] += total;
+                }
+            }
+        }
+    }
+
+    typename MaskType::Pointer mask_;
+    std::vector<RunType> runs_;                 ///< The rows of the region, or the runs of the ROI.
+    MetricPrecisionType precision_;
+
+    mutable itk::SizeValueType numPixels_;      ///< Pixels which mapped inside the moving image.
+    mutable bool withDerivative_;
+    mutable bool singlePrecision_;              ///< The precision of the pass being run.
+    mutable std::vector<double> threadSums_;
+    mutable std::vector<itk::SizeValueType> threadCounts_;
+    mutable std::vector<std::vector<double> > threadDerivatives_;
+    mutable std::vector<TransformJacobianType> threadJacobians_;
+
+    mutable unsigned long numCompared_;         ///< Evaluations validated since the last report.
+    mutable double maxValueDifference_;
+    mutable double maxDerivativeDifference_;
+
+    log4cplus::Logger logger_;
+};
+
+typedef DenseMeanSquaresImageToImageMetric<Image2D, Image2D> DenseMSImageToImageMetric2D;
+typedef DenseMeanSquaresImageToImageMetric<Image3D, Image3D> DenseMSImageToImageMetric3D;
+
+#endif /* defined(__DCEFit__DenseMeanSquaresImageToImageMetric__) */
@@ -9,6 +9,8 @@
 #include <itkVersion.h>
 #include <itkMultiThreader.h>
 
+#include "CoreScheduler.h"
+
 #import <OsiriXAPI/ViewerController.h>
 #import <OsiriXAPI/DicomImage.h>
 #import <OsiriXAPI/DCMPix.h>
@@ -272,9 +274,11 @@ enum ComboBoxTags
     if (requested > 0)
         numThreads = requested;
 
-    // Set the global max for ITK
-    itk::MultiThreader::SetGlobalDefaultNumberOfThreads(numThreads);
+    // Cap ITK at this and let the scheduler share it out between registrations.
+    // The default is only set here, before any registration runs.
     itk::MultiThreader::SetGlobalMaximumNumberOfThreads(numThreads);
+    itk::MultiThreader::SetGlobalDefaultNumberOfThreads(numThreads);
+    CoreScheduler::GetInstance().SetNumberOfCores(numThreads);
 
     regParams.maxNumberOfThreads = maxThreads;
     regParams.numberOfThreads = numThreads;
@@ -376,8 +380,14 @@ enum ComboBoxTags
 
             // do this once per series
             if ((timeIdx == 0) && (sliceIdx == 0))
+            {
                 firstTime = acqTime;
 
+                tag = [DCMAttributeTag tagWithName:@"SeriesInstanceUID"];
+                info.seriesUID = [[[dcmObj attributeForTag:tag] value] description];
+                LOG4M_DEBUG(logger_, @"Series instance UID = %@", info.seriesUID);
+            }
+
             // do this once per time increment
             if (sliceIdx == 0)
             {
@@ -931,6 +941,9 @@ enum ComboBoxTags
         case MeanSquares:
             break;
         case MattesMutualInformation:
+        case FastMattesMutualInformation:
+        case LocalNormalizedCorrelation:
+        case NormalizedGradientField:
             openSheet_ = rigidRegMMIMetricConfigPanel;
             break;
     }
@@ -948,6 +961,9 @@ enum ComboBoxTags
         case MeanSquares:
             break;
         case MattesMutualInformation:
+        case FastMattesMutualInformation:
+        case LocalNormalizedCorrelation:
+        case NormalizedGradientField:
             openSheet_ = bsplineRegMMIMetricConfigPanel;
             break;
     }
@@ -1695,6 +1711,9 @@ enum ComboBoxTags
         switch (regParams.rigidRegMetric)
         {
             case MattesMutualInformation:
+            case FastMattesMutualInformation:
+            case LocalNormalizedCorrelation:
+            case NormalizedGradientField:
                 [rigidRegMetricConfigButton setEnabled:YES];
                 break;
             default:
@@ -1711,7 +1730,7 @@ enum ComboBoxTags
     [bsplineRegMetricConfigButton setEnabled:bsplineEnabled];
     if (bsplineEnabled)
     {
-        if (regParams.bsplineRegMetric == MattesMutualInformation)
+        if (regParams.bsplineRegMetric != MeanSquares)
         {
             [bsplineRegMetricConfigButton setEnabled:YES];
         }
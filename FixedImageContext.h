@@ -0,0 +1,886 @@
+//
+//  FixedImageContext.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__FixedImageContext__
+#define __DCEFit__FixedImageContext__
+
+#include "ItkTypedefs.h"
+#include "CoreScheduler.h"
+#include "ProjectDefs.h"
+#include "FixedImageMask.h"
+#include "PhaseCorrelation.h"
+
+#include <itkLightObject.h>
+#include <itkImageMomentsCalculator.h>
+#include <itkMersenneTwisterRandomVariateGenerator.h>
+#include <itkSimpleFastMutexLock.h>
+#include <itkMutexLockHolder.h>
+#include <itkRecursiveGaussianImageFilter.h>
+#include <itkShrinkImageFilter.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <vector>
+
+/**
+ * Store for metric sample sets. The samples drawn from the fixed image depend only
+ * upon the fixed image, the region and the number of samples so a set drawn for one
+ * moving image may be copied for the next.
+ */
+template <class TSampleContainer>
+class FixedImageSampleCache
+{
+public:
+    typedef std::vector<unsigned long> KeyType;
+
+    /**
+     * Look for a sample set.
+     * @param key Identifies the set.
+     * @param samples Set to the stored samples if found.
+     * @return true if found.
+     */
+    bool Find(const KeyType& key, TSampleContainer& samples)
+    {
+        LockHolder lock(mutex_);
+
+        typename CacheType::const_iterator iter = cache_.find(key);
+        if (iter == cache_.end())
+            return false;
+
+        samples = iter->second;
+        return true;
+    }
+
+    /**
+     * Store a sample set.
+     * @param key Identifies the set.
+     * @param samples The samples.
+     */
+    void Store(const KeyType& key, const TSampleContainer& samples)
+    {
+        LockHolder lock(mutex_);
+        cache_[key] = samples;
+    }
+
+private:
+    typedef itk::MutexLockHolder<itk::SimpleFastMutexLock> LockHolder;
+    typedef std::map<KeyType, TSampleContainer> CacheType;
+
+    itk::SimpleFastMutexLock mutex_;
+    CacheType cache_;
+};
+
+/**
+ * What a v3 metric works out for each of its samples when its transform is a
+ * B-spline: the weights and indices of the coefficients which move the sample and
+ * the point before the transform. They depend only upon the samples and the grid
+ * of the transform, so they are the same for every moving image of a series.
+ * @param TBaseMetric The itk::ImageToImageMetric the values belong to.
+ */
+template <class TBaseMetric>
+struct BSplineSampleValues
+{
+    typename TBaseMetric::BSplineTransformWeightsArrayType weights;
+    typename TBaseMetric::BSplineTransformIndicesArrayType indices;
+    typename TBaseMetric::MovingImagePointArrayType points;
+    typename TBaseMetric::BooleanArrayType inside;
+};
+
+/**
+ * A v3 image to image metric which takes its fixed image samples from a
+ * FixedImageSampleCache if it has one, and likewise the values it computes for
+ * a B-spline transform at those samples. Without the caches it behaves exactly
+ * as TMetric.
+ */
+template <class TMetric>
+class FixedSampleCachingMetric : public TMetric
+{
+public:
+    typedef FixedSampleCachingMetric Self;
+    typedef TMetric Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(FixedSampleCachingMetric, TMetric);
+
+    typedef typename Superclass::FixedImageSampleContainer SampleContainer;
+    typedef FixedImageSampleCache<SampleContainer> SampleCacheType;
+    typedef typename Superclass::FixedImageType FixedImageType;
+    typedef itk::ImageToImageMetric<FixedImageType, typename Superclass::MovingImageType> BaseMetricType;
+    typedef BSplineSampleValues<BaseMetricType> BSplineValuesType;
+    typedef FixedImageSampleCache<BSplineValuesType> BSplineCacheType;
+    typedef FixedImageMask<FixedImageType> MaskType;
+
+    /**
+     * Set the cache to use.
+     * @param cache The cache. May be 0.
+     */
+    void SetSampleCache(SampleCacheType* cache)
+    {
+        sampleCache_ = cache;
+    }
+
+    /**
+     * Set the cache of the B-spline values of the samples. It is used only
+     * together with a sample cache.
+     * @param cache The cache. May be 0.
+     */
+    void SetBSplineCache(BSplineCacheType* cache)
+    {
+        bsplineCache_ = cache;
+    }
+
+    /**
+     * Set the ROI to draw the samples from. The sampling rate then applies to
+     * the pixels of the region inside the ROI rather than the whole region.
+     * @param mask The ROI. May be null.
+     */
+    void SetRasterMask(typename MaskType::Pointer mask)
+    {
+        mask_ = mask;
+    }
+
+protected:
+    FixedSampleCachingMetric()
+    : sampleCache_(0), bsplineCache_(0)
+    {
+    }
+
+    virtual void SampleFixedImageRegion(SampleContainer& samples) const
+    {
+        SampleFromCache(samples, false);
+    }
+
+    virtual void SampleFullFixedImageRegion(SampleContainer& samples) const
+    {
+        SampleFromCache(samples, true);
+    }
+
+    /**
+     * The values depend only upon the samples and the grid of the transform so
+     * with a cache they are computed for the first image of the series which
+     * uses them and copied for the others.
+     */
+    virtual void PreComputeTransformValues()
+    {
+        if ((bsplineCache_ == 0) || sampleKey_.empty())
+        {
+            Superclass::PreComputeTransformValues();
+            return;
+        }
+
+        typename BSplineCacheType::KeyType key = sampleKey_;
+        const typename Superclass::TransformParametersType& grid = this->m_Transform->GetFixedParameters();
+        for (unsigned idx = 0; idx < grid.GetSize(); ++idx)
+            key.push_back(DoubleBits(grid[idx]));
+
+        BSplineValuesType values;
+        if (bsplineCache_->Find(key, values))
+        {
+            this->m_BSplineTransformWeightsArray = values.weights;
+            this->m_BSplineTransformIndicesArray = values.indices;
+            this->m_BSplinePreTransformPointsArray = values.points;
+            this->m_WithinBSplineSupportRegionArray = values.inside;
+            return;
+        }
+
+        Superclass::PreComputeTransformValues();
+
+        values.weights = this->m_BSplineTransformWeightsArray;
+        values.indices = this->m_BSplineTransformIndicesArray;
+        values.points = this->m_BSplinePreTransformPointsArray;
+        values.inside = this->m_WithinBSplineSupportRegionArray;
+        bsplineCache_->Store(key, values);
+    }
+
+private:
+    /// The Morton code of a sample's cell and the sample.
+    typedef std::pair<unsigned long, typename FixedImageType::IndexType> DrawnSample;
+
+    void SampleFromCache(SampleContainer& samples, bool allPixels) const
+    {
+        if (sampleCache_ == 0)
+        {
+            Sample(samples, allPixels);
+            return;
+        }
+
+        // The fixed image comes from a shared pyramid level so its buffer
+        // identifies the image and the level.
+        const typename Superclass::FixedImageRegionType& region = this->GetFixedImageRegion();
+        typename SampleCacheType::KeyType key;
+        key.push_back(reinterpret_cast<unsigned long>(this->GetFixedImage()->GetBufferPointer()));
+        for (unsigned dim = 0; dim < Superclass::FixedImageDimension; ++dim)
+        {
+            key.push_back(static_cast<unsigned long>(region.GetIndex(dim)));
+            key.push_back(static_cast<unsigned long>(region.GetSize(dim)));
+        }
+        key.push_back(this->GetNumberOfFixedImageSamples());
+        key.push_back(allPixels ? 1 : 0);
+        key.push_back(reinterpret_cast<unsigned long>(mask_.GetPointer()));
+        sampleKey_ = key;
+
+        if (sampleCache_->Find(key, samples))
+        {
+            SetNumberOfSamples(samples.size());
+            return;
+        }
+
+        Sample(samples, allPixels);
+        sampleCache_->Store(key, samples);
+    }
+
+    void Sample(SampleContainer& samples, bool allPixels) const
+    {
+        if (!allPixels)
+            SampleStratified(samples);
+        else if (mask_.IsNotNull())
+            SampleRaster(samples);
+        else
+            Superclass::SampleFullFixedImageRegion(samples);
+    }
+
+    /**
+     * Use every pixel inside the ROI.
+     */
+    void SampleRaster(SampleContainer& samples) const
+    {
+        const FixedImageType* image = this->GetFixedImage();
+        const typename MaskType::Raster& raster = mask_->GetRaster(image, this->GetFixedImageRegion());
+
+        itk::SizeValueType numInside = raster.GetNumberOfPixels();
+        if (numInside == 0)
+        {
+            itkExceptionMacro(<< "The ROI holds none of the pixels of the registration region.");
+        }
+
+        SetNumberOfSamples(numInside);
+        samples.resize(numInside);
+
+        typename SampleContainer::iterator sample = samples.begin();
+        const std::vector<typename MaskType::Run>& runs = raster.GetRuns();
+        for (unsigned runIdx = 0; runIdx < runs.size(); ++runIdx)
+        {
+            typename FixedImageType::IndexType index = runs[runIdx].start;
+            for (itk::SizeValueType idx = 0; idx < runs[runIdx].length; ++idx, ++index[0], ++sample)
+                SetSample(*sample, image, index);
+        }
+    }
+
+    /**
+     * Draw the samples on a jittered grid: the region is divided into cells of
+     * about one sample's share of the pixels each and one pixel is drawn at random
+     * from each cell. This keeps the samples spread evenly, as random sampling
+     * does not, while they stay random within the cells. With an ROI the cells
+     * outside it are skipped, so the number of samples falls in proportion to the
+     * part of the region inside. The samples are then put in the Morton order of
+     * their cells so that neighbouring samples are close in memory in both images.
+     */
+    void SampleStratified(SampleContainer& samples) const
+    {
+        typedef typename FixedImageType::IndexType IndexType;
+        const unsigned dimension = Superclass::FixedImageDimension;
+
+        const FixedImageType* image = this->GetFixedImage();
+        const typename Superclass::FixedImageRegionType& region = this->GetFixedImageRegion();
+        const typename MaskType::Raster* raster = 0;
+        if (mask_.IsNotNull())
+        {
+            raster = &mask_->GetRaster(image, region);
+            if (raster->GetNumberOfPixels() == 0)
+            {
+                itkExceptionMacro(<< "The ROI holds none of the pixels of the registration region.");
+            }
+        }
+
+        // The cell sizes. The shortest axes, normally the slices, are given out first
+        // so that a cell never spans more than the whole of an axis.
+        double pixelsPerSample = std::max(1.0, static_cast<double>(region.GetNumberOfPixels())
+                                               / std::max<itk::SizeValueType>(this->GetNumberOfFixedImageSamples(), 1));
+        std::vector<std::pair<itk::SizeValueType, unsigned> > axes;
+        for (unsigned dim = 0; dim < dimension; ++dim)
+            axes.push_back(std::make_pair(region.GetSize(dim), dim));
+        std::sort(axes.begin(), axes.end());
+
+        double cellSize[dimension];
+        unsigned long numCells[dimension];
+        unsigned long totalCells = 1;
+        for (unsigned axis = 0; axis < dimension; ++axis)
+        {
+            unsigned dim = axes[axis].second;
+            double edge = std::pow(pixelsPerSample, 1.0 / (dimension - axis));
+            cellSize[dim] = std::min(static_cast<double>(region.GetSize(dim)), std::max(edge, 1.0));
+            pixelsPerSample /= cellSize[dim];
+            numCells[dim] = static_cast<unsigned long>(std::ceil(region.GetSize(dim) / cellSize[dim] - 1e-9));
+            totalCells *= numCells[dim];
+        }
+
+        // A fixed seed so that a run can be repeated, as the stages seed their metrics.
+        typedef itk::Statistics::MersenneTwisterRandomVariateGenerator GeneratorType;
+        GeneratorType::Pointer generator = GeneratorType::New();
+        generator->Initialize(8370276);
+
+        std::vector<DrawnSample> drawn;
+        drawn.reserve(totalCells);
+        for (unsigned long cell = 0; cell < totalCells; ++cell)
+        {
+            unsigned long position[dimension];
+            long start[dimension];
+            long extent[dimension];
+            unsigned long rest = cell;
+            for (unsigned dim = 0; dim < dimension; ++dim)
+            {
+                position[dim] = rest % numCells[dim];
+                rest /= numCells[dim];
+                start[dim] = static_cast<long>(std::floor(position[dim] * cellSize[dim]));
+                long end = std::min(static_cast<long>(std::floor((position[dim] + 1) * cellSize[dim])),
+                                    static_cast<long>(region.GetSize(dim)));
+                extent[dim] = std::max(end - start[dim], 1L);
+            }
+
+            // A few tries at a pixel inside the ROI before the cell is given up.
+            for (unsigned attempt = 0; attempt < 4; ++attempt)
+            {
+                IndexType index;
+                for (unsigned dim = 0; dim < dimension; ++dim)
+                {
+                    long offset = static_cast<long>(generator->GetUniformVariate(0.0, 1.0) * extent[dim]);
+                    index[dim] = region.GetIndex(dim) + start[dim] + std::min(offset, extent[dim] - 1);
+                }
+
+                if ((raster == 0) || raster->IsInside(index))
+                {
+                    drawn.push_back(std::make_pair(MortonCode(position, dimension), index));
+                    break;
+                }
+            }
+        }
+
+        if (drawn.empty())
+        {
+            itkExceptionMacro(<< "No samples could be drawn from inside the ROI.");
+        }
+
+        std::sort(drawn.begin(), drawn.end(), LessCode);
+
+        SetNumberOfSamples(drawn.size());
+        samples.resize(drawn.size());
+        for (std::size_t idx = 0; idx < drawn.size(); ++idx)
+            SetSample(samples[idx], image, drawn[idx].second);
+    }
+
+    /**
+     * Interleave the bits of the cell coordinates.
+     */
+    static unsigned long MortonCode(const unsigned long* position, unsigned dimension)
+    {
+        const unsigned bitsPerAxis = (8 * sizeof(unsigned long)) / dimension;
+        unsigned long code = 0;
+        for (unsigned bit = 0; bit < bitsPerAxis; ++bit)
+            for (unsigned dim = 0; dim < dimension; ++dim)
+                code |= ((position[dim] >> bit) & 1ul) << (bit * dimension + dim);
+
+        return code;
+    }
+
+    static bool LessCode(const DrawnSample& first, const DrawnSample& second)
+    {
+        return first.first < second.first;
+    }
+
+    static void SetSample(typename SampleContainer::value_type& sample, const FixedImageType* image,
+                          const typename FixedImageType::IndexType& index)
+    {
+        image->TransformIndexToPhysicalPoint(index, sample.point);
+        sample.value = image->GetPixel(index);
+        sample.valueIndex = 0;
+    }
+
+    /**
+     * The base class sizes the rest of its work by the number of samples. The
+     * jittered grid and the ROI decide how many there are, not the request.
+     */
+    void SetNumberOfSamples(itk::SizeValueType numSamples) const
+    {
+        const_cast<Self*>(this)->m_NumberOfFixedImageSamples = numSamples;
+    }
+
+    /**
+     * The bits of a grid parameter, so that grids must match exactly to share values.
+     */
+    static unsigned long DoubleBits(double value)
+    {
+        unsigned long bits = 0;
+        std::memcpy(&bits, &value, std::min(sizeof(bits), sizeof(value)));
+        return bits;
+    }
+
+    FixedSampleCachingMetric(const Self&);   // Not implemented.
+    void operator=(const Self&);            // Not implemented.
+
+    SampleCacheType* sampleCache_;
+    BSplineCacheType* bsplineCache_;
+    mutable typename SampleCacheType::KeyType sampleKey_;   ///< Identifies the samples in use.
+    typename MaskType::Pointer mask_;
+};
+
+/**
+ * Everything on the fixed side of a registration which is the same for every
+ * moving image of a series. It is built lazily, once, and shared by all of the
+ * registrations of the series, concurrent or not.
+ *
+ * A context may also be made from a moving image so that its pyramid and moments
+ * can be computed ahead of its registration.
+ */
+template <class TImage>
+class FixedImageContext : public itk::LightObject
+{
+public:
+    typedef FixedImageContext Self;
+    typedef itk::LightObject Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+
+    typedef typename TImage::Pointer ImagePointer;
+    typedef itk::MultiResolutionPyramidImageFilter<TImage, TImage> PyramidType;
+    typedef typename PyramidType::ScheduleType ScheduleType;
+    typedef std::vector<ImagePointer> ImageLevels;
+    typedef itk::BSplineTransform<double, TImage::ImageDimension, BSPLINE_ORDER> BSplineTransformType;
+    typedef typename BSplineTransformType::FixedParametersType FixedParametersType;
+    typedef itk::ImageMomentsCalculator<TImage> MomentsCalculatorType;
+    typedef typename MomentsCalculatorType::VectorType VectorType;
+    typedef FixedSampleCachingMetric<itk::MeanSquaresImageToImageMetric<TImage, TImage> > SamplingMetricType;
+    typedef typename SamplingMetricType::SampleCacheType SampleCacheType;
+    typedef typename SamplingMetricType::BSplineCacheType BSplineValuesCacheType;
+
+    /**
+     * Create a context.
+     * @param fixedImage The fixed image of the series.
+     * @return Smart pointer to the context.
+     */
+    static Pointer New(ImagePointer fixedImage)
+    {
+        Pointer context = new Self(fixedImage);
+        context->UnRegister();
+        return context;
+    }
+
+    /**
+     * @return The fixed image.
+     */
+    ImagePointer GetFixedImage() const
+    {
+        return fixedImage_;
+    }
+
+    /**
+     * Copy part of an image. The copy keeps its physical position so transforms
+     * found with it apply to the whole image.
+     * @param image The image.
+     * @param region The part to copy.
+     * @return The copy.
+     */
+    static ImagePointer CropImage(ImagePointer image, const typename TImage::RegionType& region)
+    {
+        typedef itk::RegionOfInterestImageFilter<TImage, TImage> RegionFilterType;
+        typename RegionFilterType::Pointer filter = RegionFilterType::New();
+        filter->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+        filter->SetInput(image);
+        filter->SetRegionOfInterest(region);
+        filter->Update();
+
+        return filter->GetOutput();
+    }
+
+    /**
+     * Get a context for a crop of the fixed image, making it on first use, so that
+     * the crop and its pyramids are made once for the series.
+     * @param region The part of the fixed image.
+     * @return The context of the crop.
+     */
+    Pointer GetCroppedContext(const typename TImage::RegionType& region)
+    {
+        LockHolder lock(mutex_);
+
+        std::vector<long> key;
+        for (unsigned dim = 0; dim < TImage::ImageDimension; ++dim)
+        {
+            key.push_back(region.GetIndex(dim));
+            key.push_back(static_cast<long>(region.GetSize(dim)));
+        }
+
+        typename CropCache::iterator iter = crops_.find(key);
+        if (iter != crops_.end())
+            return iter->second;
+
+        return crops_[key] = Self::New(CropImage(fixedImage_, region));
+    }
+
+    /**
+     * Get the levels of the fixed image pyramid, computing them on first use.
+     * Each level depends only upon its own shrink factors so the levels are kept
+     * by shrink factor and shared by every schedule which has them. Only the
+     * levels not seen before are computed, each from the next finer level rather
+     * than from the full image. See ShrinkLevel().
+     * @param schedule The shrink factors, one row per level.
+     * @return The images, coarsest first.
+     */
+    ImageLevels GetPyramidLevels(const ScheduleType& schedule)
+    {
+        LockHolder lock(mutex_);
+
+        // Work from the finest level to the coarsest so that the level a missing
+        // one is made from is always at hand.
+        ImageLevels levels(schedule.rows());
+        ImagePointer finer = fixedImage_;
+        LevelKeyType finerKey(schedule.cols(), 1);
+        for (unsigned level = schedule.rows(); level-- > 0; )
+        {
+            LevelKeyType key = LevelKey(schedule, level);
+            typename LevelCache::iterator iter = levels_.find(key);
+            if (iter == levels_.end())
+            {
+                // The finer level can only be shrunk by whole factors.
+                for (unsigned dim = 0; dim < key.size(); ++dim)
+                {
+                    if ((key[dim] < finerKey[dim]) || ((key[dim] % finerKey[dim]) != 0))
+                    {
+                        finer = fixedImage_;
+                        finerKey.assign(key.size(), 1);
+                        break;
+                    }
+                }
+
+                iter = levels_.insert(std::make_pair(key, ShrinkLevel(finer, finerKey, key))).first;
+            }
+
+            levels[level] = iter->second;
+            finer = iter->second;
+            finerKey = key;
+        }
+
+        return levels;
+    }
+
+    /**
+     * Get the phase correlation against the coarsest level of a schedule, computing
+     * the spectrum of the level on first use.
+     * @param schedule The shrink factors, one row per level.
+     * @return The phase correlation.
+     */
+    typename PhaseCorrelation<TImage>::Pointer GetPhaseCorrelation(const ScheduleType& schedule)
+    {
+        ScheduleType coarsest(1, schedule.cols());
+        coarsest.set_row(0, schedule.get_row(0));
+        LevelKeyType key = LevelKey(coarsest, 0);
+
+        {
+            LockHolder lock(mutex_);
+            typename CorrelationCache::iterator iter = correlations_.find(key);
+            if (iter != correlations_.end())
+                return iter->second;
+        }
+
+        // Made without the lock as GetPyramidLevels() takes it.
+        typename PhaseCorrelation<TImage>::Pointer correlation =
+                                    PhaseCorrelation<TImage>::New(GetPyramidLevels(coarsest)[0]);
+
+        LockHolder lock(mutex_);
+        return correlations_.insert(std::make_pair(key, correlation)).first->second;
+    }
+
+    /**
+     * Get the centre of gravity of the fixed image, computing it on first use.
+     * @return The centre in physical coordinates.
+     */
+    VectorType GetCenterOfGravity()
+    {
+        LockHolder lock(mutex_);
+
+        if (!haveCentre_)
+        {
+            typename MomentsCalculatorType::Pointer calculator = MomentsCalculatorType::New();
+            calculator->SetImage(fixedImage_);
+            calculator->Compute();
+            centre_ = calculator->GetCenterOfGravity();
+            haveCentre_ = true;
+        }
+
+        return centre_;
+    }
+
+    /**
+     * Initialise a centred transform as itk::CenteredTransformInitializer does with
+     * MomentsOn() but using the cached centre of gravity of the fixed image. Only the
+     * moments of the moving image are computed.
+     * @param transform The transform to initialise.
+     * @param movingImage The moving image.
+     */
+    template <class TTransform>
+    void InitializeCenteredTransform(TTransform* transform, const TImage* movingImage)
+    {
+        typename MomentsCalculatorType::Pointer calculator = MomentsCalculatorType::New();
+        calculator->SetImage(movingImage);
+        calculator->Compute();
+
+        InitializeCenteredTransform(transform, calculator->GetCenterOfGravity());
+    }
+
+    /**
+     * As above but with the moments of the moving image also taken from a context.
+     * @param transform The transform to initialise.
+     * @param movingContext A context made from the moving image.
+     */
+    template <class TTransform>
+    void InitializeCenteredTransform(TTransform* transform, Self* movingContext)
+    {
+        InitializeCenteredTransform(transform, movingContext->GetCenterOfGravity());
+    }
+
+    /**
+     * Initialise a centred transform from the two centres of gravity.
+     * @param transform The transform to initialise.
+     * @param movingCentre The centre of gravity of the moving image.
+     */
+    template <class TTransform>
+    void InitializeCenteredTransform(TTransform* transform, const VectorType& movingCentre)
+    {
+        VectorType fixedCentre = GetCenterOfGravity();
+
+        typename TTransform::InputPointType centre;
+        typename TTransform::OutputVectorType translation;
+        for (unsigned dim = 0; dim < TImage::ImageDimension; ++dim)
+        {
+            centre[dim] = fixedCentre[dim];
+            translation[dim] = movingCentre[dim] - fixedCentre[dim];
+        }
+
+        transform->SetIdentity();
+        transform->SetCenter(centre);
+        transform->SetTranslation(translation);
+    }
+
+    /**
+     * Get the fixed parameters of a B-spline transform covering the fixed image,
+     * as set by itk::BSplineTransformInitializer.
+     * @param meshSize The mesh size.
+     * @return The fixed parameters.
+     */
+    FixedParametersType GetBSplineFixedParameters(const typename BSplineTransformType::MeshSizeType& meshSize)
+    {
+        LockHolder lock(mutex_);
+
+        std::vector<unsigned long> key(meshSize.m_Size, meshSize.m_Size + TImage::ImageDimension);
+        typename BSplineCache::iterator iter = bsplineParams_.find(key);
+        if (iter != bsplineParams_.end())
+            return iter->second;
+
+        typedef itk::BSplineTransformInitializer<BSplineTransformType, TImage> InitializerType;
+        typename BSplineTransformType::Pointer transform = BSplineTransformType::New();
+        typename InitializerType::Pointer initializer = InitializerType::New();
+        initializer->SetTransform(transform);
+        initializer->SetImage(fixedImage_);
+        initializer->SetTransformDomainMeshSize(meshSize);
+        initializer->InitializeTransform();
+
+        return bsplineParams_[key] = transform->GetFixedParameters();
+    }
+
+    /**
+     * Get the ROI mask of the fixed image, making it on first use. Its rasters
+     * are then shared by all of the registrations of the series.
+     * @param vertices The vertices of the ROI as x and y pixel indices in turn.
+     * @return The mask.
+     */
+    typename FixedImageMask<TImage>::Pointer GetMask(const std::vector<float>& vertices)
+    {
+        LockHolder lock(mutex_);
+
+        if (mask_.IsNull() || (maskVertices_ != vertices))
+        {
+            mask_ = FixedImageMask<TImage>::New(vertices, fixedImage_);
+            maskVertices_ = vertices;
+        }
+
+        return mask_;
+    }
+
+    /**
+     * @return The store of metric sample sets for this fixed image.
+     */
+    SampleCacheType* GetSampleCache()
+    {
+        return &samples_;
+    }
+
+    /**
+     * @return The store of the B-spline values of metric samples for this fixed image.
+     */
+    BSplineValuesCacheType* GetBSplineValuesCache()
+    {
+        return &bsplineValues_;
+    }
+
+protected:
+    FixedImageContext(ImagePointer fixedImage)
+    : fixedImage_(fixedImage), haveCentre_(false)
+    {
+    }
+
+private:
+    typedef itk::MutexLockHolder<itk::SimpleFastMutexLock> LockHolder;
+    typedef std::vector<unsigned long> LevelKeyType;
+    typedef std::map<LevelKeyType, ImagePointer> LevelCache;
+    typedef std::map<std::vector<unsigned long>, FixedParametersType> BSplineCache;
+    typedef std::map<std::vector<long>, Pointer> CropCache;
+    typedef std::map<LevelKeyType, typename PhaseCorrelation<TImage>::Pointer> CorrelationCache;
+
+    FixedImageContext(const Self&);   // Not implemented.
+    void operator=(const Self&);      // Not implemented.
+
+    static LevelKeyType LevelKey(const ScheduleType& schedule, unsigned level)
+    {
+        return LevelKeyType(schedule[level], schedule[level] + schedule.cols());
+    }
+
+    /**
+     * Make a level of the pyramid from a finer one. The smoothing is that of
+     * itk::MultiResolutionPyramidImageFilter, a sigma of half the shrink factor in
+     * pixels of the full image along each axis, except that an axis which is not
+     * shrunk is not smoothed. Because Gaussians add in variance the finer level
+     * needs only the difference, applied one axis at a time with a recursive
+     * filter whose cost does not depend upon the sigma. It is then subsampled.
+     * @param finer The finer level, or the full image.
+     * @param finerFactors The shrink factors of the finer level, all 1 for the full image.
+     * @param factors The shrink factors of the new level, each a multiple of the
+     * finer level's.
+     * @return The new level.
+     */
+    static ImagePointer ShrinkLevel(ImagePointer finer, const LevelKeyType& finerFactors,
+                                    const LevelKeyType& factors)
+    {
+        typedef itk::RecursiveGaussianImageFilter<TImage, TImage> SmootherType;
+        typedef itk::ShrinkImageFilter<TImage, TImage> ShrinkerType;
+
+        ImagePointer image = finer;
+        typename ShrinkerType::ShrinkFactorsType shrinkFactors;
+        bool shrink = false;
+        for (unsigned dim = 0; dim < TImage::ImageDimension; ++dim)
+        {
+            shrinkFactors[dim] = factors[dim] / finerFactors[dim];
+            if (shrinkFactors[dim] > 1)
+                shrink = true;
+
+            double pixel = finer->GetSpacing()[dim] / finerFactors[dim];
+            double sigma = (factors[dim] > 1) ? 0.5 * factors[dim] * pixel : 0.0;
+            double finerSigma = (finerFactors[dim] > 1) ? 0.5 * finerFactors[dim] * pixel : 0.0;
+            double variance = sigma * sigma - finerSigma * finerSigma;
+
+            // The recursive filter needs at least 4 pixels along its axis.
+            if ((variance <= 0.0) || (image->GetLargestPossibleRegion().GetSize(dim) < 4))
+                continue;
+
+            typename SmootherType::Pointer smoother = SmootherType::New();
+            smoother->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+            smoother->SetInput(image);
+            smoother->SetDirection(dim);
+            smoother->SetZeroOrder();
+            smoother->SetSigma(std::sqrt(variance));
+            smoother->Update();
+
+            image = smoother->GetOutput();
+            image->DisconnectPipeline();
+        }
+
+        if (!shrink)
+            return image;
+
+        typename ShrinkerType::Pointer shrinker = ShrinkerType::New();
+        shrinker->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+        shrinker->SetInput(image);
+        shrinker->SetShrinkFactors(shrinkFactors);
+        shrinker->Update();
+
+        ImagePointer result = shrinker->GetOutput();
+        result->DisconnectPipeline();
+
+        return result;
+    }
+
+    itk::SimpleFastMutexLock mutex_;
+    ImagePointer fixedImage_;
+    LevelCache levels_;
+    bool haveCentre_;
+    VectorType centre_;
+    BSplineCache bsplineParams_;
+    SampleCacheType samples_;
+    BSplineValuesCacheType bsplineValues_;
+    typename FixedImageMask<TImage>::Pointer mask_;
+    std::vector<float> maskVertices_;
+    CropCache crops_;
+    CorrelationCache correlations_;
+};
+
+/**
+ * A fixed image pyramid which takes its levels from a FixedImageContext rather than
+ * computing them. The output images share their buffers with the context's copies.
+ * Without a context the levels are computed as a context would, so that fixed and
+ * moving pyramids are always smoothed alike.
+ */
+template <class TImage>
+class FixedImagePyramidFilter : public itk::MultiResolutionPyramidImageFilter<TImage, TImage>
+{
+public:
+    typedef FixedImagePyramidFilter Self;
+    typedef itk::MultiResolutionPyramidImageFilter<TImage, TImage> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(FixedImagePyramidFilter, MultiResolutionPyramidImageFilter);
+
+    /**
+     * Set the context holding the levels.
+     * @param context The context. May be null.
+     */
+    void SetContext(typename FixedImageContext<TImage>::Pointer context)
+    {
+        context_ = context;
+    }
+
+protected:
+    FixedImagePyramidFilter()
+    {
+    }
+
+    virtual void GenerateData()
+    {
+        // Without a context the levels are made the same way, in one used once.
+        typename FixedImageContext<TImage>::Pointer context = context_;
+        if (context.IsNull())
+            context = FixedImageContext<TImage>::New(const_cast<TImage*>(this->GetInput()));
+
+        typename FixedImageContext<TImage>::ImageLevels levels =
+                                    context->GetPyramidLevels(this->GetSchedule());
+        for (unsigned level = 0; level < levels.size(); ++level)
+            this->GraftNthOutput(level, levels[level]);
+    }
+
+private:
+    FixedImagePyramidFilter(const Self&);   // Not implemented.
+    void operator=(const Self&);            // Not implemented.
+
+    typename FixedImageContext<TImage>::Pointer context_;
+};
+
+typedef FixedImageContext<Image2D> FixedImageContext2D;
+typedef FixedImageContext<Image3D> FixedImageContext3D;
+
+#endif /* defined(__DCEFit__FixedImageContext__) */
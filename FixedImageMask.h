@@ -0,0 +1,323 @@
+//
+//  FixedImageMask.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__FixedImageMask__
+#define __DCEFit__FixedImageMask__
+
+#include "ItkTypedefs.h"
+
+#include <itkLightObject.h>
+#include <itkContinuousIndex.h>
+#include <itkImageMaskSpatialObject.h>
+#include <itkSimpleFastMutexLock.h>
+#include <itkMutexLockHolder.h>
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <vector>
+
+/**
+ * The pixels of an image grid which lie inside a polygon ROI drawn in the plane
+ * of the slices, stored as runs along the rows. The polygon is rasterized once per
+ * grid, so testing a pixel never involves the polygon itself. A 3D mask extends
+ * the polygon through every slice as the registration region does.
+ */
+template <class TImage>
+class FixedImageMask : public itk::LightObject
+{
+public:
+    typedef FixedImageMask Self;
+    typedef itk::LightObject Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+
+    itkStaticConstMacro(ImageDimension, unsigned, TImage::ImageDimension);
+
+    typedef typename TImage::IndexType IndexType;
+    typedef typename TImage::RegionType RegionType;
+    typedef typename TImage::PointType PointType;
+    typedef itk::ContinuousIndex<double, TImage::ImageDimension> ContinuousIndexType;
+    typedef itk::ImageMaskSpatialObject<TImage::ImageDimension> SpatialObjectType;
+
+    /**
+     * A run of pixels inside the polygon, starting at an index and extending along
+     * the row.
+     */
+    struct Run
+    {
+        IndexType start;
+        itk::SizeValueType length;
+    };
+
+    /**
+     * The runs of one grid in raster order.
+     */
+    class Raster
+    {
+    public:
+        /**
+         * @return The runs in raster order.
+         */
+        const std::vector<Run>& GetRuns() const
+        {
+            return runs_;
+        }
+
+        /**
+         * @return The number of pixels inside the polygon.
+         */
+        itk::SizeValueType GetNumberOfPixels() const
+        {
+            return ends_.empty() ? 0 : ends_.back();
+        }
+
+        /**
+         * Find a pixel by its position in the raster order of the pixels inside.
+         * @param pos The position, less than GetNumberOfPixels().
+         * @return The index of the pixel.
+         */
+        IndexType GetIndex(itk::SizeValueType pos) const
+        {
+            typename std::vector<itk::SizeValueType>::const_iterator iter =
+                                            std::upper_bound(ends_.begin(), ends_.end(), pos);
+            unsigned runIdx = iter - ends_.begin();
+            const Run& run = runs_[runIdx];
+
+            IndexType index = run.start;
+            index[0] += pos - (ends_[runIdx] - run.length);
+            return index;
+        }
+
+        /**
+         * Test a pixel by searching the runs.
+         * @param index The index of the pixel.
+         * @return true if the pixel is inside the polygon.
+         */
+        bool IsInside(const IndexType& index) const
+        {
+            typename std::vector<Run>::const_iterator iter =
+                                std::upper_bound(runs_.begin(), runs_.end(), index, StartsAfter);
+            if (iter == runs_.begin())
+                return false;
+            --iter;
+
+            for (unsigned dim = 1; dim < ImageDimension; ++dim)
+                if (iter->start[dim] != index[dim])
+                    return false;
+
+            return index[0] < iter->start[0] + static_cast<long>(iter->length);
+        }
+
+        /**
+         * Add a run after the others.
+         * @param run The run.
+         */
+        void AddRun(const Run& run)
+        {
+            runs_.push_back(run);
+            ends_.push_back(GetNumberOfPixels() + run.length);
+        }
+
+    private:
+        /**
+         * @return true if the run starts after the pixel in raster order.
+         */
+        static bool StartsAfter(const IndexType& index, const Run& run)
+        {
+            for (int dim = ImageDimension - 1; dim >= 0; --dim)
+                if (index[dim] != run.start[dim])
+                    return index[dim] < run.start[dim];
+
+            return false;
+        }
+
+        std::vector<Run> runs_;
+        std::vector<itk::SizeValueType> ends_;    ///< Pixels up to and including each run.
+    };
+
+    /**
+     * Create a mask.
+     * @param vertices The vertices of the polygon as x and y pixel indices of
+     * image in turn.
+     * @param image The image the vertices are given in.
+     * @return Smart pointer to the mask.
+     */
+    static Pointer New(const std::vector<float>& vertices, const TImage* image)
+    {
+        Pointer mask = new Self(vertices, image);
+        mask->UnRegister();
+        return mask;
+    }
+
+    /**
+     * Get the pixels of a grid which are inside the polygon, rasterizing it on first use.
+     * @param image An image on the grid, such as a pyramid level of the fixed image.
+     * @param region Only pixels in this region are included.
+     * @return The pixels inside.
+     */
+    const Raster& GetRaster(const TImage* image, const RegionType& region)
+    {
+        LockHolder lock(mutex_);
+
+        std::vector<double> key;
+        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+        {
+            key.push_back(image->GetOrigin()[dim]);
+            key.push_back(image->GetSpacing()[dim]);
+            key.push_back(region.GetIndex(dim));
+            key.push_back(region.GetSize(dim));
+        }
+
+        typename RasterCache::iterator iter = rasters_.find(key);
+        if (iter != rasters_.end())
+            return iter->second;
+
+        return rasters_[key] = Rasterize(image, region);
+    }
+
+    /**
+     * Make a spatial object from the raster of an image for the metrics which
+     * take one. Testing a point is then a pixel lookup.
+     * @param image The image whose grid is used.
+     * @param region Only pixels in this region are inside.
+     * @return The spatial object.
+     */
+    typename SpatialObjectType::Pointer CreateSpatialObject(const TImage* image, const RegionType& region)
+    {
+        typedef typename SpatialObjectType::ImageType MaskImageType;
+        typename MaskImageType::Pointer maskImage = MaskImageType::New();
+        maskImage->CopyInformation(image);
+        maskImage->SetRegions(image->GetLargestPossibleRegion());
+        maskImage->Allocate();
+        maskImage->FillBuffer(0);
+
+        const std::vector<Run>& runs = GetRaster(image, region).GetRuns();
+        for (typename std::vector<Run>::const_iterator iter = runs.begin(); iter != runs.end(); ++iter)
+        {
+            IndexType index = iter->start;
+            for (itk::SizeValueType idx = 0; idx < iter->length; ++idx, ++index[0])
+                maskImage->SetPixel(index, 1);
+        }
+
+        typename SpatialObjectType::Pointer spatialObject = SpatialObjectType::New();
+        spatialObject->SetImage(maskImage);
+        return spatialObject;
+    }
+
+protected:
+    FixedImageMask(const std::vector<float>& vertices, const TImage* image)
+    {
+        for (unsigned idx = 0; idx + 1 < vertices.size(); idx += 2)
+        {
+            ContinuousIndexType index;
+            index.Fill(0.0);
+            index[0] = vertices[idx];
+            index[1] = vertices[idx + 1];
+
+            PointType point;
+            image->TransformContinuousIndexToPhysicalPoint(index, point);
+            polygon_.push_back(point);
+        }
+    }
+
+private:
+    typedef itk::MutexLockHolder<itk::SimpleFastMutexLock> LockHolder;
+    typedef std::map<std::vector<double>, Raster> RasterCache;
+
+    FixedImageMask(const Self&);      // Not implemented.
+    void operator=(const Self&);      // Not implemented.
+
+    /**
+     * Scan convert the polygon. A pixel is inside if its centre is, by the even-odd
+     * rule, and rows are found in raster order, fastest first.
+     */
+    Raster Rasterize(const TImage* image, const RegionType& region) const
+    {
+        Raster raster;
+        if ((polygon_.size() < 3) || (region.GetNumberOfPixels() == 0))
+            return raster;
+
+        // The vertices in the grid of the image. The grids of the pyramid share the
+        // orientation of the image so only the in plane coordinates are needed.
+        std::vector<double> xs, ys;
+        for (unsigned idx = 0; idx < polygon_.size(); ++idx)
+        {
+            ContinuousIndexType index;
+            image->TransformPhysicalPointToContinuousIndex(polygon_[idx], index);
+            xs.push_back(index[0]);
+            ys.push_back(index[1]);
+        }
+
+        const IndexType regionStart = region.GetIndex();
+        const long firstCol = regionStart[0];
+        const long lastCol = firstCol + static_cast<long>(region.GetSize(0)) - 1;
+
+        // The spans of each row of the region, in the plane.
+        std::vector<std::vector<std::pair<long, long> > > rowSpans(region.GetSize(1));
+        std::vector<double> crossings;
+        for (unsigned row = 0; row < rowSpans.size(); ++row)
+        {
+            double y = static_cast<double>(regionStart[1] + static_cast<long>(row));
+
+            crossings.clear();
+            unsigned prev = xs.size() - 1;
+            for (unsigned idx = 0; idx < xs.size(); prev = idx++)
+            {
+                if ((ys[idx] <= y) != (ys[prev] <= y))
+                    crossings.push_back(xs[idx] + (y - ys[idx]) * (xs[prev] - xs[idx])
+                                        / (ys[prev] - ys[idx]));
+            }
+            std::sort(crossings.begin(), crossings.end());
+
+            for (unsigned idx = 0; idx + 1 < crossings.size(); idx += 2)
+            {
+                long first = std::max(static_cast<long>(std::ceil(crossings[idx])), firstCol);
+                long last = std::min(static_cast<long>(std::floor(crossings[idx + 1])), lastCol);
+                if (first <= last)
+                    rowSpans[row].push_back(std::make_pair(first, last));
+            }
+        }
+
+        // Step through the rows of the region, the row index fastest, and lay
+        // the spans of the plane down on each.
+        IndexType index = regionStart;
+        bool done = false;
+        while (!done)
+        {
+            const std::vector<std::pair<long, long> >& spans = rowSpans[index[1] - regionStart[1]];
+            for (unsigned idx = 0; idx < spans.size(); ++idx)
+            {
+                Run run;
+                run.start = index;
+                run.start[0] = spans[idx].first;
+                run.length = spans[idx].second - spans[idx].first + 1;
+                raster.AddRun(run);
+            }
+
+            unsigned dim = 1;
+            for (; dim < ImageDimension; ++dim)
+            {
+                if (++index[dim] < regionStart[dim] + static_cast<long>(region.GetSize(dim)))
+                    break;
+                index[dim] = regionStart[dim];
+            }
+            done = (dim == ImageDimension);
+        }
+
+        return raster;
+    }
+
+    itk::SimpleFastMutexLock mutex_;
+    std::vector<PointType> polygon_;    ///< The vertices in physical coordinates.
+    RasterCache rasters_;
+};
+
+typedef FixedImageMask<Image2D> FixedImageMask2D;
+typedef FixedImageMask<Image3D> FixedImageMask3D;
+
+#endif /* defined(__DCEFit__FixedImageMask__) */
@@ -0,0 +1,303 @@
+//
+//  ImageRegistration.cpp
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#include "ImageRegistration.h"
+#include "RegisterOneImageRigid2D.h"
+#include "RegisterOneImageRigid3D.h"
+#include "RegisterOneImageBSpline2D.h"
+#include "RegisterOneImageBSpline3D.h"
+#include "RegisterOneImageRigid3Dv4.h"
+#include "RegisterOneImageBSpline3Dv4.h"
+#include "RegisterOneImageDemons2D.h"
+#include "RegisterOneImageDemons3D.h"
+#include "RegionCrop.h"
+#include "MotionCheck.h"
+#include "RegistrationProgress.h"
+
+/**
+ * The stage classes and rigid transform of each dimension. There is no ITKv4 engine
+ * for 2D so the v3 stages stand in for it.
+ */
+template <class TImage>
+struct StageTypes;
+
+template <>
+struct StageTypes<Image2D>
+{
+    typedef RegisterOneImageRigid2D RigidType;
+    typedef RegisterOneImageBSpline2D BSplineType;
+    typedef RegisterOneImageRigid2D RigidV4Type;
+    typedef RegisterOneImageBSpline2D BSplineV4Type;
+    typedef RegisterOneImageDemons2D DemonsType;
+    typedef CenteredRigid2DTransform RigidTransformType;
+};
+
+template <>
+struct StageTypes<Image3D>
+{
+    typedef RegisterOneImageRigid3D RigidType;
+    typedef RegisterOneImageBSpline3D BSplineType;
+    typedef RegisterOneImageRigid3Dv4 RigidV4Type;
+    typedef RegisterOneImageBSpline3Dv4 BSplineV4Type;
+    typedef RegisterOneImageDemons3D DemonsType;
+    typedef VersorTransform3D RigidTransformType;
+};
+
+/**
+ * Run one rigid or B-spline stage.
+ * @param stageParams The registration parameters.
+ * @param progress Receives the progress of the stage.
+ * @param fixedContext The context of the fixed image.
+ * @param movingContext A context made from the moving image, shared by the stages.
+ * @param warmStart The transform to start from. May be empty.
+ * @param movingInitialTransform Result of the rigid stage to register through. May be empty.
+ * @param resampleResult Whether to resample the moving image with the transform found.
+ * @param movingImage The image to register.
+ * @param finalTransform Set to the transform found.
+ * @param code Set to the result of the stage.
+ * @return The registered image, or the moving image if it was not resampled.
+ */
+template <class TStage, class TImage>
+static typename TImage::Pointer RunTransformStage(const ItkRegistrationParams& stageParams,
+                                        RegistrationProgress* progress,
+                                        typename FixedImageContext<TImage>::Pointer fixedContext,
+                                        typename FixedImageContext<TImage>::Pointer movingContext,
+                                        const TransformParams& warmStart,
+                                        const TransformParams& movingInitialTransform,
+                                        bool resampleResult,
+                                        typename TImage::Pointer movingImage,
+                                        TransformParams& finalTransform,
+                                        ResultCode& code)
+{
+    TStage stage(progress, fixedContext->GetFixedImage(), stageParams);
+    stage.SetFixedImageContext(fixedContext);
+    stage.SetMovingImageContext(movingContext);
+    stage.SetWarmStart(warmStart);
+    stage.SetMovingInitialTransform(movingInitialTransform);
+    stage.SetResampleResult(resampleResult);
+    typename TImage::Pointer regImage = stage.registerImage(movingImage, code);
+    finalTransform = stage.GetFinalTransform();
+
+    return regImage;
+}
+
+template <class TImage>
+ImageRegistration<TImage>::ImageRegistration(const ItkRegistrationParams& params,
+                                             RegistrationProgress* progress,
+                                             RegistrationSupervisor* supervisor)
+    : params_(params),
+      progress_((progress != 0) ? progress : RegistrationProgress::GetNull()),
+      supervisor_((supervisor != 0) ? supervisor : RegistrationSupervisor::GetUnattended())
+{
+}
+
+template <class TImage>
+typename ImageRegistration<TImage>::ImagePointer
+ImageRegistration<TImage>::Register(ImagePointer movingImage, ContextPointer fixedContext,
+                                    ContextPointer movingContext, const ImageTransforms* warmStart,
+                                    unsigned imageIdx, unsigned sliceIdx, Result& result)
+{
+    // The rigid and B-spline stages share the pyramid of the moving image.
+    if (!params_.cropToRegion
+        && (movingContext.IsNull() || (movingContext->GetFixedImage() != movingImage)))
+        movingContext = FixedImageContext<TImage>::New(movingImage);
+
+    Result found;
+    ImagePointer regImage = RunStages(movingImage, params_, fixedContext, movingContext,
+                                      warmStart, found);
+
+    if ((found.code == DISASTER) && (params_.failurePolicy == RetryOnFailure)
+        && !supervisor_->IsCancelled())
+        regImage = Retry(movingImage, fixedContext, movingContext, warmStart,
+                         imageIdx, sliceIdx, found);
+
+    if (supervisor_->IsCancelled())
+        return 0;
+
+    result = found;
+    return regImage;
+}
+
+template <class TImage>
+typename ImageRegistration<TImage>::ImagePointer
+ImageRegistration<TImage>::Retry(ImagePointer movingImage, ContextPointer fixedContext,
+                                 ContextPointer movingContext, const ImageTransforms* warmStart,
+                                 unsigned imageIdx, unsigned sliceIdx, Result& result)
+{
+    // Fewer levels and the other metric, starting from the neighbour's result
+    // if there is one.
+    ItkRegistrationParams fallback = params_.CreateFallback();
+    supervisor_->ReportFailure(imageIdx, sliceIdx,
+                               "Registration failed. Retrying with fallback settings.");
+
+    result = Result();
+    ImagePointer regImage = RunStages(movingImage, fallback, fixedContext, movingContext,
+                                      warmStart, result);
+    if (supervisor_->IsCancelled())
+        return 0;
+
+    if (result.code != DISASTER)
+    {
+        result.outcome = "Registered with fallback settings.";
+        supervisor_->ReportFailure(imageIdx, sliceIdx, result.outcome);
+        return regImage;
+    }
+
+    // Then the rigid stage alone, if that is not what just failed.
+    if (fallback.regSequence != Rigid)
+    {
+        fallback.regSequence = Rigid;
+        supervisor_->ReportFailure(imageIdx, sliceIdx,
+                                   "Fallback settings failed. Retrying with rigid registration only.");
+
+        result = Result();
+        regImage = RunStages(movingImage, fallback, fixedContext, movingContext, warmStart, result);
+        if (supervisor_->IsCancelled())
+            return 0;
+
+        if (result.code != DISASTER)
+        {
+            result.outcome = "Registered rigidly only.";
+            supervisor_->ReportFailure(imageIdx, sliceIdx, result.outcome);
+            return regImage;
+        }
+    }
+
+    // Nothing worked so the image is kept as it was.
+    result = Result();
+    result.code = DISASTER;
+    result.outcome = "All retries failed. Left unregistered.";
+    supervisor_->ReportFailure(imageIdx, sliceIdx, result.outcome);
+
+    return movingImage;
+}
+
+template <class TImage>
+typename ImageRegistration<TImage>::ImagePointer
+ImageRegistration<TImage>::RunStages(ImagePointer movingImage,
+                                     const ItkRegistrationParams& stageParams,
+                                     ContextPointer fixedContext, ContextPointer movingContext,
+                                     const ImageTransforms* warmStart, Result& result)
+{
+    typedef StageTypes<TImage> Types;
+
+    // The stages run on crops and the result is applied to the whole image.
+    if (stageParams.cropToRegion)
+        return RunCroppedStages(movingImage, stageParams, fixedContext, warmStart, result);
+
+    if (movingContext.IsNull() || (movingContext->GetFixedImage() != movingImage))
+        movingContext = FixedImageContext<TImage>::New(movingImage);
+
+    // An image which has not moved is left as it is, with no transforms.
+    if (stageParams.motionCheck
+        && MotionCheck<TImage>(stageParams, fixedContext).IsStill(movingImage, movingContext))
+        return movingImage;
+
+    ResultCode resultCode = SUCCESS;
+    bool useV4Engine = (stageParams.registrationEngine == V4Engine);
+
+    // Do this so that the deformable registration will get the moving
+    // image even if rigid registration is disabled.
+    ImagePointer regImage = movingImage;
+
+    if (stageParams.isRigidRegEnabled())
+    {
+        // The B-spline stage starts from the original image and the rigid transform
+        // so the rigid stage need not resample.
+        TransformParams rigidWarmStart = (warmStart != 0) ? warmStart->rigid : TransformParams();
+        bool resampleRigid = !stageParams.isBSplineRegEnabled();
+        if (useV4Engine)
+            regImage = RunTransformStage<typename Types::RigidV4Type, TImage>(stageParams, progress_,
+                                    fixedContext, movingContext, rigidWarmStart, TransformParams(),
+                                    resampleRigid, movingImage, result.transforms.rigid, resultCode);
+        else
+            regImage = RunTransformStage<typename Types::RigidType, TImage>(stageParams, progress_,
+                                    fixedContext, movingContext, rigidWarmStart, TransformParams(),
+                                    resampleRigid, movingImage, result.transforms.rigid, resultCode);
+    }
+
+    if ((resultCode == DISASTER) && !StageFailed(stageParams, result))
+        return regImage;
+
+    if (supervisor_->IsCancelled())
+        return 0;
+
+    if (stageParams.isBSplineRegEnabled())
+    {
+        TransformParams bsplineWarmStart = (warmStart != 0) ? warmStart->deformable : TransformParams();
+        if (useV4Engine)
+            regImage = RunTransformStage<typename Types::BSplineV4Type, TImage>(stageParams, progress_,
+                                    fixedContext, movingContext, bsplineWarmStart, result.transforms.rigid,
+                                    true, movingImage, result.transforms.deformable, resultCode);
+        else
+            regImage = RunTransformStage<typename Types::BSplineType, TImage>(stageParams, progress_,
+                                    fixedContext, movingContext, bsplineWarmStart, result.transforms.rigid,
+                                    true, movingImage, result.transforms.deformable, resultCode);
+    }
+    else if (stageParams.isDemonsRegEnabled())
+    {
+        typename Types::DemonsType demonsReg(progress_, fixedContext->GetFixedImage(), stageParams);
+        demonsReg.SetFixedImageContext(fixedContext);
+        regImage = demonsReg.registerImage(regImage, resultCode);
+        result.field = demonsReg.GetDisplacementField();
+    }
+
+    if ((resultCode == DISASTER) && !StageFailed(stageParams, result))
+        return regImage;
+
+    if (supervisor_->IsCancelled())
+        return 0;
+
+    if ((resultCode == FAILURE) && (result.code == SUCCESS))
+        result.code = FAILURE;
+
+    return regImage;
+}
+
+template <class TImage>
+typename ImageRegistration<TImage>::ImagePointer
+ImageRegistration<TImage>::RunCroppedStages(ImagePointer movingImage,
+                                            const ItkRegistrationParams& stageParams,
+                                            ContextPointer fixedContext,
+                                            const ImageTransforms* warmStart, Result& result)
+{
+    typedef StageTypes<TImage> Types;
+
+    RegionCrop<TImage> crop(fixedContext->GetFixedImage(), stageParams);
+    ItkRegistrationParams cropParams = crop.CropParams(stageParams);
+
+    ImagePointer regImage = RunStages(crop.Crop(movingImage), cropParams,
+                                      fixedContext->GetCroppedContext(crop.GetRegion()), 0,
+                                      warmStart, result);
+    if (regImage.IsNull())
+        return 0;
+
+    // The crop is no use to the caller.
+    if (result.code == DISASTER)
+        return movingImage;
+
+    return crop.template Uncrop<typename Types::RigidTransformType, FieldType>(movingImage,
+                                                                result.transforms, result.field);
+}
+
+template <class TImage>
+bool ImageRegistration<TImage>::StageFailed(const ItkRegistrationParams& stageParams,
+                                            Result& result)
+{
+    result.code = DISASTER;
+
+    // Unattended, the caller decides what to do next.
+    if (stageParams.failurePolicy == RetryOnFailure)
+        return false;
+
+    supervisor_->QueryContinue();
+    return true;
+}
+
+template class ImageRegistration<Image2D>;
+template class ImageRegistration<Image3D>;
@@ -0,0 +1,162 @@
+//
+//  ImageRegistration.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__ImageRegistration__
+#define __DCEFit__ImageRegistration__
+
+#include "ItkTypedefs.h"
+#include "ProjectDefs.h"
+#include "ItkRegistrationParams.h"
+#include "FixedImageContext.h"
+#include "SeriesTransforms.h"
+
+#include <string>
+
+class RegistrationProgress;
+
+/**
+ * What ImageRegistration needs from the program running it. This class suits a
+ * program with nobody watching. Nothing is ever cancelled and failures are not
+ * reported as they happen. The plugin asks its user and reports to its failure
+ * report. Implementations may be called from any thread.
+ */
+class RegistrationSupervisor
+{
+public:
+    virtual ~RegistrationSupervisor()
+    {
+    }
+
+    /**
+     * @return true if the registrations are to stop.
+     */
+    virtual bool IsCancelled()
+    {
+        return false;
+    }
+
+    /**
+     * A stage failed and the failure policy is to ask the user what to do. Returns
+     * once they have answered. If they cancel, IsCancelled() returns true from then on.
+     */
+    virtual void QueryContinue()
+    {
+    }
+
+    /**
+     * Report a step of the retries of a registration which failed.
+     * @param imageIdx Index of the image.
+     * @param sliceIdx Index of the slice. 0 unless slice-wise.
+     * @param outcome What was done.
+     */
+    virtual void ReportFailure(unsigned imageIdx, unsigned sliceIdx, const std::string& outcome)
+    {
+    }
+
+    /**
+     * @return A shared instance for a program with nobody watching.
+     */
+    static RegistrationSupervisor* GetUnattended()
+    {
+        static RegistrationSupervisor unattended;
+        return &unattended;
+    }
+};
+
+/**
+ * Registers one image, or one slice of it, to the fixed image. This is the whole
+ * of the work done for each image of a series, by the plugin and by SeriesRegistration
+ * alike. The motion check comes first, then the rigid stage and the B-spline or Demons
+ * stage, on crops around the registration region if asked. A registration which fails
+ * is retried, if the failure policy says so, with fallback settings, then rigidly only,
+ * and is otherwise left as it was.
+ *
+ * It is instantiated for Image2D and Image3D. There is no ITKv4 engine for 2D so the
+ * v3 stages are used for it.
+ */
+template <class TImage>
+class ImageRegistration
+{
+public:
+    typedef typename TImage::Pointer ImagePointer;
+    typedef typename FixedImageContext<TImage>::Pointer ContextPointer;
+    typedef itk::Vector<float, TImage::ImageDimension> FieldPixelType;
+    typedef itk::Image<FieldPixelType, TImage::ImageDimension> FieldType;
+    typedef typename FieldType::Pointer FieldPointer;
+
+    /**
+     * The outcome of registering one image.
+     */
+    struct Result
+    {
+        Result()
+        : code(SUCCESS)
+        {
+        }
+
+        ImageTransforms transforms;   ///< The rigid and B-spline results.
+        FieldPointer field;           ///< The Demons result.
+        ResultCode code;              ///< DISASTER if left unregistered.
+        std::string outcome;          ///< What the retries did. Empty if none.
+    };
+
+    /**
+     * Constructor.
+     * @param params The registration parameters. They must outlive this.
+     * @param progress Receives the progress of the stages. May be 0.
+     * @param supervisor Says whether to stop and hears of failures. May be 0 if
+     * nobody is watching.
+     */
+    ImageRegistration(const ItkRegistrationParams& params, RegistrationProgress* progress,
+                      RegistrationSupervisor* supervisor = 0);
+
+    /**
+     * Register an image.
+     * @param movingImage The image to register.
+     * @param fixedContext The context of the fixed image.
+     * @param movingContext A context already made from the moving image. May be empty.
+     * @param warmStart The transforms to start from. May be 0.
+     * @param imageIdx Index of the image, for the failure reports.
+     * @param sliceIdx Index of the slice, for the failure reports.
+     * @param result Set to the result.
+     * @return The registered image, the moving image if it was left as it was, or
+     * empty if the registrations were cancelled.
+     */
+    ImagePointer Register(ImagePointer movingImage, ContextPointer fixedContext,
+                          ContextPointer movingContext, const ImageTransforms* warmStart,
+                          unsigned imageIdx, unsigned sliceIdx, Result& result);
+
+private:
+    ImagePointer Retry(ImagePointer movingImage, ContextPointer fixedContext,
+                       ContextPointer movingContext, const ImageTransforms* warmStart,
+                       unsigned imageIdx, unsigned sliceIdx, Result& result);
+
+    ImagePointer RunStages(ImagePointer movingImage, const ItkRegistrationParams& stageParams,
+                           ContextPointer fixedContext, ContextPointer movingContext,
+                           const ImageTransforms* warmStart, Result& result);
+
+    /**
+     * Run the stages on crops of the images around the registration region and
+     * apply the result to the whole moving image.
+     */
+    ImagePointer RunCroppedStages(ImagePointer movingImage, const ItkRegistrationParams& stageParams,
+                                  ContextPointer fixedContext, const ImageTransforms* warmStart,
+                                  Result& result);
+
+    /**
+     * Deal with a stage which failed.
+     * @return true if the stages are to go on.
+     */
+    bool StageFailed(const ItkRegistrationParams& stageParams, Result& result);
+
+    const ItkRegistrationParams& params_;  ///< The registration parameters.
+    RegistrationProgress* progress_;       ///< Receives the progress of the stages.
+    RegistrationSupervisor* supervisor_;   ///< Says whether to stop and hears of failures.
+};
+
+#endif /* defined(__DCEFit__ImageRegistration__) */
@@ -8,6 +8,7 @@
 
 #include "ImageSlicer.h"
 
+#include <cstring>
 #include <stdexcept>
 
 #include <boost/lexical_cast.hpp>
@@ -33,12 +34,9 @@ typename Image2D::Pointer
         throw std::range_error(msg);
     }
 
-    // Instantiate a filter to effect dimensional reduction
-    ExtractSliceFilter::Pointer filter = ExtractSliceFilter::New();
-
-    // Get the start and size of the 3D image
-    typename Image3D::RegionType sliceRegion = images_[imageIdx]->GetLargestPossibleRegion();
-    unsigned numSlices = sliceRegion.GetSize(2);
+    const Image3D* image = images_[imageIdx];
+    typename Image3D::RegionType region = image->GetLargestPossibleRegion();
+    unsigned numSlices = region.GetSize(2);
     if (sliceIdx >= numSlices)
     {
         std::string msg = "ImageSlicer::GetSlice2D, ";
@@ -47,18 +45,31 @@ typename Image2D::Pointer
         throw std::range_error(msg);
     }
 
-    // Change the region to reflect what we want
-    sliceRegion.SetSize(2, 0);             // triggers dimension reduction
-    sliceRegion.SetIndex(2, sliceIdx);     // Get this slice
+    // Copy the slice straight out of the buffer as SetSlice2D() copies it back.
+    // Several threads take slices of the same image at once in the slice-wise
+    // modes and a filter would run a pipeline on the shared image for each.
+    // The geometry is that of itk::ExtractImageFilter with the direction
+    // collapsed to the identity.
+    Image2D::RegionType sliceRegion;
+    Image2D::PointType origin;
+    Image2D::SpacingType spacing;
+    for (unsigned dim = 0; dim < 2; ++dim)
+    {
+        sliceRegion.SetIndex(dim, region.GetIndex(dim));
+        sliceRegion.SetSize(dim, region.GetSize(dim));
+        origin[dim] = image->GetOrigin()[dim];
+        spacing[dim] = image->GetSpacing()[dim];
+    }
 
-    // tell the filter about it
-    filter->SetDirectionCollapseToIdentity();
-    filter->SetExtractionRegion(sliceRegion);
-    filter->SetInput(images_[imageIdx]);
+    typename Image2D::Pointer slice = Image2D::New();
+    slice->SetRegions(sliceRegion);
+    slice->SetOrigin(origin);
+    slice->SetSpacing(spacing);
+    slice->Allocate();
 
-    // Get the slice
-    typename Image2D::Pointer slice = filter->GetOutput();
-    filter->Update();
+    size_t numPixels = region.GetSize(0) * region.GetSize(1);
+    const Image3D::PixelType* srcBuffer = image->GetBufferPointer() + numPixels * sliceIdx;
+    memcpy(slice->GetBufferPointer(), srcBuffer, numPixels * sizeof(Image2D::PixelType));
 
     return slice;
 }
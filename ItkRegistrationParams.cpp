@@ -0,0 +1,696 @@
+//
+//  ItkRegistrationParams.cpp
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#include "ItkRegistrationParams.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+
+/**
+ * Set the four levels of a per level parameter.
+ */
+template <typename TValueType>
+static void SetLevels(ParamVector<TValueType>& vec, TValueType level1, TValueType level2,
+                      TValueType level3, TValueType level4)
+{
+    vec[0] = level1;
+    vec[1] = level2;
+    vec[2] = level3;
+    vec[3] = level4;
+}
+
+/**
+ * Read a single value.
+ * @param in The stream holding the value.
+ * @param value Set to the value read.
+ * @return true if a value was read and nothing followed it.
+ */
+template <typename TValueType>
+static bool ReadValue(std::istream& in, TValueType& value)
+{
+    if (!(in >> value))
+        return false;
+
+    std::string rest;
+    return !(in >> rest);
+}
+
+/**
+ * Read an enumeration given as its number.
+ */
+template <typename TEnumType>
+static bool ReadEnum(std::istream& in, TEnumType& value)
+{
+    int number = 0;
+    if (!ReadValue(in, number))
+        return false;
+
+    value = static_cast<TEnumType>(number);
+    return true;
+}
+
+/**
+ * Read the values of a per level parameter. If fewer values than levels are given
+ * the last one is used for the rest.
+ */
+template <typename TValueType>
+static bool ReadLevels(std::istream& in, ParamVector<TValueType>& vec)
+{
+    unsigned level = 0;
+    TValueType value;
+    while ((level < MAX_REGISTRATION_LEVELS) && (in >> value))
+        vec[level++] = value;
+
+    if ((level == 0) || !in.eof())
+        return false;
+
+    for (; level < MAX_REGISTRATION_LEVELS; ++level)
+        vec[level] = vec[level - 1];
+
+    return true;
+}
+
+ItkRegistrationParams::ItkRegistrationParams()
+: regSequence(Demons),
+  numImages(0),
+  slicesPerImage(0),
+  fixedImageNumber(1),
+  flippedData(false),
+  parallelSeries(false),
+  maxConcurrentImages(0),
+  sliceWise(false),
+  warmStart(NoWarmStart),
+  checkpoint(true),
+  failurePolicy(AskOnFailure),
+  registrationEngine(V3Engine),
+  cropToRegion(false),
+  cropMargin(10.0f),
+  motionCheck(false),
+  motionMaxShift(0.5f),
+  motionMinCorrelation(0.98f),
+  metricPrecision(DoublePrecision),
+  seriesName("Registered with DCEFit"),
+  rigidLevels(2),
+  rigidRegMetric(MattesMutualInformation),
+  rigidRegOptimiser(LBFGSB),
+  rigidPhaseCorrelation(false),
+
+  deformShowField(false),
+
+  bsplineLevels(3),
+  bsplineMetric(MattesMutualInformation),
+  bsplineOptimiser(LBFGSB),
+
+  demonsLevels(2),
+  demonsHistogramBins(1000),
+  demonsHistogramMatchPoints(10),
+  demonsStandardDeviations(1.0f),
+
+  objcParams(0)
+{
+    std::string name = std::string(LOGGER_NAME) + ".ItkRegistrationParams";
+    logger_ = log4cplus::Logger::getInstance(name);
+    LOG4CPLUS_TRACE(logger_, "");
+
+    // These are the plugin's factory defaults. See UserDefaults.m.
+    rigidMMINumBins.Fill(50);
+    rigidMMISampleRate.Fill(1.0f);
+    rigidLBFGSBCostConvergence.Fill(1e9f);
+    rigidLBFGSBGradientTolerance.Fill(0.0f);
+    rigidLBFGSGradientConvergence.Fill(1e-5f);
+    rigidLBFGSDefaultStepSize.Fill(1e-1f);
+    SetLevels(rigidRSGDMinStepSize, 1e-6f, 1e-5f, 1e-4f, 1e-4f);
+    rigidRSGDMaxStepSize.Fill(1e-1f);
+    rigidRSGDRelaxationFactor.Fill(0.5f);
+    rigidVersorOptTransScale.Fill(1e-3f);
+    SetLevels(rigidVersorOptMinStepSize, 1e-6f, 1e-5f, 1e-4f, 1e-4f);
+    rigidVersorOptMaxStepSize.Fill(1e-1f);
+    rigidVersorOptRelaxationFactor.Fill(0.5f);
+    SetLevels(rigidMaxIter, 300u, 200u, 100u, 100u);
+
+    SetLevels(bsplineMaxIter, 300u, 200u, 100u, 100u);
+    const unsigned gridSizes[MAX_REGISTRATION_LEVELS] = {21, 15, 11, 9};
+    for (unsigned level = 0; level < MAX_REGISTRATION_LEVELS; ++level)
+        for (unsigned dim = 0; dim < 3; ++dim)
+            bsplineGridSizes(level, dim) = gridSizes[level];
+    bsplineMMINumBins.Fill(50);
+    bsplineMMISampleRate.Fill(1.0f);
+    bsplineLBFGSBCostConvergence.Fill(1e9f);
+    bsplineLBFGSBGradientTolerance.Fill(0.0f);
+    SetLevels(bsplineLBFGSGradientConvergence, 1e-5f, 1e-4f, 1e-3f, 1e-3f);
+    bsplineLBFGSDefaultStepSize.Fill(1e-1f);
+    SetLevels(bsplineRSGDMinStepSize, 1e-6f, 1e-5f, 1e-4f, 1e-4f);
+    bsplineRSGDMaxStepSize.Fill(1e-1f);
+    bsplineRSGDRelaxationFactor.Fill(0.5f);
+
+    SetLevels(demonsMaxIter, 100u, 80u, 60u, 50u);
+    SetLevels(demonsMaxRMSError, 1.0f, 0.6f, 0.4f, 0.2f);
+}
+
+ItkRegistrationParams::~ItkRegistrationParams()
+{
+    //[ocParams release];
+}
+
+unsigned ItkRegistrationParams::sliceNumberToIndex(unsigned number)
+{
+    if (flippedData)
+        return slicesPerImage - number;
+    else
+        return number - 1;
+}
+
+unsigned ItkRegistrationParams::indexToSliceNumber(unsigned index)
+{
+    if (flippedData)
+        return slicesPerImage - index;
+    else
+        return index + 1;
+}
+
+bool ItkRegistrationParams::ReadFile(const std::string& path)
+{
+    std::ifstream file(path.c_str());
+    if (!file)
+    {
+        LOG4CPLUS_ERROR(logger_, "Could not open parameter file " << path);
+        return false;
+    }
+
+    bool ok = true;
+    unsigned lineNum = 0;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        ++lineNum;
+
+        std::string::size_type start = line.find_first_not_of(" \t\r");
+        if ((start == std::string::npos) || (line[start] == '#'))
+            continue;
+
+        std::string::size_type equals = line.find('=');
+        if (equals == std::string::npos)
+        {
+            LOG4CPLUS_ERROR(logger_, path << ":" << lineNum << ": Expected \"Key = value\".");
+            ok = false;
+            continue;
+        }
+
+        std::string key;
+        std::istringstream(line.substr(0, equals)) >> key;
+
+        // Commas may separate the values of lists.
+        std::string value = line.substr(equals + 1);
+        if (key != "SeriesDescription")
+            std::replace(value.begin(), value.end(), ',', ' ');
+        std::istringstream in(value);
+
+        bool read = true;
+        if (key == "RegistrationSequence")
+            read = ReadEnum(in, regSequence);
+        else if (key == "FixedImageNumber")
+            read = ReadValue(in, fixedImageNumber);
+        else if (key == "SeriesDescription")
+        {
+            std::string::size_type first = value.find_first_not_of(" \t");
+            std::string::size_type last = value.find_last_not_of(" \t\r");
+            seriesName = (first == std::string::npos) ? std::string()
+                                                      : value.substr(first, last - first + 1);
+        }
+        else if (key == "FlippedData")
+            read = ReadValue(in, flippedData);
+        else if (key == "ParallelSeriesReg")
+            read = ReadValue(in, parallelSeries);
+        else if (key == "MaxConcurrentImages")
+            read = ReadValue(in, maxConcurrentImages);
+        else if (key == "SliceWiseReg")
+            read = ReadValue(in, sliceWise);
+        else if (key == "WarmStart")
+            read = ReadEnum(in, warmStart);
+        else if (key == "CheckpointReg")
+            read = ReadValue(in, checkpoint);
+        else if (key == "FailurePolicy")
+            read = ReadEnum(in, failurePolicy);
+        else if (key == "RegistrationEngine")
+            read = ReadEnum(in, registrationEngine);
+        else if (key == "CropToRegion")
+            read = ReadValue(in, cropToRegion);
+        else if (key == "CropMargin")
+            read = ReadValue(in, cropMargin);
+        else if (key == "MotionCheck")
+            read = ReadValue(in, motionCheck);
+        else if (key == "MotionMaxShift")
+            read = ReadValue(in, motionMaxShift);
+        else if (key == "MotionMinCorrelation")
+            read = ReadValue(in, motionMinCorrelation);
+        else if (key == "MetricPrecision")
+            read = ReadEnum(in, metricPrecision);
+        else if (key == "FixedImageRegion")
+        {
+            Image2D::IndexType index;
+            Image2D::SizeType size;
+            read = static_cast<bool>(in >> index[0] >> index[1] >> size[0] >> size[1]);
+            if (read)
+            {
+                fixedImageRegion.SetIndex(index);
+                fixedImageRegion.SetSize(size);
+            }
+        }
+        else if (key == "FixedImageMask")
+        {
+            // The vertices of the ROI polygon, x and y in turn.
+            fixedImageMask.clear();
+            float coord;
+            while (in >> coord)
+                fixedImageMask.push_back(coord);
+            read = in.eof() && ((fixedImageMask.size() % 2) == 0)
+                   && (fixedImageMask.empty() || (fixedImageMask.size() >= 6));
+        }
+        else if (key == "RigidRegMultiresLevels")
+            read = ReadValue(in, rigidLevels);
+        else if (key == "RigidRegMetric")
+            read = ReadEnum(in, rigidRegMetric);
+        else if (key == "RigidRegOptimizer")
+            read = ReadEnum(in, rigidRegOptimiser);
+        else if (key == "RigidRegPhaseCorrelation")
+            read = ReadValue(in, rigidPhaseCorrelation);
+        else if (key == "RigidRegMMIHistogramBins")
+            read = ReadLevels(in, rigidMMINumBins);
+        else if (key == "RigidRegMMISampleRate")
+            read = ReadLevels(in, rigidMMISampleRate);
+        else if (key == "RigidRegLBFGSBCostConvergence")
+            read = ReadLevels(in, rigidLBFGSBCostConvergence);
+        else if (key == "RigidRegLBFGSBGradientTolerance")
+            read = ReadLevels(in, rigidLBFGSBGradientTolerance);
+        else if (key == "RigidRegLBFGSGradientConvergence")
+            read = ReadLevels(in, rigidLBFGSGradientConvergence);
+        else if (key == "RigidRegLBFGSDefaultStepSize")
+            read = ReadLevels(in, rigidLBFGSDefaultStepSize);
+        else if (key == "RigidRegRSGDMinStepSize")
+            read = ReadLevels(in, rigidRSGDMinStepSize);
+        else if (key == "RigidRegRSGDMaxStepSize")
+            read = ReadLevels(in, rigidRSGDMaxStepSize);
+        else if (key == "RigidRegRSGDRelaxationFactor")
+            read = ReadLevels(in, rigidRSGDRelaxationFactor);
+        else if (key == "RigidRegVersorOptTransScale")
+            read = ReadLevels(in, rigidVersorOptTransScale);
+        else if (key == "RigidRegVersorOptMinStepSize")
+            read = ReadLevels(in, rigidVersorOptMinStepSize);
+        else if (key == "RigidRegVersorOptMaxStepSize")
+            read = ReadLevels(in, rigidVersorOptMaxStepSize);
+        else if (key == "RigidRegVersorOptRelaxationFactor")
+            read = ReadLevels(in, rigidVersorOptRelaxationFactor);
+        else if (key == "RigidRegMaxIter")
+            read = ReadLevels(in, rigidMaxIter);
+        else if (key == "DeformRegShowField")
+            read = ReadValue(in, deformShowField);
+        else if (key == "BsplineRegMaxIter")
+            read = ReadLevels(in, bsplineMaxIter);
+        else if (key == "BsplineRegMultiresLevels")
+            read = ReadValue(in, bsplineLevels);
+        else if (key == "BsplineRegGridSizeArray")
+        {
+            for (unsigned level = 0; read && (level < MAX_REGISTRATION_LEVELS); ++level)
+                for (unsigned dim = 0; read && (dim < 3); ++dim)
+                    read = static_cast<bool>(in >> bsplineGridSizes(level, dim));
+        }
+        else if (key == "BsplineRegMetric")
+            read = ReadEnum(in, bsplineMetric);
+        else if (key == "BsplineRegOptimizer")
+            read = ReadEnum(in, bsplineOptimiser);
+        else if (key == "BsplineRegMMIHistogramBins")
+            read = ReadLevels(in, bsplineMMINumBins);
+        else if (key == "BsplineRegMMISampleRate")
+            read = ReadLevels(in, bsplineMMISampleRate);
+        else if (key == "BsplineRegLBFGSBCostConvergence")
+            read = ReadLevels(in, bsplineLBFGSBCostConvergence);
+        else if (key == "BsplineRegLBFGSBGradientTolerance")
+            read = ReadLevels(in, bsplineLBFGSBGradientTolerance);
+        else if (key == "BsplineRegRSGDGradientConvergence")
+            read = ReadLevels(in, bsplineLBFGSGradientConvergence);
+        else if (key == "BsplineRegLBFGSDefaultStepSize")
+            read = ReadLevels(in, bsplineLBFGSDefaultStepSize);
+        else if (key == "BsplineRegRSGDMinStepSize")
+            read = ReadLevels(in, bsplineRSGDMinStepSize);
+        else if (key == "BsplineRegRSGDMaxStepSize")
+            read = ReadLevels(in, bsplineRSGDMaxStepSize);
+        else if (key == "BsplineRegRSGDRelaxationFactor")
+            read = ReadLevels(in, bsplineRSGDRelaxationFactor);
+        else if (key == "DemonsRegMaxIter")
+            read = ReadLevels(in, demonsMaxIter);
+        else if (key == "DemonsRegMultiresLevels")
+            read = ReadValue(in, demonsLevels);
+        else if (key == "DemonsRegMaxRMSError")
+            read = ReadLevels(in, demonsMaxRMSError);
+        else if (key == "DemonsRegHistogramBins")
+            read = ReadValue(in, demonsHistogramBins);
+        else if (key == "DemonsRegHistogramMatchPoints")
+            read = ReadValue(in, demonsHistogramMatchPoints);
+        else if (key == "DemonsRegStandardDeviations")
+            read = ReadValue(in, demonsStandardDeviations);
+        else
+        {
+            LOG4CPLUS_ERROR(logger_, path << ":" << lineNum << ": Unknown key " << key);
+            ok = false;
+            continue;
+        }
+
+        if (!read)
+        {
+            LOG4CPLUS_ERROR(logger_, path << ":" << lineNum << ": Bad value for " << key);
+            ok = false;
+        }
+    }
+
+    if ((rigidLevels == 0) || (rigidLevels > MAX_REGISTRATION_LEVELS)
+        || (bsplineLevels == 0) || (bsplineLevels > MAX_REGISTRATION_LEVELS)
+        || (demonsLevels == 0) || (demonsLevels > MAX_REGISTRATION_LEVELS))
+    {
+        LOG4CPLUS_ERROR(logger_, path << ": Pyramid levels must be from 1 to "
+                        << MAX_REGISTRATION_LEVELS << ".");
+        ok = false;
+    }
+
+    return ok;
+}
+
+ItkRegistrationParams ItkRegistrationParams::CreateFallback() const
+{
+    ItkRegistrationParams fallback(*this);
+
+    if (fallback.rigidLevels > 1)
+        --fallback.rigidLevels;
+    if (fallback.bsplineLevels > 1)
+        --fallback.bsplineLevels;
+    if (fallback.demonsLevels > 1)
+        --fallback.demonsLevels;
+
+    fallback.rigidRegMetric = (rigidRegMetric == MeanSquares)
+                                ? MattesMutualInformation : MeanSquares;
+    fallback.bsplineMetric = (bsplineMetric == MeanSquares)
+                                ? MattesMutualInformation : MeanSquares;
+
+    return fallback;
+}
+
+std::string ItkRegistrationParams::Print() const
+{
+    
+    std::stringstream str;
+
+    str << "ItkRegistrationParams\n";
+    str << "Number of images: " << numImages << "\n";
+    str << "Slices per image: " << slicesPerImage << "\n";
+    str << "Flipped data: " << (flippedData ? "Yes" : "No") << "\n";
+    str << "Fixed image number: " << fixedImageNumber << "\n";
+    str << "Series name: " << seriesName << "\n";
+    str << "Parallel series registration: " << (parallelSeries ? "Yes" : "No") << "\n";
+    if (parallelSeries)
+        str << "  Max. concurrent images: " << maxConcurrentImages << "\n";
+    str << "Slice-wise registration: " << (sliceWise ? "Yes" : "No") << "\n";
+    str << "Temporal warm start: ";
+    switch (warmStart)
+    {
+        case PreviousWarmStart:
+            str << "Previous time point\n";
+            break;
+        case ExtrapolatedWarmStart:
+            str << "Extrapolated\n";
+            break;
+        default:
+            str << "None\n";
+            break;
+    }
+    str << "Checkpoint and resume: " << (checkpoint ? "Yes" : "No") << "\n";
+    str << "On failure: " << ((failurePolicy == RetryOnFailure) ? "Retry unattended" : "Ask") << "\n";
+    str << "Registration engine: " << ((registrationEngine == V4Engine) ? "ITKv4" : "ITKv3") << "\n";
+
+    str << "Region: " << fixedImageRegion << "\n";
+    if (cropToRegion)
+        str << "Crop to region with margin: " << cropMargin << " mm\n";
+    else
+        str << "Crop to region: No\n";
+    if (motionCheck)
+        str << "Skip images with correlation >= " << motionMinCorrelation
+            << " and shift <= " << motionMaxShift << " mm\n";
+    else
+        str << "Skip images without motion: No\n";
+    switch (metricPrecision)
+    {
+        case SinglePrecision:
+            str << "Metric precision: Single\n";
+            break;
+        case ValidatePrecision:
+            str << "Metric precision: Single, validated against double\n";
+            break;
+        default:
+            str << "Metric precision: Double\n";
+            break;
+    }
+    if (fixedImageMask.empty())
+        str << "Mask: None\n";
+    else
+        str << "Mask: ROI with " << fixedImageMask.size() / 2 << " vertices\n";
+
+    if (isRigidRegEnabled())
+    {
+        str << "Rigid registration enabled.\n";
+        str << "  Pyramid levels: " << rigidLevels << "\n";
+        str << "  Metric: ";
+        switch (rigidRegMetric)
+        {
+            case MeanSquares:
+                str << "Mean squares\n";
+                break;
+            case MattesMutualInformation:
+            case FastMattesMutualInformation:
+                str << ((rigidRegMetric == FastMattesMutualInformation) ? "Fast " : "")
+                    << "Mattes mutual information\n";
+                str << "  Number of bins: " << rigidMMINumBins << "\n";
+                str << "  Sample rate: " << std::setprecision(2) << rigidMMISampleRate << "\n";
+                break;
+            case LocalNormalizedCorrelation:
+                str << "Local normalised correlation\n";
+                str << "  Sample rate: " << std::setprecision(2) << rigidMMISampleRate << "\n";
+                break;
+            case NormalizedGradientField:
+                str << "Normalised gradient field\n";
+                str << "  Sample rate: " << std::setprecision(2) << rigidMMISampleRate << "\n";
+                break;
+            default:;
+        }
+        str << "  Optimiser: ";
+        switch (rigidRegOptimiser)
+        {
+            case LBFGSB:
+                str << "LBFGSB\n";
+                str << "  LBFGSB Convergence: " << std::scientific << std::setprecision(2)
+                                                << rigidLBFGSBCostConvergence << "\n";
+                break;
+            case LBFGS:
+                str << "LBFGS\n";
+                str << "  LBFGS Convergence: " << std::scientific << std::setprecision(2)
+                                               << rigidLBFGSGradientConvergence << "\n";
+                break;
+            case RSGD:
+                str << "RSGD\n";
+                str << "  RSGD Min. step size: " << std::scientific << std::setprecision(2)
+                << rigidRSGDMinStepSize << "\n";
+                str << "  RSGD Max. step size: " << std::scientific << std::setprecision(2)
+                << rigidRSGDMaxStepSize << "\n";
+                str << "  RSGD Relaxation factor: " << std::fixed << std::setprecision(2)
+                << rigidRSGDRelaxationFactor << "\n";
+                break;
+            case Versor:
+                str << "Versor\n";
+                str << "  Versor translation scale: " << std::scientific << std::setprecision(2)
+                << rigidVersorOptTransScale << "\n";
+                str << "  Versor Min. step size: " << std::scientific << std::setprecision(2)
+                << rigidVersorOptMinStepSize << "\n";
+                str << "  Versor Max. step size: " << std::scientific << std::setprecision(2)
+                << rigidVersorOptMaxStepSize << "\n";
+                str << "  Versor Relaxation factor: " << std::fixed << std::setprecision(2)
+                << rigidVersorOptRelaxationFactor << "\n";
+                break;
+            default:;
+        }
+
+        str << "  Max. iterations: " << rigidMaxIter << "\n";
+        str << "  Phase correlation start: " << (rigidPhaseCorrelation ? "Yes" : "No") << "\n";
+    }
+    else
+    {
+        str << "Rigid registration disabled\n";
+    }
+
+    if (isBSplineRegEnabled())
+    {
+        str << "B-spline deformable registration enabled.\n";
+        if (deformShowField)
+            str << "  Showing deformation field.\n";
+        str << "  Max. iterations: " << bsplineMaxIter << "\n";
+        str << "  Pyramid levels: " << bsplineLevels << "\n";
+        str << "  Grid size: " << bsplineGridSizes << "\n";
+        str << "  Bspline order: " << BSPLINE_ORDER << "\n";
+        str << "  Metric: ";
+        
+        switch (bsplineMetric)
+        {
+            case MeanSquares:
+                str << "Mean squares\n";
+                break;
+            case MattesMutualInformation:
+            case FastMattesMutualInformation:
+                str << ((bsplineMetric == FastMattesMutualInformation) ? "Fast " : "")
+                    << "Mattes mutual information\n";
+                str << "  Number of bins: " << bsplineMMINumBins << "\n";
+                str << "  Sample rate: " << std::fixed << std::setprecision(2)
+                << bsplineMMISampleRate << "\n";
+                break;
+            case LocalNormalizedCorrelation:
+                str << "Local normalised correlation\n";
+                str << "  Sample rate: " << std::fixed << std::setprecision(2) << bsplineMMISampleRate << "\n";
+                break;
+            case NormalizedGradientField:
+                str << "Normalised gradient field\n";
+                str << "  Sample rate: " << std::fixed << std::setprecision(2) << bsplineMMISampleRate << "\n";
+                break;
+            default:;
+        }
+        str << "  Optimizer: ";
+        switch (bsplineOptimiser)
+        {
+            case LBFGSB:
+                str << "LBFGSB\n";
+                str << "  LBFGSB Convergence: " << std::scientific << std::setprecision(2)
+                << bsplineLBFGSBCostConvergence << "\n";
+                break;
+            case LBFGS:
+                str << "LBFGS\n";
+                str << "  LBFGS Convergence: " << std::scientific << std::setprecision(2)
+                    << bsplineLBFGSGradientConvergence << "\n";
+                break;
+            case RSGD:
+                str << "RSGD\n";
+                str << "  RSGD Min. step size: " << std::scientific << std::setprecision(2)
+                    << bsplineRSGDMinStepSize << "\n";
+                str << "  RSGD Max. step size: " << std::scientific << std::setprecision(2)
+                    << bsplineRSGDMaxStepSize << "\n";
+                str << "  RSGD Relaxation factor: " << std::fixed << std::setprecision(2)
+                    << bsplineRSGDRelaxationFactor << "\n";
+                break;
+            default:;
+        }
+    }
+    else
+    {
+        str << "B-spline deformable registration disabled.\n";
+    }
+
+    if (isDemonsRegEnabled())
+    {
+        str << "Demons registration enabled.\n";
+        if (deformShowField)
+            str << "  Showing deformation field.\n";
+        str << "  Pyramid levels: " << demonsLevels << "\n";
+        str << "  Max. iterations: " << demonsMaxIter << "\n";
+        str << "  Max. RMS error: " << demonsMaxRMSError << "\n";
+        str << "  Histogram bins: " << demonsHistogramBins << "\n";
+        str << "  Histogram match points: " << demonsHistogramMatchPoints << "\n";
+        str << "  Standard deviations: " << demonsStandardDeviations << "\n";
+    }
+    else
+    {
+        str << "Demons registration disabled.\n";
+    }
+
+    return str.str();
+}
+
+std::string ItkRegistrationParams::Signature() const
+{
+    // Full precision so that any change to a value changes the text.
+    std::stringstream str;
+    str << std::setprecision(std::numeric_limits<float>::max_digits10);
+
+    str << "Sequence: " << regSequence << "\n";
+    str << "Images: " << numImages << " x " << slicesPerImage << " slices\n";
+    str << "Flipped: " << flippedData << "\n";
+    str << "Fixed image: " << fixedImageNumber << "\n";
+    str << "Slice-wise: " << sliceWise << "\n";
+    str << "Warm start: " << warmStart << "\n";
+    str << "Failure policy: " << failurePolicy << "\n";
+    str << "Engine: " << registrationEngine << "\n";
+    str << "Region: " << fixedImageRegion.GetIndex() << " " << fixedImageRegion.GetSize() << "\n";
+    str << "Mask:";
+    for (unsigned idx = 0; idx < fixedImageMask.size(); ++idx)
+        str << " " << fixedImageMask[idx];
+    str << "\n";
+    str << "Crop: " << cropToRegion << " " << cropMargin << "\n";
+    str << "Motion check: " << motionCheck << " " << motionMaxShift << " " << motionMinCorrelation << "\n";
+    str << "Metric precision: " << metricPrecision << "\n";
+    str << "Show field: " << deformShowField << "\n";
+
+    if (isRigidRegEnabled())
+    {
+        str << "Rigid: " << rigidLevels << " levels, metric " << rigidRegMetric
+            << ", optimiser " << rigidRegOptimiser << "\n";
+        str << "  Phase correlation: " << rigidPhaseCorrelation << "\n";
+        str << "  MMI: " << rigidMMINumBins << " " << rigidMMISampleRate << "\n";
+        str << "  LBFGSB: " << rigidLBFGSBCostConvergence << " " << rigidLBFGSBGradientTolerance << "\n";
+        str << "  LBFGS: " << rigidLBFGSGradientConvergence << " " << rigidLBFGSDefaultStepSize << "\n";
+        str << "  RSGD: " << rigidRSGDMinStepSize << " " << rigidRSGDMaxStepSize << " "
+            << rigidRSGDRelaxationFactor << "\n";
+        str << "  Versor: " << rigidVersorOptTransScale << " " << rigidVersorOptMinStepSize << " "
+            << rigidVersorOptMaxStepSize << " " << rigidVersorOptRelaxationFactor << "\n";
+        str << "  Max. iterations: " << rigidMaxIter << "\n";
+    }
+
+    if (isBSplineRegEnabled())
+    {
+        str << "B-spline: " << bsplineLevels << " levels, metric " << bsplineMetric
+            << ", optimiser " << bsplineOptimiser << ", order " << BSPLINE_ORDER << "\n";
+        str << "  Grid sizes: " << bsplineGridSizes << "\n";
+        str << "  MMI: " << bsplineMMINumBins << " " << bsplineMMISampleRate << "\n";
+        str << "  LBFGSB: " << bsplineLBFGSBCostConvergence << " " << bsplineLBFGSBGradientTolerance << "\n";
+        str << "  LBFGS: " << bsplineLBFGSGradientConvergence << " " << bsplineLBFGSDefaultStepSize << "\n";
+        str << "  RSGD: " << bsplineRSGDMinStepSize << " " << bsplineRSGDMaxStepSize << " "
+            << bsplineRSGDRelaxationFactor << "\n";
+        str << "  Max. iterations: " << bsplineMaxIter << "\n";
+    }
+
+    if (isDemonsRegEnabled())
+    {
+        str << "Demons: " << demonsLevels << " levels\n";
+        str << "  Max. iterations: " << demonsMaxIter << "\n";
+        str << "  Max. RMS error: " << demonsMaxRMSError << "\n";
+        str << "  Histogram: " << demonsHistogramBins << " bins, "
+            << demonsHistogramMatchPoints << " match points\n";
+        str << "  Standard deviations: " << demonsStandardDeviations << "\n";
+    }
+
+    return str.str();
+}
+
+bool ItkRegistrationParams::isRigidRegEnabled() const
+{
+    return ((regSequence == Rigid) || (regSequence == RigidBSpline));
+}
+
+bool ItkRegistrationParams::isBSplineRegEnabled() const
+{
+    return ((regSequence == BSpline) || (regSequence == RigidBSpline));
+}
+
+bool ItkRegistrationParams::isDemonsRegEnabled() const
+{
+    return (regSequence == Demons);
+}
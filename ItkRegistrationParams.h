@@ -9,16 +9,27 @@
 #ifndef ITK_REGISTRATION_PARAMS_H
 #define ITK_REGISTRATION_PARAMS_H
 
+#ifdef __OBJC__
 #import <Foundation/Foundation.h>
+#endif
 
 #include <log4cplus/loggingmacros.h>
 
 #include <itkImageRegion.h>
 
+#ifdef __OBJC__
 #import "RegistrationParams.h"
+typedef const RegistrationParams* RegistrationParamsPtr;
+#else
+typedef const void* RegistrationParamsPtr;   // Obj-C parameters are not available in C++.
+#endif
+
 #include "ProjectDefs.h"
 #include "ItkTypedefs.h"
 
+#include <string>
+#include <vector>
+
 // Essentially a C11 typedef 
 template <typename TValueType>
 using ParamVector = itk::FixedArray<TValueType, MAX_REGISTRATION_LEVELS>;
@@ -31,15 +42,56 @@ using ParamMatrix = itk::Matrix<TValueType, MAX_REGISTRATION_LEVELS, 3>;
  * to ITK as C++ parameters.
  * Because this is mostly a POD container, public access is allowed to the members
  * rather than using getters and setters to do the same thing.
+ *
+ * Without Obj-C (e.g. the command line program) the parameters start as the plugin's
+ * factory defaults and may be read from a file with ReadFile().
  */
 class ItkRegistrationParams
 {
 public:
+    /**
+     * Constructor. The parameters are the plugin's factory defaults.
+     */
+    ItkRegistrationParams();
+
+#ifdef __OBJC__
     ItkRegistrationParams(const RegistrationParams* params);
+#endif
 
     virtual ~ItkRegistrationParams();
-    
+
+    /**
+     * Read parameters from a text file of "Key = value" lines. The keys are those
+     * that the plugin uses for its user defaults, e.g. "RigidRegMultiresLevels = 2".
+     * Per level parameters take up to four values, the last being repeated for the
+     * remaining levels. BsplineRegGridSizeArray takes three values per level and
+     * FixedImageRegion takes "x y width height". FixedImageMask takes the x and y pixel
+     * coordinates of each vertex of the ROI in turn. Enumerations are given as numbers as
+     * in ProjectDefs.h. Blank lines and those starting with '#' are ignored. Keys not
+     * in the file are left as they are.
+     * @param path Path of the file.
+     * @return true if the file was read without error.
+     */
+    bool ReadFile(const std::string& path);
+
+    /**
+     * Make the parameters to retry a failed registration with. Each multiresolution
+     * stage loses its coarsest level and the metrics are swapped, which avoids the usual
+     * causes of an ITK exception: too few samples in a small level and an ill-suited metric.
+     * @return The fallback parameters.
+     */
+    ItkRegistrationParams CreateFallback() const;
+
     std::string Print() const;
+
+    /**
+     * The parameters which affect the result of a registration, as text at full
+     * precision. It keys the checkpoints, so settings such as the concurrency and
+     * the series name are left out and a run may resume under different ones.
+     * @return The signature.
+     */
+    std::string Signature() const;
+
     unsigned sliceNumberToIndex(unsigned number);
     unsigned indexToSliceNumber(unsigned index);
     bool isRigidRegEnabled() const;
@@ -51,14 +103,28 @@ public:
     unsigned slicesPerImage;                 ///< Number of slices (2D) per time sample.
     unsigned fixedImageNumber;               ///< Number of fixed image, 1 based as in OsiriX.
     bool flippedData;                        ///< OsiriX flag. If true, slice #1 is last slice.
+    bool parallelSeries;                     ///< Register the images of the series concurrently.
+    unsigned maxConcurrentImages;            ///< Max. images registered at once. 0 = system decides.
+    bool sliceWise;                          ///< Register multi-slice series slice by slice.
+    WarmStartType warmStart;                 ///< Seed each time point from its neighbours.
+    bool checkpoint;                         ///< Save finished images so that a stopped run can resume.
+    FailurePolicyType failurePolicy;         ///< What to do when a registration stage fails.
+    RegistrationEngineType registrationEngine; ///< Framework used for 3D rigid and B-spline registration.
+    bool cropToRegion;                       ///< Register crops of the region plus a margin.
+    float cropMargin;                        ///< Margin around the region in mm when cropping.
+    bool motionCheck;                        ///< Skip images which have not moved.
+    float motionMaxShift;                    ///< Largest shift in mm of an image which has not moved.
+    float motionMinCorrelation;              ///< Least correlation of an image which has not moved.
+    MetricPrecisionType metricPrecision;     ///< Precision of the per pixel metric arithmetic.
     std::string seriesName;                  ///< Series description to save data with.
     Image2D::RegionType fixedImageRegion;    ///< Region to register.
-    SpatialMask2D::Pointer fixedImageMask;   ///< Spatial mask for registration.
+    std::vector<float> fixedImageMask;       ///< ROI vertices, x and y in pixels in turn. Empty if none.
 
     //bool rigidRegEnabled;                    ///< Do rigid step first if  true.
     unsigned rigidLevels;                    ///< Number of multi-res levels to use (max 4).
     MetricType rigidRegMetric;               ///< Type of metric to use.
     OptimizerType rigidRegOptimiser;         ///< Optimiser to use.
+    bool rigidPhaseCorrelation;              ///< Start from the translation found by phase correlation.
 
     ParamVector<unsigned> rigidMMINumBins;            ///< MMI bins. See ITK docs.
     ParamVector<float> rigidMMISampleRate;            ///< Fraction of image for MMI metric to sample.
@@ -104,12 +170,12 @@ public:
     unsigned demonsHistogramMatchPoints;
     float demonsStandardDeviations;
 
-    void createFixedImageMask(Image2D::Pointer image); ///< Create spatial object mask.
-
 private:
     log4cplus::Logger logger_;             ///< The instance logger.
+#ifdef __OBJC__
     void setRegion(const Region2D* reg);   ///< Make ITK region from Obj-C region.
-    const RegistrationParams* objcParams;  ///< Obj-C params we construct from.
+#endif
+    RegistrationParamsPtr objcParams;      ///< Obj-C params we construct from.
 };
 
 
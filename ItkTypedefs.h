@@ -39,8 +39,17 @@
 #include <itkDemonsRegistrationFilter.h>
 #include <itkMultiResolutionPDEDeformableRegistration.h>
 #include <itkWarpImageFilter.h>
+#include <itkImageRegistrationMethodv4.h>
+#include <itkMattesMutualInformationImageToImageMetricv4.h>
+#include <itkMeanSquaresImageToImageMetricv4.h>
+#include <itkRegularStepGradientDescentOptimizerv4.h>
+#include <itkLBFGSBOptimizerv4.h>
+#include <itkRegionOfInterestImageFilter.h>
 
 #include "ProjectDefs.h"
+#include "FastMattesMIImageToImageMetric.h"
+#include "LocalNormalizedCorrelationImageToImageMetric.h"
+#include "NormalizedGradientFieldImageToImageMetric.h"
 
 /// The working pixel type
 typedef float TPixel;
@@ -69,9 +78,15 @@ typedef itk::MultiResolutionPyramidImageFilter<Image3D, Image3D> ImagePyramid3D;
 typedef itk::ImageToImageMetric<Image2D, Image2D> ImageToImageMetric2D;
 typedef itk::MattesMutualInformationImageToImageMetric<Image2D, Image2D> MMIImageToImageMetric2D;
 typedef itk::MeanSquaresImageToImageMetric<Image2D, Image2D> MSImageToImageMetric2D;
+typedef FastMattesMIImageToImageMetric<Image2D, Image2D> FastMMIImageToImageMetric2D;
+typedef LocalNormalizedCorrelationImageToImageMetric<Image2D, Image2D> LNCCImageToImageMetric2D;
+typedef NormalizedGradientFieldImageToImageMetric<Image2D, Image2D> NGFImageToImageMetric2D;
 typedef itk::ImageToImageMetric<Image3D, Image3D> ImageToImageMetric3D;
 typedef itk::MattesMutualInformationImageToImageMetric<Image3D, Image3D> MMIImageToImageMetric3D;
 typedef itk::MeanSquaresImageToImageMetric<Image3D, Image3D> MSImageToImageMetric3D;
+typedef FastMattesMIImageToImageMetric<Image3D, Image3D> FastMMIImageToImageMetric3D;
+typedef LocalNormalizedCorrelationImageToImageMetric<Image3D, Image3D> LNCCImageToImageMetric3D;
+typedef NormalizedGradientFieldImageToImageMetric<Image3D, Image3D> NGFImageToImageMetric3D;
 
 // Typedefs for the optimizers
 typedef itk::SingleValuedNonLinearOptimizer SingleValuedNonLinearOptimizer;
@@ -95,6 +110,17 @@ typedef itk::CenteredVersorTransformInitializer<Image3D, Image3D>
 typedef itk::BSplineTransformInitializer<BSplineTransform2D, Image2D> BSplineTransformInitializer2D;
 typedef itk::BSplineTransformInitializer<BSplineTransform3D, Image3D> BSplineTransformInitializer3D;
 
+// The ITKv4 registration objects, metrics and optimizers
+typedef itk::ImageRegistrationMethodv4<Image3D, Image3D, VersorTransform3D> RigidRegistrationMethod3Dv4;
+typedef itk::ImageRegistrationMethodv4<Image3D, Image3D, BSplineTransform3D> BSplineRegistrationMethod3Dv4;
+typedef itk::ImageToImageMetricv4<Image3D, Image3D> ImageToImageMetric3Dv4;
+typedef itk::MattesMutualInformationImageToImageMetricv4<Image3D, Image3D> MMIImageToImageMetric3Dv4;
+typedef itk::MeanSquaresImageToImageMetricv4<Image3D, Image3D> MSImageToImageMetric3Dv4;
+typedef itk::ObjectToObjectOptimizerBase OptimizerBasev4;
+typedef itk::RegularStepGradientDescentOptimizerv4<double> RSGDOptimizerv4;
+typedef itk::LBFGSBOptimizerv4 LBFGSBOptimizerv4;
+typedef itk::RegionOfInterestImageFilter<Image3D, Image3D> RegionOfInterestFilter3D;
+
 // Typedefs for interpolators
 typedef itk::LinearInterpolateImageFunction<Image2D, double> LinearInterpolator2D;
 typedef itk::LinearInterpolateImageFunction<Image3D, double> LinearInterpolator3D;
@@ -0,0 +1,279 @@
+//
+//  LocalNormalizedCorrelationImageToImageMetric.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__LocalNormalizedCorrelationImageToImageMetric__
+#define __DCEFit__LocalNormalizedCorrelationImageToImageMetric__
+
+#include "ThreadedSampleMetric.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * The negative of the normalised cross correlation of the fixed and moving images,
+ * worked out separately in blocks of the fixed region and averaged. Contrast uptake
+ * changes the intensities of a DCE series region by region, so while the relation
+ * between the images is far from the same everywhere it is close to linear over a
+ * small block. The average is weighted by the number of samples in each block, and
+ * blocks with too few samples or no variation are left out.
+ *
+ * The block of every sample is found once when the level is initialised. Each
+ * thread keeps the sums of its samples for each block and the threads sum slices of
+ * them. From those the derivative pass needs only a weight for each block for the
+ * fixed and moving values of a sample.
+ */
+template <class TFixedImage, class TMovingImage>
+class LocalNormalizedCorrelationImageToImageMetric
+    : public ThreadedSampleMetric<TFixedImage, TMovingImage>
+{
+public:
+    typedef LocalNormalizedCorrelationImageToImageMetric Self;
+    typedef ThreadedSampleMetric<TFixedImage, TMovingImage> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(LocalNormalizedCorrelationImageToImageMetric, ThreadedSampleMetric);
+
+    typedef typename Superclass::MeasureType MeasureType;
+    typedef typename Superclass::DerivativeType DerivativeType;
+    typedef typename Superclass::ParametersType ParametersType;
+    typedef typename Superclass::MovingImagePointType MovingImagePointType;
+    typedef typename Superclass::ImageDerivativesType ImageDerivativesType;
+
+    itkStaticConstMacro(FixedImageDimension, unsigned, TFixedImage::ImageDimension);
+    itkStaticConstMacro(MovingImageDimension, unsigned, TMovingImage::ImageDimension);
+
+    /**
+     * Set the size of the blocks in pixels of the level being registered. Along
+     * the slice axis of a 3D image the blocks are a quarter as deep.
+     * @param size The size. At least 4.
+     */
+    void SetBlockSize(unsigned size)
+    {
+        size = std::max(size, 4u);
+        if (size != blockSize_)
+        {
+            blockSize_ = size;
+            this->Modified();
+        }
+    }
+
+    unsigned GetBlockSize() const
+    {
+        return blockSize_;
+    }
+
+    /**
+     * Sample the fixed image and find the block of each sample.
+     */
+    virtual void Initialize() throw (itk::ExceptionObject)
+    {
+        Superclass::Initialize();
+
+        const typename TFixedImage::RegionType& region = this->GetFixedImageRegion();
+        unsigned blockSizes[FixedImageDimension];
+        unsigned long blockCounts[FixedImageDimension];
+        numBlocks_ = 1;
+        for (unsigned dim = 0; dim < FixedImageDimension; ++dim)
+        {
+            blockSizes[dim] = (dim < 2u) ? blockSize_ : std::max(blockSize_ / 4u, 1u);
+            blockCounts[dim] = (region.GetSize(dim) + blockSizes[dim] - 1) / blockSizes[dim];
+            numBlocks_ *= blockCounts[dim];
+        }
+
+        const itk::SizeValueType numSamples = this->m_NumberOfFixedImageSamples;
+        sampleBlocks_.resize(numSamples);
+        for (itk::SizeValueType sample = 0; sample < numSamples; ++sample)
+        {
+            typename TFixedImage::IndexType index;
+            this->m_FixedImage->TransformPhysicalPointToIndex(this->m_FixedImageSamples[sample].point, index);
+
+            unsigned long block = 0;
+            for (int dim = FixedImageDimension - 1; dim >= 0; --dim)
+            {
+                long offset = std::max(index[dim] - region.GetIndex(dim), 0L);
+                unsigned long pos = std::min(static_cast<unsigned long>(offset) / blockSizes[dim],
+                                             blockCounts[dim] - 1);
+                block = block * blockCounts[dim] + pos;
+            }
+            sampleBlocks_[sample] = static_cast<unsigned>(block);
+        }
+
+        threadSums_.assign(this->m_NumberOfThreads, std::vector<double>(numBlocks_ * NumSums, 0.0));
+        sums_.assign(numBlocks_ * NumSums, 0.0);
+        weights_.assign(numBlocks_ * NumWeights, 0.0);
+
+        this->InitializeThreadDerivatives();
+    }
+
+    virtual MeasureType GetValue(const ParametersType& parameters) const
+    {
+        this->SetTransformParameters(parameters);
+        return ComputeValue();
+    }
+
+    virtual void GetValueAndDerivative(const ParametersType& parameters, MeasureType& value,
+                                       DerivativeType& derivative) const
+    {
+        this->SetTransformParameters(parameters);
+        value = ComputeValue();
+        this->ComputeThreadedDerivative(derivative, 1.0);
+    }
+
+protected:
+    LocalNormalizedCorrelationImageToImageMetric()
+    : blockSize_(16), numBlocks_(1)
+    {
+    }
+
+    virtual ~LocalNormalizedCorrelationImageToImageMetric()
+    {
+    }
+
+    virtual void PrintSelf(std::ostream& os, itk::Indent indent) const
+    {
+        Superclass::PrintSelf(os, indent);
+        os << indent << "BlockSize: " << blockSize_ << std::endl;
+        os << indent << "NumberOfBlocks: " << numBlocks_ << std::endl;
+    }
+
+    virtual void GetValueThreadPreProcess(itk::ThreadIdType threadId,
+                                          bool itkNotUsed(withinSampleThread)) const
+    {
+        std::fill(threadSums_[threadId].begin(), threadSums_[threadId].end(), 0.0);
+    }
+
+    virtual bool GetValueThreadProcessSample(itk::ThreadIdType threadId, itk::SizeValueType fixedImageSample,
+                                             const MovingImagePointType& itkNotUsed(mappedPoint),
+                                             double movingImageValue) const
+    {
+        const double fixedValue = this->m_FixedImageSamples[fixedImageSample].value;
+        double* sums = &threadSums_[threadId][sampleBlocks_[fixedImageSample] * NumSums];
+        sums[0] += 1.0;
+        sums[1] += fixedValue;
+        sums[2] += movingImageValue;
+        sums[3] += fixedValue * fixedValue;
+        sums[4] += movingImageValue * movingImageValue;
+        sums[5] += fixedValue * movingImageValue;
+
+        return true;
+    }
+
+    virtual void GetValueThreadPostProcess(itk::ThreadIdType threadId,
+                                           bool itkNotUsed(withinSampleThread)) const
+    {
+        this->SumSlice(threadSums_, sums_, threadId);
+    }
+
+    virtual bool GetValueAndDerivativeThreadProcessSample(itk::ThreadIdType threadId,
+                                                          itk::SizeValueType fixedImageSample,
+                                                          const MovingImagePointType& itkNotUsed(mappedPoint),
+                                                          double movingImageValue,
+                                                          const ImageDerivativesType& movingImageGradientValue) const
+    {
+        const double* weights = &weights_[sampleBlocks_[fixedImageSample] * NumWeights];
+        if (weights[0] == 0.0 && weights[2] == 0.0)
+            return true;
+
+        // d(-NCC)/dm for the sample, from the sums of its block.
+        const double fixedValue = this->m_FixedImageSamples[fixedImageSample].value;
+        double weight = -(weights[0] * (fixedValue - weights[1])
+                          - weights[2] * (movingImageValue - weights[3]));
+
+        double direction[MovingImageDimension];
+        for (unsigned dim = 0; dim < MovingImageDimension; ++dim)
+            direction[dim] = weight * movingImageGradientValue[dim];
+        this->AddToDerivative(threadId, fixedImageSample, direction);
+
+        return true;
+    }
+
+private:
+    LocalNormalizedCorrelationImageToImageMetric(const Self&);  // Not implemented.
+    void operator=(const Self&);                                // Not implemented.
+
+    /// Count, fixed, moving, fixed^2, moving^2 and fixed * moving for each block.
+    enum { NumSums = 6 };
+
+    /// The weights of the fixed and moving values, and their means, for each block.
+    enum { NumWeights = 4 };
+
+    /**
+     * Sum the blocks and set the weights the derivative pass needs.
+     */
+    MeasureType ComputeValue() const
+    {
+        this->GetValueMultiThreadedInitiate();
+        this->GetValueMultiThreadedPostProcessInitiate();
+
+        if (this->m_NumberOfPixelsCounted < this->m_NumberOfFixedImageSamples / 16)
+        {
+            itkExceptionMacro("Too many samples map outside moving image buffer: "
+                              << this->m_NumberOfPixelsCounted << " / "
+                              << this->m_NumberOfFixedImageSamples << std::endl);
+        }
+
+        // A block needs enough samples for its correlation to mean anything.
+        const double minSamples = 8.0;
+        double totalSamples = 0.0;
+        for (unsigned long block = 0; block < numBlocks_; ++block)
+        {
+            const double count = sums_[block * NumSums];
+            if (count >= minSamples)
+                totalSamples += count;
+        }
+        std::fill(weights_.begin(), weights_.end(), 0.0);
+        if (totalSamples == 0.0)
+        {
+            itkExceptionMacro("No block of the region holds enough samples.");
+        }
+
+        // NCC = A / sqrt(B C), where A is the covariance and B and C the variances,
+        // each times the count.
+        double ncc = 0.0;
+        for (unsigned long block = 0; block < numBlocks_; ++block)
+        {
+            const double* sums = &sums_[block * NumSums];
+            const double count = sums[0];
+            if (count < minSamples)
+                continue;
+
+            const double fixedMean = sums[1] / count;
+            const double movingMean = sums[2] / count;
+            const double covariance = sums[5] - sums[1] * movingMean;
+            const double fixedVariance = sums[3] - sums[1] * fixedMean;
+            const double movingVariance = sums[4] - sums[2] * movingMean;
+            if ((fixedVariance <= 0.0) || (movingVariance <= 0.0))
+                continue;
+
+            const double share = count / totalSamples;
+            const double denominator = std::sqrt(fixedVariance * movingVariance);
+            ncc += share * covariance / denominator;
+
+            double* weights = &weights_[block * NumWeights];
+            weights[0] = share / denominator;
+            weights[1] = fixedMean;
+            weights[2] = share * covariance / (denominator * movingVariance);
+            weights[3] = movingMean;
+        }
+
+        return static_cast<MeasureType>(-ncc);
+    }
+
+    unsigned blockSize_;
+    unsigned long numBlocks_;
+    std::vector<unsigned> sampleBlocks_;        ///< The block of each sample.
+
+    mutable std::vector<std::vector<double> > threadSums_;
+    mutable std::vector<double> sums_;
+    mutable std::vector<double> weights_;
+};
+
+#endif /* defined(__DCEFit__LocalNormalizedCorrelationImageToImageMetric__) */
@@ -0,0 +1,189 @@
+//
+//  MotionCheck.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__MotionCheck__
+#define __DCEFit__MotionCheck__
+
+#include "ItkTypedefs.h"
+#include "ProjectDefs.h"
+#include "ItkRegistrationParams.h"
+#include "FixedImageContext.h"
+#include "RegisterOneImage.h"
+
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkContinuousIndex.h>
+#include <itkMath.h>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <string>
+
+/**
+ * A quick test of whether a moving image needs registering at all. Many of the
+ * images of a DCE series are already in line with the fixed image, so before the
+ * stages are run the coarsest levels of the two pyramids are compared. An image is
+ * left alone if their normalised cross correlation in the registration region is
+ * at least MotionMinCorrelation and the translation found by phase correlation is
+ * no more than MotionMaxShift mm.
+ *
+ * Both levels are those the first stage would use, so the work is not lost when
+ * the image is registered after all.
+ */
+template <class TImage>
+class MotionCheck
+{
+public:
+    typedef typename TImage::Pointer ImagePointer;
+    typedef typename FixedImageContext<TImage>::Pointer ContextPointer;
+    typedef typename FixedImageContext<TImage>::ScheduleType ScheduleType;
+
+    /**
+     * Constructor.
+     * @param params The registration parameters.
+     * @param fixedContext The context of the fixed image.
+     */
+    MotionCheck(const ItkRegistrationParams& params, ContextPointer fixedContext)
+    : params_(params), fixedContext_(fixedContext), correlation_(0.0), shift_(0.0)
+    {
+        std::string name = std::string(LOGGER_NAME) + ".MotionCheck";
+        logger_ = log4cplus::Logger::getInstance(name);
+
+        unsigned numLevels = params.demonsLevels;
+        if (params.isRigidRegEnabled())
+            numLevels = params.rigidLevels;
+        else if (params.isBSplineRegEnabled())
+            numLevels = params.bsplineLevels;
+
+        schedule_ = RegisterOneImage<TImage>::CreateResolutionSchedule(std::max(numLevels, 1u),
+                                                fixedContext->GetFixedImage()->GetSpacing());
+    }
+
+    /**
+     * Compare a moving image with the fixed image.
+     * @param movingImage The moving image.
+     * @param movingContext A context made from the moving image, if there is one.
+     * @return true if the image has not moved and need not be registered.
+     */
+    bool IsStill(ImagePointer movingImage, ContextPointer movingContext)
+    {
+        if (movingContext.IsNull() || (movingContext->GetFixedImage() != movingImage))
+            movingContext = FixedImageContext<TImage>::New(movingImage);
+
+        ScheduleType coarsest(1, schedule_.cols());
+        coarsest.set_row(0, schedule_.get_row(0));
+        ImagePointer fixedLevel = fixedContext_->GetPyramidLevels(coarsest)[0];
+        ImagePointer movingLevel = movingContext->GetPyramidLevels(coarsest)[0];
+
+        if (fixedLevel->GetLargestPossibleRegion() != movingLevel->GetLargestPossibleRegion())
+            return false;
+
+        correlation_ = Correlation(fixedLevel, movingLevel);
+
+        typename PhaseCorrelation<TImage>::VectorType translation;
+        if (!fixedContext_->GetPhaseCorrelation(schedule_)->ComputeTranslation(movingLevel, translation))
+            return false;
+        shift_ = translation.GetNorm();
+
+        bool still = (correlation_ >= params_.motionMinCorrelation) && (shift_ <= params_.motionMaxShift);
+        if (still)
+            LOG4CPLUS_INFO(logger_, "No motion found (correlation = " << std::fixed << std::setprecision(4)
+                           << correlation_ << ", shift = " << std::setprecision(2) << shift_
+                           << " mm). Registration skipped.");
+        else
+            LOG4CPLUS_DEBUG(logger_, "Motion found (correlation = " << std::fixed << std::setprecision(4)
+                            << correlation_ << ", shift = " << std::setprecision(2) << shift_ << " mm).");
+
+        return still;
+    }
+
+    /**
+     * @return The correlation found by the last call to IsStill().
+     */
+    double GetCorrelation() const
+    {
+        return correlation_;
+    }
+
+    /**
+     * @return The length of the translation in mm found by the last call to IsStill().
+     */
+    double GetShift() const
+    {
+        return shift_;
+    }
+
+private:
+    /**
+     * The normalised cross correlation of two levels on the same grid over the
+     * pixels which fall in the registration region.
+     */
+    double Correlation(ImagePointer fixedLevel, ImagePointer movingLevel) const
+    {
+        typedef itk::ContinuousIndex<double, TImage::ImageDimension> ContinuousIndexType;
+        ImagePointer fixedImage = fixedContext_->GetFixedImage();
+        const Image2D::RegionType& region = params_.fixedImageRegion;
+
+        double sumFixed = 0.0, sumMoving = 0.0;
+        double sumFixedSq = 0.0, sumMovingSq = 0.0, sumProduct = 0.0;
+        unsigned long count = 0;
+
+        itk::ImageRegionConstIteratorWithIndex<TImage> iter(fixedLevel,
+                                                  fixedLevel->GetLargestPossibleRegion());
+        for (; !iter.IsAtEnd(); ++iter)
+        {
+            typename TImage::PointType point;
+            fixedLevel->TransformIndexToPhysicalPoint(iter.GetIndex(), point);
+            ContinuousIndexType index;
+            fixedImage->TransformPhysicalPointToContinuousIndex(point, index);
+
+            bool inside = true;
+            for (unsigned dim = 0; dim < 2u; ++dim)
+            {
+                long pixel = itk::Math::Round<long, double>(index[dim]);
+                if ((pixel < region.GetIndex(dim))
+                    || (pixel >= region.GetIndex(dim) + static_cast<long>(region.GetSize(dim))))
+                    inside = false;
+            }
+            if (!inside)
+                continue;
+
+            double fixedValue = iter.Get();
+            double movingValue = movingLevel->GetPixel(iter.GetIndex());
+            sumFixed += fixedValue;
+            sumMoving += movingValue;
+            sumFixedSq += fixedValue * fixedValue;
+            sumMovingSq += movingValue * movingValue;
+            sumProduct += fixedValue * movingValue;
+            ++count;
+        }
+
+        if (count == 0)
+            return 0.0;
+
+        double covariance = sumProduct - sumFixed * sumMoving / count;
+        double fixedVariance = sumFixedSq - sumFixed * sumFixed / count;
+        double movingVariance = sumMovingSq - sumMoving * sumMoving / count;
+        if ((fixedVariance <= 0.0) || (movingVariance <= 0.0))
+            return 0.0;
+
+        return covariance / std::sqrt(fixedVariance * movingVariance);
+    }
+
+    const ItkRegistrationParams& params_;
+    ContextPointer fixedContext_;
+    ScheduleType schedule_;        ///< The schedule of the first stage.
+    double correlation_;
+    double shift_;
+    log4cplus::Logger logger_;
+};
+
+#endif /* defined(__DCEFit__MotionCheck__) */
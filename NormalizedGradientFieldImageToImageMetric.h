@@ -0,0 +1,351 @@
+//
+//  NormalizedGradientFieldImageToImageMetric.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__NormalizedGradientFieldImageToImageMetric__
+#define __DCEFit__NormalizedGradientFieldImageToImageMetric__
+
+#include "ThreadedSampleMetric.h"
+
+#include <itkGradientRecursiveGaussianImageFilter.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkContinuousIndex.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * The normalised gradient field distance of Haber and Modersitzki: the mean over the
+ * samples of 1 - (n_f . n_m)^2, where n is the gradient divided by its length softened
+ * by an edge noise level. It compares only where the edges are and which way they run,
+ * so the brightening of enhancing tissue does not change it while its edges stay put.
+ *
+ * The gradients of the fixed image at the samples are found once when the level is
+ * initialised. The moving gradients are interpolated linearly from the gradient image
+ * the base class makes, and the derivative takes the change in them from central
+ * differences of that image, which stands in for the Hessian of the moving image.
+ * The value and derivative are found in the one pass.
+ */
+template <class TFixedImage, class TMovingImage>
+class NormalizedGradientFieldImageToImageMetric
+    : public ThreadedSampleMetric<TFixedImage, TMovingImage>
+{
+public:
+    typedef NormalizedGradientFieldImageToImageMetric Self;
+    typedef ThreadedSampleMetric<TFixedImage, TMovingImage> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkNewMacro(Self);
+    itkTypeMacro(NormalizedGradientFieldImageToImageMetric, ThreadedSampleMetric);
+
+    typedef typename Superclass::MeasureType MeasureType;
+    typedef typename Superclass::DerivativeType DerivativeType;
+    typedef typename Superclass::ParametersType ParametersType;
+    typedef typename Superclass::MovingImagePointType MovingImagePointType;
+    typedef typename Superclass::ImageDerivativesType ImageDerivativesType;
+    typedef typename Superclass::GradientImageType GradientImageType;
+    typedef typename Superclass::GradientPixelType GradientPixelType;
+
+    itkStaticConstMacro(ImageDimension, unsigned, TMovingImage::ImageDimension);
+
+    /**
+     * Set the edge noise level as a fraction of the mean gradient magnitude of each
+     * image. Gradients well below it count as no edge at all.
+     * @param fraction The fraction. Greater than 0.
+     */
+    void SetEdgeNoiseFraction(double fraction)
+    {
+        if ((fraction > 0.0) && (fraction != edgeNoiseFraction_))
+        {
+            edgeNoiseFraction_ = fraction;
+            this->Modified();
+        }
+    }
+
+    double GetEdgeNoiseFraction() const
+    {
+        return edgeNoiseFraction_;
+    }
+
+    /**
+     * Sample the fixed image and find the normalised fixed gradient of each sample.
+     */
+    virtual void Initialize() throw (itk::ExceptionObject)
+    {
+        Superclass::Initialize();
+
+        typedef itk::GradientRecursiveGaussianImageFilter<TFixedImage, GradientImageType> GradientFilterType;
+        typename GradientFilterType::Pointer gradientFilter = GradientFilterType::New();
+        gradientFilter->SetInput(this->m_FixedImage);
+        gradientFilter->SetSigma(MaxSpacing(this->m_FixedImage->GetSpacing()));
+        gradientFilter->SetNormalizeAcrossScale(true);
+        gradientFilter->SetNumberOfThreads(this->m_NumberOfThreads);
+        gradientFilter->SetUseImageDirection(true);
+        gradientFilter->Update();
+        typename GradientImageType::Pointer fixedGradient = gradientFilter->GetOutput();
+
+        const itk::SizeValueType numSamples = this->m_NumberOfFixedImageSamples;
+        fixedNormals_.resize(numSamples * ImageDimension);
+        double sumMagnitude = 0.0;
+        for (itk::SizeValueType sample = 0; sample < numSamples; ++sample)
+        {
+            typename TFixedImage::IndexType index;
+            fixedGradient->TransformPhysicalPointToIndex(this->m_FixedImageSamples[sample].point, index);
+            const GradientPixelType& gradient = fixedGradient->GetPixel(index);
+            for (unsigned dim = 0; dim < ImageDimension; ++dim)
+                fixedNormals_[sample * ImageDimension + dim] = gradient[dim];
+            sumMagnitude += gradient.GetNorm();
+        }
+
+        double fixedNoise = edgeNoiseFraction_ * sumMagnitude / std::max<itk::SizeValueType>(numSamples, 1);
+        for (itk::SizeValueType sample = 0; sample < numSamples; ++sample)
+        {
+            double* normal = &fixedNormals_[sample * ImageDimension];
+            double lengthSq = fixedNoise * fixedNoise;
+            for (unsigned dim = 0; dim < ImageDimension; ++dim)
+                lengthSq += normal[dim] * normal[dim];
+            double scale = (lengthSq > 0.0) ? 1.0 / std::sqrt(lengthSq) : 0.0;
+            for (unsigned dim = 0; dim < ImageDimension; ++dim)
+                normal[dim] *= scale;
+        }
+
+        sumMagnitude = 0.0;
+        itk::ImageRegionConstIterator<GradientImageType> iter(this->m_GradientImage,
+                                                  this->m_GradientImage->GetBufferedRegion());
+        for (; !iter.IsAtEnd(); ++iter)
+            sumMagnitude += iter.Get().GetNorm();
+        double movingNoise = edgeNoiseFraction_ * sumMagnitude
+                           / this->m_GradientImage->GetBufferedRegion().GetNumberOfPixels();
+        movingNoiseSq_ = movingNoise * movingNoise;
+
+        const typename TMovingImage::SpacingType& spacing = this->m_MovingImage->GetSpacing();
+        step_ = spacing[0];
+        for (unsigned dim = 1; dim < ImageDimension; ++dim)
+            step_ = std::min(step_, spacing[dim]);
+
+        threadSums_.assign(this->m_NumberOfThreads, 0.0);
+        this->InitializeThreadDerivatives();
+    }
+
+    virtual MeasureType GetValue(const ParametersType& parameters) const
+    {
+        this->SetTransformParameters(parameters);
+        this->GetValueMultiThreadedInitiate();
+        return Value();
+    }
+
+    virtual void GetValueAndDerivative(const ParametersType& parameters, MeasureType& value,
+                                       DerivativeType& derivative) const
+    {
+        this->SetTransformParameters(parameters);
+        this->ComputeThreadedDerivative(derivative, 1.0);
+        value = Value();
+
+        const double factor = 1.0 / this->m_NumberOfPixelsCounted;
+        for (unsigned param = 0; param < derivative.GetSize(); ++param)
+            derivative[param] *= factor;
+    }
+
+protected:
+    NormalizedGradientFieldImageToImageMetric()
+    : edgeNoiseFraction_(0.1), movingNoiseSq_(0.0), step_(1.0)
+    {
+    }
+
+    virtual ~NormalizedGradientFieldImageToImageMetric()
+    {
+    }
+
+    virtual void PrintSelf(std::ostream& os, itk::Indent indent) const
+    {
+        Superclass::PrintSelf(os, indent);
+        os << indent << "EdgeNoiseFraction: " << edgeNoiseFraction_ << std::endl;
+    }
+
+    virtual void GetValueThreadPreProcess(itk::ThreadIdType threadId,
+                                          bool itkNotUsed(withinSampleThread)) const
+    {
+        threadSums_[threadId] = 0.0;
+    }
+
+    virtual bool GetValueThreadProcessSample(itk::ThreadIdType threadId, itk::SizeValueType fixedImageSample,
+                                             const MovingImagePointType& mappedPoint,
+                                             double itkNotUsed(movingImageValue)) const
+    {
+        double gradient[ImageDimension];
+        if (!MovingGradient(mappedPoint, gradient))
+            return false;
+
+        double product, lengthSq;
+        Product(fixedImageSample, gradient, product, lengthSq);
+        threadSums_[threadId] += 1.0 - product * product / lengthSq;
+
+        return true;
+    }
+
+    virtual void GetValueAndDerivativeThreadPreProcess(itk::ThreadIdType threadId,
+                                                       bool withinSampleThread) const
+    {
+        Superclass::GetValueAndDerivativeThreadPreProcess(threadId, withinSampleThread);
+        threadSums_[threadId] = 0.0;
+    }
+
+    virtual bool GetValueAndDerivativeThreadProcessSample(itk::ThreadIdType threadId,
+                                                          itk::SizeValueType fixedImageSample,
+                                                          const MovingImagePointType& mappedPoint,
+                                                          double itkNotUsed(movingImageValue),
+                                                          const ImageDerivativesType& itkNotUsed(movingImageGradientValue)) const
+    {
+        double gradient[ImageDimension];
+        if (!MovingGradient(mappedPoint, gradient))
+            return false;
+
+        double product, lengthSq;
+        Product(fixedImageSample, gradient, product, lengthSq);
+        threadSums_[threadId] += 1.0 - product * product / lengthSq;
+
+        // c = n_f . g / |g|; dc/dg = (n_f - c g / |g|) / |g| and the term is 1 - c^2.
+        const double length = std::sqrt(lengthSq);
+        const double cosine = product / length;
+        const double* normal = &fixedNormals_[fixedImageSample * ImageDimension];
+        double dcdg[ImageDimension];
+        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+            dcdg[dim] = (normal[dim] - cosine * gradient[dim] / length) / length;
+
+        // Through the Hessian, H dc/dg, one column at a time by central differences.
+        double direction[ImageDimension];
+        for (unsigned col = 0; col < ImageDimension; ++col)
+        {
+            MovingImagePointType ahead = mappedPoint;
+            MovingImagePointType behind = mappedPoint;
+            ahead[col] += step_;
+            behind[col] -= step_;
+            double gradientAhead[ImageDimension];
+            double gradientBehind[ImageDimension];
+            if (!MovingGradient(ahead, gradientAhead) || !MovingGradient(behind, gradientBehind))
+            {
+                direction[col] = 0.0;
+                continue;
+            }
+
+            double sum = 0.0;
+            for (unsigned row = 0; row < ImageDimension; ++row)
+                sum += (gradientAhead[row] - gradientBehind[row]) * dcdg[row];
+            direction[col] = -2.0 * cosine * sum / (2.0 * step_);
+        }
+
+        this->AddToDerivative(threadId, fixedImageSample, direction);
+
+        return true;
+    }
+
+private:
+    NormalizedGradientFieldImageToImageMetric(const Self&);     // Not implemented.
+    void operator=(const Self&);                                // Not implemented.
+
+    /**
+     * The mean of the sums of the threads.
+     */
+    MeasureType Value() const
+    {
+        if ((this->m_NumberOfPixelsCounted == 0)
+            || (this->m_NumberOfPixelsCounted < this->m_NumberOfFixedImageSamples / 16))
+        {
+            itkExceptionMacro("Too many samples map outside moving image buffer: "
+                              << this->m_NumberOfPixelsCounted << " / "
+                              << this->m_NumberOfFixedImageSamples << std::endl);
+        }
+
+        double sum = 0.0;
+        for (unsigned thread = 0; thread < threadSums_.size(); ++thread)
+            sum += threadSums_[thread];
+
+        return static_cast<MeasureType>(sum / this->m_NumberOfPixelsCounted);
+    }
+
+    /**
+     * The product of the normalised fixed gradient with a moving gradient, and the
+     * softened squared length of the moving gradient.
+     */
+    void Product(itk::SizeValueType fixedImageSample, const double* gradient,
+                 double& product, double& lengthSq) const
+    {
+        const double* normal = &fixedNormals_[fixedImageSample * ImageDimension];
+        product = 0.0;
+        lengthSq = movingNoiseSq_;
+        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+        {
+            product += normal[dim] * gradient[dim];
+            lengthSq += gradient[dim] * gradient[dim];
+        }
+    }
+
+    /**
+     * The gradient of the moving image at a point, interpolated linearly.
+     * @return false if the point is outside the image.
+     */
+    bool MovingGradient(const MovingImagePointType& point, double* gradient) const
+    {
+        const GradientImageType* image = this->m_GradientImage;
+        itk::ContinuousIndex<double, ImageDimension> index;
+        image->TransformPhysicalPointToContinuousIndex(point, index);
+
+        const typename GradientImageType::RegionType& region = image->GetBufferedRegion();
+        typename GradientImageType::IndexType base;
+        double fraction[ImageDimension];
+        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+        {
+            double lower = region.GetIndex(dim);
+            double upper = lower + static_cast<double>(region.GetSize(dim)) - 1.0;
+            if ((index[dim] < lower) || (index[dim] > upper))
+                return false;
+            double start = std::min(std::floor(index[dim]), std::max(upper - 1.0, lower));
+            base[dim] = static_cast<typename GradientImageType::IndexValueType>(start);
+            fraction[dim] = index[dim] - start;
+        }
+
+        std::fill(gradient, gradient + ImageDimension, 0.0);
+        const GradientPixelType* buffer = image->GetBufferPointer() + image->ComputeOffset(base);
+        const typename GradientImageType::OffsetValueType* strides = image->GetOffsetTable();
+        for (unsigned bits = 0; bits < (1u << ImageDimension); ++bits)
+        {
+            double weight = 1.0;
+            typename GradientImageType::OffsetValueType offset = 0;
+            for (unsigned dim = 0; dim < ImageDimension; ++dim)
+            {
+                bool up = ((bits >> dim) & 1u) && (region.GetSize(dim) > 1);
+                weight *= ((bits >> dim) & 1u) ? fraction[dim] : 1.0 - fraction[dim];
+                offset += up ? strides[dim] : 0;
+            }
+            const GradientPixelType& corner = buffer[offset];
+            for (unsigned dim = 0; dim < ImageDimension; ++dim)
+                gradient[dim] += weight * corner[dim];
+        }
+
+        return true;
+    }
+
+    template <class TSpacing>
+    static double MaxSpacing(const TSpacing& spacing)
+    {
+        double maxSpacing = 0.0;
+        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+            maxSpacing = std::max(maxSpacing, static_cast<double>(spacing[dim]));
+        return maxSpacing;
+    }
+
+    double edgeNoiseFraction_;
+    std::vector<double> fixedNormals_;      ///< The normalised fixed gradients, sample by sample.
+    double movingNoiseSq_;
+    double step_;                           ///< Of the central differences, in mm.
+
+    mutable std::vector<double> threadSums_;
+};
+
+#endif /* defined(__DCEFit__NormalizedGradientFieldImageToImageMetric__) */
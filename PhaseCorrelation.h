@@ -0,0 +1,275 @@
+//
+//  PhaseCorrelation.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__PhaseCorrelation__
+#define __DCEFit__PhaseCorrelation__
+
+#include "ItkTypedefs.h"
+#include "CoreScheduler.h"
+
+#include <itkLightObject.h>
+#include <itkForwardFFTImageFilter.h>
+#include <itkInverseFFTImageFilter.h>
+#include <itkResampleImageFilter.h>
+#include <itkImageRegionIterator.h>
+#include <itkImageRegionConstIterator.h>
+#include <itkImageRegionIteratorWithIndex.h>
+#include <itkImageRegionConstIteratorWithIndex.h>
+#include <itkMath.h>
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+
+/**
+ * Finds the translation between the fixed image and a moving image in one step by
+ * phase correlation. The normalised cross power spectrum of two images which differ
+ * only by a shift is the spectrum of a spike at the shift, so the peak of its inverse
+ * gives the translation however large it is. It is meant for the coarsest level of
+ * a pyramid, where the transforms are cheap, to start a rigid registration where
+ * the patient has moved too far for the centres of gravity to line up.
+ *
+ * The spectrum of the fixed image is computed when the object is made, so one
+ * object serves the whole series.
+ */
+template <class TImage>
+class PhaseCorrelation : public itk::LightObject
+{
+public:
+    typedef PhaseCorrelation Self;
+    typedef itk::LightObject Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+
+    itkStaticConstMacro(ImageDimension, unsigned, TImage::ImageDimension);
+
+    typedef typename TImage::Pointer ImagePointer;
+    typedef typename TImage::PixelType PixelType;
+    typedef itk::Image<std::complex<PixelType>, TImage::ImageDimension> ComplexImageType;
+    typedef typename ComplexImageType::Pointer ComplexImagePointer;
+    typedef itk::Vector<double, TImage::ImageDimension> VectorType;
+
+    /**
+     * Create a phase correlation against a fixed image.
+     * @param fixedImage The fixed image, normally the coarsest level of its pyramid.
+     * @return Smart pointer to the object.
+     */
+    static Pointer New(ImagePointer fixedImage)
+    {
+        Pointer correlation = new Self(fixedImage);
+        correlation->UnRegister();
+        return correlation;
+    }
+
+    /**
+     * Find the translation of a moving image relative to the fixed image.
+     * @param movingImage The moving image, normally at the same level as the fixed
+     * image. It is resampled onto the grid of the fixed image if it is not on it.
+     * @param translation Set to the translation, in physical coordinates, which takes
+     * points of the fixed image to those of the moving image, as the translation of a
+     * transform does. It is not changed if no clear peak is found.
+     * @return true if a clear peak was found.
+     */
+    bool ComputeTranslation(ImagePointer movingImage, VectorType& translation) const
+    {
+        ComplexImagePointer movingSpectrum = Transform(movingImage);
+
+        // The normalised cross power spectrum, M F* / |M F*|, into the moving spectrum.
+        itk::ImageRegionIterator<ComplexImageType> movingIter(movingSpectrum,
+                                            movingSpectrum->GetLargestPossibleRegion());
+        itk::ImageRegionConstIterator<ComplexImageType> fixedIter(fixedSpectrum_,
+                                            fixedSpectrum_->GetLargestPossibleRegion());
+        for (; !movingIter.IsAtEnd(); ++movingIter, ++fixedIter)
+        {
+            std::complex<PixelType> product = movingIter.Get() * std::conj(fixedIter.Get());
+            PixelType magnitude = std::abs(product);
+            movingIter.Set((magnitude > 0) ? product / magnitude : std::complex<PixelType>(0));
+        }
+
+        typedef itk::InverseFFTImageFilter<ComplexImageType, TImage> InverseFFTType;
+        typename InverseFFTType::Pointer inverse = InverseFFTType::New();
+        inverse->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+        inverse->SetInput(movingSpectrum);
+        inverse->Update();
+        ImagePointer surface = inverse->GetOutput();
+
+        // The peak, and the spread of the rest of the surface to judge it by.
+        itk::ImageRegionIteratorWithIndex<TImage> iter(surface, surface->GetLargestPossibleRegion());
+        typename TImage::IndexType peak = iter.GetIndex();
+        double peakValue = iter.Get();
+        double sum = 0.0;
+        double sumSquares = 0.0;
+        for (; !iter.IsAtEnd(); ++iter)
+        {
+            double value = iter.Get();
+            sum += value;
+            sumSquares += value * value;
+            if (value > peakValue)
+            {
+                peakValue = value;
+                peak = iter.GetIndex();
+            }
+        }
+
+        double numPixels = surface->GetLargestPossibleRegion().GetNumberOfPixels();
+        double mean = sum / numPixels;
+        double deviation = std::sqrt(std::max(sumSquares / numPixels - mean * mean, 0.0));
+
+        // A real shift stands well clear of the rest of the surface.
+        if (!(peakValue - mean > 5.0 * deviation))
+            return false;
+
+        // The shift in pixels, wrapping the indices past the middle round to negative
+        // shifts, refined to a fraction of a pixel by a parabola through the peak.
+        VectorType shift;
+        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+        {
+            long size = static_cast<long>(paddedSize_[dim]);
+            typename TImage::IndexType before = peak;
+            typename TImage::IndexType after = peak;
+            before[dim] = (peak[dim] + size - 1) % size;
+            after[dim] = (peak[dim] + 1) % size;
+
+            double below = surface->GetPixel(before);
+            double above = surface->GetPixel(after);
+            double curvature = below - 2.0 * peakValue + above;
+            double offset = (curvature < 0.0) ? 0.5 * (below - above) / curvature : 0.0;
+
+            long index = peak[dim];
+            if (index > size / 2)
+                index -= size;
+            shift[dim] = (index + offset) * fixedImage_->GetSpacing()[dim];
+        }
+
+        translation = fixedImage_->GetDirection() * shift;
+
+        return true;
+    }
+
+protected:
+    PhaseCorrelation(ImagePointer fixedImage)
+    : fixedImage_(fixedImage)
+    {
+        // Zero padding to sizes the FFT can take. It also stops the image wrapping
+        // onto itself for all but the largest shifts.
+        typedef itk::ForwardFFTImageFilter<TImage, ComplexImageType> FFTType;
+        typename FFTType::Pointer fft = FFTType::New();
+        fft->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+        itk::SizeValueType greatestPrime = fft->GetSizeGreatestPrimeFactor();
+
+        const typename TImage::SizeType& size = fixedImage->GetLargestPossibleRegion().GetSize();
+        for (unsigned dim = 0; dim < ImageDimension; ++dim)
+        {
+            itk::SizeValueType padded = size[dim] + size[dim] / 2;
+            while (GreatestPrimeFactor(padded) > greatestPrime)
+                ++padded;
+            paddedSize_[dim] = padded;
+        }
+
+        fixedSpectrum_ = Transform(fixedImage);
+    }
+
+private:
+    PhaseCorrelation(const Self&);     // Not implemented.
+    void operator=(const Self&);       // Not implemented.
+
+    /**
+     * The spectrum of an image on the grid of the fixed image. The mean is taken
+     * away and the image is tapered to zero at its edges in the plane of the slices
+     * so that neither the padding nor the edges themselves make a peak at zero shift.
+     */
+    ComplexImagePointer Transform(ImagePointer image) const
+    {
+        ImagePointer input = image;
+        if (!SameGrid(image))
+        {
+            typedef itk::ResampleImageFilter<TImage, TImage> ResampleFilterType;
+            typename ResampleFilterType::Pointer resampler = ResampleFilterType::New();
+            resampler->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+            resampler->SetInput(image);
+            resampler->SetReferenceImage(fixedImage_);
+            resampler->UseReferenceImageOn();
+            resampler->SetDefaultPixelValue(0.0);
+            resampler->Update();
+            input = resampler->GetOutput();
+        }
+
+        const typename TImage::RegionType& region = input->GetLargestPossibleRegion();
+        double mean = 0.0;
+        itk::ImageRegionConstIterator<TImage> meanIter(input, region);
+        for (; !meanIter.IsAtEnd(); ++meanIter)
+            mean += meanIter.Get();
+        mean /= region.GetNumberOfPixels();
+
+        typename TImage::RegionType paddedRegion;
+        paddedRegion.SetSize(paddedSize_);
+        ImagePointer padded = TImage::New();
+        padded->SetRegions(paddedRegion);
+        padded->Allocate();
+        padded->FillBuffer(0.0);
+
+        itk::ImageRegionConstIteratorWithIndex<TImage> iter(input, region);
+        for (; !iter.IsAtEnd(); ++iter)
+        {
+            typename TImage::IndexType index = iter.GetIndex();
+            double weight = 1.0;
+            for (unsigned dim = 0; dim < 2u; ++dim)
+            {
+                index[dim] -= region.GetIndex(dim);
+                weight *= 0.5 * (1.0 - std::cos(2.0 * itk::Math::pi * (index[dim] + 0.5)
+                                                / region.GetSize(dim)));
+            }
+            for (unsigned dim = 2u; dim < ImageDimension; ++dim)
+                index[dim] -= region.GetIndex(dim);
+
+            padded->SetPixel(index, static_cast<PixelType>(weight * (iter.Get() - mean)));
+        }
+
+        typedef itk::ForwardFFTImageFilter<TImage, ComplexImageType> FFTType;
+        typename FFTType::Pointer fft = FFTType::New();
+        fft->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+        fft->SetInput(padded);
+        fft->Update();
+
+        ComplexImagePointer spectrum = fft->GetOutput();
+        spectrum->DisconnectPipeline();
+
+        return spectrum;
+    }
+
+    /**
+     * @return true if the image is on the grid of the fixed image.
+     */
+    bool SameGrid(ImagePointer image) const
+    {
+        return (image->GetLargestPossibleRegion() == fixedImage_->GetLargestPossibleRegion())
+               && (image->GetOrigin() == fixedImage_->GetOrigin())
+               && (image->GetSpacing() == fixedImage_->GetSpacing())
+               && (image->GetDirection() == fixedImage_->GetDirection());
+    }
+
+    static itk::SizeValueType GreatestPrimeFactor(itk::SizeValueType value)
+    {
+        itk::SizeValueType greatest = 1;
+        for (itk::SizeValueType factor = 2; factor <= value; ++factor)
+        {
+            while ((value % factor) == 0)
+            {
+                value /= factor;
+                greatest = factor;
+            }
+        }
+
+        return greatest;
+    }
+
+    ImagePointer fixedImage_;                   ///< The grid the translation is measured on.
+    typename TImage::SizeType paddedSize_;      ///< The size the images are padded to.
+    ComplexImagePointer fixedSpectrum_;
+};
+
+#endif /* defined(__DCEFit__PhaseCorrelation__) */
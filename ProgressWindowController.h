@@ -23,6 +23,7 @@ extern NSString* CloseProgressPanelNotification;
     Logger* logger_;
     void* observer_;
     unsigned observerDims_;
+    NSMutableArray* observers_;   // All registrations in progress (NSValue wrapped pointers).
 
     BOOL registrationCancelled;
     BOOL registrationFinished;
@@ -109,6 +110,8 @@ extern NSString* CloseProgressPanelNotification;
 
 - (void)setObserver:(void*)observer;
 
+- (void)removeObserver:(void*)observer;
+
 - (void)stopRegistration;
 
 @end
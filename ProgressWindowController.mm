@@ -53,6 +53,7 @@ NSString* CloseProgressPanelNotification = @"CloseProgressPanelNotification";
         LOG4M_TRACE(logger_, @"init");
         parentController_ = parent;
         registrationCancelled = NO;
+        observers_ = [[NSMutableArray alloc] init];
     }
 
     return self;
@@ -60,6 +61,7 @@ NSString* CloseProgressPanelNotification = @"CloseProgressPanelNotification";
 
 - (void)dealloc
 {
+    [observers_ release];
     [logger_ release];
     [super dealloc];
 }
@@ -176,6 +178,26 @@ NSString* CloseProgressPanelNotification = @"CloseProgressPanelNotification";
     // If none of the above worked, observerDims_ will still be 0
     NSAssert(((observerDims_ == 2) || (observerDims_ == 3)),
         @"Argument 'observer' not an instantiation of RegistrationObserver");
+
+    // Keep track of every registration in progress so that all of them can be stopped.
+    // One started after the stop button was pressed is stopped straight away.
+    @synchronized(observers_)
+    {
+        [observers_ addObject:[NSValue valueWithPointer:observer]];
+        if (registrationCancelled)
+            static_cast<RegistrationObserverBase*>(observer)->StopRegistration();
+    }
+}
+
+- (void)removeObserver:(void*)observer
+{
+    @synchronized(observers_)
+    {
+        [observers_ removeObject:[NSValue valueWithPointer:observer]];
+    }
+
+    if (observer_ == observer)
+        observer_ = 0;
 }
 
 - (void)setMaxIterations:(NSNumber*)iterations
@@ -272,13 +294,18 @@ NSString* CloseProgressPanelNotification = @"CloseProgressPanelNotification";
 
 - (void)stopRegistration
 {
-    RegistrationObserverBase* obs = static_cast<RegistrationObserverBase*>(observer_);
-
-    obs->StopRegistration();
+    @synchronized(observers_)
+    {
+        registrationCancelled = YES;
+        for (NSValue* value in observers_)
+        {
+            RegistrationObserverBase* obs = static_cast<RegistrationObserverBase*>([value pointerValue]);
+            obs->StopRegistration();
+        }
+    }
 
     [regManager cancelRegistration];
     [statusTextField setStringValue:@"Waiting for termination."];
-    registrationCancelled = YES;
     [stopButton setEnabled:NO];
 }
 
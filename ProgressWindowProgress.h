@@ -0,0 +1,43 @@
+//
+//  ProgressWindowProgress.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__ProgressWindowProgress__
+#define __DCEFit__ProgressWindowProgress__
+
+#include "RegistrationProgress.h"
+
+@class ProgressWindowController;
+
+/**
+ * Passes the progress of the registrations to the plugin's progress window.
+ * The window is updated on the main thread.
+ */
+class ProgressWindowProgress : public RegistrationProgress
+{
+public:
+    /**
+     * Constructor.
+     * @param controller The progress window's controller. It must outlive this.
+     */
+    ProgressWindowProgress(ProgressWindowController* controller);
+
+    virtual void SetCurStage(const std::string& stage);
+    virtual void SetCurLevel(unsigned level);
+    virtual void SetMaxIterations(unsigned iterations);
+    virtual void SetCurIteration(unsigned iteration);
+    virtual void SetCurMetric(double metric);
+    virtual void SetCurStepSize(double stepSize);
+    virtual void SetStopCondition(const std::string& stopCondition);
+    virtual void AddObserver(RegistrationObserverBase* observer);
+    virtual void RemoveObserver(RegistrationObserverBase* observer);
+
+private:
+    ProgressWindowController* controller_;
+};
+
+#endif /* defined(__DCEFit__ProgressWindowProgress__) */
@@ -0,0 +1,74 @@
+//
+//  ProgressWindowProgress.mm
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#import "ProgressWindowProgress.h"
+#import "ProgressWindowController.h"
+
+ProgressWindowProgress::ProgressWindowProgress(ProgressWindowController* controller)
+    : controller_(controller)
+{
+}
+
+void ProgressWindowProgress::SetCurStage(const std::string& stage)
+{
+    [controller_ performSelectorOnMainThread:@selector(setCurStage:)
+                                  withObject:[NSString stringWithUTF8String:stage.c_str()]
+                               waitUntilDone:YES];
+}
+
+void ProgressWindowProgress::SetCurLevel(unsigned level)
+{
+    [controller_ performSelectorOnMainThread:@selector(setCurLevel:)
+                                  withObject:[NSNumber numberWithUnsignedInt:level]
+                               waitUntilDone:YES];
+}
+
+void ProgressWindowProgress::SetMaxIterations(unsigned iterations)
+{
+    [controller_ performSelectorOnMainThread:@selector(setMaxIterations:)
+                                  withObject:[NSNumber numberWithUnsignedInt:iterations]
+                               waitUntilDone:YES];
+}
+
+void ProgressWindowProgress::SetCurIteration(unsigned iteration)
+{
+    [controller_ performSelectorOnMainThread:@selector(setCurIteration:)
+                                  withObject:[NSNumber numberWithUnsignedInt:iteration]
+                               waitUntilDone:YES];
+}
+
+void ProgressWindowProgress::SetCurMetric(double metric)
+{
+    [controller_ performSelectorOnMainThread:@selector(setCurMetric:)
+                                  withObject:[NSNumber numberWithDouble:metric]
+                               waitUntilDone:YES];
+}
+
+void ProgressWindowProgress::SetCurStepSize(double stepSize)
+{
+    [controller_ performSelectorOnMainThread:@selector(setCurStepSize:)
+                                  withObject:[NSNumber numberWithDouble:stepSize]
+                               waitUntilDone:YES];
+}
+
+void ProgressWindowProgress::SetStopCondition(const std::string& stopCondition)
+{
+    [controller_ performSelectorOnMainThread:@selector(setStopCondition:)
+                                  withObject:[NSString stringWithUTF8String:stopCondition.c_str()]
+                               waitUntilDone:YES];
+}
+
+void ProgressWindowProgress::AddObserver(RegistrationObserverBase* observer)
+{
+    [controller_ setObserver:observer];
+}
+
+void ProgressWindowProgress::RemoveObserver(RegistrationObserverBase* observer)
+{
+    [controller_ removeObserver:observer];
+}
@@ -31,7 +31,10 @@
 enum MetricType
 {
     MeanSquares = 0,
-    MattesMutualInformation = 1
+    MattesMutualInformation = 1,
+    FastMattesMutualInformation = 2, ///< Mattes MI with our own joint histogram kernel.
+    LocalNormalizedCorrelation = 3,  ///< Normalised cross correlation averaged over blocks.
+    NormalizedGradientField = 4      ///< Alignment of the edges only.
 };
 
 // Used as a selector for the optimizer to use
@@ -43,6 +46,36 @@ enum OptimizerType
     Versor = 3
 };
 
+// How to start each time point's registration.
+enum WarmStartType
+{
+    NoWarmStart = 0,          /// Start from the initialisers' guesses.
+    PreviousWarmStart = 1,    /// Start from the neighbouring time point's result.
+    ExtrapolatedWarmStart = 2 /// Start from a linear prediction from the two neighbours.
+};
+
+// What to do when a registration stage fails.
+enum FailurePolicyType
+{
+    AskOnFailure = 0,   /// Ask the user whether to carry on.
+    RetryOnFailure = 1  /// Retry with fallback settings, then rigid only, then leave the image.
+};
+
+// Which ITK registration framework does the rigid and B-spline 3D stages.
+enum RegistrationEngineType
+{
+    V3Engine = 0,  /// itk::MultiResolutionImageRegistrationMethod and the v3 metrics.
+    V4Engine = 1   /// itk::ImageRegistrationMethodv4 and the threaded v4 metrics.
+};
+
+// The precision of the per pixel arithmetic of the metrics which support it.
+enum MetricPrecisionType
+{
+    DoublePrecision = 0,   /// Double throughout.
+    SinglePrecision = 1,   /// Single precision per pixel, double sums and optimizer state.
+    ValidatePrecision = 2  /// Both, reporting how far the single precision results differ.
+};
+
 /**
  * Values to use to return the results of the registration.
  */
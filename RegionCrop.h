@@ -0,0 +1,172 @@
+//
+//  RegionCrop.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__RegionCrop__
+#define __DCEFit__RegionCrop__
+
+#include "ItkTypedefs.h"
+#include "CoreScheduler.h"
+#include "ItkRegistrationParams.h"
+#include "FixedImageContext.h"
+#include "SeriesTransforms.h"
+
+#include <itkPasteImageFilter.h>
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * The part of the images a cropped registration works on: the registration region
+ * in the plane of the slices plus a margin, through all of the slices. The stages
+ * are run on crops of the fixed and moving images so that the pyramids and the
+ * B-spline grid cover only the crop. The transforms found are in physical
+ * coordinates, so they are applied to the whole moving image afterwards.
+ */
+template <class TImage>
+class RegionCrop
+{
+public:
+    typedef typename TImage::Pointer ImagePointer;
+    typedef typename TImage::RegionType RegionType;
+
+    /**
+     * Constructor.
+     * @param fixedImage The whole fixed image.
+     * @param params The registration parameters, giving the region and margin.
+     */
+    RegionCrop(ImagePointer fixedImage, const ItkRegistrationParams& params)
+    : fixedImage_(fixedImage)
+    {
+        const RegionType& largest = fixedImage->GetLargestPossibleRegion();
+        region_ = largest;
+
+        for (unsigned dim = 0; dim < 2u; ++dim)
+        {
+            long margin = static_cast<long>(std::ceil(std::max(params.cropMargin, 0.0f)
+                                                      / fixedImage->GetSpacing()[dim]));
+            long start = std::max(params.fixedImageRegion.GetIndex(dim) - margin,
+                                  largest.GetIndex(dim));
+            long end = std::min(params.fixedImageRegion.GetIndex(dim)
+                                + static_cast<long>(params.fixedImageRegion.GetSize(dim)) + margin,
+                                largest.GetIndex(dim) + static_cast<long>(largest.GetSize(dim)));
+            region_.SetIndex(dim, start);
+            region_.SetSize(dim, static_cast<itk::SizeValueType>(std::max(end - start, 1L)));
+        }
+    }
+
+    /**
+     * @return The part of the fixed image cropped.
+     */
+    const RegionType& GetRegion() const
+    {
+        return region_;
+    }
+
+    /**
+     * Crop an image of the series.
+     * @param image The image.
+     * @return The crop.
+     */
+    ImagePointer Crop(ImagePointer image) const
+    {
+        return FixedImageContext<TImage>::CropImage(image, region_);
+    }
+
+    /**
+     * The parameters for registering the crops. The region and ROI are moved to the
+     * pixel coordinates of the crop.
+     * @param params The registration parameters.
+     * @return The parameters for the crops.
+     */
+    ItkRegistrationParams CropParams(const ItkRegistrationParams& params) const
+    {
+        ItkRegistrationParams cropParams(params);
+        cropParams.cropToRegion = false;
+
+        Image2D::RegionType cropPlane;
+        for (unsigned dim = 0; dim < 2u; ++dim)
+        {
+            cropParams.fixedImageRegion.SetIndex(dim, params.fixedImageRegion.GetIndex(dim)
+                                                 - region_.GetIndex(dim));
+            cropPlane.SetIndex(dim, 0);
+            cropPlane.SetSize(dim, region_.GetSize(dim));
+        }
+        cropParams.fixedImageRegion.Crop(cropPlane);
+
+        for (unsigned idx = 0; idx + 1 < cropParams.fixedImageMask.size(); idx += 2)
+        {
+            cropParams.fixedImageMask[idx] -= region_.GetIndex(0);
+            cropParams.fixedImageMask[idx + 1] -= region_.GetIndex(1);
+        }
+
+        return cropParams;
+    }
+
+    /**
+     * Apply the results of registering the crops to the whole moving image.
+     * @param movingImage The whole moving image.
+     * @param transforms The transforms found.
+     * @param field The Demons field found for the crop, if any. It is replaced by
+     * one covering the whole image, zero outside the crop.
+     * @return The registered image, the size of the fixed image.
+     */
+    template <class TRigidTransform, class TField>
+    ImagePointer Uncrop(ImagePointer movingImage, const ImageTransforms& transforms,
+                        typename TField::Pointer& field) const
+    {
+        if (field.IsNotNull())
+        {
+            field = PadField<TField>(field);
+
+            ImagePointer rigidImage = movingImage;
+            if (!transforms.rigid.IsEmpty())
+                rigidImage = ResampleWithTransforms<TImage, TRigidTransform>(movingImage, fixedImage_,
+                                                            transforms.rigid, TransformParams());
+            return WarpWithField<TImage, TField>(rigidImage, field);
+        }
+
+        if (transforms.rigid.IsEmpty() && transforms.deformable.IsEmpty())
+            return movingImage;
+
+        // Outside the crop the B-spline transform does nothing.
+        return ResampleWithTransforms<TImage, TRigidTransform>(movingImage, fixedImage_,
+                                                    transforms.rigid, transforms.deformable);
+    }
+
+private:
+    /**
+     * Put a field found for the crop into one covering the whole fixed image.
+     */
+    template <class TField>
+    typename TField::Pointer PadField(typename TField::Pointer cropField) const
+    {
+        typename TField::Pointer field = TField::New();
+        field->CopyInformation(fixedImage_);
+        field->SetRegions(fixedImage_->GetLargestPossibleRegion());
+        field->Allocate();
+        typename TField::PixelType zero;
+        zero.Fill(0.0);
+        field->FillBuffer(zero);
+
+        typedef itk::PasteImageFilter<TField> PasteFilterType;
+        typename PasteFilterType::Pointer paste = PasteFilterType::New();
+        paste->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+        paste->SetDestinationImage(field);
+        paste->SetSourceImage(cropField);
+        paste->SetSourceRegion(cropField->GetLargestPossibleRegion());
+        paste->SetDestinationIndex(region_.GetIndex());
+        paste->Update();
+
+        return paste->GetOutput();
+    }
+
+    ImagePointer fixedImage_;   ///< The whole fixed image.
+    RegionType region_;         ///< The part cropped, in the pixels of the fixed image.
+};
+
+#endif /* defined(__DCEFit__RegionCrop__) */
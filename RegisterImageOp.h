@@ -14,6 +14,8 @@
 #include "ItkRegistrationParams.h"
 
 @class Logger;
+class RegistrationCheckpoint;
+class ProgressWindowProgress;
 
 @interface RegisterImageOp : NSOperation <NSAlertDelegate>
 {
@@ -24,6 +26,12 @@
     RegistrationManager* manager;
     ItkRegistrationParams* params;
     ProgressWindowController* progController;
+    ProgressWindowProgress* progress_;   // Passes the registrations' progress to progController.
+    NSOperationQueue* imageQueue_;   // Runs the images concurrently in parallel mode.
+    NSOperationQueue* prefetchQueue_;    // Prepares the next moving image in serial mode.
+    NSOperationQueue* writeBackQueue_;   // Copies registered images into OsiriX in serial mode.
+    RegistrationCheckpoint* checkpoint_; // Finished images, so that a stopped run can resume.
+    NSMutableArray* failureReport_;      // What was done about each failed image.
     //Image3D::Pointer image;
 
     Logger* logger_;
@@ -8,21 +8,130 @@
 
 #import "RegisterImageOp.h"
 
-#include "RegisterOneImageRigid2D.h"
-#include "RegisterOneImageRigid3D.h"
-#include "RegisterOneImageBSpline2D.h"
-#include "RegisterOneImageBSpline3D.h"
-#include "RegisterOneImageDemons2D.h"
-#include "RegisterOneImageDemons3D.h"
+#include "RegisterOneImage.h"
+#include "ImageRegistration.h"
+#include "CoreScheduler.h"
+#include "FixedImageContext.h"
+#include "RegistrationCheckpoint.h"
+#include "ParseITKException.h"
+#include "ProgressWindowProgress.h"
+#include "SeriesTransforms.h"
 
 #import "SeriesInfo.h"
 
 #import <Log4m/Logger.h>
 #import <Log4m/LoggingMacros.h>
 
+#include <vector>
+
+/**
+ * Find the next image to be registered.
+ * @param order The image indices in the order they are registered.
+ * @param step The step to start looking from.
+ * @param fixedImageIdx Index of the fixed image, which is not registered.
+ * @return The step of the next image to register, order.size() if there are none.
+ */
+static unsigned NextStepToRegister(const std::vector<unsigned>& order, unsigned step,
+                                   unsigned fixedImageIdx)
+{
+    while ((step < order.size()) && (order[step] == fixedImageIdx))
+        ++step;
+
+    return step;
+}
+
+/// Write-backs allowed to wait before the registration waits for them.
+static const NSUInteger MaxPendingWriteBacks = 2;
+
 // used in register2dSeries
 //static Image2D::Pointer reduceTo2D(Image3D::Pointer image3d);
 
+@interface RegisterImageOp ()
+
+- (void)queryContinueAndWait;
+
+- (void)reportFailure:(NSString*)outcome Image:(unsigned)imageIdx Slice:(unsigned)sliceIdx;
+
+- (void)logFailureReport;
+
+- (void)setupCheckpoint;
+
+- (Image2D::Pointer)resumeImage2D:(Image2D::Pointer)movingImage
+                       FixedImage:(Image2D::Pointer)fixedImage
+                       ImageIndex:(unsigned)imageIdx
+                       SliceIndex:(unsigned)sliceIdx
+                       Transforms:(ImageTransforms*)transforms;
+
+- (Image3D::Pointer)resumeImage3D:(Image3D::Pointer)movingImage
+                       FixedImage:(Image3D::Pointer)fixedImage
+                       ImageIndex:(unsigned)imageIdx
+                       Transforms:(ImageTransforms*)transforms;
+
+- (Image2D::Pointer)registerImage2D:(Image2D::Pointer)movingImage
+                         ImageIndex:(unsigned)imageIdx
+                         SliceIndex:(unsigned)sliceIdx
+                       FixedContext:(FixedImageContext2D::Pointer)fixedContext
+                      MovingContext:(FixedImageContext2D::Pointer)movingContext
+                          WarmStart:(const ImageTransforms*)warmStart
+                         Transforms:(ImageTransforms*)transforms;
+
+- (Image3D::Pointer)registerImage3D:(Image3D::Pointer)movingImage
+                         ImageIndex:(unsigned)imageIdx
+                       FixedContext:(FixedImageContext3D::Pointer)fixedContext
+                      MovingContext:(FixedImageContext3D::Pointer)movingContext
+                          WarmStart:(const ImageTransforms*)warmStart
+                         Transforms:(ImageTransforms*)transforms;
+
+- (unsigned)firstStageLevels;
+
+- (BOOL)needsMovingContext:(unsigned)imageIdx;
+
+- (NSOperation*)prefetchImage2D:(unsigned)imageIdx Into:(FixedImageContext2D::Pointer*)context;
+
+- (NSOperation*)prefetchImage3D:(unsigned)imageIdx Into:(FixedImageContext3D::Pointer*)context;
+
+- (void)addWriteBack:(NSOperation*)writeOp;
+
+- (void)register2dSeriesConcurrently:(FixedImageContext2D::Pointer)fixedContext;
+
+- (void)register3dSeriesConcurrently:(FixedImageContext3D::Pointer)fixedContext;
+
+- (void)registerSliceWiseSeries;
+
+@end
+
+/**
+ * Lets the registration of each image ask the operation whether it has been
+ * cancelled, ask the user what to do after a failure and add to the failure report.
+ */
+class OperationSupervisor : public RegistrationSupervisor
+{
+public:
+    OperationSupervisor(RegisterImageOp* op)
+    : op_(op)
+    {
+    }
+
+    virtual bool IsCancelled()
+    {
+        return [op_ isCancelled];
+    }
+
+    virtual void QueryContinue()
+    {
+        [op_ queryContinueAndWait];
+    }
+
+    virtual void ReportFailure(unsigned imageIdx, unsigned sliceIdx, const std::string& outcome)
+    {
+        [op_ reportFailure:[NSString stringWithUTF8String:outcome.c_str()]
+                     Image:imageIdx Slice:sliceIdx];
+    }
+
+private:
+    RegisterImageOp* op_;
+};
+
 @implementation RegisterImageOp
 
 - (id)initWithManager:(RegistrationManager *)regManager
@@ -42,7 +151,33 @@
 
         manager = regManager;
         progController = controller;
+        progress_ = new ProgressWindowProgress(controller);
         params = manager.itkParams;
+
+        // Single slices are small and gain little from ITK's threads so they are
+        // run one per core. Volumes keep at least two threads each for their
+        // finest levels.
+        unsigned minThreadsPerJob = 2;
+        if ((params->slicesPerImage == 1) || params->sliceWise)
+            minThreadsPerJob = 1;
+
+        imageQueue_ = [[NSOperationQueue alloc] init];
+        unsigned maxJobs = CoreScheduler::GetInstance().GetNumberOfConcurrentJobs(
+                                            params->maxConcurrentImages, minThreadsPerJob);
+        [imageQueue_ setMaxConcurrentOperationCount:maxJobs];
+
+        // The serial modes run as a pipeline. The next moving image is prepared and
+        // the last registered one written back while the current one is registered.
+        prefetchQueue_ = [[NSOperationQueue alloc] init];
+        [prefetchQueue_ setMaxConcurrentOperationCount:1];
+        writeBackQueue_ = [[NSOperationQueue alloc] init];
+        [writeBackQueue_ setMaxConcurrentOperationCount:1];
+
+        checkpoint_ = 0;
+        if (params->checkpoint)
+            [self setupCheckpoint];
+
+        failureReport_ = [[NSMutableArray alloc] init];
     }
 
     return self;
@@ -50,6 +185,12 @@
 
 - (void)dealloc
 {
+    [imageQueue_ release];
+    [prefetchQueue_ release];
+    [writeBackQueue_ release];
+    delete checkpoint_;
+    delete progress_;
+    [failureReport_ release];
     [logger_ release];
     [super dealloc];
 }
@@ -57,6 +198,10 @@
 - (void)cancel
 {
     [super cancel];
+
+    // Images not yet started in parallel mode are dropped.
+    [imageQueue_ cancelAllOperations];
+    [prefetchQueue_ cancelAllOperations];
 }
 
 - (BOOL)isFinished
@@ -84,11 +229,21 @@
     {
         [self register2dSeries];
     }
+    else if (params->sliceWise)
+    {
+        [self registerSliceWiseSeries];
+    }
     else
     {
         [self register3dSeries];
     }
 
+    [self logFailureReport];
+
+    // A series which was not stopped has no need of its checkpoint.
+    if ((checkpoint_ != 0) && ![self isCancelled])
+        checkpoint_->Remove();
+
     [self willChangeValueForKey:@"isFinished"];
     finished_ = YES;
     [self didChangeValueForKey:@"isFinished"];
@@ -117,14 +272,341 @@
 {
     if (returnCode == NSAlertFirstButtonReturn)
         [self cancel];
-    
+
     waitingForAnswer_ = NO;
 }
 
+- (void)queryContinueAndWait
+{
+    // Only one question at a time when several images are being registered at once.
+    @synchronized(self)
+    {
+        // Someone else may already have answered "Cancel".
+        if ([self isCancelled])
+            return;
+
+        waitingForAnswer_ = YES;
+        [self performSelectorOnMainThread:@selector(queryContinue) withObject:nil waitUntilDone:NO];
+        while (waitingForAnswer_)
+            sleep(1);
+    }
+}
+
+- (void)reportFailure:(NSString*)outcome Image:(unsigned)imageIdx Slice:(unsigned)sliceIdx
+{
+    NSString* entry;
+    if (params->sliceWise && (params->slicesPerImage > 1))
+        entry = [NSString stringWithFormat:@"Image %u, slice %u: %@", imageIdx + 1,
+                 sliceIdx + 1, outcome];
+    else
+        entry = [NSString stringWithFormat:@"Image %u: %@", imageIdx + 1, outcome];
+
+    LOG4M_WARN(logger_, @"%@", entry);
+
+    @synchronized(failureReport_)
+    {
+        [failureReport_ addObject:entry];
+    }
+}
+
+- (void)logFailureReport
+{
+    @synchronized(failureReport_)
+    {
+        if ([failureReport_ count] == 0)
+            return;
+
+        LOG4M_WARN(logger_, @"Failure report for series %@:\n%@", manager.seriesInfo.seriesUID,
+                   [failureReport_ componentsJoinedByString:@"\n"]);
+    }
+}
+
+- (void)setupCheckpoint
+{
+    // ~/Library/Application Support/DCEFit/Checkpoints
+    NSArray* paths = NSSearchPathForDirectoriesInDomains(NSApplicationSupportDirectory,
+                                                         NSUserDomainMask, YES);
+    if ([paths count] == 0)
+    {
+        LOG4M_WARN(logger_, @"No application support directory. Checkpoint disabled.");
+        return;
+    }
+
+    NSString* dir = [[paths objectAtIndex:0] stringByAppendingPathComponent:@"DCEFit/Checkpoints"];
+    NSError* error = nil;
+    if (![[NSFileManager defaultManager] createDirectoryAtPath:dir withIntermediateDirectories:YES
+                                                    attributes:nil error:&error])
+    {
+        LOG4M_WARN(logger_, @"Could not create %@ (%@). Checkpoint disabled.",
+                   dir, [error localizedDescription]);
+        return;
+    }
+
+    // Any change to the parameters which affect the result gives a new checkpoint.
+    NSString* seriesUID = manager.seriesInfo.seriesUID;
+    std::string uid = (seriesUID != nil) ? [seriesUID UTF8String] : "";
+    checkpoint_ = new RegistrationCheckpoint([dir UTF8String], uid, params->Signature());
+}
+
+- (Image2D::Pointer)resumeImage2D:(Image2D::Pointer)movingImage
+                       FixedImage:(Image2D::Pointer)fixedImage
+                       ImageIndex:(unsigned)imageIdx
+                       SliceIndex:(unsigned)sliceIdx
+                       Transforms:(ImageTransforms*)transforms
+{
+    RegistrationCheckpoint::Record record;
+    if ((checkpoint_ == 0) || !checkpoint_->Find(imageIdx, sliceIdx, record))
+        return 0;
+
+    Image2D::Pointer regImage;
+    try
+    {
+        if (record.displacementField.empty())
+        {
+            regImage = ResampleWithTransforms<Image2D, CenteredRigid2DTransform>(
+                                        movingImage, fixedImage, record.rigid, record.deformable);
+        }
+        else
+        {
+            DemonsDisplacementField2D::Pointer field;
+            if (!checkpoint_->LoadDisplacementField(record, field))
+                return 0;
+            regImage = WarpWithField<Image2D, DemonsDisplacementField2D>(movingImage, field);
+        }
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        LOG4M_WARN(logger_, @"Could not restore image %u, slice %u. Registering it again. %s",
+                   imageIdx + 1, sliceIdx + 1, ParseITKException(err));
+        return 0;
+    }
+
+    if (transforms != 0)
+    {
+        transforms->rigid = record.rigid;
+        transforms->deformable = record.deformable;
+    }
+
+    LOG4M_INFO(logger_, @"Image %u, slice %u restored from checkpoint.", imageIdx + 1, sliceIdx + 1);
+
+    return regImage;
+}
+
+- (Image3D::Pointer)resumeImage3D:(Image3D::Pointer)movingImage
+                       FixedImage:(Image3D::Pointer)fixedImage
+                       ImageIndex:(unsigned)imageIdx
+                       Transforms:(ImageTransforms*)transforms
+{
+    RegistrationCheckpoint::Record record;
+    if ((checkpoint_ == 0) || !checkpoint_->Find(imageIdx, 0, record))
+        return 0;
+
+    Image3D::Pointer regImage;
+    try
+    {
+        if (record.displacementField.empty())
+        {
+            regImage = ResampleWithTransforms<Image3D, VersorTransform3D>(
+                                        movingImage, fixedImage, record.rigid, record.deformable);
+        }
+        else
+        {
+            DemonsDisplacementField3D::Pointer field;
+            if (!checkpoint_->LoadDisplacementField(record, field))
+                return 0;
+            regImage = WarpWithField<Image3D, DemonsDisplacementField3D>(movingImage, field);
+        }
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        LOG4M_WARN(logger_, @"Could not restore image %u. Registering it again. %s",
+                   imageIdx + 1, ParseITKException(err));
+        return 0;
+    }
+
+    if (transforms != 0)
+    {
+        transforms->rigid = record.rigid;
+        transforms->deformable = record.deformable;
+    }
+
+    LOG4M_INFO(logger_, @"Image %u restored from checkpoint.", imageIdx + 1);
+
+    return regImage;
+}
+
+- (Image2D::Pointer)registerImage2D:(Image2D::Pointer)movingImage
+                         ImageIndex:(unsigned)imageIdx
+                         SliceIndex:(unsigned)sliceIdx
+                       FixedContext:(FixedImageContext2D::Pointer)fixedContext
+                      MovingContext:(FixedImageContext2D::Pointer)movingContext
+                          WarmStart:(const ImageTransforms*)warmStart
+                         Transforms:(ImageTransforms*)transforms
+{
+    // A run which was stopped may already have done this one.
+    Image2D::Pointer resumed = [self resumeImage2D:movingImage
+                                        FixedImage:fixedContext->GetFixedImage()
+                                        ImageIndex:imageIdx SliceIndex:sliceIdx
+                                        Transforms:transforms];
+    if (resumed.IsNotNull())
+        return resumed;
+
+    OperationSupervisor supervisor(self);
+    ImageRegistration<Image2D> registration(*params, progress_, &supervisor);
+    ImageRegistration<Image2D>::Result found;
+    Image2D::Pointer regImage = registration.Register(movingImage, fixedContext, movingContext,
+                                                      warmStart, imageIdx, sliceIdx, found);
+    if (regImage.IsNull())
+        return 0;
+
+    if (transforms != 0)
+        *transforms = found.transforms;
+
+    // Only a result worth keeping goes into the checkpoint.
+    if ((checkpoint_ != 0) && (found.code != DISASTER))
+    {
+        RegistrationCheckpoint::Record record;
+        record.rigid = found.transforms.rigid;
+        record.deformable = found.transforms.deformable;
+        if (found.field.IsNotNull())
+            record.displacementField = checkpoint_->StoreDisplacementField(imageIdx, sliceIdx,
+                                                                           found.field.GetPointer());
+        if (found.field.IsNull() || !record.displacementField.empty())
+            checkpoint_->Store(imageIdx, sliceIdx, record);
+    }
+
+    return regImage;
+}
+
+- (Image3D::Pointer)registerImage3D:(Image3D::Pointer)movingImage
+                         ImageIndex:(unsigned)imageIdx
+                       FixedContext:(FixedImageContext3D::Pointer)fixedContext
+                      MovingContext:(FixedImageContext3D::Pointer)movingContext
+                          WarmStart:(const ImageTransforms*)warmStart
+                         Transforms:(ImageTransforms*)transforms
+{
+    // A run which was stopped may already have done this one.
+    Image3D::Pointer resumed = [self resumeImage3D:movingImage
+                                        FixedImage:fixedContext->GetFixedImage()
+                                        ImageIndex:imageIdx Transforms:transforms];
+    if (resumed.IsNotNull())
+        return resumed;
+
+    OperationSupervisor supervisor(self);
+    ImageRegistration<Image3D> registration(*params, progress_, &supervisor);
+    ImageRegistration<Image3D>::Result found;
+    Image3D::Pointer regImage = registration.Register(movingImage, fixedContext, movingContext,
+                                                      warmStart, imageIdx, 0, found);
+    if (regImage.IsNull())
+        return 0;
+
+    if (transforms != 0)
+        *transforms = found.transforms;
+
+    // Only a result worth keeping goes into the checkpoint.
+    if ((checkpoint_ != 0) && (found.code != DISASTER))
+    {
+        RegistrationCheckpoint::Record record;
+        record.rigid = found.transforms.rigid;
+        record.deformable = found.transforms.deformable;
+        if (found.field.IsNotNull())
+            record.displacementField = checkpoint_->StoreDisplacementField(imageIdx, 0,
+                                                                           found.field.GetPointer());
+        if (found.field.IsNull() || !record.displacementField.empty())
+            checkpoint_->Store(imageIdx, 0, record);
+    }
+
+    return regImage;
+}
+
+- (unsigned)firstStageLevels
+{
+    if (params->isRigidRegEnabled())
+        return params->rigidLevels;
+    else if (params->isBSplineRegEnabled())
+        return params->bsplineLevels;
+    else
+        return 0;
+}
+
+- (BOOL)needsMovingContext:(unsigned)imageIdx
+{
+    // The cropped stages build their pyramids from the crop.
+    if (params->cropToRegion)
+        return NO;
+
+    // An image in the checkpoint is resampled, not registered.
+    RegistrationCheckpoint::Record record;
+    if ((checkpoint_ != 0) && checkpoint_->Find(imageIdx, 0, record))
+        return NO;
+
+    return YES;
+}
+
+- (NSOperation*)prefetchImage2D:(unsigned)imageIdx Into:(FixedImageContext2D::Pointer*)context
+{
+    // Only the rigid and B-spline stages take their pyramids from a context.
+    unsigned numLevels = [self firstStageLevels];
+    if ((numLevels == 0) || ![self needsMovingContext:imageIdx])
+        return nil;
+
+    NSBlockOperation* prefetchOp = [NSBlockOperation blockOperationWithBlock:^{
+        if ([self isCancelled])
+            return;
+
+        Image2D::Pointer movingImage = [manager slice:0 FromImage:imageIdx];
+        FixedImageContext2D::Pointer movingContext = FixedImageContext2D::New(movingImage);
+        movingContext->GetPyramidLevels(RegisterOneImage<Image2D>::CreateResolutionSchedule(numLevels,
+                                                    movingImage->GetSpacing()));
+        *context = movingContext;
+    }];
+
+    [prefetchQueue_ addOperation:prefetchOp];
+    return prefetchOp;
+}
+
+- (NSOperation*)prefetchImage3D:(unsigned)imageIdx Into:(FixedImageContext3D::Pointer*)context
+{
+    // Only the rigid and B-spline stages take their pyramids from a context.
+    unsigned numLevels = [self firstStageLevels];
+    if ((numLevels == 0) || ![self needsMovingContext:imageIdx])
+        return nil;
+
+    BOOL needMoments = params->isRigidRegEnabled();
+    NSBlockOperation* prefetchOp = [NSBlockOperation blockOperationWithBlock:^{
+        if ([self isCancelled])
+            return;
+
+        Image3D::Pointer movingImage = [manager imageAtIndex:imageIdx];
+        FixedImageContext3D::Pointer movingContext = FixedImageContext3D::New(movingImage);
+        movingContext->GetPyramidLevels(RegisterOneImage<Image3D>::CreateResolutionSchedule(numLevels,
+                                                    movingImage->GetSpacing()));
+        if (needMoments)
+            movingContext->GetCenterOfGravity();
+        *context = movingContext;
+    }];
+
+    [prefetchQueue_ addOperation:prefetchOp];
+    return prefetchOp;
+}
+
+- (void)addWriteBack:(NSOperation*)writeOp
+{
+    // Keep the queue short so that registered images do not pile up in memory
+    // when the viewer is slower than the registration.
+    while ([writeBackQueue_ operationCount] >= MaxPendingWriteBacks)
+    {
+        NSArray* pending = [writeBackQueue_ operations];
+        if ([pending count] > 0)
+            [[pending objectAtIndex:0] waitUntilFinished];
+    }
+
+    [writeBackQueue_ addOperation:writeOp];
+}
+
 - (void)register2dSeries
 {
     unsigned numImages = params->numImages;
-    ResultCode resultCode = SUCCESS;
     waitingForAnswer_ = NO;
 
     [progController performSelectorOnMainThread:@selector(setNumImages:)
@@ -135,15 +617,35 @@
     unsigned fixedImageIdx = params->fixedImageNumber - 1;
     const Image2D::Pointer fixedImage = [manager slice:0 FromImage:fixedImageIdx];
 
+    // The fixed side is prepared once and shared by all of the registrations.
+    FixedImageContext2D::Pointer fixedContext = FixedImageContext2D::New(fixedImage);
+
+    if (params->parallelSeries)
+    {
+        [self register2dSeriesConcurrently:fixedContext];
+        return;
+    }
+
+    std::vector<ImageTransforms> transforms(numImages);
+    std::vector<unsigned> order = RegistrationOrder(numImages, fixedImageIdx, params->warmStart);
+
+    // The moving images prepared ahead of their registration. A prefetch operation
+    // writes an element and we read it after the operation has finished.
+    std::vector<FixedImageContext2D::Pointer> movingContexts(numImages);
+    NSOperation* prefetchOp = nil;
+    unsigned firstStep = NextStepToRegister(order, 0, fixedImageIdx);
+    if (firstStep < order.size())
+        prefetchOp = [self prefetchImage2D:order[firstStep] Into:&movingContexts[order[firstStep]]];
+
     // We iterate over the image number that the user sees.
-    for (unsigned imageNum = 1; imageNum <= numImages; ++imageNum)
+    for (unsigned step = 0; step < order.size(); ++step)
     {
-        resultCode = SUCCESS;
-        unsigned imageIdx = imageNum - 1;
+        unsigned imageIdx = order[step];
+        unsigned imageNum = imageIdx + 1;
 
         // Set progress window to current slice.
         [progController performSelectorOnMainThread:@selector(setCurImage:)
-                                         withObject:[NSNumber numberWithUnsignedInt:imageNum]
+                                         withObject:[NSNumber numberWithUnsignedInt:step + 1]
                                       waitUntilDone:YES];
 
         // No need to register the fixed image
@@ -169,60 +671,124 @@
         if ([self isCancelled])
             break;
 
+        // Wait for this image to be prepared then start preparing the next one.
+        [prefetchOp waitUntilFinished];
+        unsigned nextStep = NextStepToRegister(order, step + 1, fixedImageIdx);
+        if (nextStep < order.size())
+            prefetchOp = [self prefetchImage2D:order[nextStep] Into:&movingContexts[order[nextStep]]];
+
         // Pull the image from the 4D series.
-        Image2D::Pointer movingImage = [manager slice:0 FromImage:imageIdx];
+        FixedImageContext2D::Pointer movingContext = movingContexts[imageIdx];
+        movingContexts[imageIdx] = 0;
+        Image2D::Pointer movingImage;
+        if (movingContext.IsNotNull())
+            movingImage = movingContext->GetFixedImage();
+        else
+            movingImage = [manager slice:0 FromImage:imageIdx];
 
-        // Do this so that the deformable registration will get the moving
-        // image even if rigid registration is disabled.
-        Image2D::Pointer regImage = movingImage;
+        ImageTransforms warmStart = PredictTransforms(&transforms[0], imageIdx, fixedImageIdx,
+                                                      params->warmStart);
+        Image2D::Pointer regImage = [self registerImage2D:movingImage
+                                               ImageIndex:imageIdx
+                                               SliceIndex:0
+                                             FixedContext:fixedContext
+                                            MovingContext:movingContext
+                                                WarmStart:&warmStart
+                                               Transforms:&transforms[imageIdx]];
 
-        if (params->isRigidRegEnabled())
-        {
-            RegisterOneImageRigid2D rigidReg(progController, fixedImage, *params);
-            regImage = rigidReg.registerImage(movingImage, resultCode);
-        }
+        if (regImage.IsNull())
+            break;
 
-        if (resultCode == DISASTER)
-        {
-            [self performSelectorOnMainThread:@selector(queryContinue) withObject:nil waitUntilDone:NO];
-            while (waitingForAnswer_)
-                sleep(1);
-        }
+        // Hand the result on so that the next registration need not wait for the viewer.
+        NSBlockOperation* writeOp = [NSBlockOperation blockOperationWithBlock:^{
+            [manager insertSliceIntoViewer:regImage ImageIndex:imageIdx SliceIndex:0];
+        }];
+        [self addWriteBack:writeOp];
+    }
 
-        if ([self isCancelled])
-            break;
+    // The prefetch operations write into movingContexts so they must be done with it.
+    [prefetchQueue_ cancelAllOperations];
+    [prefetchQueue_ waitUntilAllOperationsAreFinished];
+    [writeBackQueue_ waitUntilAllOperationsAreFinished];
+}
 
-        if (params->isBSplineRegEnabled())
-        {
-            RegisterOneImageBSpline2D bsplineReg(progController, fixedImage, *params);
-            regImage = bsplineReg.registerImage(regImage, resultCode);
-        }
-        else if (params->isDemonsRegEnabled())
+- (void)register2dSeriesConcurrently:(FixedImageContext2D::Pointer)fixedContext
+{
+    const Image2D::Pointer fixedImage = fixedContext->GetFixedImage();
+    unsigned numImages = params->numImages;
+    unsigned fixedImageIdx = params->fixedImageNumber - 1;
+    WarmStartType warmStartType = params->warmStart;
+
+    LOG4M_INFO(logger_, @"Registering %u images concurrently (maximum = %ld).",
+               numImages - 1, (long)[imageQueue_ maxConcurrentOperationCount]);
+
+    [progController performSelectorOnMainThread:@selector(setCurImage:)
+                                     withObject:[NSNumber numberWithUnsignedInt:0]
+                                  waitUntilDone:YES];
+
+    // Each operation writes only its own element and reads those of the images
+    // it depends upon after they have finished.
+    std::vector<ImageTransforms> transforms(numImages);
+    ImageTransforms* solved = &transforms[0];
+
+    std::vector<NSOperation*> imageOps(numImages, (NSOperation*)nil);
+    std::vector<unsigned> order = RegistrationOrder(numImages, fixedImageIdx, warmStartType);
+    for (unsigned step = 0; step < order.size(); ++step)
+    {
+        unsigned imageIdx = order[step];
+        if (imageIdx == fixedImageIdx)
         {
-            RegisterOneImageDemons2D demonsReg(progController, fixedImage, *params);
-            regImage = demonsReg.registerImage(regImage, resultCode);
+            LOG4M_INFO(logger_, @"Skipping fixed image: %u (index = %u)", imageIdx + 1, imageIdx);
+            [manager insertSliceIntoViewer:fixedImage ImageIndex:imageIdx SliceIndex:0];
+            [progController performSelectorOnMainThread:@selector(incrCurImage)
+                                             withObject:nil waitUntilDone:NO];
+            continue;
         }
 
-        if (resultCode == DISASTER)
-        {
-            [self queryContinue];
-            [self performSelectorOnMainThread:@selector(queryContinue) withObject:nil waitUntilDone:NO];
+        NSBlockOperation* imageOp = [NSBlockOperation blockOperationWithBlock:^{
+            if ([self isCancelled])
+                return;
 
-            while (waitingForAnswer_)
-                sleep(1);
-        }
+            LOG4M_INFO(logger_, @"Registering image %u (index = %u)", imageIdx + 1, imageIdx);
 
-        if ([self isCancelled])
-            break;
+            Image2D::Pointer movingImage = [manager slice:0 FromImage:imageIdx];
+            ImageTransforms warmStart = PredictTransforms(solved, imageIdx, fixedImageIdx,
+                                                          warmStartType);
+            Image2D::Pointer regImage = [self registerImage2D:movingImage
+                                                   ImageIndex:imageIdx
+                                                   SliceIndex:0
+                                                 FixedContext:fixedContext
+                                                MovingContext:0
+                                                    WarmStart:&warmStart
+                                                   Transforms:solved + imageIdx];
+            if (regImage.IsNull())
+                return;
 
-        [manager insertSliceIntoViewer:regImage ImageIndex:imageIdx SliceIndex:0];
+            [manager insertSliceIntoViewer:regImage ImageIndex:imageIdx SliceIndex:0];
+
+            NSString* msg = [NSString stringWithFormat:@"Registered image %u.", imageIdx + 1];
+            [progController performSelectorOnMainThread:@selector(setStopCondition:)
+                                             withObject:msg waitUntilDone:NO];
+            [progController performSelectorOnMainThread:@selector(incrCurImage)
+                                             withObject:nil waitUntilDone:NO];
+        }];
+
+        // With a warm start each image waits for its inner neighbour so the two
+        // directions in time run as two chains.
+        unsigned innerIdx = InnerNeighbour(imageIdx, fixedImageIdx);
+        if ((warmStartType != NoWarmStart) && (innerIdx != fixedImageIdx))
+            [imageOp addDependency:imageOps[innerIdx]];
+
+        imageOps[imageIdx] = imageOp;
+        [imageQueue_ addOperation:imageOp];
     }
+
+    [imageQueue_ waitUntilAllOperationsAreFinished];
 }
 
 - (void)register3dSeries
 {
     unsigned numImages = params->numImages;
-    ResultCode resultCode = SUCCESS;
     waitingForAnswer_ = NO;
 
     [progController performSelectorOnMainThread:@selector(setNumImages:)
@@ -233,15 +799,35 @@
     unsigned fixedImageIdx = params->fixedImageNumber - 1;
     const Image3D::Pointer fixedImage = [manager imageAtIndex:fixedImageIdx];
 
+    // The fixed side is prepared once and shared by all of the registrations.
+    FixedImageContext3D::Pointer fixedContext = FixedImageContext3D::New(fixedImage);
+
+    if (params->parallelSeries)
+    {
+        [self register3dSeriesConcurrently:fixedContext];
+        return;
+    }
+
+    std::vector<ImageTransforms> transforms(numImages);
+    std::vector<unsigned> order = RegistrationOrder(numImages, fixedImageIdx, params->warmStart);
+
+    // The moving images prepared ahead of their registration. A prefetch operation
+    // writes an element and we read it after the operation has finished.
+    std::vector<FixedImageContext3D::Pointer> movingContexts(numImages);
+    NSOperation* prefetchOp = nil;
+    unsigned firstStep = NextStepToRegister(order, 0, fixedImageIdx);
+    if (firstStep < order.size())
+        prefetchOp = [self prefetchImage3D:order[firstStep] Into:&movingContexts[order[firstStep]]];
+
     // We iterate over the image number that the user sees.
-    for (unsigned imageNum = 1; imageNum <= numImages; ++imageNum)
+    for (unsigned step = 0; step < order.size(); ++step)
     {
-        resultCode = SUCCESS;
-        unsigned imageIdx = imageNum - 1;
+        unsigned imageIdx = order[step];
+        unsigned imageNum = imageIdx + 1;
 
         // Set progress window to current slice.
         [progController performSelectorOnMainThread:@selector(setCurImage:)
-                                         withObject:[NSNumber numberWithUnsignedInt:imageNum]
+                                         withObject:[NSNumber numberWithUnsignedInt:step + 1]
                                       waitUntilDone:YES];
 
         // No need to register the fixed image
@@ -266,63 +852,220 @@
         if ([self isCancelled])
             break;
 
+        // Wait for this image to be prepared then start preparing the next one.
+        [prefetchOp waitUntilFinished];
+        unsigned nextStep = NextStepToRegister(order, step + 1, fixedImageIdx);
+        if (nextStep < order.size())
+            prefetchOp = [self prefetchImage3D:order[nextStep] Into:&movingContexts[order[nextStep]]];
+
         // Pull the 3D volume from the time series.
-        Image3D::Pointer movingImage = [manager imageAtIndex:imageIdx];
+        FixedImageContext3D::Pointer movingContext = movingContexts[imageIdx];
+        movingContexts[imageIdx] = 0;
+        Image3D::Pointer movingImage;
+        if (movingContext.IsNotNull())
+            movingImage = movingContext->GetFixedImage();
+        else
+            movingImage = [manager imageAtIndex:imageIdx];
 
-        // Do this so that the deformable registration will get the moving
-        // image even if rigid registration is disabled.
-        Image3D::Pointer regImage = movingImage;
+        ImageTransforms warmStart = PredictTransforms(&transforms[0], imageIdx, fixedImageIdx,
+                                                      params->warmStart);
+        Image3D::Pointer regImage = [self registerImage3D:movingImage
+                                               ImageIndex:imageIdx
+                                             FixedContext:fixedContext
+                                            MovingContext:movingContext
+                                                WarmStart:&warmStart
+                                               Transforms:&transforms[imageIdx]];
 
-        if (params->isRigidRegEnabled())
-        {
-            RegisterOneImageRigid3D rigidReg(progController, fixedImage, *params);
-            regImage = rigidReg.registerImage(movingImage, resultCode);
-        }
+        if (regImage.IsNull())
+            break;
 
-        if (resultCode == DISASTER)
-        {
-            [self performSelectorOnMainThread:@selector(queryContinue) withObject:nil waitUntilDone:YES];
-            while (waitingForAnswer_)
-                sleep(1);
-        }
+        // Hand the result on so that the next registration need not wait for the viewer.
+        NSBlockOperation* writeOp = [NSBlockOperation blockOperationWithBlock:^{
+            [manager insertImageIntoViewer:regImage Index:imageIdx];
+        }];
+        [self addWriteBack:writeOp];
+    }
 
-        if ([self isCancelled])
-            break;
+    // The prefetch operations write into movingContexts so they must be done with it.
+    [prefetchQueue_ cancelAllOperations];
+    [prefetchQueue_ waitUntilAllOperationsAreFinished];
+    [writeBackQueue_ waitUntilAllOperationsAreFinished];
+}
+
+- (void)register3dSeriesConcurrently:(FixedImageContext3D::Pointer)fixedContext
+{
+    unsigned numImages = params->numImages;
+    unsigned fixedImageIdx = params->fixedImageNumber - 1;
+    WarmStartType warmStartType = params->warmStart;
+
+    LOG4M_INFO(logger_, @"Registering %u images concurrently (maximum = %ld).",
+               numImages - 1, (long)[imageQueue_ maxConcurrentOperationCount]);
 
-        if (params->isBSplineRegEnabled())
+    [progController performSelectorOnMainThread:@selector(setCurImage:)
+                                     withObject:[NSNumber numberWithUnsignedInt:0]
+                                  waitUntilDone:YES];
+
+    // Each operation writes only its own element and reads those of the images
+    // it depends upon after they have finished.
+    std::vector<ImageTransforms> transforms(numImages);
+    ImageTransforms* solved = &transforms[0];
+
+    std::vector<NSOperation*> imageOps(numImages, (NSOperation*)nil);
+    std::vector<unsigned> order = RegistrationOrder(numImages, fixedImageIdx, warmStartType);
+    for (unsigned step = 0; step < order.size(); ++step)
+    {
+        unsigned imageIdx = order[step];
+        if (imageIdx == fixedImageIdx)
         {
-            RegisterOneImageBSpline3D bsplineReg(progController, fixedImage, *params);
-            regImage = bsplineReg.registerImage(regImage, resultCode);
+            LOG4M_INFO(logger_, @"Skipping fixed image: %u (index = %u)", imageIdx + 1, imageIdx);
+            [progController performSelectorOnMainThread:@selector(incrCurImage)
+                                             withObject:nil waitUntilDone:NO];
+            continue;
         }
-        else if (params->isDemonsRegEnabled())
+
+        // Without a warm start the images are independent of each other. The queue
+        // hands them to idle threads as earlier ones finish.
+        NSBlockOperation* imageOp = [NSBlockOperation blockOperationWithBlock:^{
+            if ([self isCancelled])
+                return;
+
+            LOG4M_INFO(logger_, @"Registering image %u (index = %u)", imageIdx + 1, imageIdx);
+
+            Image3D::Pointer movingImage = [manager imageAtIndex:imageIdx];
+            ImageTransforms warmStart = PredictTransforms(solved, imageIdx, fixedImageIdx,
+                                                          warmStartType);
+            Image3D::Pointer regImage = [self registerImage3D:movingImage
+                                                   ImageIndex:imageIdx
+                                                 FixedContext:fixedContext
+                                                MovingContext:0
+                                                    WarmStart:&warmStart
+                                                   Transforms:solved + imageIdx];
+            if (regImage.IsNull())
+                return;
+
+            [manager insertImageIntoViewer:regImage Index:imageIdx];
+
+            NSString* msg = [NSString stringWithFormat:@"Registered image %u.", imageIdx + 1];
+            [progController performSelectorOnMainThread:@selector(setStopCondition:)
+                                             withObject:msg waitUntilDone:NO];
+            [progController performSelectorOnMainThread:@selector(incrCurImage)
+                                             withObject:nil waitUntilDone:NO];
+        }];
+
+        // With a warm start each image waits for its inner neighbour so the two
+        // directions in time run as two chains.
+        unsigned innerIdx = InnerNeighbour(imageIdx, fixedImageIdx);
+        if ((warmStartType != NoWarmStart) && (innerIdx != fixedImageIdx))
+            [imageOp addDependency:imageOps[innerIdx]];
+
+        imageOps[imageIdx] = imageOp;
+        [imageQueue_ addOperation:imageOp];
+    }
+
+    [imageQueue_ waitUntilAllOperationsAreFinished];
+}
+
+- (void)registerSliceWiseSeries
+{
+    unsigned numImages = params->numImages;
+    unsigned numSlices = params->slicesPerImage;
+    unsigned fixedImageIdx = params->fixedImageNumber - 1;
+    waitingForAnswer_ = NO;
+
+    // Every (image, slice) pair is a unit of work and a step of the progress bar.
+    [progController performSelectorOnMainThread:@selector(setNumImages:)
+                                     withObject:[NSNumber numberWithUnsignedInt:numImages * numSlices]
+                                  waitUntilDone:NO];
+    [progController performSelectorOnMainThread:@selector(setCurImage:)
+                                     withObject:[NSNumber numberWithUnsignedInt:0]
+                                  waitUntilDone:YES];
+
+    // Extract the fixed slices once. They are shared by all of the time points.
+    std::vector<FixedImageContext2D::Pointer> fixedContexts(numSlices);
+    for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+    {
+        Image2D::Pointer fixedSlice = [manager slice:sliceIdx FromImage:fixedImageIdx];
+        fixedContexts[sliceIdx] = FixedImageContext2D::New(fixedSlice);
+    }
+
+    // The transform found for each (image, slice) pair. Each operation writes only
+    // its own element and reads its neighbour's after that neighbour has finished.
+    std::vector<ImageTransforms> transforms(numImages * numSlices);
+    ImageTransforms* solved = &transforms[0];
+
+    // The middle slice of each image is registered from scratch. The slices on either
+    // side of it wait for their inner neighbour and start from its solution so the
+    // work fans out towards both ends of the stack. See SliceOrder().
+    LOG4M_INFO(logger_, @"Registering %u slices of %u images slice by slice (maximum = %ld).",
+               numSlices, numImages - 1, (long)[imageQueue_ maxConcurrentOperationCount]);
+
+    for (unsigned imageIdx = 0; imageIdx < numImages; ++imageIdx)
+    {
+        if (imageIdx == fixedImageIdx)
         {
-            RegisterOneImageDemons3D demonsReg(progController, fixedImage, *params);
-            regImage = demonsReg.registerImage(regImage, resultCode);
+            LOG4M_INFO(logger_, @"Skipping fixed image: %u (index = %u)", imageIdx + 1, imageIdx);
+            for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+                [progController performSelectorOnMainThread:@selector(incrCurImage)
+                                                 withObject:nil waitUntilDone:NO];
+            continue;
         }
 
-        if (resultCode == DISASTER)
+        NSMutableArray* sliceOps = [NSMutableArray arrayWithCapacity:numSlices];
+        for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
         {
-            [self performSelectorOnMainThread:@selector(queryContinue) withObject:nil waitUntilDone:NO];
-            while (waitingForAnswer_)
-                sleep(1);
+            const FixedImageContext2D::Pointer fixedContext = fixedContexts[sliceIdx];
+            ImageTransforms* result = solved + imageIdx * numSlices + sliceIdx;
+
+            unsigned innerIdx = InnerSlice(sliceIdx, numSlices);
+            const ImageTransforms* warmStart = 0;
+            if (innerIdx != sliceIdx)
+                warmStart = solved + imageIdx * numSlices + innerIdx;
+
+            NSBlockOperation* sliceOp = [NSBlockOperation blockOperationWithBlock:^{
+                if ([self isCancelled])
+                    return;
 
-            while (waitingForAnswer_)
-                sleep(1);
+                LOG4M_DEBUG(logger_, @"Registering image %u, slice %u", imageIdx + 1, sliceIdx + 1);
+
+                Image2D::Pointer movingSlice = [manager slice:sliceIdx FromImage:imageIdx];
+                Image2D::Pointer regSlice = [self registerImage2D:movingSlice
+                                                       ImageIndex:imageIdx
+                                                       SliceIndex:sliceIdx
+                                                     FixedContext:fixedContext
+                                                    MovingContext:0
+                                                        WarmStart:warmStart
+                                                       Transforms:result];
+                if (regSlice.IsNull())
+                    return;
+
+                [manager insertSliceIntoViewer:regSlice ImageIndex:imageIdx SliceIndex:sliceIdx];
+
+                [progController performSelectorOnMainThread:@selector(incrCurImage)
+                                                 withObject:nil waitUntilDone:NO];
+            }];
+            [sliceOps addObject:sliceOp];
         }
 
-        if ([self isCancelled])
-            break;
+        // Chain each slice to the neighbour it starts from.
+        for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+        {
+            unsigned innerIdx = InnerSlice(sliceIdx, numSlices);
+            if (innerIdx != sliceIdx)
+                [[sliceOps objectAtIndex:sliceIdx] addDependency:[sliceOps objectAtIndex:innerIdx]];
+        }
 
-        [manager insertImageIntoViewer:regImage Index:imageIdx];
+        [imageQueue_ addOperations:sliceOps waitUntilFinished:NO];
     }
 
-    [self willChangeValueForKey:@"isFinished"];
-    finished_ = YES;
-    [self didChangeValueForKey:@"isFinished"];
-    [self willChangeValueForKey:@"isExecuting"];
-    executing_ = NO;
-    [self didChangeValueForKey:@"isExecuting"];
+    [imageQueue_ waitUntilAllOperationsAreFinished];
+
+    if (![self isCancelled])
+    {
+        NSString* msg = [NSString stringWithFormat:@"Registered %u slices.",
+                         (numImages - 1) * numSlices];
+        [progController performSelectorOnMainThread:@selector(setStopCondition:)
+                                         withObject:msg waitUntilDone:NO];
+    }
 }
 
 @end
-
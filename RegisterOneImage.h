@@ -12,11 +12,20 @@
 #include "ItkTypedefs.h"
 #include "ProjectDefs.h"
 #include "ItkRegistrationParams.h"
+#include "RegistrationObserverBase.h"
+#include "CoreScheduler.h"
+#include "FixedImageContext.h"
+#include "TransformParams.h"
+#include "RegistrationProgress.h"
 
-#import "ProgressWindowController.h"
+#include <itkBSplineTransformParametersAdaptor.h>
+#include <itkMath.h>
 
 #include <log4cplus/logger.h>
 
+#include <algorithm>
+#include <cmath>
+
 /**
  * Abstract base class for performing a multiresolution registration of one image
  */
@@ -24,23 +33,30 @@ template <class TImage>
 class RegisterOneImage
 {
   public:
+    typedef typename itk::MultiResolutionPyramidImageFilter<TImage, TImage>::ScheduleType ScheduleType;
+
     /**
      * Constructor.
-     * @param progressController ProgressController for updates and registration mamagement.
+     * @param progress Receives updates and manages the registration. May be 0.
      * @param fixedImage The fixed image.
      * @param params The registration parameters.
      */
-    RegisterOneImage(ProgressWindowController* progressController,
+    RegisterOneImage(RegistrationProgress* progress,
                        typename TImage::Pointer fixedImage,
                        const ItkRegistrationParams& itkParams)
-    : progController_(progressController), fixedImage_(fixedImage), itkParams_(itkParams)
+    : progress_((progress != 0) ? progress : RegistrationProgress::GetNull()),
+      fixedImage_(fixedImage), itkParams_(itkParams), resampleResult_(true)
     {
-
+        // Each instance is one registration sharing the cores with the others.
+        CoreScheduler::GetInstance().JobStarted();
     }
 
     virtual ~RegisterOneImage()
     {
-        [progController_ setObserver:0];
+        if (observer_.IsNotNull())
+            progress_->RemoveObserver(observer_.GetPointer());
+
+        CoreScheduler::GetInstance().JobFinished();
     }
 
     /**
@@ -52,11 +68,397 @@ class RegisterOneImage
     virtual typename TImage::Pointer registerImage(typename TImage::Pointer movingImage,
                                                ResultCode& code) = 0;
 
+    /**
+     * Start the optimisation from this transform rather than from the initialiser's guess.
+     * Use it to warm start a registration from the result of a neighbouring one.
+     * @param warmStart Result of a previous registration of the same kind.
+     */
+    void SetWarmStart(const TransformParams& warmStart)
+    {
+        warmStart_ = warmStart;
+    }
+
+    /**
+     * Share the fixed side of the registration with the other registrations of
+     * the series. The context must have been made from the fixed image.
+     * @param context The context for the fixed image.
+     */
+    void SetFixedImageContext(typename FixedImageContext<TImage>::Pointer context)
+    {
+        fixedContext_ = context;
+    }
+
+    /**
+     * Take the moving image pyramid from a context prepared ahead of time rather than
+     * building it during the registration. It is used only if it was made from the
+     * image passed to registerImage().
+     * @param context A context made from the moving image.
+     */
+    void SetMovingImageContext(typename FixedImageContext<TImage>::Pointer context)
+    {
+        movingContext_ = context;
+    }
+
+    /**
+     * Register the moving image as seen through a transform found by an earlier stage,
+     * usually the rigid one. The transform is held fixed. The registered image is made
+     * by resampling the original moving image once through both transforms rather than
+     * resampling the output of the earlier stage again.
+     * @param transform Result of the earlier stage. May be empty.
+     */
+    void SetMovingInitialTransform(const TransformParams& transform)
+    {
+        movingInitialTransform_ = transform;
+    }
+
+    /**
+     * Whether registerImage() resamples the moving image with the transform found.
+     * Turn it off when a later stage starts from the original moving image and this
+     * stage's transform, so that a full image resample is not wasted. registerImage()
+     * then returns the moving image unchanged. On by default.
+     * @param resample true to resample the moving image.
+     */
+    void SetResampleResult(bool resample)
+    {
+        resampleResult_ = resample;
+    }
+
+    /**
+     * Create the shrink factors of a multiresolution registration from the spacing of
+     * the image. At each level the pixels along the most finely sampled axis are twice
+     * the size of those of the next finer level. Every other axis is shrunk by the power
+     * of two which brings its pixels nearest that size, so the slices of DCE images,
+     * which are far apart to begin with, are shrunk only at the coarse levels if at all.
+     * Powers of two keep each level a whole shrink of the next finer one.
+     * @param numLevels The number of levels.
+     * @param spacing The spacing of the image.
+     * @return The schedule, one row per level, coarsest first.
+     */
+    static ScheduleType CreateResolutionSchedule(unsigned numLevels,
+                                                 const typename TImage::SpacingType& spacing)
+    {
+        double finest = spacing[0];
+        for (unsigned dim = 1; dim < TImage::ImageDimension; ++dim)
+            finest = std::min(finest, static_cast<double>(spacing[dim]));
+
+        ScheduleType schedule(numLevels, TImage::ImageDimension);
+        for (unsigned level = 0; level < schedule.rows(); ++level)
+        {
+            double factor = std::pow(2.0, static_cast<double>(numLevels - level - 1));
+            for (unsigned dim = 0; dim < schedule.cols(); ++dim)
+            {
+                double ratio = factor * finest / spacing[dim];
+                int power = std::max(itk::Math::Round<int, double>(std::log(ratio) / std::log(2.0)), 0);
+                schedule[level][dim] = itk::Math::Round<itk::SizeValueType,
+                                                    double>(std::pow(2.0, static_cast<double>(power)));
+            }
+        }
+
+        return schedule;
+    }
+
+    /**
+     * The transform found by the last call to registerImage(). Empty if the
+     * registration failed or was cancelled.
+     * @return The final transform.
+     */
+    const TransformParams& GetFinalTransform() const
+    {
+        return finalTransform_;
+    }
+
 protected:
+    typedef itk::Transform<double, TImage::ImageDimension, TImage::ImageDimension> TransformType;
+    typedef itk::BSplineTransform<double, TImage::ImageDimension, BSPLINE_ORDER> BSplineTransformType;
+    typedef itk::MultiResolutionPyramidImageFilter<TImage, TImage> ImagePyramidType;
+
+    /**
+     * Create the fixed image pyramid. With a context its levels are computed once
+     * for the series.
+     * @return The pyramid.
+     */
+    typename ImagePyramidType::Pointer CreateFixedImagePyramid()
+    {
+        typename FixedImagePyramidFilter<TImage>::Pointer pyramid =
+                                        FixedImagePyramidFilter<TImage>::New();
+        pyramid->SetContext(fixedContext_);
+        return pyramid.GetPointer();
+    }
+
+    /**
+     * Create the moving image pyramid. Its levels come from the moving image context
+     * if that was made from this image.
+     * @param movingImage The image the pyramid will be given.
+     * @return The pyramid.
+     */
+    typename ImagePyramidType::Pointer CreateMovingImagePyramid(typename TImage::Pointer movingImage)
+    {
+        typename FixedImagePyramidFilter<TImage>::Pointer pyramid =
+                                        FixedImagePyramidFilter<TImage>::New();
+        if (movingContext_.IsNotNull() && (movingContext_->GetFixedImage() == movingImage))
+            pyramid->SetContext(movingContext_);
+        return pyramid.GetPointer();
+    }
+
+    /**
+     * Create a metric. With a context its fixed image samples, and their B-spline
+     * weights, are worked out once for the series. With an ROI the samples are
+     * drawn only from inside it.
+     * @return The metric.
+     */
+    template <class TMetric>
+    typename TMetric::Pointer CreateMetric()
+    {
+        typedef FixedSampleCachingMetric<TMetric> CachingMetricType;
+        typename CachingMetricType::Pointer metric = CachingMetricType::New();
+        if (fixedContext_.IsNotNull())
+        {
+            metric->SetSampleCache(fixedContext_->GetSampleCache());
+            metric->SetBSplineCache(fixedContext_->GetBSplineValuesCache());
+        }
+        metric->SetRasterMask(GetFixedImageMask());
+        return metric.GetPointer();
+    }
+
+    /**
+     * Get the ROI mask of the fixed image. With a context it is made once for
+     * the series.
+     * @return The mask or null if no ROI was given.
+     */
+    typename FixedImageMask<TImage>::Pointer GetFixedImageMask()
+    {
+        if (itkParams_.fixedImageMask.empty())
+            return 0;
+        else if (fixedContext_.IsNotNull())
+            return fixedContext_->GetMask(itkParams_.fixedImageMask);
+        else
+            return FixedImageMask<TImage>::New(itkParams_.fixedImageMask, fixedImage_);
+    }
+
+    /**
+     * Set up the levels of an ITKv4 registration: the same shrink factors as the v3
+     * pyramids, the smoothing the v3 pyramids apply at each factor and the metric
+     * sampling. The samples are drawn in the virtual domain, which is the fixed image
+     * given to the registration object.
+     * @param registration The ITKv4 registration object.
+     * @param numLevels The number of levels.
+     * @param metricType The metric the registration uses.
+     * @param sampleRate The fraction of the virtual domain to sample at each level, finest first.
+     */
+    template <class TRegistration>
+    void SetUpRegistrationLevelsv4(TRegistration* registration, unsigned numLevels,
+                                   MetricType metricType, const ParamVector<float>& sampleRate)
+    {
+        ScheduleType schedule = CreateResolutionSchedule(numLevels, fixedImage_->GetSpacing());
+
+        typename TRegistration::ShrinkFactorsArrayType shrinkFactors(numLevels);
+        typename TRegistration::SmoothingSigmasArrayType smoothingSigmas(numLevels);
+        typename TRegistration::MetricSamplingPercentageArrayType samplingPercentages(numLevels);
+
+        // The v3 pyramid smooths each axis with a sigma of half its factor in pixels,
+        // which is about half the size of the pixels of the level. Here the sigma is
+        // one number in mm so it is taken from the plane of the slices.
+        typename TImage::SpacingType spacing = fixedImage_->GetSpacing();
+        double pixelSpacing = std::min(spacing[0], spacing[1]);
+
+        bool sampleAll = true;
+        for (unsigned level = 0; level < numLevels; ++level)
+        {
+            shrinkFactors[level] = schedule[level][0];
+            smoothingSigmas[level] = (schedule[level][0] > 1) ?
+                                            0.5 * schedule[level][0] * pixelSpacing : 0.0;
+            samplingPercentages[level] = sampleRate[numLevels - level - 1];
+            if (samplingPercentages[level] < 0.999)
+                sampleAll = false;
+        }
+
+        registration->SetNumberOfLevels(numLevels);
+        registration->SetShrinkFactorsPerLevel(shrinkFactors);
+#if (ITK_VERSION_MAJOR > 4) || (ITK_VERSION_MINOR >= 7)
+        // Shrink each axis by its own factor, as the v3 pyramids do.
+        for (unsigned level = 0; level < numLevels; ++level)
+        {
+            typename TRegistration::ShrinkFactorsPerDimensionContainerType factors;
+            for (unsigned dim = 0; dim < TImage::ImageDimension; ++dim)
+                factors[dim] = schedule[level][dim];
+            registration->SetShrinkFactorsPerDimension(level, factors);
+        }
+#endif
+        registration->SetSmoothingSigmasPerLevel(smoothingSigmas);
+        registration->SetSmoothingSigmasAreSpecifiedInPhysicalUnits(true);
+
+        if ((metricType != MeanSquares) && !sampleAll)
+        {
+            registration->SetMetricSamplingStrategy(TRegistration::RANDOM);
+            registration->SetMetricSamplingPercentagePerLevel(samplingPercentages);
+            registration->MetricSamplingReinitializeSeed(8370276);
+        }
+        else
+        {
+            registration->SetMetricSamplingStrategy(TRegistration::NONE);
+        }
+
+        LOG4CPLUS_DEBUG(logger_, "Shrink factors = " << shrinkFactors);
+        LOG4CPLUS_DEBUG(logger_, "Smoothing sigmas (mm) = " << smoothingSigmas);
+    }
+
+    /**
+     * Copy the part of the fixed image to be registered. Given to an ITKv4 registration
+     * it becomes the virtual domain, so that only the region is sampled. It keeps its
+     * physical position.
+     * @param region The region of the fixed image.
+     * @return The part of the fixed image in the region.
+     */
+    typename TImage::Pointer ExtractFixedRegion(const typename TImage::RegionType& region)
+    {
+        return FixedImageContext<TImage>::CropImage(fixedImage_, region);
+    }
+
+    /**
+     * Replace the initial parameters of a linear transform with those of the warm
+     * start, if one was given.
+     * @param transform The transform set up by its initialiser.
+     * @return true if the warm start was applied.
+     */
+    bool ApplyWarmStart(TransformType* transform)
+    {
+        if (warmStart_.IsEmpty())
+            return false;
+
+        if (warmStart_.parameters.GetSize() != transform->GetNumberOfParameters())
+        {
+            LOG4CPLUS_WARN(logger_, "Warm start transform does not match. Ignored.");
+            return false;
+        }
+
+        if (warmStart_.fixedParameters.GetSize() != 0)
+            transform->SetFixedParameters(warmStart_.fixedParameters);
+        transform->SetParameters(warmStart_.parameters);
+        LOG4CPLUS_DEBUG(logger_, "Warm start params:" << transform->GetParameters());
+
+        return true;
+    }
+
+    /**
+     * Replace the translation of a rigid transform set up by its initialiser with the
+     * one found by phase correlation at the coarsest level of the pyramid, if that is
+     * turned on. The centre and rotation are left alone. The spectrum of the fixed
+     * level comes from the context so it is computed once for the series.
+     * @param transform The transform set up by its initialiser.
+     * @param movingImage The moving image.
+     * @param schedule The shrink factors of the registration.
+     * @return true if the translation was replaced.
+     */
+    template <class TTransform>
+    bool ApplyPhaseCorrelation(TTransform* transform, typename TImage::Pointer movingImage,
+                               const ScheduleType& schedule)
+    {
+        if (!itkParams_.rigidPhaseCorrelation)
+            return false;
+
+        typename FixedImageContext<TImage>::Pointer fixedContext = fixedContext_;
+        if (fixedContext.IsNull())
+            fixedContext = FixedImageContext<TImage>::New(fixedImage_);
+
+        typename FixedImageContext<TImage>::Pointer movingContext = movingContext_;
+        if (movingContext.IsNull() || (movingContext->GetFixedImage() != movingImage))
+            movingContext = FixedImageContext<TImage>::New(movingImage);
+
+        ScheduleType coarsest(1, schedule.cols());
+        coarsest.set_row(0, schedule.get_row(0));
+
+        typename PhaseCorrelation<TImage>::VectorType shift;
+        if (!fixedContext->GetPhaseCorrelation(schedule)->ComputeTranslation(
+                                        movingContext->GetPyramidLevels(coarsest)[0], shift))
+        {
+            LOG4CPLUS_WARN(logger_, "Phase correlation found no clear peak. Initial translation kept.");
+            return false;
+        }
+
+        typename TTransform::OutputVectorType translation;
+        for (unsigned dim = 0; dim < TImage::ImageDimension; ++dim)
+            translation[dim] = shift[dim];
+        transform->SetTranslation(translation);
+        LOG4CPLUS_DEBUG(logger_, "Phase correlation params:" << transform->GetParameters());
+
+        return true;
+    }
+
+    /**
+     * Replace the coefficients of a B-spline transform with those of the warm start,
+     * if one was given. The warm start comes from the finest grid of the previous
+     * registration so it is resampled onto the grid the transform has now.
+     * @param transform The transform set up by its initialiser on the first level grid.
+     * @return true if the warm start was applied.
+     */
+    bool ApplyBSplineWarmStart(BSplineTransformType* transform)
+    {
+        if (warmStart_.IsEmpty())
+            return false;
+
+        typename BSplineTransformType::Pointer previous = BSplineTransformType::New();
+        previous->SetFixedParameters(warmStart_.fixedParameters);
+        if (warmStart_.parameters.GetSize() != previous->GetNumberOfParameters())
+        {
+            LOG4CPLUS_WARN(logger_, "Warm start transform does not match. Ignored.");
+            return false;
+        }
+        previous->SetParameters(warmStart_.parameters);
+
+        typedef itk::BSplineTransformParametersAdaptor<BSplineTransformType> AdaptorType;
+        typename AdaptorType::Pointer adaptor = AdaptorType::New();
+        adaptor->SetTransform(previous);
+        adaptor->SetRequiredTransformDomainOrigin(transform->GetTransformDomainOrigin());
+        adaptor->SetRequiredTransformDomainDirection(transform->GetTransformDomainDirection());
+        adaptor->SetRequiredTransformDomainPhysicalDimensions(
+                                    transform->GetTransformDomainPhysicalDimensions());
+        adaptor->SetRequiredTransformDomainMeshSize(transform->GetTransformDomainMeshSize());
+        adaptor->AdaptTransformParameters();
+
+        // SetParameters() keeps a reference so we must own a copy.
+        warmStartCoefficients_ = previous->GetParameters();
+        transform->SetParameters(warmStartCoefficients_);
+        LOG4CPLUS_DEBUG(logger_, "B-spline transform warm started.");
+
+        return true;
+    }
+
+    /**
+     * Save the final transform so that the caller can retrieve it.
+     * @param transform The transform holding the final parameters.
+     */
+    void SaveFinalTransform(const TransformType* transform)
+    {
+        finalTransform_.fixedParameters = transform->GetFixedParameters();
+        finalTransform_.parameters = transform->GetParameters();
+    }
+
+    /**
+     * Hand the observer of the current registration to the progress receiver so that
+     * the registration may be stopped from there. Several registrations may be running
+     * at once so the observer is registered rather than replacing the previous one.
+     * It is kept alive until this instance is destroyed.
+     * @param observer The observer attached to the registration object.
+     */
+    void SetObserver(RegistrationObserverBase* observer)
+    {
+        observer_ = observer;
+        observer->SetProgress(progress_);
+        progress_->AddObserver(observer);
+    }
+
     log4cplus::Logger logger_;
-    ProgressWindowController* progController_;
+    RegistrationProgress* progress_;
     typename TImage::Pointer fixedImage_;
     ItkRegistrationParams itkParams_;
+    itk::SmartPointer<RegistrationObserverBase> observer_;
+    typename FixedImageContext<TImage>::Pointer fixedContext_;
+    typename FixedImageContext<TImage>::Pointer movingContext_;
+    TransformParams warmStart_;
+    TransformParams movingInitialTransform_;
+    bool resampleResult_;
+    TransformParams finalTransform_;
+    TransformParams::ParametersType warmStartCoefficients_;
 };
 
 #endif /* defined(__DCEFit__RegisterOneImage__) */
@@ -1,5 +1,5 @@
 /*
- * File:   RegisterOneImageBSpline2D.mm
+ * File:   RegisterOneImageBSpline2D.cpp
  * Author: tim
  *
  * Created on January 28, 2013, 12:47 PM
@@ -11,15 +11,14 @@
 #include "RegistrationObserverBSpline.h"
 #include "ParseITKException.h"
 #include "ImageTagger.h"
-
-#import "ProgressWindowController.h"
+#include "SeriesTransforms.h"
 
 #include <log4cplus/loggingmacros.h>
 
 RegisterOneImageBSpline2D::RegisterOneImageBSpline2D(
-    ProgressWindowController* progressController, Image2D::Pointer fixedImage,
+    RegistrationProgress* progress, Image2D::Pointer fixedImage,
     const ItkRegistrationParams& params)
-    : RegisterOneImage<Image2D>(progressController, fixedImage, params)
+    : RegisterOneImage<Image2D>(progress, fixedImage, params)
 {
     std::string name = std::string(LOGGER_NAME) + ".RegisterOneImageBSpline2D";
     logger_ = log4cplus::Logger::getInstance(name);
@@ -39,24 +38,12 @@ Image2D::Pointer RegisterOneImageBSpline2D::registerImage(Image2D::Pointer movin
 
     // Assume the best to start.
     code = SUCCESS;
+    finalTransform_ = TransformParams();
 
     // Set the resolution schedule
-    MultiResRegistrationMethod2D::ScheduleType resolutionSchedule(itkParams_.bsplineLevels, 2u);
-    itk::SizeValueType factor = itk::Math::Round<itk::SizeValueType,
-                double>(std::pow(2.0, static_cast<double>(itkParams_.bsplineLevels - 1)));
-    for (unsigned level = 0; level < resolutionSchedule.rows(); ++level)
-    {
-        for (unsigned dim = 0; dim < resolutionSchedule.cols(); ++dim)
-        {
-            resolutionSchedule[level][dim] = factor;
-            LOG4CPLUS_DEBUG(logger_, "    Resolution schedule: level " << level << ", dim "
-                            << dim << " = " << factor);
-        }
-
-        factor /= 2;
-        if (factor < 1)
-            factor = 1;
-    }
+    MultiResRegistrationMethod2D::ScheduleType resolutionSchedule =
+                            CreateResolutionSchedule(itkParams_.bsplineLevels,
+                                                     fixedImage_->GetSpacing());
 
     LOG4CPLUS_DEBUG(logger_, "Shrink factors = " << resolutionSchedule);
 
@@ -64,8 +51,7 @@ Image2D::Pointer RegisterOneImageBSpline2D::registerImage(Image2D::Pointer movin
     RegistrationObserverBSpline2D::Pointer observer = RegistrationObserverBSpline2D::New();
     observer->SetNumberOfLevels(itkParams_.bsplineLevels);
     observer->SetGridSizeSchedule(itkParams_.bsplineGridSizes);
-    observer->SetProgressWindowController(progController_);
-    [progController_ setObserver:observer];
+    SetObserver(observer);
 
     //
     // Set up the BSplineTransform.
@@ -77,11 +63,19 @@ Image2D::Pointer RegisterOneImageBSpline2D::registerImage(Image2D::Pointer movin
     for (unsigned dim = 0; dim < Image2D::GetImageDimension(); ++dim)
         meshSize[dim] = itkParams_.bsplineGridSizes(0, dim) - BSPLINE_ORDER;
     
-    BSplineTransformInitializer2D::Pointer transformInitializer = BSplineTransformInitializer2D::New();
-    transformInitializer->SetTransform(transform);
-    transformInitializer->SetImage(fixedImage_);
-    transformInitializer->SetTransformDomainMeshSize(meshSize);
-    transformInitializer->InitializeTransform();
+    if (fixedContext_.IsNotNull())
+    {
+        // The grid depends only on the fixed image so it is set up once for the series.
+        transform->SetFixedParameters(fixedContext_->GetBSplineFixedParameters(meshSize));
+    }
+    else
+    {
+        BSplineTransformInitializer2D::Pointer transformInitializer = BSplineTransformInitializer2D::New();
+        transformInitializer->SetTransform(transform);
+        transformInitializer->SetImage(fixedImage_);
+        transformInitializer->SetTransformDomainMeshSize(meshSize);
+        transformInitializer->InitializeTransform();
+    }
     //LOG4CPLUS_DEBUG(logger_, "Initial transform params:" << transform->GetParameters());
 
     const itk::SizeValueType numberOfParameters = transform->GetNumberOfParameters();
@@ -89,6 +83,9 @@ Image2D::Pointer RegisterOneImageBSpline2D::registerImage(Image2D::Pointer movin
     parameters.Fill(0.0);
     transform->SetParameters(parameters);
 
+    // Start from a neighbour's solution if we have one.
+    ApplyBSplineWarmStart(transform);
+
     /*
      * Set up the metric
      * We can set up those things which will not change between levels here and
@@ -96,29 +93,52 @@ Image2D::Pointer RegisterOneImageBSpline2D::registerImage(Image2D::Pointer movin
      */
 
     MMIImageToImageMetric2D::Pointer mmiMetric;
+    FastMMIImageToImageMetric2D::Pointer fastMMIMetric;
+    LNCCImageToImageMetric2D::Pointer lnccMetric;
+    NGFImageToImageMetric2D::Pointer ngfMetric;
     MSImageToImageMetric2D::Pointer msMetric;
     ImageToImageMetric2D::Pointer metric;
     switch (itkParams_.bsplineMetric)
     {
         case MattesMutualInformation:
-            mmiMetric = MMIImageToImageMetric2D::New();
-            mmiMetric->UseExplicitPDFDerivativesOn();  // Best for large number of parameters
+            mmiMetric = CreateMetric<MMIImageToImageMetric2D>();
+            // Without explicit PDF derivatives each sample adds only to the coefficients
+            // of its own B-spline support, in a derivative per thread which is summed at
+            // the end, rather than to a bins x bins x parameters array per thread.
+            mmiMetric->UseExplicitPDFDerivativesOff();  // Best for large number of parameters
             mmiMetric->SetUseCachingOfBSplineWeights(true); // default == true
             mmiMetric->ReinitializeSeed(76926294);
             observer->SetMMISchedules(itkParams_.bsplineMMINumBins, itkParams_.bsplineMMISampleRate);
             metric = mmiMetric;
             break;
+        case FastMattesMutualInformation:
+            fastMMIMetric = CreateMetric<FastMMIImageToImageMetric2D>();
+            fastMMIMetric->ReinitializeSeed(76926294);
+            observer->SetMMISchedules(itkParams_.bsplineMMINumBins, itkParams_.bsplineMMISampleRate);
+            metric = fastMMIMetric;
+            break;
+        case LocalNormalizedCorrelation:
+            // The sample rate of the MMI settings applies; the bins are not used.
+            lnccMetric = CreateMetric<LNCCImageToImageMetric2D>();
+            lnccMetric->ReinitializeSeed(76926294);
+            observer->SetMMISchedules(itkParams_.bsplineMMINumBins, itkParams_.bsplineMMISampleRate);
+            metric = lnccMetric;
+            break;
+        case NormalizedGradientField:
+            ngfMetric = CreateMetric<NGFImageToImageMetric2D>();
+            ngfMetric->ReinitializeSeed(76926294);
+            observer->SetMMISchedules(itkParams_.bsplineMMINumBins, itkParams_.bsplineMMISampleRate);
+            metric = ngfMetric;
+            break;
         case MeanSquares:
-            msMetric = MSImageToImageMetric2D::New();
+            msMetric = CreateMetric<MSImageToImageMetric2D>();
             metric = msMetric;
             break;
         default:
             break;
     }
 
-//    itkParams_.createFixedImageMask(fixedImage_);
-//    if (itkParams_.fixedImageMask.IsNotNull())
-//        metric->SetFixedImageMask(itkParams_.fixedImageMask);
+    // With an ROI the metric draws its samples from inside it only. See CreateMetric().
 
     // Set up the optimizer. We are using the Bspline transform so there is no scaling needed.
     SingleValuedNonLinearOptimizer::Pointer optimizer;
@@ -156,13 +176,20 @@ Image2D::Pointer RegisterOneImageBSpline2D::registerImage(Image2D::Pointer movin
     BSplineInterpolator2D::Pointer interpolator = BSplineInterpolator2D::New();
     interpolator->SetSplineOrder(BSPLINE_ORDER);
 
-    //
+    // With a transform from the rigid stage we register the moving image as seen
+    // through it. The v3 metrics are fast only with a bare B-spline transform so
+    // the image is resampled for the registration rather than using a composite.
+    Image2D::Pointer regMovingImage = movingImage;
+    if (!movingInitialTransform_.IsEmpty())
+        regMovingImage = ResampleWithTransforms<Image2D, CenteredRigid2DTransform>(movingImage,
+                                    fixedImage_, movingInitialTransform_, TransformParams());
+
     // The image pyramids
     // These will be set up by the registration object.
-    ImagePyramid2D::Pointer fixedImagePyramid = ImagePyramid2D::New();
+    ImagePyramid2D::Pointer fixedImagePyramid = CreateFixedImagePyramid();
     fixedImagePyramid->SetNumberOfLevels(itkParams_.bsplineLevels);
 
-    ImagePyramid2D::Pointer movingImagePyramid = ImagePyramid2D::New();
+    ImagePyramid2D::Pointer movingImagePyramid = CreateMovingImagePyramid(regMovingImage);
     movingImagePyramid->SetNumberOfLevels(itkParams_.bsplineLevels);
 
     // Set up the registration
@@ -173,7 +200,7 @@ Image2D::Pointer RegisterOneImageBSpline2D::registerImage(Image2D::Pointer movin
     registration->SetOptimizer(optimizer);
     registration->SetTransform(transform);
     registration->SetFixedImage(fixedImage_);
-    registration->SetMovingImage(movingImage);
+    registration->SetMovingImage(regMovingImage);
     registration->SetFixedImagePyramid(fixedImagePyramid);
     registration->SetMovingImagePyramid(movingImagePyramid);
     registration->SetFixedImageRegion(itkParams_.fixedImageRegion);
@@ -210,6 +237,8 @@ Image2D::Pointer RegisterOneImageBSpline2D::registerImage(Image2D::Pointer movin
         registration->GetLastTransformParameters();
 
     transform->SetParameters(finalParameters);
+    if (code != DISASTER)
+        SaveFinalTransform(transform);
 
     if (itkParams_.deformShowField)
     {
@@ -217,7 +246,13 @@ Image2D::Pointer RegisterOneImageBSpline2D::registerImage(Image2D::Pointer movin
         tagImage(*(movingImage.GetPointer()));
     }
 
+    // One resample of the original image through both transforms.
+    if (!movingInitialTransform_.IsEmpty())
+        return ResampleWithTransforms<Image2D, CenteredRigid2DTransform>(movingImage,
+                                    fixedImage_, movingInitialTransform_, finalTransform_);
+
     ResampleFilter2D::Pointer resampler = ResampleFilter2D::New();
+    resampler->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
     resampler->SetTransform(transform);
     resampler->SetInterpolator(interpolator);
     resampler->SetInput(movingImage);
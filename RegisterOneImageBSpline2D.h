@@ -18,11 +18,11 @@ class RegisterOneImageBSpline2D : public RegisterOneImage<Image2D>
 public:
     /**
      * Constructor.
-     * @param progressController ProgressController for updates and registration mamagement.
+     * @param progress Receives updates and manages the registration. May be 0.
      * @param fixedImage The fixed image.
      * @param params The registration parameters.
      */
-    RegisterOneImageBSpline2D(ProgressWindowController* progressController,
+    RegisterOneImageBSpline2D(RegistrationProgress* progress,
                 Image2D::Pointer fixedImage, const ItkRegistrationParams& params);
 
     /**
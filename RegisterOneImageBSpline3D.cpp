@@ -1,5 +1,5 @@
 /*
- * File:   RegisterOneImageBSpline3D.mm
+ * File:   RegisterOneImageBSpline3D.cpp
  * Author: tim
  *
  * Created on January 28, 2013, 12:47 PM
@@ -11,15 +11,14 @@
 #include "RegistrationObserverBSpline.h"
 #include "ParseITKException.h"
 #include "ImageTagger.h"
-
-#import "ProgressWindowController.h"
+#include "SeriesTransforms.h"
 
 #include <log4cplus/loggingmacros.h>
 
 RegisterOneImageBSpline3D::RegisterOneImageBSpline3D(
-    ProgressWindowController* progressController, Image3D::Pointer fixedImage,
+    RegistrationProgress* progress, Image3D::Pointer fixedImage,
     const ItkRegistrationParams& params)
-    : RegisterOneImage<Image3D>(progressController, fixedImage, params)
+    : RegisterOneImage<Image3D>(progress, fixedImage, params)
 {
     std::string name = std::string(LOGGER_NAME) + ".RegisterOneImageBSpline3D";
     logger_ = log4cplus::Logger::getInstance(name);
@@ -39,29 +38,12 @@ Image3D::Pointer RegisterOneImageBSpline3D::registerImage(Image3D::Pointer movin
 
     // Assume the best to start.
     code = SUCCESS;
+    finalTransform_ = TransformParams();
     
     // Set the resolution schedule
-    // We use reduced resolution in the plane of the slices but not in the other dimension
-    // because it is small to begin with in DCE images.
-    MultiResRegistrationMethod3D::ScheduleType resolutionSchedule(itkParams_.bsplineLevels, Image3D::ImageDimension);
-    itk::SizeValueType factor = itk::Math::Round<itk::SizeValueType,
-                double>(std::pow(2.0, static_cast<double>(itkParams_.bsplineLevels - 1)));
-    for (unsigned level = 0; level < resolutionSchedule.rows(); ++level)
-    {
-        for (unsigned dim = 0; dim < resolutionSchedule.cols(); ++dim)
-        {
-            if (dim == 2)
-                resolutionSchedule[level][dim] = 1;
-            else
-                resolutionSchedule[level][dim] = factor;
-            LOG4CPLUS_DEBUG(logger_, "    Resolution schedule: level " << level << ", dim "
-                            << dim << " = " << factor);
-        }
-
-        factor /= 2;
-        if (factor < 1)
-            factor = 1;
-    }
+    MultiResRegistrationMethod3D::ScheduleType resolutionSchedule =
+                            CreateResolutionSchedule(itkParams_.bsplineLevels,
+                                                     fixedImage_->GetSpacing());
 
     LOG4CPLUS_DEBUG(logger_, "Shrink factors = " << resolutionSchedule);
 
@@ -69,8 +51,7 @@ Image3D::Pointer RegisterOneImageBSpline3D::registerImage(Image3D::Pointer movin
     RegistrationObserverBSpline<Image3D>::Pointer observer = RegistrationObserverBSpline<Image3D>::New();
     observer->SetNumberOfLevels(itkParams_.bsplineLevels);
     observer->SetGridSizeSchedule(itkParams_.bsplineGridSizes);
-    observer->SetProgressWindowController(progController_);
-    [progController_ setObserver:observer];
+    SetObserver(observer);
 
     //
     // Set up the BSplineTransform.
@@ -82,11 +63,19 @@ Image3D::Pointer RegisterOneImageBSpline3D::registerImage(Image3D::Pointer movin
     for (unsigned dim = 0; dim < Image3D::ImageDimension; ++dim)
         meshSize[dim] = itkParams_.bsplineGridSizes(0, dim) - BSPLINE_ORDER;
 
-    BSplineTransformInitializer3D::Pointer transformInitializer = BSplineTransformInitializer3D::New();
-    transformInitializer->SetTransform(transform);
-    transformInitializer->SetImage(fixedImage_);
-    transformInitializer->SetTransformDomainMeshSize(meshSize);
-    transformInitializer->InitializeTransform();
+    if (fixedContext_.IsNotNull())
+    {
+        // The grid depends only on the fixed image so it is set up once for the series.
+        transform->SetFixedParameters(fixedContext_->GetBSplineFixedParameters(meshSize));
+    }
+    else
+    {
+        BSplineTransformInitializer3D::Pointer transformInitializer = BSplineTransformInitializer3D::New();
+        transformInitializer->SetTransform(transform);
+        transformInitializer->SetImage(fixedImage_);
+        transformInitializer->SetTransformDomainMeshSize(meshSize);
+        transformInitializer->InitializeTransform();
+    }
     //LOG4CPLUS_DEBUG(logger_, "Initial transform params:" << transform->GetParameters());
 
     const itk::SizeValueType numberOfParameters = transform->GetNumberOfParameters();
@@ -94,35 +83,61 @@ Image3D::Pointer RegisterOneImageBSpline3D::registerImage(Image3D::Pointer movin
     parameters.Fill(0.0);
     transform->SetParameters(parameters);
 
+    // Start from a neighbour's solution if we have one.
+    ApplyBSplineWarmStart(transform);
+
     /*
      * Set up the metric
      * We can set up those things which will not change between levels here and
      * leave the rest for the first IterationEvent in the observer.
      */
     MMIImageToImageMetric3D::Pointer mmiMetric;
+    FastMMIImageToImageMetric3D::Pointer fastMMIMetric;
+    LNCCImageToImageMetric3D::Pointer lnccMetric;
+    NGFImageToImageMetric3D::Pointer ngfMetric;
     MSImageToImageMetric3D::Pointer msMetric;
     ImageToImageMetric3D::Pointer metric;
     switch (itkParams_.bsplineMetric)
     {
         case MattesMutualInformation:
-            mmiMetric = MMIImageToImageMetric3D::New();
-            mmiMetric->UseExplicitPDFDerivativesOn();  // Best for large number of parameters
+            mmiMetric = CreateMetric<MMIImageToImageMetric3D>();
+            // Without explicit PDF derivatives each sample adds only to the coefficients
+            // of its own B-spline support, in a derivative per thread which is summed at
+            // the end, rather than to a bins x bins x parameters array per thread.
+            mmiMetric->UseExplicitPDFDerivativesOff();  // Best for large number of parameters
             mmiMetric->SetUseCachingOfBSplineWeights(true); // default == true
             mmiMetric->ReinitializeSeed(76926294);
             observer->SetMMISchedules(itkParams_.bsplineMMINumBins, itkParams_.bsplineMMISampleRate);
             metric = mmiMetric;
             break;
+        case FastMattesMutualInformation:
+            fastMMIMetric = CreateMetric<FastMMIImageToImageMetric3D>();
+            fastMMIMetric->ReinitializeSeed(76926294);
+            observer->SetMMISchedules(itkParams_.bsplineMMINumBins, itkParams_.bsplineMMISampleRate);
+            metric = fastMMIMetric;
+            break;
+        case LocalNormalizedCorrelation:
+            // The sample rate of the MMI settings applies; the bins are not used.
+            lnccMetric = CreateMetric<LNCCImageToImageMetric3D>();
+            lnccMetric->ReinitializeSeed(76926294);
+            observer->SetMMISchedules(itkParams_.bsplineMMINumBins, itkParams_.bsplineMMISampleRate);
+            metric = lnccMetric;
+            break;
+        case NormalizedGradientField:
+            ngfMetric = CreateMetric<NGFImageToImageMetric3D>();
+            ngfMetric->ReinitializeSeed(76926294);
+            observer->SetMMISchedules(itkParams_.bsplineMMINumBins, itkParams_.bsplineMMISampleRate);
+            metric = ngfMetric;
+            break;
         case MeanSquares:
-            msMetric = MSImageToImageMetric3D::New();
+            msMetric = CreateMetric<MSImageToImageMetric3D>();
             metric = msMetric;
             break;
         default:
             break;
     }
 
-//    itkParams_.createFixedImageMask(fixedImage_);
-//    if (itkParams_.fixedImageMask.IsNotNull())
-//        metric->SetFixedImageMask(itkParams_.fixedImageMask);
+    // With an ROI the metric draws its samples from inside it only. See CreateMetric().
 
     // Set up the optimizer. We are using the Bspline transform so there is no scaling needed.
     SingleValuedNonLinearOptimizer::Pointer optimizer;
@@ -165,12 +180,20 @@ Image3D::Pointer RegisterOneImageBSpline3D::registerImage(Image3D::Pointer movin
     //BSplineInterpolator3D::Pointer interpolator = BSplineInterpolator3D::New();
     //interpolator->SetSplineOrder(BSPLINE_ORDER);
 
+    // With a transform from the rigid stage we register the moving image as seen
+    // through it. The v3 metrics are fast only with a bare B-spline transform so
+    // the image is resampled for the registration rather than using a composite.
+    Image3D::Pointer regMovingImage = movingImage;
+    if (!movingInitialTransform_.IsEmpty())
+        regMovingImage = ResampleWithTransforms<Image3D, VersorTransform3D>(movingImage,
+                                    fixedImage_, movingInitialTransform_, TransformParams());
+
     // The image pyramids
     // These will be set up by the registration object.
-    ImagePyramid3D::Pointer fixedImagePyramid = ImagePyramid3D::New();
+    ImagePyramid3D::Pointer fixedImagePyramid = CreateFixedImagePyramid();
     fixedImagePyramid->SetNumberOfLevels(itkParams_.bsplineLevels);
 
-    ImagePyramid3D::Pointer movingImagePyramid = ImagePyramid3D::New();
+    ImagePyramid3D::Pointer movingImagePyramid = CreateMovingImagePyramid(regMovingImage);
     movingImagePyramid->SetNumberOfLevels(itkParams_.bsplineLevels);
 
     // Set up the registration
@@ -184,7 +207,7 @@ Image3D::Pointer RegisterOneImageBSpline3D::registerImage(Image3D::Pointer movin
     registration->SetOptimizer(optimizer);
     registration->SetTransform(transform);
     registration->SetFixedImage(fixedImage_);
-    registration->SetMovingImage(movingImage);
+    registration->SetMovingImage(regMovingImage);
     registration->SetFixedImagePyramid(fixedImagePyramid);
     registration->SetMovingImagePyramid(movingImagePyramid);
     registration->SetFixedImageRegion(regRegion);
@@ -221,6 +244,8 @@ Image3D::Pointer RegisterOneImageBSpline3D::registerImage(Image3D::Pointer movin
         registration->GetLastTransformParameters();
 
     transform->SetParameters(finalParameters);
+    if (code != DISASTER)
+        SaveFinalTransform(transform);
 
     if (itkParams_.deformShowField)
     {
@@ -228,7 +253,13 @@ Image3D::Pointer RegisterOneImageBSpline3D::registerImage(Image3D::Pointer movin
         tagImage(*(movingImage.GetPointer()));
     }
 
+    // One resample of the original image through both transforms.
+    if (!movingInitialTransform_.IsEmpty())
+        return ResampleWithTransforms<Image3D, VersorTransform3D>(movingImage, fixedImage_,
+                                                movingInitialTransform_, finalTransform_);
+
     ResampleFilter3D::Pointer resampler = ResampleFilter3D::New();
+    resampler->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
     resampler->SetTransform(transform);
     resampler->SetInterpolator(interpolator);
     resampler->SetInput(movingImage);
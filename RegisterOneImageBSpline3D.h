@@ -18,11 +18,11 @@ class RegisterOneImageBSpline3D : public RegisterOneImage<Image3D>
   public:
     /**
      * Constructor.
-     * @param progressController ProgressController for updates and registration mamagement.
+     * @param progress Receives updates and manages the registration. May be 0.
      * @param fixedImage The fixed image.
      * @param params The registration parameters.
      */
-    RegisterOneImageBSpline3D(ProgressWindowController* progressController,
+    RegisterOneImageBSpline3D(RegistrationProgress* progress,
                 Image3D::Pointer fixedImage, const ItkRegistrationParams& params);
 
     /**
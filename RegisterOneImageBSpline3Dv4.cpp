@@ -0,0 +1,275 @@
+/*
+ * File:   RegisterOneImageBSpline3Dv4.cpp
+ * Author: tim
+ *
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#include "RegisterOneImageBSpline3Dv4.h"
+#include "ItkTypedefs.h"
+#include "RegistrationObserverv4.h"
+#include "ParseITKException.h"
+#include "ImageTagger.h"
+#include "SeriesTransforms.h"
+
+#include <itkBSplineTransformParametersAdaptor.h>
+
+#include <log4cplus/loggingmacros.h>
+
+RegisterOneImageBSpline3Dv4::RegisterOneImageBSpline3Dv4(
+    RegistrationProgress* progress, Image3D::Pointer fixedImage,
+    const ItkRegistrationParams& params)
+    : RegisterOneImage<Image3D>(progress, fixedImage, params)
+{
+    std::string name = std::string(LOGGER_NAME) + ".RegisterOneImageBSpline3Dv4";
+    logger_ = log4cplus::Logger::getInstance(name);
+    LOG4CPLUS_TRACE(logger_, "");
+
+    // don't do anything if this is turned off
+    if (itkParams_.bsplineLevels == 0)
+    {
+        LOG4CPLUS_FATAL(logger_, "B-spline deformable registration levels == 0.");
+        throw itk::InvalidArgumentError();
+    }
+}
+
+Image3D::Pointer RegisterOneImageBSpline3Dv4::registerImage(Image3D::Pointer movingImage, ResultCode& code)
+{
+    LOG4CPLUS_TRACE(logger_, "Enter");
+
+    // Assume the best to start.
+    code = SUCCESS;
+    finalTransform_ = TransformParams();
+
+    unsigned numLevels = itkParams_.bsplineLevels;
+
+    // Set up the observer
+    typedef RegistrationObserverv4<BSplineRegistrationMethod3Dv4> ObserverType;
+    ObserverType::Pointer observer = ObserverType::New();
+    observer->SetNumberOfLevels(numLevels);
+    observer->SetStageName("Deformable");
+    SetObserver(observer);
+
+    //
+    // Set up the BSplineTransform on the grid of the coarsest level. The grids of
+    // the other levels are made by the registration object with the adaptors below.
+    BSplineTransform3D::Pointer transform = BSplineTransform3D::New();
+    BSplineTransform3D::MeshSizeType meshSize;
+    for (unsigned dim = 0; dim < Image3D::ImageDimension; ++dim)
+        meshSize[dim] = itkParams_.bsplineGridSizes(numLevels - 1, dim) - BSPLINE_ORDER;
+
+    if (fixedContext_.IsNotNull())
+    {
+        // The grid depends only on the fixed image so it is set up once for the series.
+        transform->SetFixedParameters(fixedContext_->GetBSplineFixedParameters(meshSize));
+    }
+    else
+    {
+        BSplineTransformInitializer3D::Pointer transformInitializer = BSplineTransformInitializer3D::New();
+        transformInitializer->SetTransform(transform);
+        transformInitializer->SetImage(fixedImage_);
+        transformInitializer->SetTransformDomainMeshSize(meshSize);
+        transformInitializer->InitializeTransform();
+    }
+
+    BSplineTransform3D::ParametersType parameters(transform->GetNumberOfParameters());
+    parameters.Fill(0.0);
+    transform->SetParameters(parameters);
+
+    // Start from a neighbour's solution if we have one.
+    ApplyBSplineWarmStart(transform);
+
+    typedef itk::BSplineTransformParametersAdaptor<BSplineTransform3D> TransformAdaptorType;
+    BSplineRegistrationMethod3Dv4::TransformParametersAdaptorsContainerType adaptors;
+    for (unsigned level = 0; level < numLevels; ++level)
+    {
+        BSplineTransform3D::MeshSizeType levelMeshSize;
+        for (unsigned dim = 0; dim < Image3D::ImageDimension; ++dim)
+            levelMeshSize[dim] = itkParams_.bsplineGridSizes(numLevels - level - 1, dim) - BSPLINE_ORDER;
+
+        TransformAdaptorType::Pointer adaptor = TransformAdaptorType::New();
+        adaptor->SetTransform(transform);
+        adaptor->SetRequiredTransformDomainOrigin(transform->GetTransformDomainOrigin());
+        adaptor->SetRequiredTransformDomainDirection(transform->GetTransformDomainDirection());
+        adaptor->SetRequiredTransformDomainPhysicalDimensions(
+                                            transform->GetTransformDomainPhysicalDimensions());
+        adaptor->SetRequiredTransformDomainMeshSize(levelMeshSize);
+        adaptors.push_back(adaptor.GetPointer());
+    }
+
+    /*
+     * Set up the metric
+     * The number of bins is set by the observer at each level. The v4 metrics
+     * use as many threads as they are given.
+     */
+    MMIImageToImageMetric3Dv4::Pointer mmiMetric;
+    MSImageToImageMetric3Dv4::Pointer msMetric;
+    ImageToImageMetric3Dv4::Pointer metric;
+    switch (itkParams_.bsplineMetric)
+    {
+        case FastMattesMutualInformation:
+        case LocalNormalizedCorrelation:
+        case NormalizedGradientField:
+            LOG4CPLUS_WARN(logger_, "Metric " << itkParams_.bsplineMetric
+                           << " is not available with the ITKv4 engine. Using Mattes MI.");
+            // Fall through.
+        case MattesMutualInformation:
+            mmiMetric = MMIImageToImageMetric3Dv4::New();
+            mmiMetric->SetNumberOfHistogramBins(itkParams_.bsplineMMINumBins[numLevels - 1]);
+            observer->SetMMISchedules(itkParams_.bsplineMMINumBins);
+            metric = mmiMetric;
+            break;
+        case MeanSquares:
+            msMetric = MSImageToImageMetric3Dv4::New();
+            metric = msMetric;
+            break;
+        default:
+            break;
+    }
+
+    // Set up the optimizer. There is no v4 version of the LBFGS optimiser that
+    // accepts bounds so LBFGSB is used in its place.
+    OptimizerBasev4::Pointer optimizer;
+    RSGDOptimizerv4::Pointer rsgdOptimizer;
+    LBFGSBOptimizerv4::Pointer lbfgsbOptimizer;
+    switch (itkParams_.bsplineOptimiser)
+    {
+        case LBFGS:
+            LOG4CPLUS_WARN(logger_, "LBFGS is not available with the ITKv4 engine. Using LBFGSB.");
+            // Fall through.
+        case LBFGSB:
+            lbfgsbOptimizer = LBFGSBOptimizerv4::New();
+            lbfgsbOptimizer->SetMaximumNumberOfCorrections(100);
+            observer->SetLBFGSBSchedules(itkParams_.bsplineLBFGSBCostConvergence,
+                                         itkParams_.bsplineLBFGSBGradientTolerance,
+                                         itkParams_.bsplineMaxIter);
+            optimizer = lbfgsbOptimizer;
+            break;
+        case RSGD:
+            rsgdOptimizer = RSGDOptimizerv4::New();
+            rsgdOptimizer->SetGradientMagnitudeTolerance(1e-4);
+            observer->SetRSGDSchedules(itkParams_.bsplineRSGDMinStepSize,
+                                       itkParams_.bsplineRSGDMaxStepSize,
+                                       itkParams_.bsplineRSGDRelaxationFactor,
+                                       itkParams_.bsplineMaxIter);
+            optimizer = rsgdOptimizer;
+            break;
+        default:
+            LOG4CPLUS_FATAL(logger_, "B-spline registration optimiser "
+                            << itkParams_.bsplineOptimiser << " is invalid.");
+            throw itk::InvalidArgumentError();
+    }
+
+    optimizer->AddObserver(itk::IterationEvent(), observer);
+
+    // Set up the registration
+    // The 3D region based upon the 2D region in the slice plane becomes the virtual
+    // domain so that only it is sampled.
+    Image3D::RegionType reg = fixedImage_->GetLargestPossibleRegion();
+    Image3D::RegionType regRegion = Create3DRegion(itkParams_.fixedImageRegion, reg.GetSize(2u));
+    Image3D::Pointer regFixedImage = ExtractFixedRegion(regRegion);
+
+    // The v4 metrics test each point against a mask so the ROI is given to them as
+    // a rasterized image, where the test is a pixel lookup.
+    FixedImageMask3D::Pointer mask = GetFixedImageMask();
+    if (mask.IsNotNull())
+        metric->SetFixedImageMask(mask->CreateSpatialObject(regFixedImage,
+                                                regFixedImage->GetLargestPossibleRegion()));
+
+    BSplineRegistrationMethod3Dv4::Pointer registration = BSplineRegistrationMethod3Dv4::New();
+    registration->AddObserver(itk::MultiResolutionIterationEvent(), observer);
+    registration->SetMetric(metric);
+    registration->SetOptimizer(optimizer);
+    registration->SetFixedImage(regFixedImage);
+    registration->SetMovingImage(movingImage);
+    registration->SetInitialTransform(transform);
+    registration->InPlaceOn();
+
+    // The rigid transform goes into the registration's composite transform as a
+    // fixed one so the metric sees the original moving image through both.
+    VersorTransform3D::Pointer rigidTransform;
+    if (!movingInitialTransform_.IsEmpty())
+    {
+        rigidTransform = VersorTransform3D::New();
+        if (movingInitialTransform_.fixedParameters.GetSize() != 0)
+            rigidTransform->SetFixedParameters(movingInitialTransform_.fixedParameters);
+        rigidTransform->SetParameters(movingInitialTransform_.parameters);
+        registration->SetMovingInitialTransform(rigidTransform);
+    }
+    SetUpRegistrationLevelsv4(registration.GetPointer(), numLevels,
+                              itkParams_.bsplineMetric, itkParams_.bsplineMMISampleRate);
+    registration->SetTransformParametersAdaptorsPerLevel(adaptors);
+
+    try
+    {
+        registration->Update();
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        code = DISASTER;
+        LOG4CPLUS_ERROR(logger_, "Severe error in registration. " << ParseITKException(err));
+    }
+
+    std::string stopCondition;
+    if (observer->RegistrationWasCancelled())
+    {
+        stopCondition = "Registration cancelled by user.";
+        return movingImage;
+    }
+
+    stopCondition = optimizer->GetStopConditionDescription();
+    progress_->SetStopCondition(stopCondition);
+
+    LOG4CPLUS_INFO(logger_, "Optimizer stop condition = " << stopCondition);
+    LOG4CPLUS_INFO(logger_, "Optimizer best metric = " << std::scientific
+                   << std::setprecision(6) << optimizer->GetValue());
+
+    // The registration optimised the transform in place, finishing on the finest grid.
+    if (code != DISASTER)
+        SaveFinalTransform(transform);
+
+    if (itkParams_.deformShowField)
+    {
+        ImageTagger<Image3D> tagImage(10);
+        tagImage(*(movingImage.GetPointer()));
+    }
+
+    // One resample of the original image through both transforms.
+    if (!movingInitialTransform_.IsEmpty())
+        return ResampleWithTransforms<Image3D, VersorTransform3D>(movingImage, fixedImage_,
+                                                movingInitialTransform_, finalTransform_);
+
+    LinearInterpolator3D::Pointer interpolator = LinearInterpolator3D::New();
+
+    ResampleFilter3D::Pointer resampler = ResampleFilter3D::New();
+    resampler->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+    resampler->SetTransform(transform);
+    resampler->SetInterpolator(interpolator);
+    resampler->SetInput(movingImage);
+    resampler->SetSize(fixedImage_->GetLargestPossibleRegion().GetSize());
+    resampler->SetOutputOrigin(fixedImage_->GetOrigin());
+    resampler->SetOutputSpacing(fixedImage_->GetSpacing());
+    resampler->SetOutputDirection(fixedImage_->GetDirection());
+    resampler->SetDefaultPixelValue(0.0);
+    resampler->Update();
+
+    Image3D::Pointer result = resampler->GetOutput();
+
+    return result;
+}
+
+Image3D::RegionType RegisterOneImageBSpline3Dv4::Create3DRegion(const Image2D::RegionType& region2D,
+                                                                unsigned numSlices)
+{
+    Image3D::RegionType region;
+
+    for (unsigned idx = 0; idx < 2u; ++idx)
+    {
+        region.SetIndex(idx, region2D.GetIndex(idx));
+        region.SetSize(idx, region2D.GetSize(idx));
+    }
+    region.SetIndex(2u, 0);
+    region.SetSize(2u, numSlices);
+
+    return region;
+}
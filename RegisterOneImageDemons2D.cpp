@@ -1,5 +1,5 @@
 /*
- * File:   RegisterOneImageDemons2D.mm
+ * File:   RegisterOneImageDemons2D.cpp
  * Author: tim
  *
  * Created on January 28, 2013, 12:47 PM
@@ -12,14 +12,12 @@
 #include "ParseITKException.h"
 #include "ImageTagger.h"
 
-#import "ProgressWindowController.h"
-
 #include <log4cplus/loggingmacros.h>
 
 RegisterOneImageDemons2D::RegisterOneImageDemons2D(
-    ProgressWindowController* progressController, Image2D::Pointer fixedImage,
+    RegistrationProgress* progress, Image2D::Pointer fixedImage,
     const ItkRegistrationParams& params)
-    : RegisterOneImage<Image2D>(progressController, fixedImage, params)
+    : RegisterOneImage<Image2D>(progress, fixedImage, params)
 {
     std::string name = std::string(LOGGER_NAME) + ".RegisterOneImageDemons2D";
     logger_ = log4cplus::Logger::getInstance(name);
@@ -39,6 +37,7 @@ Image2D::Pointer RegisterOneImageDemons2D::registerImage(Image2D::Pointer moving
 
     // Assume the best to start.
     code = SUCCESS;
+    displacementField_ = 0;
 
     // Set up the observer
     typedef RegistrationObserverDemons<Image2D, DemonsDisplacementField2D> ObserverType;
@@ -46,11 +45,11 @@ Image2D::Pointer RegisterOneImageDemons2D::registerImage(Image2D::Pointer moving
     observer->SetNumberOfLevels(itkParams_.demonsLevels);
     observer->SetOptimizerSchedule(itkParams_.demonsMaxRMSError);
     observer->SetIterationSchedule(itkParams_.demonsMaxIter);
-    observer->SetProgressWindowController(progController_);
-    [progController_ setObserver:observer];
+    SetObserver(observer);
 
     // Match the histograms between source and target
     MatchingFilterType2D::Pointer matcher = MatchingFilterType2D::New();
+    matcher->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
     matcher->SetInput(movingImage);
     matcher->SetReferenceImage(fixedImage_);
     matcher->SetNumberOfHistogramLevels(itkParams_.demonsHistogramBins);
@@ -63,8 +62,13 @@ Image2D::Pointer RegisterOneImageDemons2D::registerImage(Image2D::Pointer moving
     filter->AddObserver(itk::IterationEvent(), observer);
     observer->SetRegistrationFilter(filter);
 
+    // The fixed pyramid keeps the default schedule of the Demons registration but
+    // takes its levels from the context, where they are shared with the other
+    // stages where the shrink factors match. The moving pyramid is built the same way.
     DemonsMultiResRegistration2D::Pointer multires = DemonsMultiResRegistration2D::New();
     multires->SetRegistrationFilter(filter);
+    multires->SetFixedImagePyramid(CreateFixedImagePyramid());
+    multires->SetMovingImagePyramid(CreateMovingImagePyramid(matcher->GetOutput()));
     multires->SetNumberOfLevels(itkParams_.demonsLevels);
     multires->SetFixedImage(fixedImage_);
     multires->SetMovingImage(matcher->GetOutput());
@@ -107,6 +111,7 @@ Image2D::Pointer RegisterOneImageDemons2D::registerImage(Image2D::Pointer moving
     }
     // compute the output (warped) image
     DemonsWarper2D::Pointer warper = DemonsWarper2D::New();
+    warper->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
     LinearInterpolator2D::Pointer interpolator = LinearInterpolator2D::New();
 
     warper->SetInput(movingImage);
@@ -122,10 +127,7 @@ Image2D::Pointer RegisterOneImageDemons2D::registerImage(Image2D::Pointer moving
         tagImage(*(movingImage.GetPointer()));
     }
 
-
-//    itkParams_.createFixedImageMask(fixedImage_);
-//    if (itkParams_.fixedImageMask.IsNotNull())
-//        metric->SetFixedImageMask(itkParams_.fixedImageMask);
+    // The Demons filters take no mask so the ROI does not apply here.
 
     try
     {
@@ -139,5 +141,11 @@ Image2D::Pointer RegisterOneImageDemons2D::registerImage(Image2D::Pointer moving
 
     Image2D::Pointer result = warper->GetOutput();
 
+    if (code != DISASTER)
+    {
+        displacementField_ = multires->GetOutput();
+        displacementField_->DisconnectPipeline();
+    }
+
     return result;
 }
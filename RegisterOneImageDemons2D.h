@@ -18,11 +18,11 @@ class RegisterOneImageDemons2D : public RegisterOneImage<Image2D>
 public:
     /**
      * Constructor.
-     * @param progressController ProgressController for updates and registration mamagement.
+     * @param progress Receives updates and manages the registration. May be 0.
      * @param fixedImage The fixed image.
      * @param params The registration parameters.
      */
-    RegisterOneImageDemons2D(ProgressWindowController* progressController,
+    RegisterOneImageDemons2D(RegistrationProgress* progress,
                 Image2D::Pointer fixedImage, const ItkRegistrationParams& params);
 
     /**
@@ -31,6 +31,19 @@ public:
      * @return The registered moving image.
      */
     virtual Image2D::Pointer registerImage(Image2D::Pointer movingImage, ResultCode& code);
+
+    /**
+     * The displacement field found by the last call to registerImage(). Null if the
+     * registration failed or was cancelled.
+     * @return The displacement field.
+     */
+    DemonsDisplacementField2D::Pointer GetDisplacementField() const
+    {
+        return displacementField_;
+    }
+
+private:
+    DemonsDisplacementField2D::Pointer displacementField_;
 };
 
 #endif	/* RegisterOneImageDemons2D_H */
@@ -1,5 +1,5 @@
 /*
- * File:   RegisterOneImageDemons3D.mm
+ * File:   RegisterOneImageDemons3D.cpp
  * Author: tim
  *
  * Created on January 28, 2013, 12:47 PM
@@ -12,14 +12,12 @@
 #include "ParseITKException.h"
 #include "ImageTagger.h"
 
-#import "ProgressWindowController.h"
-
 #include <log4cplus/loggingmacros.h>
 
 RegisterOneImageDemons3D::RegisterOneImageDemons3D(
-    ProgressWindowController* progressController, Image3D::Pointer fixedImage,
+    RegistrationProgress* progress, Image3D::Pointer fixedImage,
     const ItkRegistrationParams& params)
-    : RegisterOneImage<Image3D>(progressController, fixedImage, params)
+    : RegisterOneImage<Image3D>(progress, fixedImage, params)
 {
     std::string name = std::string(LOGGER_NAME) + ".RegisterOneImageDemons3D";
     logger_ = log4cplus::Logger::getInstance(name);
@@ -39,6 +37,7 @@ Image3D::Pointer RegisterOneImageDemons3D::registerImage(Image3D::Pointer moving
 
     // Assume the best to start.
     code = SUCCESS;
+    displacementField_ = 0;
 
     // Set up the observer
     typedef RegistrationObserverDemons<Image3D, DemonsDisplacementField3D> ObserverType;
@@ -46,11 +45,11 @@ Image3D::Pointer RegisterOneImageDemons3D::registerImage(Image3D::Pointer moving
     observer->SetNumberOfLevels(itkParams_.demonsLevels);
     observer->SetOptimizerSchedule(itkParams_.demonsMaxRMSError);
     observer->SetIterationSchedule(itkParams_.demonsMaxIter);
-    observer->SetProgressWindowController(progController_);
-    [progController_ setObserver:observer];
+    SetObserver(observer);
 
     // Match the histograms between source and target
     MatchingFilterType3D::Pointer matcher = MatchingFilterType3D::New();
+    matcher->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
     matcher->SetInput(movingImage);
     matcher->SetReferenceImage(fixedImage_);
     matcher->SetNumberOfHistogramLevels(itkParams_.demonsHistogramBins);
@@ -63,8 +62,13 @@ Image3D::Pointer RegisterOneImageDemons3D::registerImage(Image3D::Pointer moving
     filter->AddObserver(itk::IterationEvent(), observer);
     observer->SetRegistrationFilter(filter);
 
+    // The fixed pyramid keeps the default schedule of the Demons registration but
+    // takes its levels from the context, where they are shared with the other
+    // stages where the shrink factors match. The moving pyramid is built the same way.
     DemonsMultiResRegistration3D::Pointer multires = DemonsMultiResRegistration3D::New();
     multires->SetRegistrationFilter(filter);
+    multires->SetFixedImagePyramid(CreateFixedImagePyramid());
+    multires->SetMovingImagePyramid(CreateMovingImagePyramid(matcher->GetOutput()));
     multires->SetNumberOfLevels(itkParams_.demonsLevels);
     multires->SetFixedImage(fixedImage_);
     multires->SetMovingImage(matcher->GetOutput());
@@ -107,6 +111,7 @@ Image3D::Pointer RegisterOneImageDemons3D::registerImage(Image3D::Pointer moving
     }
     // compute the output (warped) image
     DemonsWarper3D::Pointer warper = DemonsWarper3D::New();
+    warper->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
     LinearInterpolator3D::Pointer interpolator = LinearInterpolator3D::New();
 
     warper->SetInput(movingImage);
@@ -122,10 +127,7 @@ Image3D::Pointer RegisterOneImageDemons3D::registerImage(Image3D::Pointer moving
         tagImage(*(movingImage.GetPointer()));
     }
 
-
-//    itkParams_.createFixedImageMask(fixedImage_);
-//    if (itkParams_.fixedImageMask.IsNotNull())
-//        metric->SetFixedImageMask(itkParams_.fixedImageMask);
+    // The Demons filters take no mask so the ROI does not apply here.
 
     try
     {
@@ -140,5 +142,11 @@ Image3D::Pointer RegisterOneImageDemons3D::registerImage(Image3D::Pointer moving
 
     Image3D::Pointer result = warper->GetOutput();
 
+    if (code != DISASTER)
+    {
+        displacementField_ = multires->GetOutput();
+        displacementField_->DisconnectPipeline();
+    }
+
     return result;
 }
@@ -18,11 +18,11 @@ class RegisterOneImageDemons3D : public RegisterOneImage<Image3D>
 public:
     /**
      * Constructor.
-     * @param progressController ProgressController for updates and registration mamagement.
+     * @param progress Receives updates and manages the registration. May be 0.
      * @param fixedImage The fixed image.
      * @param params The registration parameters.
      */
-    RegisterOneImageDemons3D(ProgressWindowController* progressController,
+    RegisterOneImageDemons3D(RegistrationProgress* progress,
                 Image3D::Pointer fixedImage, const ItkRegistrationParams& params);
 
     /**
@@ -31,6 +31,19 @@ public:
      * @return The registered moving image.
      */
     virtual Image3D::Pointer registerImage(Image3D::Pointer movingImage, ResultCode& code);
+
+    /**
+     * The displacement field found by the last call to registerImage(). Null if the
+     * registration failed or was cancelled.
+     * @return The displacement field.
+     */
+    DemonsDisplacementField3D::Pointer GetDisplacementField() const
+    {
+        return displacementField_;
+    }
+
+private:
+    DemonsDisplacementField3D::Pointer displacementField_;
 };
 
 #endif	/* RegisterOneImageDemons3D_H */
@@ -1,5 +1,5 @@
 /*
- * File:   RegisterOneImageRigid2D.mm
+ * File:   RegisterOneImageRigid2D.cpp
  * Author: tim
  *
  * Created on January 28, 2013, 12:47 PM
@@ -10,15 +10,14 @@
 #include "RegistrationObserverBSpline.h"
 #include "ParseITKException.h"
 #include "ImageTagger.h"
-
-#import "ProgressWindowController.h"
+#include "DenseMeanSquaresImageToImageMetric.h"
 
 #include <log4cplus/loggingmacros.h>
 
 RegisterOneImageRigid2D::RegisterOneImageRigid2D(
-    ProgressWindowController* progressController, Image2D::Pointer fixedImage,
+    RegistrationProgress* progress, Image2D::Pointer fixedImage,
     const ItkRegistrationParams& itkParams)
-    : RegisterOneImage(progressController, fixedImage, itkParams)
+    : RegisterOneImage(progress, fixedImage, itkParams)
 {
     std::string name = std::string(LOGGER_NAME) + ".RegisterOneImageRigid2D";
     logger_ = log4cplus::Logger::getInstance(name);
@@ -40,32 +39,20 @@ Image2D::Pointer RegisterOneImageRigid2D::registerImage(
     
     // Assume the best to start.
     code = SUCCESS;
+    finalTransform_ = TransformParams();
 
     // Set the resolution schedule
-    MultiResRegistrationMethod2D::ScheduleType resolutionSchedule(itkParams_.rigidLevels, Image2D::ImageDimension);
-    itk::SizeValueType factor = itk::Math::Round<itk::SizeValueType,
-                    double>(std::pow(2.0, static_cast<double>(itkParams_.rigidLevels - 1)));
-    for (unsigned level = 0; level < resolutionSchedule.rows(); ++level)
-    {
-        for (unsigned dim = 0; dim < resolutionSchedule.cols(); ++dim)
-        {
-            resolutionSchedule[level][dim] = factor;
-            LOG4CPLUS_DEBUG(logger_, "    Resolution schedule: level " << level << ", dim "
-                            << dim << " = " << factor);
-        }
-        factor /= 2;
-        if (factor < 1)
-            factor = 1;
-    }
+    MultiResRegistrationMethod2D::ScheduleType resolutionSchedule =
+                            CreateResolutionSchedule(itkParams_.rigidLevels,
+                                                     fixedImage_->GetSpacing());
 
     LOG4CPLUS_DEBUG(logger_, "Shrink factors = " << resolutionSchedule);
 
     // Set up the observer
     typedef RegistrationObserverBSpline<Image2D> ObserverType;
     ObserverType::Pointer observer = ObserverType::New();
-    observer->SetProgressWindowController(progController_);
     observer->SetNumberOfLevels(itkParams_.rigidLevels);
-    [progController_ setObserver:observer];
+    SetObserver(observer);
 
     std::stringstream str;
 //    str << "Fixed Image ***************\n";
@@ -99,6 +86,12 @@ Image2D::Pointer RegisterOneImageRigid2D::registerImage(
     transformInitializer->InitializeTransform();
     LOG4CPLUS_DEBUG(logger_, "Initial transform params:" << transform->GetParameters());
 
+    // A large movement of the patient is found in one step at the coarsest level.
+    ApplyPhaseCorrelation(transform.GetPointer(), movingImage, resolutionSchedule);
+
+    // Start from a neighbour's solution if we have one.
+    ApplyWarmStart(transform);
+
     /*
      * Set up the metric
      * We can set up those things which will not change between levels here and
@@ -106,12 +99,15 @@ Image2D::Pointer RegisterOneImageRigid2D::registerImage(
      */
     
     MMIImageToImageMetric2D::Pointer MMImetric;
-    MSImageToImageMetric2D::Pointer MSMetric;
+    FastMMIImageToImageMetric2D::Pointer fastMMIMetric;
+    LNCCImageToImageMetric2D::Pointer lnccMetric;
+    NGFImageToImageMetric2D::Pointer ngfMetric;
+    DenseMSImageToImageMetric2D::Pointer MSMetric;
     ImageToImageMetric2D::Pointer metric;
     switch (itkParams_.rigidRegMetric)
     {
         case MattesMutualInformation:
-            MMImetric = MMIImageToImageMetric2D::New();
+            MMImetric = CreateMetric<MMIImageToImageMetric2D>();
             MMImetric->UseExplicitPDFDerivativesOff();
             MMImetric->SetUseCachingOfBSplineWeights(true); // default == true
                                                             //MMImetric->SetNumberOfThreads(1);
@@ -119,18 +115,38 @@ Image2D::Pointer RegisterOneImageRigid2D::registerImage(
             observer->SetMMISchedules(itkParams_.rigidMMINumBins, itkParams_.rigidMMISampleRate);
             metric = MMImetric;
             break;
+        case FastMattesMutualInformation:
+            fastMMIMetric = CreateMetric<FastMMIImageToImageMetric2D>();
+            fastMMIMetric->ReinitializeSeed(8370276);
+            observer->SetMMISchedules(itkParams_.rigidMMINumBins, itkParams_.rigidMMISampleRate);
+            metric = fastMMIMetric;
+            break;
+        case LocalNormalizedCorrelation:
+            // The sample rate of the MMI settings applies; the bins are not used.
+            lnccMetric = CreateMetric<LNCCImageToImageMetric2D>();
+            lnccMetric->ReinitializeSeed(8370276);
+            observer->SetMMISchedules(itkParams_.rigidMMINumBins, itkParams_.rigidMMISampleRate);
+            metric = lnccMetric;
+            break;
+        case NormalizedGradientField:
+            ngfMetric = CreateMetric<NGFImageToImageMetric2D>();
+            ngfMetric->ReinitializeSeed(8370276);
+            observer->SetMMISchedules(itkParams_.rigidMMINumBins, itkParams_.rigidMMISampleRate);
+            metric = ngfMetric;
+            break;
         case MeanSquares:
-            MSMetric = MSImageToImageMetric2D::New();
-            //MSMetric->SetNumberOfThreads(1);
+            // The rigid transforms are linear so the metric can step along the rows
+            // and use every pixel of the region. It takes the ROI itself.
+            MSMetric = DenseMSImageToImageMetric2D::New();
+            MSMetric->SetRasterMask(GetFixedImageMask());
+            MSMetric->SetPrecision(itkParams_.metricPrecision);
             metric = MSMetric;
             break;
         default:
             break;
     }
 
-//    itkParams_.createFixedImageMask(fixedImage_);
-//    if (itkParams_.fixedImageMask.IsNotNull())
-//        metric->SetFixedImageMask(itkParams_.fixedImageMask);
+    // With an ROI the metric draws its samples from inside it only. See CreateMetric().
 
     // This is independent of the type of optimizer except that the LBFGSB
     // optimizer does not accept scaling.
@@ -186,10 +202,10 @@ Image2D::Pointer RegisterOneImageRigid2D::registerImage(
     //
     // The image pyramids
     // These will be set up by the registration object.
-    ImagePyramid2D::Pointer fixedImagePyramid = ImagePyramid2D::New();
+    ImagePyramid2D::Pointer fixedImagePyramid = CreateFixedImagePyramid();
     fixedImagePyramid->SetNumberOfLevels(itkParams_.rigidLevels);
 
-    ImagePyramid2D::Pointer movingImagePyramid = ImagePyramid2D::New();
+    ImagePyramid2D::Pointer movingImagePyramid = CreateMovingImagePyramid(movingImage);
     movingImagePyramid->SetNumberOfLevels(itkParams_.rigidLevels);
 
     // Set up the registration
@@ -260,13 +276,20 @@ Image2D::Pointer RegisterOneImageRigid2D::registerImage(
     
     // Apply the transform to the movong image
     transform->SetParameters(finalParameters);
+    if (code != DISASTER)
+        SaveFinalTransform(transform);
 
     /*
      ImageTagger<Image2D> tagImage(10);
      tagImage(*(movingImage.GetPointer()));
      */
 
+    // The next stage resamples the original image itself.
+    if (!resampleResult_)
+        return movingImage;
+
     ResampleFilter2D::Pointer resampler = ResampleFilter2D::New();
+    resampler->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
     resampler->SetTransform(transform);
     resampler->SetInput(movingImage);
     resampler->SetSize(fixedImage_->GetLargestPossibleRegion().GetSize());
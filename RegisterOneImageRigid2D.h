@@ -18,11 +18,11 @@ class RegisterOneImageRigid2D : public RegisterOneImage<Image2D>
 public:
     /**
      * Constructor.
-     * @param progressController ProgressController for updates and registration mamagement.
+     * @param progress Receives updates and manages the registration. May be 0.
      * @param fixedImage The fixed image.
      * @param params The registration parameters.
      */
-    RegisterOneImageRigid2D(ProgressWindowController* progressController,
+    RegisterOneImageRigid2D(RegistrationProgress* progress,
                 Image2D::Pointer fixedImage, const ItkRegistrationParams& itkParams);
 
     /**
@@ -1,5 +1,5 @@
 /*
- * File:   RegisterOneImageRigid3D.mm
+ * File:   RegisterOneImageRigid3D.cpp
  * Author: tim
  *
  * Created on January 28, 2013, 12:47 PM
@@ -11,15 +11,14 @@
 #include "RegistrationObserverBSpline.h"
 #include "ParseITKException.h"
 #include "ImageTagger.h"
-
-#import "ProgressWindowController.h"
+#include "DenseMeanSquaresImageToImageMetric.h"
 
 #include <log4cplus/loggingmacros.h>
 
 RegisterOneImageRigid3D::RegisterOneImageRigid3D(
-    ProgressWindowController* progressController, Image3D::Pointer fixedImage,
+    RegistrationProgress* progress, Image3D::Pointer fixedImage,
     const ItkRegistrationParams& itkParams)
-    : RegisterOneImage<Image3D>(progressController, fixedImage, itkParams)
+    : RegisterOneImage<Image3D>(progress, fixedImage, itkParams)
 {
     std::string name = std::string(LOGGER_NAME) + ".RegisterOneImageRigid3D";
     logger_ = log4cplus::Logger::getInstance(name);
@@ -40,37 +39,19 @@ Image3D::Pointer RegisterOneImageRigid3D::registerImage(Image3D::Pointer movingI
     
     // Assume the best to start.
     code = SUCCESS;
+    finalTransform_ = TransformParams();
 
     // Set the resolution schedule
-    // We use reduced resolution in the plane of the slices but not in the other dimension
-    // because it is small to begin with in DCE images.
-    MultiResRegistrationMethod3D::ScheduleType resolutionSchedule(itkParams_.rigidLevels, Image3D::ImageDimension);
-    itk::SizeValueType factor = itk::Math::Round<itk::SizeValueType,
-                    double>(std::pow(2.0, static_cast<double>(itkParams_.rigidLevels - 1)));
-    for (unsigned level = 0; level < resolutionSchedule.rows(); ++level)
-    {
-        for (unsigned dim = 0; dim < resolutionSchedule.cols(); ++dim)
-        {
-            if (dim == 2)
-                resolutionSchedule[level][dim] = 1;
-            else
-                resolutionSchedule[level][dim] = factor;
-            LOG4CPLUS_DEBUG(logger_, "    Resolution schedule: level " << level << ", dim "
-                            << dim << " = " << factor);
-        }
-
-        factor /= 2;
-        if (factor < 1)
-            factor = 1;
-    }
+    MultiResRegistrationMethod3D::ScheduleType resolutionSchedule =
+                            CreateResolutionSchedule(itkParams_.rigidLevels,
+                                                     fixedImage_->GetSpacing());
 
     LOG4CPLUS_DEBUG(logger_, "Shrink factors = " << resolutionSchedule);
 
     // Set up the observer
     RegistrationObserverBSpline<Image3D>::Pointer observer = RegistrationObserverBSpline<Image3D>::New();
-    observer->SetProgressWindowController(progController_);
     observer->SetNumberOfLevels(itkParams_.rigidLevels);
-    [progController_ setObserver:observer];
+    SetObserver(observer);
 
     std::stringstream str;
     str << "Fixed Image ***************\n";
@@ -93,45 +74,89 @@ Image3D::Pointer RegisterOneImageRigid3D::registerImage(Image3D::Pointer movingI
      * Use the initializer to set up the transform
      */
     VersorTransform3D::Pointer transform = VersorTransform3D::New();
-    CenteredVersorTransformInitializer3D::Pointer transformInitializer =
-            CenteredVersorTransformInitializer3D::New();
-    transformInitializer->SetTransform(transform);
-    transformInitializer->SetFixedImage(fixedImage_);
-    transformInitializer->SetMovingImage(movingImage);
-    transformInitializer->SetComputeRotation(false);
-    transformInitializer->InitializeTransform();
+    if (fixedContext_.IsNotNull() && movingContext_.IsNotNull()
+        && (movingContext_->GetFixedImage() == movingImage))
+    {
+        // The moving image moments were computed while the previous image was registered.
+        fixedContext_->InitializeCenteredTransform(transform.GetPointer(), movingContext_.GetPointer());
+    }
+    else if (fixedContext_.IsNotNull())
+    {
+        // Same as the initializer below but the fixed image moments are computed
+        // once for the series.
+        fixedContext_->InitializeCenteredTransform(transform.GetPointer(), movingImage);
+    }
+    else
+    {
+        CenteredVersorTransformInitializer3D::Pointer transformInitializer =
+                CenteredVersorTransformInitializer3D::New();
+        transformInitializer->SetTransform(transform);
+        transformInitializer->SetFixedImage(fixedImage_);
+        transformInitializer->SetMovingImage(movingImage);
+        transformInitializer->SetComputeRotation(false);
+        transformInitializer->InitializeTransform();
+    }
     LOG4CPLUS_DEBUG(logger_, "Initial transform params:" << transform->GetParameters());
 
+    // A large movement of the patient is found in one step at the coarsest level.
+    ApplyPhaseCorrelation(transform.GetPointer(), movingImage, resolutionSchedule);
+
+    // Start from a neighbour's solution if we have one.
+    ApplyWarmStart(transform);
+
     /*
      * Set up the metric.
      * We can set up those things which will not change between levels here and
      *leave the rest for the first IterationEvent in the observer.
      */
     MMIImageToImageMetric3D::Pointer MMImetric;
-    MSImageToImageMetric3D::Pointer MSMetric;
+    FastMMIImageToImageMetric3D::Pointer fastMMIMetric;
+    LNCCImageToImageMetric3D::Pointer lnccMetric;
+    NGFImageToImageMetric3D::Pointer ngfMetric;
+    DenseMSImageToImageMetric3D::Pointer MSMetric;
     ImageToImageMetric3D::Pointer metric;
     switch (itkParams_.rigidRegMetric)
     {
         case MattesMutualInformation:
-            MMImetric = MMIImageToImageMetric3D::New();
+            MMImetric = CreateMetric<MMIImageToImageMetric3D>();
             MMImetric->UseExplicitPDFDerivativesOff();  // Best for small number of parameters
             //MMImetric->SetNumberOfThreads(1);
             MMImetric->ReinitializeSeed(8370276);
             observer->SetMMISchedules(itkParams_.rigidMMINumBins, itkParams_.rigidMMISampleRate);
             metric = MMImetric;
             break;
+        case FastMattesMutualInformation:
+            fastMMIMetric = CreateMetric<FastMMIImageToImageMetric3D>();
+            fastMMIMetric->ReinitializeSeed(8370276);
+            observer->SetMMISchedules(itkParams_.rigidMMINumBins, itkParams_.rigidMMISampleRate);
+            metric = fastMMIMetric;
+            break;
+        case LocalNormalizedCorrelation:
+            // The sample rate of the MMI settings applies; the bins are not used.
+            lnccMetric = CreateMetric<LNCCImageToImageMetric3D>();
+            lnccMetric->ReinitializeSeed(8370276);
+            observer->SetMMISchedules(itkParams_.rigidMMINumBins, itkParams_.rigidMMISampleRate);
+            metric = lnccMetric;
+            break;
+        case NormalizedGradientField:
+            ngfMetric = CreateMetric<NGFImageToImageMetric3D>();
+            ngfMetric->ReinitializeSeed(8370276);
+            observer->SetMMISchedules(itkParams_.rigidMMINumBins, itkParams_.rigidMMISampleRate);
+            metric = ngfMetric;
+            break;
         case MeanSquares:
-            MSMetric = MSImageToImageMetric3D::New();
-            //MSMetric->SetNumberOfThreads(1);
+            // The rigid transforms are linear so the metric can step along the rows
+            // and use every pixel of the region. It takes the ROI itself.
+            MSMetric = DenseMSImageToImageMetric3D::New();
+            MSMetric->SetRasterMask(GetFixedImageMask());
+            MSMetric->SetPrecision(itkParams_.metricPrecision);
             metric = MSMetric;
             break;
         default:
             break;
     }
 
-    //    itkParams_.createFixedImageMask(fixedImage_);
-    //    if (itkParams_.fixedImageMask.IsNotNull())
-    //        metric->SetFixedImageMask(itkParams_.fixedImageMask);
+    // With an ROI the metric draws its samples from inside it only. See CreateMetric().
 
     // This is independent of the type of optimizer except that the LBFGSB
     // optimizer does not accept scaling.
@@ -175,10 +200,10 @@ Image3D::Pointer RegisterOneImageRigid3D::registerImage(Image3D::Pointer movingI
 
     // The image pyramids
     // These will be set up by the registration object.
-    ImagePyramid3D::Pointer fixedImagePyramid = ImagePyramid3D::New();
+    ImagePyramid3D::Pointer fixedImagePyramid = CreateFixedImagePyramid();
     fixedImagePyramid->SetNumberOfLevels(itkParams_.rigidLevels);
 
-    ImagePyramid3D::Pointer movingImagePyramid = ImagePyramid3D::New();
+    ImagePyramid3D::Pointer movingImagePyramid = CreateMovingImagePyramid(movingImage);
     movingImagePyramid->SetNumberOfLevels(itkParams_.rigidLevels);
 
     // Set up the registration
@@ -253,13 +278,20 @@ Image3D::Pointer RegisterOneImageRigid3D::registerImage(Image3D::Pointer movingI
     
     // Apply the transform to the movong image
     transform->SetParameters(finalParameters);
+    if (code != DISASTER)
+        SaveFinalTransform(transform);
 
     /*
      ImageTagger<Image2D> tagImage(10);
      tagImage(*(movingImage.GetPointer()));
      */
 
+    // The next stage resamples the original image itself.
+    if (!resampleResult_)
+        return movingImage;
+
     ResampleFilter3D::Pointer resampler = ResampleFilter3D::New();
+    resampler->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
     resampler->SetTransform(transform);
     resampler->SetInput(movingImage);
     resampler->SetSize(fixedImage_->GetLargestPossibleRegion().GetSize());
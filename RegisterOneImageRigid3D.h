@@ -18,11 +18,11 @@ class RegisterOneImageRigid3D : public RegisterOneImage<Image3D>
 public:
     /**
      * Constructor.
-     * @param progressController ProgressController for updates and registration mamagement.
+     * @param progress Receives updates and manages the registration. May be 0.
      * @param fixedImage The fixed image.
      * @param params The registration parameters.
      */
-    RegisterOneImageRigid3D(ProgressWindowController* progressController,
+    RegisterOneImageRigid3D(RegistrationProgress* progress,
                 Image3D::Pointer fixedImage, const ItkRegistrationParams& itkParams);
 
     /**
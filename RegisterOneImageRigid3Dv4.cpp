@@ -0,0 +1,224 @@
+/*
+ * File:   RegisterOneImageRigid3Dv4.cpp
+ * Author: tim
+ *
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#include "RegisterOneImageRigid3Dv4.h"
+#include "ItkTypedefs.h"
+#include "RegistrationObserverv4.h"
+#include "ParseITKException.h"
+
+#include <log4cplus/loggingmacros.h>
+
+RegisterOneImageRigid3Dv4::RegisterOneImageRigid3Dv4(
+    RegistrationProgress* progress, Image3D::Pointer fixedImage,
+    const ItkRegistrationParams& itkParams)
+    : RegisterOneImage<Image3D>(progress, fixedImage, itkParams)
+{
+    std::string name = std::string(LOGGER_NAME) + ".RegisterOneImageRigid3Dv4";
+    logger_ = log4cplus::Logger::getInstance(name);
+    LOG4CPLUS_TRACE(logger_, "");
+
+    // don't do anything if this is turned off
+    if (itkParams_.rigidLevels == 0)
+    {
+        LOG4CPLUS_FATAL(logger_, "Rigid registration levels == 0.");
+        throw itk::InvalidArgumentError();
+    }
+}
+
+Image3D::Pointer RegisterOneImageRigid3Dv4::registerImage(Image3D::Pointer movingImage, ResultCode& code)
+{
+    LOG4CPLUS_TRACE(logger_, "Enter");
+
+    // Assume the best to start.
+    code = SUCCESS;
+    finalTransform_ = TransformParams();
+
+    // Set up the observer
+    typedef RegistrationObserverv4<RigidRegistrationMethod3Dv4> ObserverType;
+    ObserverType::Pointer observer = ObserverType::New();
+    observer->SetNumberOfLevels(itkParams_.rigidLevels);
+    observer->SetStageName("Rigid");
+    SetObserver(observer);
+
+    // Set up the rigid transform as RegisterOneImageRigid3D does.
+    VersorTransform3D::Pointer transform = VersorTransform3D::New();
+    if (fixedContext_.IsNotNull() && movingContext_.IsNotNull()
+        && (movingContext_->GetFixedImage() == movingImage))
+    {
+        fixedContext_->InitializeCenteredTransform(transform.GetPointer(), movingContext_.GetPointer());
+    }
+    else if (fixedContext_.IsNotNull())
+    {
+        fixedContext_->InitializeCenteredTransform(transform.GetPointer(), movingImage);
+    }
+    else
+    {
+        CenteredVersorTransformInitializer3D::Pointer transformInitializer =
+                CenteredVersorTransformInitializer3D::New();
+        transformInitializer->SetTransform(transform);
+        transformInitializer->SetFixedImage(fixedImage_);
+        transformInitializer->SetMovingImage(movingImage);
+        transformInitializer->SetComputeRotation(false);
+        transformInitializer->InitializeTransform();
+    }
+    LOG4CPLUS_DEBUG(logger_, "Initial transform params:" << transform->GetParameters());
+
+    // A large movement of the patient is found in one step at the coarsest level.
+    ScheduleType schedule = CreateResolutionSchedule(itkParams_.rigidLevels, fixedImage_->GetSpacing());
+    ApplyPhaseCorrelation(transform.GetPointer(), movingImage, schedule);
+
+    // Start from a neighbour's solution if we have one.
+    ApplyWarmStart(transform);
+
+    /*
+     * Set up the metric.
+     * The number of bins is set by the observer at each level. The v4 metrics
+     * use as many threads as they are given.
+     */
+    MMIImageToImageMetric3Dv4::Pointer mmiMetric;
+    MSImageToImageMetric3Dv4::Pointer msMetric;
+    ImageToImageMetric3Dv4::Pointer metric;
+    switch (itkParams_.rigidRegMetric)
+    {
+        case FastMattesMutualInformation:
+        case LocalNormalizedCorrelation:
+        case NormalizedGradientField:
+            LOG4CPLUS_WARN(logger_, "Metric " << itkParams_.rigidRegMetric
+                           << " is not available with the ITKv4 engine. Using Mattes MI.");
+            // Fall through.
+        case MattesMutualInformation:
+            mmiMetric = MMIImageToImageMetric3Dv4::New();
+            mmiMetric->SetNumberOfHistogramBins(itkParams_.rigidMMINumBins[itkParams_.rigidLevels - 1]);
+            observer->SetMMISchedules(itkParams_.rigidMMINumBins);
+            metric = mmiMetric;
+            break;
+        case MeanSquares:
+            msMetric = MSImageToImageMetric3Dv4::New();
+            metric = msMetric;
+            break;
+        default:
+            break;
+    }
+
+    // The Versor parameters are used for the v4 regular step optimiser, which
+    // updates the versor by composition as the Versor optimiser does.
+    if (itkParams_.rigidRegOptimiser != Versor)
+    {
+        LOG4CPLUS_FATAL(logger_, "Rigid 3D registration optimiser " << itkParams_.rigidRegOptimiser
+                        << "is invalid.");
+        throw itk::InvalidArgumentError();
+    }
+
+    RSGDOptimizerv4::ScalesType optimizerScales(transform->GetNumberOfParameters());
+    double translationScaleFactor = itkParams_.rigidVersorOptTransScale[0];
+    optimizerScales[0] = 1.0;
+    optimizerScales[1] = 1.0;
+    optimizerScales[2] = 1.0;
+    optimizerScales[3] = translationScaleFactor;
+    optimizerScales[4] = translationScaleFactor;
+    optimizerScales[5] = translationScaleFactor;
+    LOG4CPLUS_DEBUG(logger_, "  optimizerScales = "
+                        << std::fixed << std::setprecision(4) << optimizerScales);
+
+    RSGDOptimizerv4::Pointer optimizer = RSGDOptimizerv4::New();
+    optimizer->SetScales(optimizerScales);
+    optimizer->SetGradientMagnitudeTolerance(1e-4);
+    observer->SetVersorSchedules(itkParams_.rigidVersorOptMinStepSize,
+                                 itkParams_.rigidVersorOptMaxStepSize,
+                                 itkParams_.rigidVersorOptRelaxationFactor,
+                                 itkParams_.rigidVersorOptTransScale,
+                                 itkParams_.rigidMaxIter);
+    optimizer->AddObserver(itk::IterationEvent(), observer);
+
+    // Set up the registration
+    // The 3D region based upon the 2D region in the slice plane becomes the virtual
+    // domain so that only it is sampled.
+    Image3D::RegionType region = fixedImage_->GetLargestPossibleRegion();
+    Image3D::RegionType regRegion = Create3DRegion(itkParams_.fixedImageRegion, region.GetSize(2u));
+    Image3D::Pointer regFixedImage = ExtractFixedRegion(regRegion);
+
+    // The v4 metrics test each point against a mask so the ROI is given to them as
+    // a rasterized image, where the test is a pixel lookup.
+    FixedImageMask3D::Pointer mask = GetFixedImageMask();
+    if (mask.IsNotNull())
+        metric->SetFixedImageMask(mask->CreateSpatialObject(regFixedImage,
+                                                regFixedImage->GetLargestPossibleRegion()));
+
+    RigidRegistrationMethod3Dv4::Pointer registration = RigidRegistrationMethod3Dv4::New();
+    registration->AddObserver(itk::MultiResolutionIterationEvent(), observer);
+    registration->SetMetric(metric);
+    registration->SetOptimizer(optimizer);
+    registration->SetFixedImage(regFixedImage);
+    registration->SetMovingImage(movingImage);
+    registration->SetInitialTransform(transform);
+    registration->InPlaceOn();
+    SetUpRegistrationLevelsv4(registration.GetPointer(), itkParams_.rigidLevels,
+                              itkParams_.rigidRegMetric, itkParams_.rigidMMISampleRate);
+
+    try
+    {
+        registration->Update();
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        code = DISASTER;
+        LOG4CPLUS_ERROR(logger_, "Severe error in registration. " << ParseITKException(err));
+    }
+
+    std::string stopCondition;
+    if (observer->RegistrationWasCancelled())
+    {
+        stopCondition = "Registration cancelled by user.";
+        return movingImage;
+    }
+
+    stopCondition = optimizer->GetStopConditionDescription();
+    progress_->SetStopCondition(stopCondition);
+    LOG4CPLUS_INFO(logger_, "Optimizer stop condition = " << stopCondition);
+
+    // The registration optimised the transform in place.
+    LOG4CPLUS_DEBUG(logger_, "Last Transform Parameters " << std::fixed << std::setprecision(4)
+                    << transform->GetParameters() << ", best metric = " << optimizer->GetValue());
+
+    if (code != DISASTER)
+        SaveFinalTransform(transform);
+
+    // The next stage resamples the original image itself.
+    if (!resampleResult_)
+        return movingImage;
+
+    ResampleFilter3D::Pointer resampler = ResampleFilter3D::New();
+    resampler->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+    resampler->SetTransform(transform);
+    resampler->SetInput(movingImage);
+    resampler->SetSize(fixedImage_->GetLargestPossibleRegion().GetSize());
+    resampler->SetOutputOrigin(fixedImage_->GetOrigin());
+    resampler->SetOutputSpacing(fixedImage_->GetSpacing());
+    resampler->SetOutputDirection(fixedImage_->GetDirection());
+    resampler->SetDefaultPixelValue(0.0);
+    resampler->Update();
+
+    Image3D::Pointer result = resampler->GetOutput();
+
+    return result;
+}
+
+Image3D::RegionType RegisterOneImageRigid3Dv4::Create3DRegion(const Image2D::RegionType& region2D,
+                                                              unsigned numSlices)
+{
+    Image3D::RegionType region;
+
+    for (unsigned idx = 0; idx < 2u; ++idx)
+    {
+        region.SetIndex(idx, region2D.GetIndex(idx));
+        region.SetSize(idx, region2D.GetSize(idx));
+    }
+    region.SetIndex(2u, 0);
+    region.SetSize(2u, numSlices);
+
+    return region;
+}
@@ -0,0 +1,48 @@
+/*
+ * File:   RegisterOneImageRigid3Dv4.h
+ * Author: tim
+ *
+ * Created on October 17, 2026, 10:12 AM
+ */
+
+#ifndef REGISTERONEIMAGERIGID3DV4_H
+#define	REGISTERONEIMAGERIGID3DV4_H
+
+#include "RegisterOneImage.h"
+
+/**
+ * Performs a multiresolution rigid registration of one image with the ITKv4
+ * registration framework. It is selected with the registration engine parameter
+ * and otherwise does what RegisterOneImageRigid3D does.
+ */
+class RegisterOneImageRigid3Dv4 : public RegisterOneImage<Image3D>
+{
+public:
+    /**
+     * Constructor.
+     * @param progress Receives updates and manages the registration. May be 0.
+     * @param fixedImage The fixed image.
+     * @param params The registration parameters.
+     */
+    RegisterOneImageRigid3Dv4(RegistrationProgress* progress,
+                Image3D::Pointer fixedImage, const ItkRegistrationParams& itkParams);
+
+    /**
+     * Do the registration.
+     * @param movingImage The moving image to be registered.
+     * @return The registered moving image.
+     */
+    virtual Image3D::Pointer registerImage(Image3D::Pointer movingImage, ResultCode& code);
+
+    /**
+     * Set up the registration region. The region will be a 3D region defined by the 2D region
+     * in the plane of the slices and the full thickness of the image.
+     *
+     * @param region2D The 2D region in the plane of the slices
+     * @param numSlices The thickness of the image in slices.
+     * @return The 3D region.
+     */
+    Image3D::RegionType Create3DRegion(const Image2D::RegionType& region2D, unsigned numSlices);
+};
+
+#endif	/* REGISTERONEIMAGERIGID3DV4_H */
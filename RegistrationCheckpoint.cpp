@@ -0,0 +1,291 @@
+//
+//  RegistrationCheckpoint.cpp
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#include "RegistrationCheckpoint.h"
+#include "ProjectDefs.h"
+#include "ParseITKException.h"
+
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkMutexLockHolder.h>
+
+#include <log4cplus/loggingmacros.h>
+
+#include <boost/lexical_cast.hpp>
+
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+typedef itk::MutexLockHolder<itk::SimpleFastMutexLock> LockHolder;
+
+/// Last word of every complete record line.
+static const char* const EndOfRecord = "end";
+
+/// Written in place of an empty field file name.
+static const char* const NoField = "-";
+
+/**
+ * 64 bit FNV-1a hash of a string.
+ * @param str The string.
+ * @return The hash as 16 hexadecimal digits.
+ */
+static std::string HashString(const std::string& str)
+{
+    unsigned long long hash = 14695981039346656037ULL;
+    for (std::string::const_iterator iter = str.begin(); iter != str.end(); ++iter)
+    {
+        hash ^= static_cast<unsigned char>(*iter);
+        hash *= 1099511628211ULL;
+    }
+
+    std::ostringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0') << hash;
+    return out.str();
+}
+
+static void WriteParameters(std::ostream& out, const TransformParams::ParametersType& params)
+{
+    out << ' ' << params.GetSize();
+    for (unsigned idx = 0; idx < params.GetSize(); ++idx)
+        out << ' ' << params[idx];
+}
+
+static bool ReadParameters(std::istream& in, TransformParams::ParametersType& params)
+{
+    unsigned size = 0;
+    if (!(in >> size))
+        return false;
+
+    params.SetSize(size);
+    for (unsigned idx = 0; idx < size; ++idx)
+    {
+        if (!(in >> params[idx]))
+            return false;
+    }
+
+    return true;
+}
+
+template <class TField>
+static bool WriteField(const std::string& path, const TField* field, log4cplus::Logger& logger)
+{
+    typedef itk::ImageFileWriter<TField> WriterType;
+    typename WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(path);
+    writer->SetInput(field);
+    writer->UseCompressionOn();
+
+    try
+    {
+        writer->Update();
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        LOG4CPLUS_WARN(logger, "Could not write displacement field " << path << ". "
+                       << ParseITKException(err));
+        return false;
+    }
+
+    return true;
+}
+
+template <class TField>
+static bool ReadField(const std::string& path, typename TField::Pointer& field,
+                      log4cplus::Logger& logger)
+{
+    typedef itk::ImageFileReader<TField> ReaderType;
+    typename ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(path);
+
+    try
+    {
+        reader->Update();
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        LOG4CPLUS_WARN(logger, "Could not read displacement field " << path << ". "
+                       << ParseITKException(err));
+        return false;
+    }
+
+    field = reader->GetOutput();
+    field->DisconnectPipeline();
+    return true;
+}
+
+RegistrationCheckpoint::RegistrationCheckpoint(const std::string& directory,
+                                               const std::string& seriesUID,
+                                               const std::string& paramSignature)
+    : enabled_(false), directory_(directory), numResumed_(0)
+{
+    std::string name = std::string(LOGGER_NAME) + ".RegistrationCheckpoint";
+    logger_ = log4cplus::Logger::getInstance(name);
+
+    if (directory.empty() || seriesUID.empty())
+    {
+        LOG4CPLUS_WARN(logger_, "No series UID or checkpoint directory. Checkpoint disabled.");
+        return;
+    }
+
+    baseName_ = seriesUID + "-" + HashString(paramSignature);
+    path_ = directory_ + "/" + baseName_ + ".txt";
+    enabled_ = true;
+
+    Load();
+
+    if (numResumed_ > 0)
+        LOG4CPLUS_INFO(logger_, "Resuming from " << path_ << " with " << numResumed_
+                       << " images already registered.");
+    else
+        LOG4CPLUS_INFO(logger_, "Checkpointing to " << path_);
+}
+
+bool RegistrationCheckpoint::Find(unsigned imageIdx, unsigned sliceIdx, Record& record)
+{
+    LockHolder lock(mutex_);
+
+    RecordMap::const_iterator iter = records_.find(KeyType(imageIdx, sliceIdx));
+    if (iter == records_.end())
+        return false;
+
+    record = iter->second;
+    return true;
+}
+
+void RegistrationCheckpoint::Store(unsigned imageIdx, unsigned sliceIdx, const Record& record)
+{
+    if (!enabled_)
+        return;
+
+    LockHolder lock(mutex_);
+
+    // Write the whole line at once and flush it so that a crash leaves at most
+    // one incomplete line, which Load() ignores.
+    std::ostringstream line;
+    line << std::setprecision(17) << imageIdx << ' ' << sliceIdx;
+    WriteParameters(line, record.rigid.fixedParameters);
+    WriteParameters(line, record.rigid.parameters);
+    WriteParameters(line, record.deformable.fixedParameters);
+    WriteParameters(line, record.deformable.parameters);
+    line << ' ' << (record.displacementField.empty() ? NoField : record.displacementField)
+         << ' ' << EndOfRecord << '\n';
+
+    std::ofstream file(path_.c_str(), std::ios::out | std::ios::app);
+    file << line.str();
+    file.flush();
+    if (!file)
+    {
+        LOG4CPLUS_WARN(logger_, "Could not write to " << path_ << ". Checkpoint disabled.");
+        enabled_ = false;
+        return;
+    }
+
+    records_[KeyType(imageIdx, sliceIdx)] = record;
+}
+
+std::string RegistrationCheckpoint::StoreDisplacementField(unsigned imageIdx, unsigned sliceIdx,
+                                                           const DemonsDisplacementField2D* field)
+{
+    std::string fileName = FieldFileName(imageIdx, sliceIdx);
+    if (!enabled_ || !WriteField(directory_ + "/" + fileName, field, logger_))
+        return std::string();
+
+    return fileName;
+}
+
+std::string RegistrationCheckpoint::StoreDisplacementField(unsigned imageIdx, unsigned sliceIdx,
+                                                           const DemonsDisplacementField3D* field)
+{
+    std::string fileName = FieldFileName(imageIdx, sliceIdx);
+    if (!enabled_ || !WriteField(directory_ + "/" + fileName, field, logger_))
+        return std::string();
+
+    return fileName;
+}
+
+bool RegistrationCheckpoint::LoadDisplacementField(const Record& record,
+                                                   DemonsDisplacementField2D::Pointer& field)
+{
+    if (record.displacementField.empty())
+        return false;
+
+    return ReadField<DemonsDisplacementField2D>(directory_ + "/" + record.displacementField,
+                                                field, logger_);
+}
+
+bool RegistrationCheckpoint::LoadDisplacementField(const Record& record,
+                                                   DemonsDisplacementField3D::Pointer& field)
+{
+    if (record.displacementField.empty())
+        return false;
+
+    return ReadField<DemonsDisplacementField3D>(directory_ + "/" + record.displacementField,
+                                                field, logger_);
+}
+
+void RegistrationCheckpoint::Remove()
+{
+    if (!enabled_)
+        return;
+
+    LockHolder lock(mutex_);
+
+    for (RecordMap::const_iterator iter = records_.begin(); iter != records_.end(); ++iter)
+    {
+        if (!iter->second.displacementField.empty())
+            std::remove((directory_ + "/" + iter->second.displacementField).c_str());
+    }
+    std::remove(path_.c_str());
+    records_.clear();
+
+    LOG4CPLUS_INFO(logger_, "Series finished. Removed " << path_);
+}
+
+void RegistrationCheckpoint::Load()
+{
+    std::ifstream file(path_.c_str());
+    if (!file)
+        return;
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        std::istringstream in(line);
+        unsigned imageIdx = 0;
+        unsigned sliceIdx = 0;
+        Record record;
+        std::string fieldName;
+        std::string end;
+
+        if (!(in >> imageIdx >> sliceIdx)
+            || !ReadParameters(in, record.rigid.fixedParameters)
+            || !ReadParameters(in, record.rigid.parameters)
+            || !ReadParameters(in, record.deformable.fixedParameters)
+            || !ReadParameters(in, record.deformable.parameters)
+            || !(in >> fieldName >> end) || (end != EndOfRecord))
+        {
+            LOG4CPLUS_WARN(logger_, "Ignoring incomplete checkpoint record: " << line);
+            continue;
+        }
+
+        if (fieldName != NoField)
+            record.displacementField = fieldName;
+
+        records_[KeyType(imageIdx, sliceIdx)] = record;
+    }
+
+    numResumed_ = records_.size();
+}
+
+std::string RegistrationCheckpoint::FieldFileName(unsigned imageIdx, unsigned sliceIdx) const
+{
+    return baseName_ + "-" + boost::lexical_cast<std::string>(imageIdx) + "-"
+        + boost::lexical_cast<std::string>(sliceIdx) + ".mha";
+}
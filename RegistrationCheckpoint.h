@@ -0,0 +1,146 @@
+//
+//  RegistrationCheckpoint.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__RegistrationCheckpoint__
+#define __DCEFit__RegistrationCheckpoint__
+
+#include "ItkTypedefs.h"
+#include "TransformParams.h"
+
+#include <itkSimpleFastMutexLock.h>
+
+#include <log4cplus/logger.h>
+
+#include <map>
+#include <string>
+#include <utility>
+
+/**
+ * Keeps the results of the images of a series that have already been registered
+ * so that a run stopped by the user or by a crash can resume where it stopped.
+ *
+ * When an image (or a slice in slice-wise mode) is finished, its final transforms
+ * are appended as one line to a text file. Demons displacement fields are written
+ * beside that file as MetaImage files. The file name is made from the series
+ * instance UID and a hash of the registration parameters which affect the result.
+ * A checkpoint is therefore only reused by a run which would give the same result,
+ * whatever its concurrency and other such settings.
+ *
+ * Failure to read or write the checkpoint is logged and never stops a registration.
+ */
+class RegistrationCheckpoint
+{
+public:
+    /**
+     * What is kept for one image.
+     */
+    struct Record
+    {
+        TransformParams rigid;          ///< Final rigid transform. Empty if not used.
+        TransformParams deformable;     ///< Final B-spline transform. Empty if not used.
+        std::string displacementField;  ///< File holding the Demons field. Empty if not used.
+    };
+
+    /**
+     * Constructor. Reads the records of an earlier run if there are any.
+     * @param directory Directory to keep the checkpoints in. It must exist.
+     * @param seriesUID The DICOM series instance UID of the series.
+     * @param paramSignature Text which changes whenever a parameter that affects the
+     * result changes.
+     */
+    RegistrationCheckpoint(const std::string& directory, const std::string& seriesUID,
+                           const std::string& paramSignature);
+
+    /**
+     * @return true if records are being kept.
+     */
+    bool IsEnabled() const
+    {
+        return enabled_;
+    }
+
+    /**
+     * @return The number of images found from an earlier run.
+     */
+    unsigned GetNumberOfResumedRecords() const
+    {
+        return numResumed_;
+    }
+
+    /**
+     * Look for the record of an image.
+     * @param imageIdx Index of the image.
+     * @param sliceIdx Index of the slice. 0 unless registering slice by slice.
+     * @param record Set to the record if found.
+     * @return true if found.
+     */
+    bool Find(unsigned imageIdx, unsigned sliceIdx, Record& record);
+
+    /**
+     * Keep the record of a finished image. It is on disk when this returns.
+     * @param imageIdx Index of the image.
+     * @param sliceIdx Index of the slice. 0 unless registering slice by slice.
+     * @param record The record.
+     */
+    void Store(unsigned imageIdx, unsigned sliceIdx, const Record& record);
+
+    /**
+     * Write a Demons displacement field.
+     * @param imageIdx Index of the image.
+     * @param sliceIdx Index of the slice.
+     * @param field The field.
+     * @return The name to put into the image's record. Empty if it could not be written.
+     */
+    std::string StoreDisplacementField(unsigned imageIdx, unsigned sliceIdx,
+                                       const DemonsDisplacementField2D* field);
+    std::string StoreDisplacementField(unsigned imageIdx, unsigned sliceIdx,
+                                       const DemonsDisplacementField3D* field);
+
+    /**
+     * Read the Demons displacement field of a record.
+     * @param record The record.
+     * @param field Set to the field.
+     * @return true if the field was read.
+     */
+    bool LoadDisplacementField(const Record& record, DemonsDisplacementField2D::Pointer& field);
+    bool LoadDisplacementField(const Record& record, DemonsDisplacementField3D::Pointer& field);
+
+    /**
+     * Delete the checkpoint and its files. Used when the series has been finished.
+     */
+    void Remove();
+
+private:
+    typedef std::pair<unsigned, unsigned> KeyType;
+    typedef std::map<KeyType, Record> RecordMap;
+
+    /**
+     * Read the records of an earlier run. A line cut short by a crash is ignored.
+     */
+    void Load();
+
+    /**
+     * Make the name of a displacement field file.
+     */
+    std::string FieldFileName(unsigned imageIdx, unsigned sliceIdx) const;
+
+    // Not implemented
+    RegistrationCheckpoint(const RegistrationCheckpoint&);
+    RegistrationCheckpoint& operator=(const RegistrationCheckpoint&);
+
+    log4cplus::Logger logger_;         ///< The logger.
+    itk::SimpleFastMutexLock mutex_;   ///< Guards the records and the file.
+    bool enabled_;                     ///< false if there is nowhere to keep the records.
+    std::string directory_;            ///< The directory holding the files.
+    std::string baseName_;             ///< File name stem: series UID and parameter hash.
+    std::string path_;                 ///< Full path of the record file.
+    RecordMap records_;                ///< The records, by image and slice.
+    unsigned numResumed_;              ///< Records found from an earlier run.
+};
+
+#endif /* defined(__DCEFit__RegistrationCheckpoint__) */
@@ -36,6 +36,7 @@
     NSOperationQueue* opQueue;
     RegisterImageOp* op;
     SeriesInfo* seriesInfo_;
+    BOOL displayUpdatePending_;   // A viewer refresh is waiting on the main thread.
 }
 
 @property (readonly) ItkRegistrationParams* itkParams;
@@ -57,6 +58,8 @@
 
 - (Image2D::Pointer)slice:(unsigned)sliceIndex FromImage:(unsigned)imageIndex;
 
+- (void)requestDisplayUpdate;
+
 - (void)doRegistration;
 
 - (void)cancelRegistration;
@@ -38,6 +38,7 @@
         viewer = viewerController;
         progressController_ = progController;
         seriesInfo_ = seriesInfo;
+        displayUpdatePending_ = NO;
 
         // Copy the Objective-C params to itk params
         itkParams = new ItkRegistrationParams(params);
@@ -51,6 +52,11 @@
         for (unsigned idx = 0; idx < numImages; ++idx)
         {
             Image3D::Pointer image = [imageImporter getImageAtIndex:idx];
+
+            // The concurrent modes read the image from several threads. Cut it loose
+            // from its importer so that the filters reading it never update the
+            // importer. The slicer copies slices from the buffer without a pipeline.
+            image->DisconnectPipeline();
             slicer->AddImage(image);
         }
 
@@ -126,9 +132,7 @@
     float* imageData = slice->GetPixelContainer()->GetBufferPointer();
     memcpy(data, imageData, numBytes);
 
-    [viewer performSelectorOnMainThread:@selector(needsDisplayUpdate) withObject:nil
-                          waitUntilDone:YES];
-    
+    [self requestDisplayUpdate];
 }
 
 - (void)insertImageIntoViewer:(Image3D::Pointer)image Index:(unsigned)imageIndex
@@ -147,9 +151,7 @@
     float* imageData = image->GetPixelContainer()->GetBufferPointer();
     memcpy(data, imageData, numBytes);
 
-    [viewer performSelectorOnMainThread:@selector(needsDisplayUpdate) withObject:nil
-                          waitUntilDone:YES];
-    
+    [self requestDisplayUpdate];
 }
 
 - (Image2D::Pointer)slice:(unsigned int)sliceIndex FromImage:(unsigned int)imageIndex
@@ -159,6 +161,32 @@
     return slice;
 }
 
+- (void)requestDisplayUpdate
+{
+    // Several images may be written back in the time the viewer takes to redraw.
+    // Requests made while a refresh is waiting on the main thread are folded into it.
+    @synchronized(self)
+    {
+        if (displayUpdatePending_)
+            return;
+        displayUpdatePending_ = YES;
+    }
+
+    [self performSelectorOnMainThread:@selector(updateDisplay) withObject:nil
+                        waitUntilDone:NO];
+}
+
+- (void)updateDisplay
+{
+    // Clear the flag first so that an image written during the redraw asks for another.
+    @synchronized(self)
+    {
+        displayUpdatePending_ = NO;
+    }
+
+    [viewer needsDisplayUpdate];
+}
+
 - (void)doRegistration
 {
     LOG4M_TRACE(logger_, @"Enter");
@@ -172,7 +200,10 @@
     LOG4M_INFO(logger_, @"Starting registration.");
     
     unsigned numImages = itkParams->numImages;
-    [progressController_ setProgressMinimum:(double)0 andMaximum:(double)numImages];
+    unsigned numSteps = numImages;
+    if (itkParams->sliceWise && (itkParams->slicesPerImage > 1))
+        numSteps *= itkParams->slicesPerImage;
+    [progressController_ setProgressMinimum:(double)0 andMaximum:(double)numSteps];
 
     if (itkParams->regSequence == RigidBSpline)
     {
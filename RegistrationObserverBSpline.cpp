@@ -1,14 +1,12 @@
 //
-//  RegistrationObserverBSpline.mm
+//  RegistrationObserverBSpline.cpp
 //  DCEFit
 //
 //  Created by Tim Allman on 2013-04-25.
 //
 //
 
-#import "RegistrationObserverBSpline.h"
-#import "RegProgressValues.h"
-#import "ProgressWindowController.h"
+#include "RegistrationObserverBSpline.h"
 
 #include "OptimizerUtils.h"
 
@@ -33,6 +31,10 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
         LBFGSOpt = dynamic_cast<LBFGSOptimizer*>(multiResReg->GetOptimizer());
         RSGDOpt = dynamic_cast<RSGDOptimizer*>(multiResReg->GetOptimizer());
         versorOpt = dynamic_cast<VersorOptimizer*>(multiResReg->GetOptimizer());
+
+        // We were asked to stop before the registration started.
+        if (stopReg)
+            StopRegistration();
     }
 
     std::string eventName = event.GetEventName();
@@ -52,25 +54,20 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
             if (transformClassName.find("Rigid") != std::string::npos)
             {
                 LOG4CPLUS_INFO(logger_, "Multiresolution Rigid Registration level = " << level);
-                [progressWindowController performSelectorOnMainThread:@selector(setCurStage:)
-                                                           withObject:@"Rigid" waitUntilDone:YES];
+                progress->SetCurStage("Rigid");
             }
             else
             {
                 LOG4CPLUS_INFO(logger_, "Multiresolution Deformable Registration level = " << level);
-                [progressWindowController performSelectorOnMainThread:@selector(setCurStage:)
-                                                           withObject:@"Deformable" waitUntilDone:YES];
+                progress->SetCurStage("Deformable");
             }
 
             // Set the parameters for the current level.
             CalcMultiResRegistrationParameters();
 
-            [progressWindowController performSelectorOnMainThread:@selector(setMaxIterations:)
-                                                       withObject:[NSNumber numberWithUnsignedInt:maxIterSchedule[level]]
-                                                    waitUntilDone:YES];
+            progress->SetMaxIterations(maxIterSchedule[level]);
             
-            [progressWindowController performSelectorOnMainThread:@selector(setCurLevel:)
-                        withObject:[NSNumber numberWithUnsignedInt:level+1] waitUntilDone:YES];
+            progress->SetCurLevel(level + 1);
         }
         else if (LBFGSBOpt != 0) // the caller is the LBFGSB optimizer
         {
@@ -87,8 +84,7 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
                 iteration = curIteration;
                 double metricValue = LBFGSBOpt->GetValue();
 
-                [progressWindowController performSelectorOnMainThread:@selector(setCurMetric:)
-                        withObject:[NSNumber numberWithDouble:metricValue] waitUntilDone:YES];
+                progress->SetCurMetric(metricValue);
 
                 LOG4CPLUS_DEBUG(logger_, "** " << iteration << " [" << std::fixed
                                 << metricValue << "] ");
@@ -113,11 +109,9 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
 
                 iteration = curIteration;
                 double metricValue = RSGDOpt->GetValue();
-                [progressWindowController performSelectorOnMainThread:@selector(setCurMetric:)
-                                                           withObject:[NSNumber numberWithDouble:metricValue] waitUntilDone:YES];
+                progress->SetCurMetric(metricValue);
                 double stepSize = RSGDOpt->GetCurrentStepLength();
-                [progressWindowController performSelectorOnMainThread:@selector(setCurStepSize:)
-                                                           withObject:[NSNumber numberWithDouble:stepSize] waitUntilDone:YES];
+                progress->SetCurStepSize(stepSize);
 
                 LOG4CPLUS_DEBUG(logger_, "** " << iteration
                                 << " [metric: " << std::fixed << metricValue
@@ -142,11 +136,9 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
 
                 iteration = curIteration;
                 double metricValue = versorOpt->GetValue();
-                [progressWindowController performSelectorOnMainThread:@selector(setCurMetric:)
-                                                           withObject:[NSNumber numberWithDouble:metricValue] waitUntilDone:YES];
+                progress->SetCurMetric(metricValue);
                 double stepSize = versorOpt->GetCurrentStepLength();
-                [progressWindowController performSelectorOnMainThread:@selector(setCurStepSize:)
-                                                           withObject:[NSNumber numberWithDouble:stepSize] waitUntilDone:YES];
+                progress->SetCurStepSize(stepSize);
 
                 LOG4CPLUS_DEBUG(logger_, "** " << iteration
                                 << " [metric: " << std::fixed << metricValue
@@ -158,8 +150,7 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
             }
         }
 
-        [progressWindowController performSelectorOnMainThread:@selector(setCurIteration:)
-                                                   withObject:[NSNumber numberWithUnsignedInt:iteration] waitUntilDone:YES];
+        progress->SetCurIteration(iteration);
     }
     else if (eventName == "FunctionAndGradientEvaluationIterationEvent")
     {
@@ -188,8 +179,7 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
 
                 iteration = curIteration;
                 double metricValue = LBFGSOpt->GetValue();
-                [progressWindowController performSelectorOnMainThread:@selector(setCurMetric:)
-                                                           withObject:[NSNumber numberWithDouble:metricValue] waitUntilDone:YES];
+                progress->SetCurMetric(metricValue);
                 LOG4CPLUS_DEBUG(logger_, "** " << iteration
                                 << " [" << std::fixed << metricValue << "] ");
                 if (multiResReg->GetTransform()->GetNumberOfParameters() < 20)
@@ -197,8 +187,7 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
                                     << multiResReg->GetTransform()->GetParameters());
             }
 
-            [progressWindowController performSelectorOnMainThread:@selector(setCurIteration:)
-                    withObject:[NSNumber numberWithUnsignedInt:iteration] waitUntilDone:YES];
+            progress->SetCurIteration(iteration);
         }
     }
     else if (eventName == "EndEvent")
@@ -206,9 +195,7 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
         if (LBFGSBOpt != 0)
         {
             std::string stopConditionDesc = LBFGSBOpt->GetStopConditionDescription();
-            NSString* stopCondDesc = [NSString stringWithUTF8String:stopConditionDesc.c_str()];
-            [progressWindowController performSelectorOnMainThread:@selector(setStopCondition:)
-                                                       withObject:stopCondDesc waitUntilDone:YES];
+            progress->SetStopCondition(stopConditionDesc);
 
         }
         else if (LBFGSOpt != 0)
@@ -229,9 +216,7 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
             {
                 stopConditionDesc = LBFGSOpt->GetStopConditionDescription();
             }
-            NSString* stopCondDesc = [NSString stringWithUTF8String:stopConditionDesc.c_str()];
-            [progressWindowController performSelectorOnMainThread:@selector(setStopCondition:)
-                                                       withObject:stopCondDesc waitUntilDone:YES];
+            progress->SetStopCondition(stopConditionDesc);
         }
         else if (RSGDOpt != 0)
         {
@@ -259,9 +244,7 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
                     break;
             }
             stopConditionDesc += RSGDOpt->GetStopConditionDescription();
-            NSString* stopCondDesc = [NSString stringWithUTF8String:stopConditionDesc.c_str()];
-            [progressWindowController performSelectorOnMainThread:@selector(setStopCondition:)
-                                                       withObject:stopCondDesc waitUntilDone:YES];
+            progress->SetStopCondition(stopConditionDesc);
         }
         else if (versorOpt != 0)
         {
@@ -289,9 +272,7 @@ void RegistrationObserverBSpline<TImage>::Execute(itk::Object* caller, const itk
                     break;
             }
             stopConditionDesc += versorOpt->GetStopConditionDescription();
-            NSString* stopCondDesc = [NSString stringWithUTF8String:stopConditionDesc.c_str()];
-            [progressWindowController performSelectorOnMainThread:@selector(setStopCondition:)
-                                                       withObject:stopCondDesc waitUntilDone:YES];
+            progress->SetStopCondition(stopConditionDesc);
 
         }
         else
@@ -313,9 +294,13 @@ void RegistrationObserverBSpline<TImage>::CalcMultiResRegistrationParameters()
 
     typedef itk::BSplineTransform<double, TImage::ImageDimension, BSPLINE_ORDER> BSplineTransform;
     typedef itk::MattesMutualInformationImageToImageMetric<TImage, TImage> MMIMetric;
+    typedef FastMattesMIImageToImageMetric<TImage, TImage> FastMMIMetric;
+    typedef ThreadedSampleMetric<TImage, TImage> SampledMetric;
 
     BSplineTransform* bsplineTransform = dynamic_cast<BSplineTransform*>(multiResReg->GetTransform());
     MMIMetric* mmiMetric = dynamic_cast<MMIMetric*>(multiResReg->GetMetric());
+    FastMMIMetric* fastMMIMetric = dynamic_cast<FastMMIMetric*>(multiResReg->GetMetric());
+    SampledMetric* sampledMetric = dynamic_cast<SampledMetric*>(multiResReg->GetMetric());
     
     // for logging information below
     std::ostringstream stream;
@@ -325,6 +310,10 @@ void RegistrationObserverBSpline<TImage>::CalcMultiResRegistrationParameters()
     unsigned numberOfParameters = multiResReg->GetTransform()->GetNumberOfParameters();
     LOG4CPLUS_DEBUG(logger_, "Registration level = " << level);
 
+    // Our share of the cores for this level. The metric sets up its per thread
+    // storage when the registration initialises the level, after this event.
+    multiResReg->GetMetric()->SetNumberOfThreads(RebalanceThreads(level));
+
     // If this is the first pass (ie level == 0) the transform has partially
     // already been set up because it is used by the registration object to
     // set up the image pyramids before this event is created. Other objects
@@ -448,44 +437,13 @@ void RegistrationObserverBSpline<TImage>::CalcMultiResRegistrationParameters()
                         << versorOpt->GetNumberOfIterations());
     }
 
-    // Mattes et al eq 19 (sort of)
-    // We need to calculate the number of pixels in the current registration
-    // region for calculations below. We will just use the fixed image region
-    // and divide it by the appropriate values from the schedule. We will assume
-    // that the fixed and moving images are the same size.
+    // Our other sampled metrics take the sample rate of the MMI settings.
     if (mmiMetric != 0)
-    {
-        typename RegistrationMethod::ScheduleType pyramidSchedule =
-                                       multiResReg->GetFixedImagePyramidSchedule();
-        unsigned numPixels = multiResReg->GetFixedImageRegion().GetNumberOfPixels();
-        unsigned numSamples = numPixels;
-        
-        if (mmiSampleRateSchedule[level] > 0.999)
-            mmiMetric->UseAllPixelsOn();
-        else
-        {
-            float columnFactor = pyramidSchedule[level][0];   // linear factor in column dimension
-            float rowFactor = pyramidSchedule[level][1];      // linear factor in row dimension
-            numSamples /= columnFactor * rowFactor;           // use floats to avoid integer division
-            numSamples *= mmiSampleRateSchedule[level];          // apply user setting for sample rate
-            mmiMetric->SetNumberOfSpatialSamples(numSamples);
-        }
-
-        mmiMetric->SetNumberOfHistogramBins(mmiNumBinsSchedule[level]);
-
-        LOG4CPLUS_DEBUG(logger_, "Mattes MI parameters");
-        LOG4CPLUS_DEBUG(logger_, "   Multiresolution level  = " << level);
-        LOG4CPLUS_DEBUG(logger_, "   Column shrink factor   = " << pyramidSchedule[level][0]);
-        LOG4CPLUS_DEBUG(logger_, "   Row shrink factor      = " << pyramidSchedule[level][1]);
-        LOG4CPLUS_DEBUG(logger_, "   Number of pixels       = " << numPixels);
-        if (mmiMetric->GetUseAllPixels())
-            LOG4CPLUS_DEBUG(logger_, "   Using all pixels.");
-        else
-            LOG4CPLUS_DEBUG(logger_, "   Number of samples      = "
-                            << mmiMetric->GetNumberOfSpatialSamples());
-        LOG4CPLUS_DEBUG(logger_, "   Number of bins         = "
-                        << mmiMetric->GetNumberOfHistogramBins());
-    }
+        SetMMIParameters(mmiMetric, level);
+    else if (fastMMIMetric != 0)
+        SetMMIParameters(fastMMIMetric, level);
+    else if (sampledMetric != 0)
+        SetSamplingParameters(sampledMetric, level);
     
 //    stream.str("");
 //    stream << "Transform in CalcMultiResRegistrationParameters" << std::endl;
@@ -494,3 +452,53 @@ void RegistrationObserverBSpline<TImage>::CalcMultiResRegistrationParameters()
 //    stream << "==============================" << std::endl;
 //    LOG4CPLUS_TRACE(logger_, stream.str());
 }
+
+template <class TImage>
+template <class TMetric>
+void RegistrationObserverBSpline<TImage>::SetMMIParameters(TMetric* metric, unsigned level)
+{
+    SetSamplingParameters(metric, level);
+    metric->SetNumberOfHistogramBins(mmiNumBinsSchedule[level]);
+    LOG4CPLUS_DEBUG(logger_, "   Number of bins         = "
+                    << metric->GetNumberOfHistogramBins());
+}
+
+template <class TImage>
+template <class TMetric>
+void RegistrationObserverBSpline<TImage>::SetSamplingParameters(TMetric* metric, unsigned level)
+{
+    // Mattes et al eq 19 (sort of)
+    // We need to calculate the number of pixels in the current registration
+    // region for calculations below. We will just use the fixed image region
+    // and divide it by the appropriate values from the schedule. We will assume
+    // that the fixed and moving images are the same size.
+    typename RegistrationMethod::ScheduleType pyramidSchedule =
+                                   multiResReg->GetFixedImagePyramidSchedule();
+    unsigned numPixels = multiResReg->GetFixedImageRegion().GetNumberOfPixels();
+    unsigned numSamples = numPixels;
+    
+    if (mmiSampleRateSchedule[level] > 0.999)
+        metric->UseAllPixelsOn();
+    else
+    {
+        float shrinkFactor = 1.0f;                        // product of the linear factors
+        for (unsigned dim = 0; dim < pyramidSchedule.cols(); ++dim)
+            shrinkFactor *= pyramidSchedule[level][dim];
+        numSamples /= shrinkFactor;                       // use floats to avoid integer division
+        numSamples *= mmiSampleRateSchedule[level];          // apply user setting for sample rate
+        metric->SetNumberOfSpatialSamples(numSamples);
+    }
+
+    LOG4CPLUS_DEBUG(logger_, "Metric sampling parameters");
+    LOG4CPLUS_DEBUG(logger_, "   Multiresolution level  = " << level);
+    LOG4CPLUS_DEBUG(logger_, "   Column shrink factor   = " << pyramidSchedule[level][0]);
+    LOG4CPLUS_DEBUG(logger_, "   Row shrink factor      = " << pyramidSchedule[level][1]);
+    if (pyramidSchedule.cols() > 2)
+        LOG4CPLUS_DEBUG(logger_, "   Slice shrink factor    = " << pyramidSchedule[level][2]);
+    LOG4CPLUS_DEBUG(logger_, "   Number of pixels       = " << numPixels);
+    if (metric->GetUseAllPixels())
+        LOG4CPLUS_DEBUG(logger_, "   Using all pixels.");
+    else
+        LOG4CPLUS_DEBUG(logger_, "   Number of samples      = "
+                        << metric->GetNumberOfSpatialSamples());
+}
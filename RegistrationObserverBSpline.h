@@ -167,6 +167,12 @@ public:
     {
         stopReg = true;
         LOG4CPLUS_DEBUG(logger_, "Registration stopped. Exiting.");
+
+        // The registration may not have started yet. Execute() will stop it
+        // when the first event arrives.
+        if (multiResReg == 0)
+            return;
+
         multiResReg->StopRegistration();
 
         if (LBFGSBOpt != 0)
@@ -185,7 +191,7 @@ protected:
     * Constructor is not public to conform to ITK style.
     */
     RegistrationObserverBSpline()
-    : multiResReg(0), gradientCalls(0)
+    : multiResReg(0), LBFGSBOpt(0), LBFGSOpt(0), RSGDOpt(0), versorOpt(0), gradientCalls(0)
     {
         std::string name = std::string(LOGGER_NAME) + ".RegistrationObserverBSpline";
         logger_ = log4cplus::Logger::getInstance(name);
@@ -197,7 +203,24 @@ protected:
      * multi-resolution registration.
      */
     void CalcMultiResRegistrationParameters();
-    
+
+    /**
+     * Set the number of samples and bins of a Mattes MI metric for a level.
+     * @param metric Either of the Mattes MI metrics.
+     * @param level The registration level.
+     */
+    template <class TMetric>
+    void SetMMIParameters(TMetric* metric, unsigned level);
+
+    /**
+     * Set the number of samples of a sampled metric for a level from the MMI
+     * sample rate schedule.
+     * @param metric The metric.
+     * @param level The registration level.
+     */
+    template <class TMetric>
+    void SetSamplingParameters(TMetric* metric, unsigned level);
+
 private:
     /// The registration method object
     itk::MultiResolutionImageRegistrationMethod<TImage, TImage>* multiResReg;
@@ -10,6 +10,8 @@
 #define DCEFit_RegistrationObserverBase_h
 
 #include "ItkRegistrationParams.h"
+#include "CoreScheduler.h"
+#include "RegistrationProgress.h"
 
 #include <itkCommand.h>
 
@@ -17,13 +19,6 @@
 
 class MultiResRegistration;
 
-#ifdef __OBJC__
-@class ProgressWindowController;
-typedef ProgressWindowController* ProgressWindowControllerPtr;
-#else
-typedef void* ProgressWindowControllerPtr;
-#endif
-
 /**
  * Observer class for deformable registrations.
  * This class is an event observer that is called after each iteration of the
@@ -97,12 +92,24 @@ public:
     }
 
     /**
-     * Sets the pointer to the progress window controller.
-     * @param pointer to the ProgressWindowController instance.
+     * Sets where the progress of the registration is reported.
+     * @param progress The receiver of the reports.
+     */
+    virtual void SetProgress(RegistrationProgress* progress)
+    {
+        this->progress = progress;
+    }
+
+    /**
+     * Ask the scheduler for this registration's share of the cores for a level.
+     * Call it at each change of level.
+     * @param level The level about to start.
+     * @return The number of threads to use for the level.
      */
-    virtual void SetProgressWindowController(ProgressWindowController* controller)
+    unsigned RebalanceThreads(unsigned level)
     {
-        progressWindowController = controller;
+        numThreads = CoreScheduler::GetInstance().AcquireThreads(numThreads, level, numLevels);
+        return numThreads;
     }
 
 protected:
@@ -111,10 +118,19 @@ protected:
      * Constructor is not public to conform to ITK style.
      */
     RegistrationObserverBase()
-    : stopReg(false), iteration(0), numLevels(0)
+    : stopReg(false), iteration(0), numLevels(0), numThreads(0),
+      progress(RegistrationProgress::GetNull())
     {
     }
 
+    /**
+     * Destructor. Gives back the threads held.
+     */
+    virtual ~RegistrationObserverBase()
+    {
+        CoreScheduler::GetInstance().ReleaseThreads(numThreads);
+    }
+
     log4cplus::Logger logger_;
 
     /// Stops the registration when set.
@@ -126,8 +142,11 @@ protected:
     /// Number of levels for this registration.
     unsigned numLevels;
 
-    // Used for displaying progress in GUI
-    ProgressWindowControllerPtr progressWindowController;
+    /// Number of threads allocated by the scheduler for the current level.
+    unsigned numThreads;
+
+    /// Receives the progress of the registration.
+    RegistrationProgress* progress;
 };
 
 #endif
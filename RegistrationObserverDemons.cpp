@@ -1,14 +1,12 @@
 //
-//  RegistrationObserverDemons.mm
+//  RegistrationObserverDemons.cpp
 //  DCEFit
 //
 //  Created by Tim Allman on 2013-04-25.
 //
 //
 
-#import "RegistrationObserverDemons.h"
-#import "RegProgressValues.h"
-#import "ProgressWindowController.h"
+#include "RegistrationObserverDemons.h"
 
 #include <itkCommand.h>
 
@@ -48,17 +46,14 @@ void RegistrationObserverDemons<TImage, TDisplacementField>::Execute(itk::Object
 
             // Set the parameters for the current level.
             regFilter->SetMaximumRMSError(optimizerConvergenceSchedule[level]);
+            regFilter->SetNumberOfThreads(RebalanceThreads(level));
 
             LOG4CPLUS_DEBUG(logger_, "  RMS error set to "
                             << std::fixed << std::setprecision(4) << regFilter->GetMaximumRMSError());
 
-            [progressWindowController performSelectorOnMainThread:@selector(setCurLevel:)
-                                                       withObject:[NSNumber numberWithUnsignedInt:level+1] waitUntilDone:YES];
-            [progressWindowController performSelectorOnMainThread:@selector(setCurStage:)
-                                                       withObject:@"Demons" waitUntilDone:YES];
-            [progressWindowController performSelectorOnMainThread:@selector(setMaxIterations:)
-                                                       withObject:[NSNumber numberWithUnsignedInt:maxIterSchedule[level]]
-                                                    waitUntilDone:YES];
+            progress->SetCurLevel(level + 1);
+            progress->SetCurStage("Demons");
+            progress->SetMaxIterations(maxIterSchedule[level]);
         }
     }
     else if (eventName == "IterationEvent")
@@ -70,11 +65,9 @@ void RegistrationObserverDemons<TImage, TDisplacementField>::Execute(itk::Object
             //double metricValue = regFilter->GetMetric();
             double diff = regFilter->GetRMSChange();
 
-            [progressWindowController performSelectorOnMainThread:@selector(setCurMetric:)
-                                                       withObject:[NSNumber numberWithDouble:diff] waitUntilDone:YES];
+            progress->SetCurMetric(diff);
 
-            [progressWindowController performSelectorOnMainThread:@selector(setCurIteration:)
-                                                       withObject:[NSNumber numberWithUnsignedInt:iteration] waitUntilDone:YES];
+            progress->SetCurIteration(iteration);
 
             LOG4CPLUS_DEBUG(logger_, "** Iteration: " << iteration
                             << " [" << std::fixed << std::setprecision(4) << diff << "] ");
@@ -104,9 +97,7 @@ void RegistrationObserverDemons<TImage, TDisplacementField>::Execute(itk::Object
 
         stopCondition = str.str();
 
-        NSString* stopCondDesc = [NSString stringWithUTF8String:stopCondition.c_str()];
-        [progressWindowController performSelectorOnMainThread:@selector(setStopCondition:)
-                                                   withObject:stopCondDesc waitUntilDone:YES];
+        progress->SetStopCondition(stopCondition);
         LOG4CPLUS_DEBUG(logger_, str.str());
     }
     else
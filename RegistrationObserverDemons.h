@@ -18,13 +18,6 @@
 
 class MultiResRegistration;
 
-#ifdef __OBJC__
-@class ProgressWindowController;
-typedef ProgressWindowController* ProgressWindowControllerPtr;
-#else
-typedef void* ProgressWindowControllerPtr;
-#endif
-
 /**
  * Observer class for demons registrations.
  * This class is an event observer that is called after each iteration of the
@@ -93,7 +86,8 @@ public:
     {
         stopReg = true;
         LOG4CPLUS_DEBUG(logger_, "Registration stopped. Exiting.");
-        multiResReg->StopRegistration();
+        if (multiResReg != 0)
+            multiResReg->StopRegistration();
 
         //        else if (versorOpt != 0)
         //            versorOpt->SetNumberOfIterations(1);
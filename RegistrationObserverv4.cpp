@@ -0,0 +1,167 @@
+//
+//  RegistrationObserverv4.cpp
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#include "RegistrationObserverv4.h"
+
+#include <itkCommand.h>
+
+#include <log4cplus/loggingmacros.h>
+
+template <class TRegistration>
+void RegistrationObserverv4<TRegistration>::Execute(itk::Object* caller, const itk::EventObject& event)
+{
+    // The first event comes from the registration object as it starts the
+    // first level. We use it to find the optimiser.
+    RegistrationMethod* reg = dynamic_cast<RegistrationMethod*>(caller);
+    if (reg != 0)
+    {
+        registration = reg;
+        RSGDOpt = dynamic_cast<RSGDOptimizerv4*>(registration->GetModifiableOptimizer());
+        LBFGSBOpt = dynamic_cast<LBFGSBOptimizerv4*>(registration->GetModifiableOptimizer());
+    }
+
+    if (itk::MultiResolutionIterationEvent().CheckEvent(&event) && (reg != 0))
+    {
+        LOG4CPLUS_TRACE(logger_, event.GetEventName());
+
+        // Change levels
+        iteration = 0;
+
+        unsigned level = registration->GetCurrentLevel();
+        LOG4CPLUS_INFO(logger_, "ITKv4 " << stageName << " Registration level = " << level);
+        progress->SetCurStage(stageName);
+
+        // Set the parameters for the current level.
+        CalcMultiResRegistrationParameters();
+
+        progress->SetMaxIterations(maxIterSchedule[level]);
+        progress->SetCurLevel(level + 1);
+
+        // We were asked to stop before this level started.
+        if (stopReg)
+            StopRegistration();
+    }
+    else if (itk::IterationEvent().CheckEvent(&event))
+    {
+        LOG4CPLUS_TRACE(logger_, event.GetEventName());
+
+        double metricValue = 0.0;
+        if (RSGDOpt != 0)
+        {
+            iteration = RSGDOpt->GetCurrentIteration();
+            metricValue = RSGDOpt->GetValue();
+            progress->SetCurStepSize(RSGDOpt->GetLearningRate());
+        }
+        else if (LBFGSBOpt != 0)
+        {
+            iteration = LBFGSBOpt->GetCurrentIteration();
+            metricValue = LBFGSBOpt->GetValue();
+        }
+        else
+        {
+            LOG4CPLUS_WARN(logger_, "Unexpected IterationEvent. Caller: " << caller->GetNameOfClass());
+            return;
+        }
+
+        progress->SetCurMetric(metricValue);
+        progress->SetCurIteration(iteration);
+
+        LOG4CPLUS_DEBUG(logger_, "** " << iteration << " [" << std::fixed << metricValue << "] ");
+    }
+    else
+    {
+        LOG4CPLUS_WARN(logger_, "Unexpected event: " << event.GetEventName());
+    }
+}
+
+template <class TRegistration>
+void RegistrationObserverv4<TRegistration>::CalcMultiResRegistrationParameters()
+{
+    LOG4CPLUS_TRACE(logger_, "Enter");
+
+    unsigned level = registration->GetCurrentLevel();
+    MetricType* metric = dynamic_cast<MetricType*>(registration->GetModifiableMetric());
+
+    // The transform of this level has been adapted by now so this is the
+    // number of parameters being optimised.
+    unsigned numberOfParameters = metric->GetNumberOfParameters();
+
+    // Our share of the cores for this level. The v4 metrics and optimisers split
+    // their work over as many threads as they are allowed.
+    unsigned numThreads = RebalanceThreads(level);
+    metric->SetMaximumNumberOfThreads(numThreads);
+    registration->GetModifiableOptimizer()->SetNumberOfThreads(numThreads);
+    LOG4CPLUS_DEBUG(logger_, "Threads set to " << numThreads);
+
+    // Set the optimizer termination criterion
+    if (RSGDOpt != 0)
+    {
+        RSGDOpt->SetLearningRate(rsgdMaxStepSizeSchedule[level]);
+        RSGDOpt->SetMinimumStepLength(rsgdMinStepSizeSchedule[level]);
+        RSGDOpt->SetRelaxationFactor(rsgdRelaxationFactorSchedule[level]);
+        RSGDOpt->SetNumberOfIterations(maxIterSchedule[level]);
+
+        RSGDOptimizerv4::ScalesType scales = RSGDOpt->GetScales();
+        if (scales.GetSize() != numberOfParameters)
+        {
+            scales.SetSize(numberOfParameters);
+            scales.Fill(1.0);
+        }
+
+        // here we change only the translation scaling
+        if (useTranslationScales)
+            scales[3] = scales[4] = scales[5] = translationScaleSchedule[level];
+        RSGDOpt->SetScales(scales);
+
+        LOG4CPLUS_DEBUG(logger_, "Min. step size set to " << RSGDOpt->GetMinimumStepLength());
+        LOG4CPLUS_DEBUG(logger_, "Max. step size set to " << RSGDOpt->GetLearningRate());
+        LOG4CPLUS_DEBUG(logger_, "Relaxation factor set to " << RSGDOpt->GetRelaxationFactor());
+        LOG4CPLUS_DEBUG(logger_, "Max. iterations set to " << RSGDOpt->GetNumberOfIterations());
+    }
+    else if (LBFGSBOpt != 0)
+    {
+        LBFGSBOpt->SetCostFunctionConvergenceFactor(lbfgsbConvergenceSchedule[level]);
+        LBFGSBOpt->SetGradientConvergenceTolerance(lbfgsbGradientToleranceSchedule[level]);
+        LBFGSBOpt->SetNumberOfIterations(maxIterSchedule[level]);
+        LBFGSBOpt->SetMaximumNumberOfFunctionEvaluations(maxIterSchedule[level]);
+
+        LOG4CPLUS_DEBUG(logger_, "Convergence factor set to "
+                        << LBFGSBOpt->GetCostFunctionConvergenceFactor());
+        LOG4CPLUS_DEBUG(logger_, "Gradient tolerance set to "
+                        << LBFGSBOpt->GetGradientConvergenceTolerance());
+        LOG4CPLUS_DEBUG(logger_, "Max. iterations set to " << maxIterSchedule[level]);
+
+        // Update bounds arrays to reflect new parameter length
+        LBFGSBOptimizerv4::BoundSelectionType boundSelect(numberOfParameters);
+        LBFGSBOptimizerv4::BoundValueType upperBound(numberOfParameters);
+        LBFGSBOptimizerv4::BoundValueType lowerBound(numberOfParameters);
+        boundSelect.Fill(0);
+        upperBound.Fill(0.0);
+        lowerBound.Fill(0.0);
+        LBFGSBOpt->SetBoundSelection(boundSelect);
+        LBFGSBOpt->SetUpperBound(upperBound);
+        LBFGSBOpt->SetLowerBound(lowerBound);
+    }
+
+    // The metric has been initialised for this level so it must be initialised
+    // again if the histogram changes.
+    MMIMetricType* mmiMetric = dynamic_cast<MMIMetricType*>(metric);
+    if ((mmiMetric != 0) && (mmiMetric->GetNumberOfHistogramBins() != mmiNumBinsSchedule[level]))
+    {
+        mmiMetric->SetNumberOfHistogramBins(mmiNumBinsSchedule[level]);
+        mmiMetric->Initialize();
+    }
+
+    if (mmiMetric != 0)
+    {
+        LOG4CPLUS_DEBUG(logger_, "Mattes MI parameters");
+        LOG4CPLUS_DEBUG(logger_, "   Multiresolution level  = " << level);
+        LOG4CPLUS_DEBUG(logger_, "   Number of bins         = "
+                        << mmiMetric->GetNumberOfHistogramBins());
+    }
+}
@@ -0,0 +1,208 @@
+//
+//  RegistrationObserverv4.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__RegistrationObserverv4__
+#define __DCEFit__RegistrationObserverv4__
+
+#include "ItkTypedefs.h"
+#include "ItkRegistrationParams.h"
+
+#include "RegistrationObserverBase.h"
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+/**
+ * Observer class for registrations done with itk::ImageRegistrationMethodv4.
+ * It responds to the MultiResolutionIterationEvents of the registration object
+ * and to the IterationEvents of the RegularStepGradientDescentOptimizerv4 and
+ * LBFGSBOptimizerv4 optimisers.
+ *
+ * The registration object sets up the shrink factors, the smoothing, the sampling
+ * and the B-spline grid of each level itself. This updates the optimiser and the
+ * metric at each resolution change.
+ */
+template <class TRegistration>
+class RegistrationObserverv4: public RegistrationObserverBase
+{
+public:
+    typedef RegistrationObserverv4 Self;
+    typedef itk::Command Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    itkNewMacro(Self);
+
+    typedef TRegistration RegistrationMethod;
+    typedef typename TRegistration::FixedImageType ImageType;
+    typedef itk::ImageToImageMetricv4<ImageType, ImageType> MetricType;
+    typedef itk::MattesMutualInformationImageToImageMetricv4<ImageType, ImageType> MMIMetricType;
+
+    /**
+     * Called by the registration or optimisation object after each iteration.
+     * @param caller Pointer to the caller
+     * @param event Reference to an EventObject. Should be a MultiResolutionIterationEvent
+     * or an IterationEvent.
+     */
+    void Execute(itk::Object* caller, const itk::EventObject& event);
+
+    /**
+     * @param name The name of the stage reported to the progress receiver.
+     */
+    void SetStageName(const std::string& name)
+    {
+        stageName = name;
+    }
+
+    /**
+     * Set the multilevel schedule for the MMI metric. The sample rate is given to the
+     * registration object, which draws the samples in the virtual domain.
+     * @param bins The number of bins in the histogram.
+     */
+    void SetMMISchedules(const ParamVector<unsigned>& bins)
+    {
+        for (unsigned idx = 0; idx < numLevels; ++idx)
+            mmiNumBinsSchedule[numLevels - idx - 1] = bins[idx];
+    }
+
+    /**
+     * Set the multilevel schedules for the LBFGSB optimizer.
+     * @param convergence The metric convergence schedule.
+     * @param gradientTolerance The gradient tolerance schedule.
+     * @param iterations The maximum number of iterations schedule.
+     */
+    void SetLBFGSBSchedules(const ParamVector<float>& convergence,
+                            const ParamVector<float>& gradientTolerance,
+                            const ParamVector<unsigned>& iterations)
+    {
+        for (unsigned idx = 0; idx < numLevels; ++idx)
+        {
+            lbfgsbConvergenceSchedule[numLevels - idx - 1] = convergence[idx];
+            lbfgsbGradientToleranceSchedule[numLevels - idx - 1] = gradientTolerance[idx];
+            maxIterSchedule[numLevels - idx - 1] = iterations[idx];
+        }
+    }
+
+    /**
+     * Set the multilevel schedules for the RSGD optimizer.
+     * @param minStepSize The minimum step size schedule.
+     * @param maxStepSize The maximum step size schedule.
+     * @param relaxationFactor The relaxation factor schedule.
+     * @param iterations The maximum number of iterations schedule.
+     */
+    void SetRSGDSchedules(const ParamVector<float>& minStepSize,
+                          const ParamVector<float>& maxStepSize,
+                          const ParamVector<float>& relaxationFactor,
+                          const ParamVector<unsigned>& iterations)
+    {
+        for (unsigned idx = 0; idx < numLevels; ++idx)
+        {
+            rsgdMinStepSizeSchedule[numLevels - idx - 1] = minStepSize[idx];
+            rsgdMaxStepSizeSchedule[numLevels - idx - 1] = maxStepSize[idx];
+            rsgdRelaxationFactorSchedule[numLevels - idx - 1] = relaxationFactor[idx];
+            maxIterSchedule[numLevels - idx - 1] = iterations[idx];
+        }
+    }
+
+    /**
+     * Set the multilevel schedules of the Versor parameters. The v4 regular step
+     * optimiser composes versors itself so these drive that optimiser.
+     * @param minStepSize The minimum step size schedule.
+     * @param maxStepSize The maximum step size schedule.
+     * @param relaxationFactor The relaxation factor schedule.
+     * @param scaleFactor The translation scale factor.
+     * @param iterations The maximum number of iterations schedule.
+     */
+    void SetVersorSchedules(const ParamVector<float>& minStepSize,
+                            const ParamVector<float>& maxStepSize,
+                            const ParamVector<float>& relaxationFactor,
+                            const ParamVector<float>& scaleFactor,
+                            const ParamVector<unsigned>& iterations)
+    {
+        SetRSGDSchedules(minStepSize, maxStepSize, relaxationFactor, iterations);
+        for (unsigned idx = 0; idx < numLevels; ++idx)
+            translationScaleSchedule[numLevels - idx - 1] = scaleFactor[idx];
+        useTranslationScales = true;
+    }
+
+    /**
+     *	Terminates the registration.
+     */
+    void StopRegistration()
+    {
+        stopReg = true;
+        LOG4CPLUS_DEBUG(logger_, "Registration stopped. Exiting.");
+
+        // The registration object cannot be stopped but its remaining levels are
+        // cut short when they start. Execute() also does this if the registration
+        // has not started yet.
+        if (RSGDOpt != 0)
+        {
+            RSGDOpt->SetNumberOfIterations(1);
+            RSGDOpt->StopOptimization();
+        }
+        else if (LBFGSBOpt != 0)
+        {
+            LBFGSBOpt->SetNumberOfIterations(1);
+            LBFGSBOpt->SetMaximumNumberOfFunctionEvaluations(1);
+        }
+    }
+
+protected:
+    /**
+     * Default constructor.
+     * Constructor is not public to conform to ITK style.
+     */
+    RegistrationObserverv4()
+    : registration(0), RSGDOpt(0), LBFGSBOpt(0), useTranslationScales(false)
+    {
+        std::string name = std::string(LOGGER_NAME) + ".RegistrationObserverv4";
+        logger_ = log4cplus::Logger::getInstance(name);
+        LOG4CPLUS_TRACE(logger_, "Enter");
+    }
+
+    /**
+     * Sets the registration parameters at each level of the registration.
+     */
+    void CalcMultiResRegistrationParameters();
+
+private:
+    /// The registration method object
+    RegistrationMethod* registration;
+
+    /// The optimizers. Only one will be set.
+    RSGDOptimizerv4* RSGDOpt;
+    LBFGSBOptimizerv4* LBFGSBOpt;
+
+    /// Reported to the progress receiver at each level.
+    std::string stageName;
+
+    /// schedule for multiresolution number of bins for
+    /// Mattes mutual information metric
+    ParamVector<unsigned> mmiNumBinsSchedule;
+
+    /// schedules for LBFGSB optimization
+    ParamVector<float> lbfgsbConvergenceSchedule;
+    ParamVector<float> lbfgsbGradientToleranceSchedule;
+
+    /// schedules for RSGD optimization
+    ParamVector<float> rsgdMinStepSizeSchedule;
+    ParamVector<float> rsgdMaxStepSizeSchedule;
+    ParamVector<float> rsgdRelaxationFactorSchedule;
+
+    /// schedule for the translation scales of a rigid transform
+    ParamVector<float> translationScaleSchedule;
+    bool useTranslationScales;
+
+    /// schedule for multiresolution maximum number of iterations for
+    ParamVector<unsigned> maxIterSchedule;
+};
+
+// Explictly instantiate these classes
+template class RegistrationObserverv4<RigidRegistrationMethod3Dv4>;
+template class RegistrationObserverv4<BSplineRegistrationMethod3Dv4>;
+
+#endif /* defined(__DCEFit__RegistrationObserverv4__) */
@@ -27,6 +27,19 @@
     unsigned fixedImageNumber;
     unsigned slicesPerImage;
     BOOL flippedData;
+    BOOL parallelSeriesReg;
+    unsigned maxConcurrentImages;
+    BOOL sliceWiseReg;
+    enum WarmStartType warmStart;
+    BOOL checkpointReg;
+    enum FailurePolicyType failurePolicy;
+    enum RegistrationEngineType registrationEngine;
+    BOOL cropToRegion;
+    float cropMargin;
+    BOOL motionCheck;
+    float motionMaxShift;
+    float motionMinCorrelation;
+    enum MetricPrecisionType metricPrecision;
 
     // Series description in DICOM file
     NSString* seriesDescription;
@@ -45,6 +58,7 @@
     unsigned rigidRegMultiresLevels;
     enum MetricType rigidRegMetric;
     enum OptimizerType rigidRegOptimizer;
+    BOOL rigidRegPhaseCorrelation;
     NSMutableArray* rigidRegMMIHistogramBins;  // contains NSNumbers (unsigned)
     NSMutableArray* rigidRegMMISampleRate;     // contains NSNumbers (float)
     NSMutableArray* rigidRegLBFGSBCostConvergence;
@@ -100,6 +114,19 @@
 @property (assign) unsigned fixedImageNumber;   ///< What the user sees, ie 1,2,3.
 @property (assign) unsigned slicesPerImage;     ///< Number of 2D slices in each image.
 @property (assign) BOOL flippedData;            ///< OsiriX flippedData flag.
+@property (assign) BOOL parallelSeriesReg;      ///< Register the images of the series concurrently.
+@property (assign) unsigned maxConcurrentImages; ///< Max. images registered at once. 0 = system decides.
+@property (assign) BOOL sliceWiseReg;           ///< Register multi-slice series slice by slice.
+@property (assign) enum WarmStartType warmStart; ///< Seed each time point from its neighbours.
+@property (assign) BOOL checkpointReg;          ///< Save finished images so that a stopped run can resume.
+@property (assign) enum FailurePolicyType failurePolicy; ///< What to do when a registration stage fails.
+@property (assign) enum RegistrationEngineType registrationEngine; ///< Framework used for 3D rigid and B-spline registration.
+@property (assign) BOOL cropToRegion;          ///< Register crops of the region plus a margin.
+@property (assign) float cropMargin;           ///< Margin around the region in mm when cropping.
+@property (assign) BOOL motionCheck;           ///< Skip images which have not moved.
+@property (assign) float motionMaxShift;        ///< Largest shift in mm of an image which has not moved.
+@property (assign) float motionMinCorrelation;  ///< Least correlation of an image which has not moved.
+@property (assign) enum MetricPrecisionType metricPrecision; ///< Precision of the per pixel metric arithmetic.
 @property (copy) NSString* seriesDescription;   ///< Description to save with new series.
 @property (copy) Region2D* fixedImageRegion;    ///< Registration region in plane of the slices.
 @property (retain) NSMutableArray* fixedImageMask;  ///< Spatial object registration. mask.
@@ -108,6 +135,7 @@
 @property (assign) unsigned rigidRegMultiresLevels;  /**< Number of levels to use (0 - 4). */
 @property (assign) enum MetricType rigidRegMetric;   /**< The metric to use. (enum value) */
 @property (assign) enum OptimizerType rigidRegOptimizer;     /**< The optimizer to use. (enum value) */
+@property (assign) BOOL rigidRegPhaseCorrelation;  /**< Start from the translation found by phase correlation. */
 @property (retain) NSMutableArray* rigidRegMMIHistogramBins; /**< Number of bins for MMI metric. */
 @property (retain) NSMutableArray* rigidRegMMISampleRate; /**< Fraction of voxels to sample for MMI. */
 @property (retain) NSMutableArray* rigidRegLBFGSBCostConvergence;  /**< LBFGSB termination criterion. */
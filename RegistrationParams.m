@@ -24,6 +24,19 @@
 @synthesize fixedImageNumber;
 @synthesize slicesPerImage;
 @synthesize flippedData;
+@synthesize parallelSeriesReg;
+@synthesize maxConcurrentImages;
+@synthesize sliceWiseReg;
+@synthesize warmStart;
+@synthesize checkpointReg;
+@synthesize failurePolicy;
+@synthesize registrationEngine;
+@synthesize cropToRegion;
+@synthesize cropMargin;
+@synthesize motionCheck;
+@synthesize motionMaxShift;
+@synthesize motionMinCorrelation;
+@synthesize metricPrecision;
 @synthesize seriesDescription;
 @synthesize fixedImageRegion;
 @synthesize fixedImageMask;
@@ -33,6 +46,7 @@
 @synthesize rigidRegMultiresLevels;
 @synthesize rigidRegMetric;
 @synthesize rigidRegOptimizer;
+@synthesize rigidRegPhaseCorrelation;
 @synthesize rigidRegMMIHistogramBins;
 @synthesize rigidRegMMISampleRate;
 @synthesize rigidRegLBFGSBCostConvergence;
@@ -152,12 +166,26 @@
     self.fixedImageNumber = [def integerForKey:FixedImageNumberKey];
     self.seriesDescription = [def stringForKey:SeriesDescriptionKey];
     self.regSequence = [def integerForKey:RegistrationSequenceKey];
+    self.parallelSeriesReg = [def booleanForKey:ParallelSeriesRegKey];
+    self.maxConcurrentImages = [def unsignedIntegerForKey:MaxConcurrentImagesKey];
+    self.sliceWiseReg = [def booleanForKey:SliceWiseRegKey];
+    self.warmStart = [def integerForKey:WarmStartKey];
+    self.checkpointReg = [def booleanForKey:CheckpointRegKey];
+    self.failurePolicy = [def integerForKey:FailurePolicyKey];
+    self.registrationEngine = [def integerForKey:RegistrationEngineKey];
+    self.cropToRegion = [def booleanForKey:CropToRegionKey];
+    self.cropMargin = [def floatForKey:CropMarginKey];
+    self.motionCheck = [def booleanForKey:MotionCheckKey];
+    self.motionMaxShift = [def floatForKey:MotionMaxShiftKey];
+    self.motionMinCorrelation = [def floatForKey:MotionMinCorrelationKey];
+    self.metricPrecision = [def integerForKey:MetricPrecisionKey];
 
     // Rigid registration parameters
     //self.rigidRegEnabled = [def booleanForKey:RigidRegEnabledKey];
     self.rigidRegMultiresLevels = [def unsignedIntegerForKey:RigidRegMultiresLevelsKey];
     self.rigidRegMetric = [def integerForKey:RigidRegMetricKey];
     self.rigidRegOptimizer = [def integerForKey:RigidRegOptimizerKey];
+    self.rigidRegPhaseCorrelation = [def booleanForKey:RigidRegPhaseCorrelationKey];
     self.rigidRegMMIHistogramBins = [NSMutableArray arrayWithArray:
                                      [def objectForKey:RigidRegMMIHistogramBinsKey]];
     self.rigidRegMMISampleRate = [NSMutableArray arrayWithArray:
@@ -0,0 +1,107 @@
+//
+//  RegistrationProgress.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__RegistrationProgress__
+#define __DCEFit__RegistrationProgress__
+
+#include <string>
+
+class RegistrationObserverBase;
+
+/**
+ * Receives the progress of the registrations. The registration classes report through
+ * this rather than to the progress window so that they do not depend upon the user
+ * interface and can be built without it.
+ *
+ * This class ignores everything it is told. It is what a registration reports to if it
+ * is given nothing else. The plugin forwards the reports to its progress window with
+ * ProgressWindowProgress. Implementations may be called from any thread.
+ */
+class RegistrationProgress
+{
+public:
+    virtual ~RegistrationProgress()
+    {
+    }
+
+    /**
+     * @param stage Name of the stage now running.
+     */
+    virtual void SetCurStage(const std::string& stage)
+    {
+    }
+
+    /**
+     * @param level The level now running, 1 based.
+     */
+    virtual void SetCurLevel(unsigned level)
+    {
+    }
+
+    /**
+     * @param iterations Maximum number of iterations of the current level.
+     */
+    virtual void SetMaxIterations(unsigned iterations)
+    {
+    }
+
+    /**
+     * @param iteration The current iteration.
+     */
+    virtual void SetCurIteration(unsigned iteration)
+    {
+    }
+
+    /**
+     * @param metric The current metric value.
+     */
+    virtual void SetCurMetric(double metric)
+    {
+    }
+
+    /**
+     * @param stepSize The current optimiser step size.
+     */
+    virtual void SetCurStepSize(double stepSize)
+    {
+    }
+
+    /**
+     * @param stopCondition Why the optimiser stopped.
+     */
+    virtual void SetStopCondition(const std::string& stopCondition)
+    {
+    }
+
+    /**
+     * A registration has started. Its observer can be used to stop it.
+     * @param observer The observer of the registration.
+     */
+    virtual void AddObserver(RegistrationObserverBase* observer)
+    {
+    }
+
+    /**
+     * A registration has finished.
+     * @param observer The observer given to AddObserver().
+     */
+    virtual void RemoveObserver(RegistrationObserverBase* observer)
+    {
+    }
+
+    /**
+     * @return A shared instance which ignores everything.
+     */
+    static RegistrationProgress* GetNull()
+    {
+        static RegistrationProgress nullProgress;
+        return &nullProgress;
+    }
+};
+
+#endif /* defined(__DCEFit__RegistrationProgress__) */
@@ -17,6 +17,7 @@
     unsigned sliceWidth;
     unsigned slicesPerImage;
     BOOL isFlipped;
+    NSString* seriesUID;
     
     int roiImageIdx;
     int roiSliceIdx;
@@ -32,6 +33,7 @@
 @property (assign) unsigned sliceWidth;     ///< The width in pixels of a slice.
 @property (assign) unsigned slicesPerImage; ///< The number of slices in an image.
 @property (assign) BOOL isFlipped;          ///< Osirix numbers images backwards if true.
+@property (copy) NSString* seriesUID;       ///< The DICOM series instance UID.
 @property (assign) int roiImageIdx;     ///< The time image index containing the registration ROI.
 @property (assign) int roiSliceIdx;     ///< The slice index in the image of the registration ROI.
 @property (assign) ROI* regROI;             ///< The first ROI defining the registration region.
@@ -15,6 +15,7 @@
 @synthesize sliceWidth;
 @synthesize slicesPerImage;
 @synthesize isFlipped;
+@synthesize seriesUID;
 @synthesize roiImageIdx;
 @synthesize roiSliceIdx;
 @synthesize regROI;
@@ -39,6 +40,7 @@
 {
     [acqTimeArray release];
     [acqTimeStringArray release];
+    [seriesUID release];
     [super dealloc];
 }
 
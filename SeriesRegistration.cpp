@@ -0,0 +1,227 @@
+//
+//  SeriesRegistration.cpp
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#include "SeriesRegistration.h"
+#include "ImageRegistration.h"
+#include "FixedImageContext.h"
+#include "RegistrationProgress.h"
+
+#include <log4cplus/loggingmacros.h>
+
+static void SetField(SeriesRegistration::ImageResult& result, DemonsDisplacementField2D::Pointer field)
+{
+    result.field2D = field;
+}
+
+static void SetField(SeriesRegistration::ImageResult& result, DemonsDisplacementField3D::Pointer field)
+{
+    result.field3D = field;
+}
+
+SeriesRegistration::SeriesRegistration(const ItkRegistrationParams& params,
+                                       RegistrationProgress* progress)
+    : params_(params), progress_((progress != 0) ? progress : RegistrationProgress::GetNull())
+{
+    std::string name = std::string(LOGGER_NAME) + ".SeriesRegistration";
+    logger_ = log4cplus::Logger::getInstance(name);
+
+    // Nobody is watching so a failure is always dealt with unattended.
+    if (params_.failurePolicy != RetryOnFailure)
+    {
+        LOG4CPLUS_INFO(logger_, "Running unattended. Failed registrations will be retried.");
+        params_.failurePolicy = RetryOnFailure;
+    }
+
+    unsigned slicesPerResult = IsSliceWise() ? params_.slicesPerImage : 1;
+    results_.resize(params_.numImages * slicesPerResult);
+}
+
+bool SeriesRegistration::IsSliceWise() const
+{
+    return (params_.slicesPerImage == 1) || params_.sliceWise;
+}
+
+const SeriesRegistration::ImageResult& SeriesRegistration::GetResult(unsigned imageIdx,
+                                                                     unsigned sliceIdx) const
+{
+    unsigned slicesPerResult = IsSliceWise() ? params_.slicesPerImage : 1;
+    return results_.at(imageIdx * slicesPerResult + sliceIdx);
+}
+
+SeriesRegistration::ImageResult& SeriesRegistration::Result(unsigned imageIdx, unsigned sliceIdx)
+{
+    unsigned slicesPerResult = IsSliceWise() ? params_.slicesPerImage : 1;
+    return results_.at(imageIdx * slicesPerResult + sliceIdx);
+}
+
+unsigned SeriesRegistration::Register(ImageSlicer& slicer)
+{
+    std::vector<unsigned> imageIndices;
+    for (unsigned imageIdx = 0; imageIdx < params_.numImages; ++imageIdx)
+        imageIndices.push_back(imageIdx);
+
+    return Register(slicer, imageIndices);
+}
+
+unsigned SeriesRegistration::Register(ImageSlicer& slicer, const std::vector<unsigned>& imageIndices)
+{
+    unsigned fixedImageIdx = params_.fixedImageNumber - 1;
+    unsigned numFailed = 0;
+
+    std::vector<bool> selected(params_.numImages, false);
+    for (unsigned idx = 0; idx < imageIndices.size(); ++idx)
+        selected.at(imageIndices[idx]) = true;
+
+    LOG4CPLUS_INFO(logger_, "Registering series.\n" << params_.Print());
+
+    // Without a region the whole of the slice is registered.
+    if (params_.fixedImageRegion.GetNumberOfPixels() == 0)
+    {
+        Image2D::Pointer fixedSlice = slicer.GetSlice2D(fixedImageIdx, 0);
+        params_.fixedImageRegion = fixedSlice->GetLargestPossibleRegion();
+    }
+
+    if (params_.slicesPerImage == 1)
+    {
+        std::vector<Image2D::Pointer> images(params_.numImages);
+        for (unsigned imageIdx = 0; imageIdx < params_.numImages; ++imageIdx)
+            if (selected[imageIdx] || (imageIdx == fixedImageIdx))
+                images[imageIdx] = slicer.GetSlice2D(imageIdx, 0);
+
+        numFailed += RegisterSeries<Image2D>(images, selected);
+
+        for (unsigned imageIdx = 0; imageIdx < params_.numImages; ++imageIdx)
+            if (selected[imageIdx] && (imageIdx != fixedImageIdx))
+                slicer.SetSlice2D(images[imageIdx], imageIdx, 0);
+    }
+    else if (params_.sliceWise)
+    {
+        numFailed += RegisterSlices(slicer, selected);
+    }
+    else
+    {
+        std::vector<Image3D::Pointer> images(params_.numImages);
+        for (unsigned imageIdx = 0; imageIdx < params_.numImages; ++imageIdx)
+            if (selected[imageIdx] || (imageIdx == fixedImageIdx))
+                images[imageIdx] = slicer.GetImage(imageIdx);
+
+        numFailed += RegisterSeries<Image3D>(images, selected);
+
+        for (unsigned imageIdx = 0; imageIdx < params_.numImages; ++imageIdx)
+            if (selected[imageIdx] && (imageIdx != fixedImageIdx))
+                slicer.SetImage(images[imageIdx], imageIdx);
+    }
+
+    if (numFailed > 0)
+        LOG4CPLUS_WARN(logger_, numFailed << " registrations failed and were left unregistered.");
+
+    return numFailed;
+}
+
+template <class TImage>
+unsigned SeriesRegistration::RegisterSeries(std::vector<typename TImage::Pointer>& images,
+                                            const std::vector<bool>& selected)
+{
+    unsigned fixedImageIdx = params_.fixedImageNumber - 1;
+    unsigned numFailed = 0;
+
+    // The registered images replace the moving ones as they are done.
+    typename FixedImageContext<TImage>::Pointer fixedContext =
+                                            FixedImageContext<TImage>::New(images[fixedImageIdx]);
+
+    std::vector<unsigned> order = RegistrationOrder(params_.numImages, fixedImageIdx,
+                                                    params_.warmStart);
+    std::vector<ImageTransforms> solved(params_.numImages);
+
+    for (unsigned step = 0; step < order.size(); ++step)
+    {
+        unsigned imageIdx = order[step];
+        if ((imageIdx == fixedImageIdx) || !selected[imageIdx])
+            continue;
+
+        LOG4CPLUS_INFO(logger_, "Registering image " << imageIdx + 1);
+
+        ImageTransforms warmStart = PredictTransforms(&solved[0], imageIdx, fixedImageIdx,
+                                                      params_.warmStart);
+        images[imageIdx] = RegisterImage<TImage>(images[imageIdx], fixedContext, &warmStart,
+                                                 imageIdx, 0);
+        solved[imageIdx] = Result(imageIdx, 0).transforms;
+
+        if (Result(imageIdx, 0).code == DISASTER)
+            ++numFailed;
+    }
+
+    return numFailed;
+}
+
+unsigned SeriesRegistration::RegisterSlices(ImageSlicer& slicer, const std::vector<bool>& selected)
+{
+    unsigned fixedImageIdx = params_.fixedImageNumber - 1;
+    unsigned numSlices = params_.slicesPerImage;
+    unsigned numFailed = 0;
+
+    // Extract the fixed slices once. They are shared by all of the time points.
+    std::vector<FixedImageContext2D::Pointer> fixedContexts(numSlices);
+    for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+        fixedContexts[sliceIdx] = FixedImageContext2D::New(slicer.GetSlice2D(fixedImageIdx, sliceIdx));
+
+    // Each slice starts from the result of its neighbour towards the middle of the
+    // stack, as in RegisterImageOp.
+    std::vector<unsigned> order = SliceOrder(numSlices);
+
+    for (unsigned imageIdx = 0; imageIdx < params_.numImages; ++imageIdx)
+    {
+        if ((imageIdx == fixedImageIdx) || !selected[imageIdx])
+            continue;
+
+        LOG4CPLUS_INFO(logger_, "Registering image " << imageIdx + 1);
+
+        for (unsigned step = 0; step < order.size(); ++step)
+        {
+            unsigned sliceIdx = order[step];
+            unsigned innerIdx = InnerSlice(sliceIdx, numSlices);
+            const ImageTransforms* warmStart = 0;
+            if (innerIdx != sliceIdx)
+                warmStart = &Result(imageIdx, innerIdx).transforms;
+
+            Image2D::Pointer regSlice = RegisterImage<Image2D>(slicer.GetSlice2D(imageIdx, sliceIdx),
+                                                              fixedContexts[sliceIdx], warmStart,
+                                                              imageIdx, sliceIdx);
+            slicer.SetSlice2D(regSlice, imageIdx, sliceIdx);
+
+            if (Result(imageIdx, sliceIdx).code == DISASTER)
+                ++numFailed;
+        }
+    }
+
+    return numFailed;
+}
+
+template <class TImage>
+typename TImage::Pointer SeriesRegistration::RegisterImage(typename TImage::Pointer movingImage,
+                                        typename FixedImageContext<TImage>::Pointer fixedContext,
+                                        const ImageTransforms* warmStart,
+                                        unsigned imageIdx, unsigned sliceIdx)
+{
+    ImageRegistration<TImage> registration(params_, progress_);
+    typename ImageRegistration<TImage>::Result found;
+    typename TImage::Pointer regImage = registration.Register(movingImage, fixedContext, 0,
+                                                              warmStart, imageIdx, sliceIdx, found);
+
+    ImageResult& result = Result(imageIdx, sliceIdx);
+    result.transforms = found.transforms;
+    SetField(result, found.field);
+    result.code = found.code;
+    result.outcome = found.outcome;
+
+    if (!result.outcome.empty())
+        LOG4CPLUS_WARN(logger_, "Image " << imageIdx + 1 << ", slice " << sliceIdx + 1
+                       << ": " << result.outcome);
+
+    return regImage;
+}
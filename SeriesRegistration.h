@@ -0,0 +1,129 @@
+//
+//  SeriesRegistration.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__SeriesRegistration__
+#define __DCEFit__SeriesRegistration__
+
+#include "ItkTypedefs.h"
+#include "ProjectDefs.h"
+#include "ItkRegistrationParams.h"
+#include "ImageSlicer.h"
+#include "FixedImageContext.h"
+#include "SeriesTransforms.h"
+
+#include <log4cplus/logger.h>
+
+#include <string>
+#include <vector>
+
+class RegistrationProgress;
+
+/**
+ * Registers a whole series without the plugin's user interface. It is what the
+ * command line program uses. Each image is registered by ImageRegistration, as in
+ * the plugin, one after another in the order RegisterImageOp uses and with the same
+ * shared fixed image context and warm starts: in time for whole images and single
+ * slice series, and from the neighbouring slice when slice by slice. There is nobody
+ * to ask when a registration fails so a failed image is always retried, first with
+ * fallback settings, then rigidly only, and is otherwise left as it was.
+ */
+class SeriesRegistration
+{
+public:
+    /**
+     * The outcome of registering one image, or one slice of it.
+     */
+    struct ImageResult
+    {
+        ImageResult()
+        : code(SUCCESS)
+        {
+        }
+
+        ImageTransforms transforms;                   ///< The rigid and B-spline results.
+        DemonsDisplacementField2D::Pointer field2D;   ///< The Demons result of a slice.
+        DemonsDisplacementField3D::Pointer field3D;   ///< The Demons result of an image.
+        ResultCode code;                              ///< DISASTER if left unregistered.
+        std::string outcome;                          ///< What the retries did. Empty if none.
+    };
+
+    /**
+     * Constructor.
+     * @param params The registration parameters. numImages and slicesPerImage must
+     * describe the series to be registered.
+     * @param progress Receives the progress of the registrations. May be 0.
+     */
+    SeriesRegistration(const ItkRegistrationParams& params, RegistrationProgress* progress = 0);
+
+    /**
+     * Register the series. The registered images replace the originals in the slicer.
+     * @param slicer Holds the images of the series.
+     * @return The number of images (slices if slice-wise) left unregistered.
+     */
+    unsigned Register(ImageSlicer& slicer);
+
+    /**
+     * Register some of the images of the series, e.g. one shard of it. Warm starts in
+     * time come only from images registered in the same call. The registered images
+     * replace the originals in the slicer; the others are left alone.
+     * @param slicer Holds the images of the series.
+     * @param imageIndices The indices of the images to register.
+     * @return The number of images (slices if slice-wise) left unregistered.
+     */
+    unsigned Register(ImageSlicer& slicer, const std::vector<unsigned>& imageIndices);
+
+    /**
+     * @return true if the series is registered slice by slice, in 2D.
+     */
+    bool IsSliceWise() const;
+
+    /**
+     * The result of one registration.
+     * @param imageIdx Index of the image.
+     * @param sliceIdx Index of the slice. 0 unless slice-wise.
+     * @return The result.
+     */
+    const ImageResult& GetResult(unsigned imageIdx, unsigned sliceIdx) const;
+
+private:
+    template <class TImage>
+    unsigned RegisterSeries(std::vector<typename TImage::Pointer>& images,
+                            const std::vector<bool>& selected);
+
+    /**
+     * Register the slices of each image one by one, out from the middle slice.
+     * @param slicer Holds the images of the series.
+     * @param selected Which images to register.
+     * @return The number of slices left unregistered.
+     */
+    unsigned RegisterSlices(ImageSlicer& slicer, const std::vector<bool>& selected);
+
+    /**
+     * Register one image or slice and keep its result.
+     * @param movingImage The image to register.
+     * @param fixedContext The context of the fixed image.
+     * @param warmStart The transforms to start from. May be 0.
+     * @param imageIdx Index of the image.
+     * @param sliceIdx Index of the slice. 0 unless slice-wise.
+     * @return The registered image.
+     */
+    template <class TImage>
+    typename TImage::Pointer RegisterImage(typename TImage::Pointer movingImage,
+                                           typename FixedImageContext<TImage>::Pointer fixedContext,
+                                           const ImageTransforms* warmStart,
+                                           unsigned imageIdx, unsigned sliceIdx);
+
+    ImageResult& Result(unsigned imageIdx, unsigned sliceIdx);
+
+    log4cplus::Logger logger_;           ///< The instance logger.
+    ItkRegistrationParams params_;       ///< The registration parameters.
+    RegistrationProgress* progress_;     ///< Receives the progress of the registrations.
+    std::vector<ImageResult> results_;   ///< Indexed by image, then slice.
+};
+
+#endif /* defined(__DCEFit__SeriesRegistration__) */
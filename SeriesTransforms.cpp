@@ -0,0 +1,79 @@
+//
+//  SeriesTransforms.cpp
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#include "SeriesTransforms.h"
+
+std::vector<unsigned> RegistrationOrder(unsigned numImages, unsigned fixedImageIdx,
+                                        WarmStartType warmStart)
+{
+    std::vector<unsigned> order;
+
+    if (warmStart == NoWarmStart)
+    {
+        for (unsigned imageIdx = 0; imageIdx < numImages; ++imageIdx)
+            order.push_back(imageIdx);
+    }
+    else
+    {
+        for (unsigned imageIdx = fixedImageIdx; imageIdx < numImages; ++imageIdx)
+            order.push_back(imageIdx);
+        for (unsigned imageIdx = fixedImageIdx; imageIdx > 0; --imageIdx)
+            order.push_back(imageIdx - 1);
+    }
+
+    return order;
+}
+
+unsigned InnerNeighbour(unsigned imageIdx, unsigned fixedImageIdx)
+{
+    return (imageIdx > fixedImageIdx) ? imageIdx - 1 : imageIdx + 1;
+}
+
+std::vector<unsigned> SliceOrder(unsigned numSlices)
+{
+    std::vector<unsigned> order;
+
+    unsigned seedSliceIdx = numSlices / 2;
+    for (unsigned sliceIdx = seedSliceIdx; sliceIdx < numSlices; ++sliceIdx)
+        order.push_back(sliceIdx);
+    for (unsigned sliceIdx = seedSliceIdx; sliceIdx > 0; --sliceIdx)
+        order.push_back(sliceIdx - 1);
+
+    return order;
+}
+
+unsigned InnerSlice(unsigned sliceIdx, unsigned numSlices)
+{
+    unsigned seedSliceIdx = numSlices / 2;
+    return (sliceIdx == seedSliceIdx) ? sliceIdx : InnerNeighbour(sliceIdx, seedSliceIdx);
+}
+
+ImageTransforms PredictTransforms(const ImageTransforms* solved, unsigned imageIdx,
+                                  unsigned fixedImageIdx, WarmStartType warmStart)
+{
+    ImageTransforms prediction;
+    if ((warmStart == NoWarmStart) || (imageIdx == fixedImageIdx))
+        return prediction;
+
+    unsigned lastIdx = InnerNeighbour(imageIdx, fixedImageIdx);
+    if (lastIdx == fixedImageIdx)
+        return prediction;
+
+    prediction = solved[lastIdx];
+
+    unsigned beforeLastIdx = InnerNeighbour(lastIdx, fixedImageIdx);
+    if ((warmStart == ExtrapolatedWarmStart) && (beforeLastIdx != fixedImageIdx))
+    {
+        const ImageTransforms& beforeLast = solved[beforeLastIdx];
+        prediction.rigid = TransformParams::Extrapolate(prediction.rigid, beforeLast.rigid);
+        prediction.deformable = TransformParams::Extrapolate(prediction.deformable,
+                                                             beforeLast.deformable);
+    }
+
+    return prediction;
+}
@@ -0,0 +1,178 @@
+//
+//  SeriesTransforms.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__SeriesTransforms__
+#define __DCEFit__SeriesTransforms__
+
+#include "ProjectDefs.h"
+#include "ItkTypedefs.h"
+#include "CoreScheduler.h"
+#include "TransformParams.h"
+
+#include <itkCompositeTransform.h>
+#include <itkResampleImageFilter.h>
+#include <itkLinearInterpolateImageFunction.h>
+
+#include <vector>
+
+/**
+ * The transforms found when registering one image or slice. Used to warm start
+ * the registration of its neighbour in time or space.
+ */
+struct ImageTransforms
+{
+    TransformParams rigid;        ///< Result of the rigid stage.
+    TransformParams deformable;   ///< Result of the B-spline stage.
+};
+
+/**
+ * The order in which to register the images. With a temporal warm start the
+ * images are registered outward from the fixed image, forward in time and then
+ * backward, so that each one comes after the neighbour it starts from. Otherwise
+ * they are registered in time order. The fixed image is included.
+ * @param numImages The number of images.
+ * @param fixedImageIdx Index of the fixed image.
+ * @param warmStart The kind of warm start.
+ * @return The image indices in order.
+ */
+std::vector<unsigned> RegistrationOrder(unsigned numImages, unsigned fixedImageIdx,
+                                        WarmStartType warmStart);
+
+/**
+ * The neighbour of an image on the side of the fixed image. With a temporal warm
+ * start the image starts from this one's result.
+ * @param imageIdx Index of the image.
+ * @param fixedImageIdx Index of the fixed image.
+ * @return The neighbour's index.
+ */
+unsigned InnerNeighbour(unsigned imageIdx, unsigned fixedImageIdx);
+
+/**
+ * The order in which to register the slices of an image slice by slice. The middle
+ * slice is registered from scratch and the others start from the result of their
+ * neighbour towards the middle, so the work fans out towards both ends of the stack.
+ * @param numSlices The number of slices.
+ * @return The slice indices in order.
+ */
+std::vector<unsigned> SliceOrder(unsigned numSlices);
+
+/**
+ * The neighbour of a slice towards the middle of the stack, which it starts from.
+ * @param sliceIdx Index of the slice.
+ * @param numSlices The number of slices.
+ * @return The neighbour's index, or sliceIdx itself for the middle slice.
+ */
+unsigned InnerSlice(unsigned sliceIdx, unsigned numSlices);
+
+/**
+ * Work out the starting transforms of an image from those of the images between it
+ * and the fixed image. They must already have been registered. The fixed image itself
+ * has no transform so its neighbours start from the initialisers' guesses.
+ * @param solved The transforms found so far, indexed by image.
+ * @param imageIdx Index of the image.
+ * @param fixedImageIdx Index of the fixed image.
+ * @param warmStart The kind of warm start.
+ * @return The starting transforms. Empty if there is no warm start.
+ */
+ImageTransforms PredictTransforms(const ImageTransforms* solved, unsigned imageIdx,
+                                  unsigned fixedImageIdx, WarmStartType warmStart);
+
+/**
+ * Apply the stored transforms of an image with a single resample. The B-spline stage
+ * registered the moving image as seen through the rigid transform so a point is moved
+ * by the B-spline transform first and then by the rigid one.
+ * @param movingImage The image to resample.
+ * @param fixedImage The fixed image, which defines the output geometry.
+ * @param rigid The rigid transform. May be empty.
+ * @param deformable The B-spline transform. May be empty.
+ * @return The resampled image.
+ */
+template <class TImage, class TRigidTransform>
+typename TImage::Pointer ResampleWithTransforms(typename TImage::Pointer movingImage,
+                                                typename TImage::Pointer fixedImage,
+                                                const TransformParams& rigid,
+                                                const TransformParams& deformable)
+{
+    typedef itk::CompositeTransform<double, TImage::ImageDimension> CompositeTransformType;
+    typedef itk::BSplineTransform<double, TImage::ImageDimension, BSPLINE_ORDER> BSplineTransformType;
+    typedef itk::ResampleImageFilter<TImage, TImage> ResamplerType;
+    typedef itk::LinearInterpolateImageFunction<TImage, double> LinearInterpolatorType;
+    typedef itk::BSplineInterpolateImageFunction<TImage, double> BSplineInterpolatorType;
+
+    typename ResamplerType::Pointer resampler = ResamplerType::New();
+    resampler->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+
+    // The composite transform applies the transform added last first.
+    typename CompositeTransformType::Pointer transform = CompositeTransformType::New();
+    if (!rigid.IsEmpty())
+    {
+        typename TRigidTransform::Pointer rigidTransform = TRigidTransform::New();
+        if (rigid.fixedParameters.GetSize() != 0)
+            rigidTransform->SetFixedParameters(rigid.fixedParameters);
+        rigidTransform->SetParameters(rigid.parameters);
+        transform->AddTransform(rigidTransform);
+        resampler->SetInterpolator(LinearInterpolatorType::New());
+    }
+
+    if (!deformable.IsEmpty())
+    {
+        // The transform keeps a reference to the parameters, which outlive it.
+        typename BSplineTransformType::Pointer bspline = BSplineTransformType::New();
+        bspline->SetFixedParameters(deformable.fixedParameters);
+        bspline->SetParameters(deformable.parameters);
+        transform->AddTransform(bspline);
+
+        // As the B-spline stages do. In 3D the coefficients of a B-spline interpolator
+        // would take another image the size of the volume.
+        if (TImage::ImageDimension == 2)
+        {
+            typename BSplineInterpolatorType::Pointer interpolator = BSplineInterpolatorType::New();
+            interpolator->SetSplineOrder(BSPLINE_ORDER);
+            resampler->SetInterpolator(interpolator);
+        }
+    }
+
+    resampler->SetTransform(transform);
+    resampler->SetInput(movingImage);
+    resampler->SetSize(fixedImage->GetLargestPossibleRegion().GetSize());
+    resampler->SetOutputOrigin(fixedImage->GetOrigin());
+    resampler->SetOutputSpacing(fixedImage->GetSpacing());
+    resampler->SetOutputDirection(fixedImage->GetDirection());
+    resampler->SetDefaultPixelValue(0.0);
+    resampler->Update();
+
+    return resampler->GetOutput();
+}
+
+/**
+ * Apply a stored Demons displacement field as the Demons registration does.
+ * @param movingImage The image to warp.
+ * @param field The displacement field.
+ * @return The warped image.
+ */
+template <class TImage, class TField>
+typename TImage::Pointer WarpWithField(typename TImage::Pointer movingImage,
+                                       typename TField::Pointer field)
+{
+    typedef itk::WarpImageFilter<TImage, TImage, TField> WarperType;
+    typedef itk::LinearInterpolateImageFunction<TImage, double> LinearInterpolatorType;
+
+    typename WarperType::Pointer warper = WarperType::New();
+    warper->SetNumberOfThreads(CoreScheduler::GetInstance().GetFairShare());
+    warper->SetInput(movingImage);
+    warper->SetInterpolator(LinearInterpolatorType::New());
+    warper->SetOutputSpacing(movingImage->GetSpacing());
+    warper->SetOutputOrigin(movingImage->GetOrigin());
+    warper->SetOutputDirection(movingImage->GetDirection());
+    warper->SetDisplacementField(field);
+    warper->Update();
+
+    return warper->GetOutput();
+}
+
+#endif /* defined(__DCEFit__SeriesTransforms__) */
@@ -0,0 +1,192 @@
+//
+//  ThreadedSampleMetric.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__ThreadedSampleMetric__
+#define __DCEFit__ThreadedSampleMetric__
+
+#include <itkImageToImageMetric.h>
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * The parts our sampled v3 metrics share. The samples are drawn and mapped by
+ * itk::ImageToImageMetric and its threads call the metric for each one. A metric
+ * works out for each sample a vector in the moving image space, its derivative with
+ * respect to the mapped point, and AddToDerivative() takes that through the Jacobian
+ * of the transform into the thread's own derivative. With a B-spline transform and
+ * cached weights only the coefficients of the sample's support are touched. The
+ * threads then sum slices of the per thread arrays in parallel.
+ */
+template <class TFixedImage, class TMovingImage>
+class ThreadedSampleMetric : public itk::ImageToImageMetric<TFixedImage, TMovingImage>
+{
+public:
+    typedef ThreadedSampleMetric Self;
+    typedef itk::ImageToImageMetric<TFixedImage, TMovingImage> Superclass;
+    typedef itk::SmartPointer<Self> Pointer;
+    typedef itk::SmartPointer<const Self> ConstPointer;
+
+    itkTypeMacro(ThreadedSampleMetric, ImageToImageMetric);
+
+    typedef typename Superclass::MeasureType MeasureType;
+    typedef typename Superclass::DerivativeType DerivativeType;
+    typedef typename Superclass::ParametersType ParametersType;
+    typedef typename Superclass::MovingImagePointType MovingImagePointType;
+    typedef typename Superclass::ImageDerivativesType ImageDerivativesType;
+    typedef typename Superclass::TransformJacobianType TransformJacobianType;
+
+    itkStaticConstMacro(MovingImageDimension, unsigned, TMovingImage::ImageDimension);
+
+    /**
+     * Set the number of samples. Used unless UseAllPixelsOn() has been called.
+     */
+    void SetNumberOfSpatialSamples(itk::SizeValueType num)
+    {
+        this->SetNumberOfFixedImageSamples(num);
+    }
+
+    itk::SizeValueType GetNumberOfSpatialSamples() const
+    {
+        return this->GetNumberOfFixedImageSamples();
+    }
+
+    virtual void GetDerivative(const ParametersType& parameters, DerivativeType& derivative) const
+    {
+        MeasureType value;
+        this->GetValueAndDerivative(parameters, value, derivative);
+    }
+
+protected:
+    ThreadedSampleMetric()
+    {
+        this->SetComputeGradient(true);
+    }
+
+    virtual ~ThreadedSampleMetric()
+    {
+    }
+
+    /**
+     * Size the derivatives of the threads. Called by the subclasses once the base
+     * class is initialised.
+     */
+    void InitializeThreadDerivatives()
+    {
+        const itk::ThreadIdType numThreads = this->m_NumberOfThreads;
+        threadDerivatives_.assign(numThreads, std::vector<double>(this->m_NumberOfParameters, 0.0));
+        threadJacobians_.assign(numThreads, TransformJacobianType(MovingImageDimension,
+                                                                 this->m_NumberOfParameters));
+        derivative_.assign(this->m_NumberOfParameters, 0.0);
+
+        // The threads zero their own storage; the sums are run separately.
+        this->m_WithinThreadPreProcess = true;
+        this->m_WithinThreadPostProcess = false;
+    }
+
+    virtual void GetValueAndDerivativeThreadPreProcess(itk::ThreadIdType threadId,
+                                                       bool itkNotUsed(withinSampleThread)) const
+    {
+        std::fill(threadDerivatives_[threadId].begin(), threadDerivatives_[threadId].end(), 0.0);
+    }
+
+    virtual void GetValueAndDerivativeThreadPostProcess(itk::ThreadIdType threadId,
+                                                        bool itkNotUsed(withinSampleThread)) const
+    {
+        SumSlice(threadDerivatives_, derivative_, threadId);
+    }
+
+    /**
+     * Add a sample's contribution to the thread's derivative.
+     * @param threadId The thread.
+     * @param fixedImageSample The sample.
+     * @param direction The derivative of the sample's term with respect to the
+     * mapped point.
+     */
+    void AddToDerivative(itk::ThreadIdType threadId, itk::SizeValueType fixedImageSample,
+                         const double* direction) const
+    {
+        double* derivPtr = &threadDerivatives_[threadId][0];
+        if (this->m_TransformIsBSpline && this->m_UseCachingOfBSplineWeights)
+        {
+            const double* bsplineWeights = this->m_BSplineTransformWeightsArray[fixedImageSample];
+            const typename Superclass::IndexValueType* bsplineIndices =
+                                            this->m_BSplineTransformIndicesArray[fixedImageSample];
+            for (unsigned dim = 0; dim < MovingImageDimension; ++dim)
+            {
+                double* dimPtr = derivPtr + this->m_BSplineParametersOffset[dim];
+                for (unsigned mu = 0; mu < this->m_NumBSplineWeights; ++mu)
+                    dimPtr[bsplineIndices[mu]] += direction[dim] * bsplineWeights[mu];
+            }
+        }
+        else
+        {
+            // The base class gives each thread after the first a copy of the transform.
+            const typename Superclass::TransformType* transform = (threadId > 0)
+                ? this->m_ThreaderTransform[threadId - 1].GetPointer()
+                : this->m_Transform.GetPointer();
+            TransformJacobianType& jacobian = threadJacobians_[threadId];
+            transform->ComputeJacobianWithRespectToParameters(
+                                    this->m_FixedImageSamples[fixedImageSample].point, jacobian);
+
+            for (unsigned mu = 0; mu < this->m_NumberOfParameters; ++mu)
+            {
+                double innerProduct = 0.0;
+                for (unsigned dim = 0; dim < MovingImageDimension; ++dim)
+                    innerProduct += jacobian[dim][mu] * direction[dim];
+                derivPtr[mu] += innerProduct;
+            }
+        }
+    }
+
+    /**
+     * Run the derivative pass and copy the summed derivative out.
+     * @param derivative Set to the derivative times the factor.
+     * @param factor The normalisation of the metric.
+     */
+    void ComputeThreadedDerivative(DerivativeType& derivative, double factor) const
+    {
+        this->GetValueAndDerivativeMultiThreadedInitiate();
+        this->GetValueAndDerivativeMultiThreadedPostProcessInitiate();
+
+        derivative.SetSize(this->m_NumberOfParameters);
+        for (unsigned param = 0; param < this->m_NumberOfParameters; ++param)
+            derivative[param] = factor * derivative_[param];
+    }
+
+    /**
+     * Sum this thread's slice of the per thread arrays into the total.
+     */
+    static void SumSlice(const std::vector<std::vector<double> >& perThread, std::vector<double>& total,
+                         itk::ThreadIdType threadId)
+    {
+        const std::size_t numThreads = perThread.size();
+        const std::size_t size = total.size();
+        const std::size_t chunk = (size + numThreads - 1) / numThreads;
+        const std::size_t begin = std::min(size, threadId * chunk);
+        const std::size_t end = std::min(size, begin + chunk);
+
+        for (std::size_t idx = begin; idx < end; ++idx)
+        {
+            double sum = 0.0;
+            for (std::size_t thread = 0; thread < numThreads; ++thread)
+                sum += perThread[thread][idx];
+            total[idx] = sum;
+        }
+    }
+
+private:
+    ThreadedSampleMetric(const Self&);      // Not implemented.
+    void operator=(const Self&);            // Not implemented.
+
+    mutable std::vector<std::vector<double> > threadDerivatives_;
+    mutable std::vector<TransformJacobianType> threadJacobians_;
+    mutable std::vector<double> derivative_;
+};
+
+#endif /* defined(__DCEFit__ThreadedSampleMetric__) */
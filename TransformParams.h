@@ -0,0 +1,55 @@
+//
+//  TransformParams.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__TransformParams__
+#define __DCEFit__TransformParams__
+
+#include "ItkTypedefs.h"
+
+/**
+ * The parameters that fully describe a transform. A registration exports these when
+ * it finishes so that a related registration may be warm started from them.
+ */
+struct TransformParams
+{
+    typedef SingleValuedNonLinearOptimizer::ParametersType ParametersType;
+
+    ParametersType fixedParameters;   ///< Transform fixed parameters (centre, grid geometry).
+    ParametersType parameters;        ///< Optimised parameters.
+
+    /**
+     * @return true if nothing has been stored.
+     */
+    bool IsEmpty() const
+    {
+        return parameters.GetSize() == 0;
+    }
+
+    /**
+     * Linear prediction of the next transform of a sequence, 2 * last - beforeLast.
+     * @param last The last transform of the sequence.
+     * @param beforeLast The one before it.
+     * @return The prediction, or last if the two transforms cannot be compared.
+     */
+    static TransformParams Extrapolate(const TransformParams& last,
+                                       const TransformParams& beforeLast)
+    {
+        if (last.IsEmpty() || beforeLast.IsEmpty()
+            || (last.parameters.GetSize() != beforeLast.parameters.GetSize())
+            || (last.fixedParameters != beforeLast.fixedParameters))
+            return last;
+
+        TransformParams prediction = last;
+        for (unsigned idx = 0; idx < prediction.parameters.GetSize(); ++idx)
+            prediction.parameters[idx] = 2.0 * last.parameters[idx] - beforeLast.parameters[idx];
+
+        return prediction;
+    }
+};
+
+#endif /* defined(__DCEFit__TransformParams__) */
@@ -20,12 +20,26 @@ extern NSString* const UseDefaultNumberOfThreadsKey;
 extern NSString* const RegistrationSequenceKey;
 extern NSString* const FixedImageNumberKey;
 extern NSString* const SeriesDescriptionKey;
+extern NSString* const ParallelSeriesRegKey;
+extern NSString* const MaxConcurrentImagesKey;
+extern NSString* const SliceWiseRegKey;
+extern NSString* const WarmStartKey;
+extern NSString* const CheckpointRegKey;
+extern NSString* const FailurePolicyKey;
+extern NSString* const RegistrationEngineKey;
+extern NSString* const CropToRegionKey;
+extern NSString* const CropMarginKey;
+extern NSString* const MotionCheckKey;
+extern NSString* const MotionMaxShiftKey;
+extern NSString* const MotionMinCorrelationKey;
+extern NSString* const MetricPrecisionKey;
 
 // rigid registration parameters
 //extern NSString* const RigidRegEnabledKey;
 extern NSString* const RigidRegMultiresLevelsKey;
 extern NSString* const RigidRegMetricKey;
 extern NSString* const RigidRegOptimizerKey;
+extern NSString* const RigidRegPhaseCorrelationKey;
 extern NSString* const RigidRegMMIHistogramBinsKey;
 extern NSString* const RigidRegMMISampleRateKey;
 extern NSString* const RigidRegLBFGSBCostConvergenceKey;
@@ -21,12 +21,26 @@ NSString* const UseDefaultNumberOfThreadsKey = @"UseDefaultNumberOfThreads";
 NSString* const RegistrationSequenceKey = @"RegistrationSequence";
 NSString* const FixedImageNumberKey = @"FixedImageNumber";
 NSString* const SeriesDescriptionKey = @"SeriesDescription";
+NSString* const ParallelSeriesRegKey = @"ParallelSeriesReg";
+NSString* const MaxConcurrentImagesKey = @"MaxConcurrentImages";
+NSString* const SliceWiseRegKey = @"SliceWiseReg";
+NSString* const WarmStartKey = @"WarmStart";
+NSString* const CheckpointRegKey = @"CheckpointReg";
+NSString* const FailurePolicyKey = @"FailurePolicy";
+NSString* const RegistrationEngineKey = @"RegistrationEngine";
+NSString* const CropToRegionKey = @"CropToRegion";
+NSString* const CropMarginKey = @"CropMargin";
+NSString* const MotionCheckKey = @"MotionCheck";
+NSString* const MotionMaxShiftKey = @"MotionMaxShift";
+NSString* const MotionMinCorrelationKey = @"MotionMinCorrelation";
+NSString* const MetricPrecisionKey = @"MetricPrecision";
 
 // rigid registration parameters
 //NSString* const RigidRegEnabledKey = @"RigidRegEnabled";
 NSString* const RigidRegMultiresLevelsKey = @"RigidRegMultiresLevels";
 NSString* const RigidRegMetricKey = @"RigidRegMetric";
 NSString* const RigidRegOptimizerKey = @"RigidRegOptimizer";
+NSString* const RigidRegPhaseCorrelationKey = @"RigidRegPhaseCorrelation";
 NSString* const RigidRegMMIHistogramBinsKey = @"RigidRegMMIHistogramBins";
 NSString* const RigidRegMMISampleRateKey = @"RigidRegMMISampleRate";
 NSString* const RigidRegLBFGSBCostConvergenceKey = @"RigidRegLBFGSBCostConvergence";
@@ -125,10 +139,24 @@ static UserDefaults* sharedInstance;
      [NSNumber numberWithInt:Demons], RegistrationSequenceKey,
      [NSNumber numberWithUnsignedInt:1], FixedImageNumberKey,
      @"Registered with DCEFit", SeriesDescriptionKey,
+     [NSNumber numberWithBool:NO], ParallelSeriesRegKey,
+     [NSNumber numberWithUnsignedInt:0], MaxConcurrentImagesKey,
+     [NSNumber numberWithBool:NO], SliceWiseRegKey,
+     [NSNumber numberWithInt:NoWarmStart], WarmStartKey,
+     [NSNumber numberWithBool:YES], CheckpointRegKey,
+     [NSNumber numberWithInt:AskOnFailure], FailurePolicyKey,
+     [NSNumber numberWithInt:V3Engine], RegistrationEngineKey,
+     [NSNumber numberWithBool:NO], CropToRegionKey,
+     [NSNumber numberWithFloat:10.0], CropMarginKey,
+     [NSNumber numberWithBool:NO], MotionCheckKey,
+     [NSNumber numberWithFloat:0.5], MotionMaxShiftKey,
+     [NSNumber numberWithFloat:0.98], MotionMinCorrelationKey,
+     [NSNumber numberWithInt:DoublePrecision], MetricPrecisionKey,
 
      [NSNumber numberWithUnsignedInt:2], RigidRegMultiresLevelsKey,
      [NSNumber numberWithInt:MattesMutualInformation], RigidRegMetricKey,
      [NSNumber numberWithInt:LBFGSB], RigidRegOptimizerKey,
+     [NSNumber numberWithBool:NO], RigidRegPhaseCorrelationKey,
      [NSArray arrayWithObjects:@50, @50, @50, @50, nil], RigidRegMMIHistogramBinsKey,
      [NSArray arrayWithObjects:@1.0, @1.0, @1.0, @1.0, nil], RigidRegMMISampleRateKey,
      [NSArray arrayWithObjects:@1e9, @1e9, @1e9, @1e9, nil], RigidRegLBFGSBCostConvergenceKey,
@@ -230,6 +258,32 @@ static UserDefaults* sharedInstance;
                      forKey:FixedImageNumberKey];
     [defaultsDict setObject:data.seriesDescription
                      forKey:SeriesDescriptionKey];
+    [defaultsDict setObject:[NSNumber numberWithBool:data.parallelSeriesReg]
+                     forKey:ParallelSeriesRegKey];
+    [defaultsDict setObject:[NSNumber numberWithUnsignedInt:data.maxConcurrentImages]
+                     forKey:MaxConcurrentImagesKey];
+    [defaultsDict setObject:[NSNumber numberWithBool:data.sliceWiseReg]
+                     forKey:SliceWiseRegKey];
+    [defaultsDict setObject:[NSNumber numberWithInt:data.warmStart]
+                     forKey:WarmStartKey];
+    [defaultsDict setObject:[NSNumber numberWithBool:data.checkpointReg]
+                     forKey:CheckpointRegKey];
+    [defaultsDict setObject:[NSNumber numberWithInt:data.failurePolicy]
+                     forKey:FailurePolicyKey];
+    [defaultsDict setObject:[NSNumber numberWithInt:data.registrationEngine]
+                     forKey:RegistrationEngineKey];
+    [defaultsDict setObject:[NSNumber numberWithBool:data.cropToRegion]
+                     forKey:CropToRegionKey];
+    [defaultsDict setObject:[NSNumber numberWithFloat:data.cropMargin]
+                     forKey:CropMarginKey];
+    [defaultsDict setObject:[NSNumber numberWithBool:data.motionCheck]
+                     forKey:MotionCheckKey];
+    [defaultsDict setObject:[NSNumber numberWithFloat:data.motionMaxShift]
+                     forKey:MotionMaxShiftKey];
+    [defaultsDict setObject:[NSNumber numberWithFloat:data.motionMinCorrelation]
+                     forKey:MotionMinCorrelationKey];
+    [defaultsDict setObject:[NSNumber numberWithInt:data.metricPrecision]
+                     forKey:MetricPrecisionKey];
 
     //[defaultsDict setObject:[NSNumber numberWithBool:data.rigidRegEnabled]
     //                 forKey:RigidRegEnabledKey];
@@ -239,6 +293,8 @@ static UserDefaults* sharedInstance;
                      forKey:RigidRegMetricKey];
     [defaultsDict setObject:[NSNumber numberWithInt:data.rigidRegOptimizer]
                      forKey:RigidRegOptimizerKey];
+    [defaultsDict setObject:[NSNumber numberWithBool:data.rigidRegPhaseCorrelation]
+                     forKey:RigidRegPhaseCorrelationKey];
     [defaultsDict setObject:[NSArray arrayWithArray:data.rigidRegMMIHistogramBins]
                      forKey:RigidRegMMIHistogramBinsKey];
     [defaultsDict setObject:[NSArray arrayWithArray:data.rigidRegMMISampleRate]
@@ -0,0 +1,248 @@
+//
+//  ShardQueue.cpp
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#include "ShardQueue.h"
+#include "ProjectDefs.h"
+
+#include <log4cplus/loggingmacros.h>
+
+#include <dirent.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+static std::string HostName()
+{
+    char host[256] = "";
+    gethostname(host, sizeof(host) - 1);
+    return host;
+}
+
+ShardQueue::ShardQueue(const std::string& directory)
+    : directory_(directory), numImages_(0), shardSize_(0), numShards_(0)
+{
+    std::string name = std::string(LOGGER_NAME) + ".ShardQueue";
+    logger_ = log4cplus::Logger::getInstance(name);
+}
+
+bool ShardQueue::Create(const std::string& paramPath, const std::string& input,
+                        const std::string& seriesUID, unsigned numImages, unsigned shardSize)
+{
+    std::string queuePath = directory_ + "/queue.txt";
+    if (std::ifstream(queuePath.c_str()))
+    {
+        LOG4CPLUS_ERROR(logger_, directory_ << " already holds a queue.");
+        return false;
+    }
+
+    input_ = input;
+    seriesUID_ = seriesUID;
+    numImages_ = numImages;
+    shardSize_ = (shardSize > 0) ? shardSize : 1;
+    numShards_ = (numImages_ + shardSize_ - 1) / shardSize_;
+
+    std::ifstream params(paramPath.c_str());
+    std::ofstream paramsCopy(GetParamPath().c_str());
+    paramsCopy << params.rdbuf();
+    if (!params || !paramsCopy)
+    {
+        LOG4CPLUS_ERROR(logger_, "Could not copy " << paramPath << " to " << GetParamPath());
+        return false;
+    }
+
+    for (unsigned shard = 0; shard < numShards_; ++shard)
+    {
+        std::ofstream todo(ShardPath(shard, "todo").c_str());
+        if (!todo)
+        {
+            LOG4CPLUS_ERROR(logger_, "Could not write " << ShardPath(shard, "todo"));
+            return false;
+        }
+    }
+
+    // Written last so that workers see a complete queue.
+    std::ofstream queue(queuePath.c_str());
+    queue << input_ << '\n' << seriesUID_ << '\n' << numImages_ << ' ' << shardSize_ << '\n';
+    if (!queue)
+    {
+        LOG4CPLUS_ERROR(logger_, "Could not write " << queuePath);
+        return false;
+    }
+
+    LOG4CPLUS_INFO(logger_, "Queued " << numShards_ << " shards of " << shardSize_
+                   << " time points in " << directory_);
+    return true;
+}
+
+bool ShardQueue::Open()
+{
+    std::string queuePath = directory_ + "/queue.txt";
+    std::ifstream queue(queuePath.c_str());
+    if (!std::getline(queue, input_) || !std::getline(queue, seriesUID_)
+        || !(queue >> numImages_ >> shardSize_) || (shardSize_ == 0))
+    {
+        LOG4CPLUS_ERROR(logger_, "Could not read " << queuePath);
+        return false;
+    }
+
+    numShards_ = (numImages_ + shardSize_ - 1) / shardSize_;
+    return true;
+}
+
+bool ShardQueue::Claim(unsigned& shard)
+{
+    for (shard = 0; shard < numShards_; ++shard)
+    {
+        // Another worker may get there first, in which case the rename fails.
+        if (std::rename(ShardPath(shard, "todo").c_str(),
+                        ShardPath(shard, ClaimSuffix()).c_str()) == 0)
+        {
+            // The rename keeps the time the queue was made, which would look like an
+            // expired lease.
+            Renew(shard);
+            LOG4CPLUS_INFO(logger_, "Claimed shard " << shard + 1 << " of " << numShards_);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool ShardQueue::Finish(unsigned shard)
+{
+    if (std::rename(ShardPath(shard, ClaimSuffix()).c_str(), ShardPath(shard, "done").c_str()) != 0)
+    {
+        LOG4CPLUS_ERROR(logger_, "Could not mark shard " << shard + 1 << " as done.");
+        return false;
+    }
+
+    return true;
+}
+
+bool ShardQueue::Renew(unsigned shard)
+{
+    if (utime(ShardPath(shard, ClaimSuffix()).c_str(), 0) != 0)
+    {
+        LOG4CPLUS_WARN(logger_, "Could not renew the claim on shard " << shard + 1);
+        return false;
+    }
+
+    return true;
+}
+
+unsigned ShardQueue::Requeue(unsigned leaseSeconds)
+{
+    unsigned numRequeued = 0;
+
+    DIR* dir = opendir(directory_.c_str());
+    if (dir == 0)
+        return 0;
+
+    std::string thisHost = HostName();
+    std::time_t now = std::time(0);
+
+    while (struct dirent* entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        std::string::size_type claimed = name.find(".claimed.");
+        if ((name.compare(0, 6, "shard-") != 0) || (claimed == std::string::npos))
+            continue;
+
+        std::string path = directory_ + "/" + name;
+        if (ClaimIsLive(name.substr(claimed + 9), path, thisHost, now, leaseSeconds))
+            continue;
+
+        std::string todo = directory_ + "/" + name.substr(0, claimed) + ".todo";
+        if (std::rename(path.c_str(), todo.c_str()) == 0)
+        {
+            LOG4CPLUS_DEBUG(logger_, "Put back " << name);
+            ++numRequeued;
+        }
+    }
+
+    closedir(dir);
+
+    LOG4CPLUS_INFO(logger_, "Put " << numRequeued << " unfinished shards back in the queue.");
+    return numRequeued;
+}
+
+std::vector<unsigned> ShardQueue::Unfinished() const
+{
+    std::vector<unsigned> unfinished;
+    for (unsigned shard = 0; shard < numShards_; ++shard)
+    {
+        if (!std::ifstream(ShardPath(shard, "done").c_str()))
+            unfinished.push_back(shard);
+    }
+
+    return unfinished;
+}
+
+std::vector<unsigned> ShardQueue::ShardImages(unsigned shard) const
+{
+    std::vector<unsigned> images;
+    for (unsigned imageIdx = shard * shardSize_;
+         (imageIdx < (shard + 1) * shardSize_) && (imageIdx < numImages_); ++imageIdx)
+        images.push_back(imageIdx);
+
+    return images;
+}
+
+std::string ShardQueue::ShardName(unsigned shard) const
+{
+    std::ostringstream name;
+    name << "shard-" << std::setw(4) << std::setfill('0') << shard + 1;
+    return name.str();
+}
+
+std::string ShardQueue::ShardPath(unsigned shard, const std::string& state) const
+{
+    return directory_ + "/" + ShardName(shard) + "." + state;
+}
+
+std::string ShardQueue::ClaimSuffix() const
+{
+    std::ostringstream suffix;
+    suffix << "claimed." << HostName() << "." << getpid();
+    return suffix.str();
+}
+
+bool ShardQueue::ClaimIsLive(const std::string& owner, const std::string& path,
+                             const std::string& thisHost, std::time_t now,
+                             unsigned leaseSeconds) const
+{
+    // The host name may itself hold dots so the pid follows the last one.
+    std::string::size_type dot = owner.rfind('.');
+    if (dot != std::string::npos)
+    {
+        std::string host = owner.substr(0, dot);
+        char* end = 0;
+        long pid = std::strtol(owner.c_str() + dot + 1, &end, 10);
+        if ((host == thisHost) && (pid > 0) && (*end == '\0'))
+        {
+            // EPERM means the process exists but belongs to someone else.
+            return (kill(static_cast<pid_t>(pid), 0) == 0) || (errno == EPERM);
+        }
+    }
+
+    // The process is on another host, so go by when the worker last renewed its claim.
+    struct stat status;
+    if (stat(path.c_str(), &status) != 0)
+        return true;
+
+    return (now - status.st_mtime) < static_cast<std::time_t>(leaseSeconds);
+}
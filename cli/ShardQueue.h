@@ -0,0 +1,157 @@
+//
+//  ShardQueue.h
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+#ifndef __DCEFit__ShardQueue__
+#define __DCEFit__ShardQueue__
+
+#include <log4cplus/logger.h>
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+/**
+ * A queue of the shards of a series, kept in a directory that all of the worker
+ * processes can see, e.g. on a shared file system. A shard is a run of consecutive
+ * time points.
+ *
+ * Each shard is a file whose name gives its state:
+ *   shard-NNNN.todo                 waiting to be registered
+ *   shard-NNNN.claimed.<host>.<pid> being registered by that process
+ *   shard-NNNN.done                 registered, its transforms are in the directory
+ * A worker claims a shard by renaming its file. The rename is atomic so only one
+ * worker gets each shard. A worker renews its claim as it goes by touching the file.
+ * A shard left claimed by a worker which died may be put back with Requeue(). On
+ * the same host a worker is known to be dead when its process is gone, on other
+ * hosts when it has not renewed its claim within the lease.
+ *
+ * The queue also holds the settings the workers share in queue.txt: the input,
+ * the DICOM series, the number of images and the shard size. The registration
+ * parameters are copied to params.txt.
+ */
+class ShardQueue
+{
+public:
+    /**
+     * Constructor.
+     * @param directory The directory of the queue.
+     */
+    ShardQueue(const std::string& directory);
+
+    /**
+     * Make a new queue. The directory must exist and not already hold a queue.
+     * @param paramPath The registration parameter file, copied into the queue.
+     * @param input The input file or DICOM directory, as the workers will see it.
+     * @param seriesUID The DICOM series. May be empty.
+     * @param numImages The number of images in the series.
+     * @param shardSize The number of time points in each shard.
+     * @return true if successful.
+     */
+    bool Create(const std::string& paramPath, const std::string& input, const std::string& seriesUID,
+                unsigned numImages, unsigned shardSize);
+
+    /**
+     * Read the settings of an existing queue.
+     * @return true if successful.
+     */
+    bool Open();
+
+    /**
+     * Claim the next shard waiting to be registered.
+     * @param shard Set to the index of the shard claimed.
+     * @return true if a shard was claimed, false if none are waiting.
+     */
+    bool Claim(unsigned& shard);
+
+    /**
+     * Mark a claimed shard as registered.
+     * @param shard The index of the shard.
+     * @return true if successful.
+     */
+    bool Finish(unsigned shard);
+
+    /**
+     * Renew the claim on a shard so that it is not taken for one left by a dead worker.
+     * @param shard The index of a shard claimed by this process.
+     * @return true if successful.
+     */
+    bool Renew(unsigned shard);
+
+    /**
+     * Put the shards claimed by workers which died back in the queue.
+     * @param leaseSeconds How long a claim by a worker on another host lasts
+     * without being renewed.
+     * @return The number of shards put back.
+     */
+    unsigned Requeue(unsigned leaseSeconds);
+
+    /**
+     * Find the shards which are not yet registered.
+     * @return The indices of those shards.
+     */
+    std::vector<unsigned> Unfinished() const;
+
+    /**
+     * @param shard The index of a shard.
+     * @return The indices of its images.
+     */
+    std::vector<unsigned> ShardImages(unsigned shard) const;
+
+    /**
+     * @param shard The index of a shard.
+     * @return The name its transforms are stored under.
+     */
+    std::string ShardName(unsigned shard) const;
+
+    const std::string& GetDirectory() const
+    {
+        return directory_;
+    }
+
+    std::string GetParamPath() const
+    {
+        return directory_ + "/params.txt";
+    }
+
+    const std::string& GetInput() const
+    {
+        return input_;
+    }
+
+    const std::string& GetSeriesUID() const
+    {
+        return seriesUID_;
+    }
+
+    unsigned GetNumImages() const
+    {
+        return numImages_;
+    }
+
+    unsigned GetNumShards() const
+    {
+        return numShards_;
+    }
+
+private:
+    std::string ShardPath(unsigned shard, const std::string& state) const;
+    std::string ClaimSuffix() const;
+    bool ClaimIsLive(const std::string& owner, const std::string& path,
+                     const std::string& thisHost, std::time_t now,
+                     unsigned leaseSeconds) const;
+
+    log4cplus::Logger logger_;   ///< The instance logger.
+    std::string directory_;      ///< Directory of the queue.
+    std::string input_;          ///< Input file or DICOM directory.
+    std::string seriesUID_;      ///< DICOM series. May be empty.
+    unsigned numImages_;         ///< Number of images in the series.
+    unsigned shardSize_;         ///< Number of images in each shard.
+    unsigned numShards_;         ///< Number of shards.
+};
+
+#endif /* defined(__DCEFit__ShardQueue__) */
@@ -0,0 +1,677 @@
+//
+//  dcefit-register.cpp
+//  DCEFit
+//
+//  Created by Tim Allman on 2026-10-17.
+//
+//
+
+// Registers a DCE series without OsiriX. The series is read from a 4D image file
+// (NIfTI, MetaImage, ...) or from a directory of DICOM files, registered with the
+// parameters in a file and written as a 4D image with the transforms beside it.
+// A large series may instead be split into shards of time points which worker
+// processes, on this or other machines, take from a queue in a shared directory.
+// A merge step then resamples the series with the transforms they left there.
+
+#include "ItkTypedefs.h"
+#include "ProjectDefs.h"
+#include "ItkRegistrationParams.h"
+#include "ImageSlicer.h"
+#include "SeriesRegistration.h"
+#include "RegistrationProgress.h"
+#include "ParseITKException.h"
+#include "LoggerUtils.h"
+#include "RegistrationCheckpoint.h"
+#include "SeriesTransforms.h"
+#include "ShardQueue.h"
+
+#include <itkImageFileReader.h>
+#include <itkImageFileWriter.h>
+#include <itkExtractImageFilter.h>
+#include <itkJoinSeriesImageFilter.h>
+#include <itkGDCMImageIO.h>
+#include <itkMetaDataObject.h>
+#include <itkTransformFileWriter.h>
+
+#include <log4cplus/logger.h>
+#include <log4cplus/loggingmacros.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+typedef itk::Image<TPixel, 4u> Image4D;
+
+/// DICOM tag of the temporal position of a slice.
+static const char* const TemporalPositionTag = "0020|0100";
+
+static log4cplus::Logger logger_;
+
+/// Default time in seconds for which a worker's claim on a shard lasts unrenewed.
+static const unsigned DefaultLeaseSeconds = 3600;
+
+/**
+ * Logs the stages and levels of the registrations as they start. A worker's claim
+ * on its shard is renewed at the same time.
+ */
+class LogProgress : public RegistrationProgress
+{
+public:
+    LogProgress()
+        : queue_(0), shard_(0)
+    {
+    }
+
+    void SetClaim(ShardQueue* queue, unsigned shard)
+    {
+        queue_ = queue;
+        shard_ = shard;
+    }
+
+    virtual void SetCurStage(const std::string& stage)
+    {
+        LOG4CPLUS_DEBUG(logger_, "  " << stage);
+        RenewClaim();
+    }
+
+    virtual void SetCurLevel(unsigned level)
+    {
+        LOG4CPLUS_DEBUG(logger_, "    Level " << level);
+        RenewClaim();
+    }
+
+    virtual void SetStopCondition(const std::string& stopCondition)
+    {
+        LOG4CPLUS_DEBUG(logger_, "    " << stopCondition);
+    }
+
+private:
+    void RenewClaim()
+    {
+        if (queue_ != 0)
+            queue_->Renew(shard_);
+    }
+
+    ShardQueue* queue_;   ///< The queue of the shard being registered, if any.
+    unsigned shard_;      ///< The shard being registered.
+};
+
+static void Usage(const char* program)
+{
+    std::cerr << "Usage: " << program << " [-v] [-s series UID] <parameter file> <input> <output>\n"
+              << "       " << program << " [-v] [-s series UID] --queue <dir> [--shard-size n]"
+                                         " <parameter file> <input>\n"
+              << "       " << program << " [-v] --worker <dir>\n"
+              << "       " << program << " [-v] --merge <dir> <output>\n"
+              << "       " << program << " [-v] --requeue <dir> [--lease s]\n"
+              << "  <input>  A 4D image file or a directory of DICOM files. The time points\n"
+              << "           of a DICOM series are told apart by Temporal Position Identifier.\n"
+              << "  <output> The registered series as a 4D image file. The transforms are\n"
+              << "           written beside it as <output stem>-t<image>[-s<slice>]-<stage>.tfm\n"
+              << "           and Demons displacement fields as ...-demons.mha.\n"
+              << "  -v       Log the progress of each registration.\n"
+              << "  -s       The DICOM series to register if the directory holds more than one.\n"
+              << "  --queue  Split the series into shards of n time points (default 1) in a work\n"
+              << "           queue in <dir>, which must be visible to all of the workers.\n"
+              << "  --worker Register shards from the queue in <dir> until none are left. Run as\n"
+              << "           many workers as wanted, on any machine which can see <dir> and <input>.\n"
+              << "  --merge  Resample the series with the transforms of all of the shards.\n"
+              << "  --requeue Put shards claimed by workers which died back in the queue. A\n"
+              << "           worker on this machine has died if its process is gone, one on\n"
+              << "           another if it has not renewed its claim for s seconds (default "
+              << DefaultLeaseSeconds << ").\n"
+              << "See ItkRegistrationParams::ReadFile() for the parameter file format.\n";
+}
+
+static bool IsDirectory(const std::string& path)
+{
+    struct stat info;
+    return (stat(path.c_str(), &info) == 0) && S_ISDIR(info.st_mode);
+}
+
+/**
+ * Read the time points of a 4D image file.
+ */
+static bool ReadImageFile(const std::string& path, ImageSlicer& slicer, unsigned& numImages)
+{
+    typedef itk::ImageFileReader<Image4D> ReaderType;
+    typedef itk::ExtractImageFilter<Image4D, Image3D> ExtractType;
+
+    ReaderType::Pointer reader = ReaderType::New();
+    reader->SetFileName(path);
+    reader->Update();
+
+    Image4D::RegionType region = reader->GetOutput()->GetLargestPossibleRegion();
+    numImages = region.GetSize(3);
+
+    for (unsigned imageIdx = 0; imageIdx < numImages; ++imageIdx)
+    {
+        Image4D::RegionType timePoint = region;
+        timePoint.SetIndex(3, region.GetIndex(3) + imageIdx);
+        timePoint.SetSize(3, 0);
+
+        ExtractType::Pointer extract = ExtractType::New();
+        extract->SetInput(reader->GetOutput());
+        extract->SetExtractionRegion(timePoint);
+        extract->SetDirectionCollapseToSubmatrix();
+        extract->Update();
+        slicer.AddImage(extract->GetOutput());
+    }
+
+    return true;
+}
+
+/**
+ * Read the time points of a DICOM series. Each time point is a sub-series with its
+ * own Temporal Position Identifier.
+ */
+static bool ReadDicomDirectory(const std::string& directory, const std::string& seriesUID,
+                               ImageSlicer& slicer, unsigned& numImages)
+{
+    DicomNameGenerator::Pointer nameGenerator = DicomNameGenerator::New();
+    nameGenerator->SetUseSeriesDetails(true);
+    nameGenerator->AddSeriesRestriction(TemporalPositionTag);
+    nameGenerator->SetDirectory(directory);
+
+    const DicomNameGenerator::SeriesUIDContainerType& uids = nameGenerator->GetSeriesUIDs();
+    std::vector<std::pair<int, std::string> > timePoints;
+    for (unsigned idx = 0; idx < uids.size(); ++idx)
+    {
+        // The sub-series identifiers begin with the UID of their series.
+        if (seriesUID.empty() || (uids[idx].compare(0, seriesUID.size(), seriesUID) == 0))
+            timePoints.push_back(std::make_pair(0, uids[idx]));
+    }
+
+    if (timePoints.empty())
+    {
+        LOG4CPLUS_ERROR(logger_, "No DICOM series found in " << directory);
+        return false;
+    }
+
+    std::vector<Image3D::Pointer> images;
+    for (unsigned idx = 0; idx < timePoints.size(); ++idx)
+    {
+        itk::GDCMImageIO::Pointer dicomIO = itk::GDCMImageIO::New();
+        SeriesReader::Pointer reader = SeriesReader::New();
+        reader->SetImageIO(dicomIO);
+        reader->SetFileNames(nameGenerator->GetFileNames(timePoints[idx].second));
+        reader->Update();
+
+        std::string position;
+        const MetaDataDictionaryArray* dicts = reader->GetMetaDataDictionaryArray();
+        if (!dicts->empty() && itk::ExposeMetaData<std::string>(*(*dicts)[0], TemporalPositionTag,
+                                                                position))
+            timePoints[idx].first = std::atoi(position.c_str());
+        else
+            timePoints[idx].first = idx;
+
+        images.push_back(reader->GetOutput());
+    }
+
+    // Put the time points in order.
+    std::vector<std::pair<int, unsigned> > order;
+    for (unsigned idx = 0; idx < timePoints.size(); ++idx)
+        order.push_back(std::make_pair(timePoints[idx].first, idx));
+    std::sort(order.begin(), order.end());
+
+    for (unsigned idx = 0; idx < order.size(); ++idx)
+        slicer.AddImage(images[order[idx].second]);
+
+    numImages = images.size();
+    LOG4CPLUS_INFO(logger_, "Read " << numImages << " time points from " << directory);
+
+    return true;
+}
+
+/**
+ * Write the registered series as a 4D image.
+ */
+static void WriteSeries(const std::string& path, ImageSlicer& slicer, unsigned numImages)
+{
+    typedef itk::JoinSeriesImageFilter<Image3D, Image4D> JoinType;
+    typedef itk::ImageFileWriter<Image4D> WriterType;
+
+    JoinType::Pointer join = JoinType::New();
+    for (unsigned imageIdx = 0; imageIdx < numImages; ++imageIdx)
+        join->SetInput(imageIdx, slicer.GetImage(imageIdx));
+
+    WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(path);
+    writer->SetInput(join->GetOutput());
+    writer->UseCompressionOn();
+    writer->Update();
+}
+
+template <class TTransform>
+static void WriteTransform(const std::string& path, const TransformParams& params)
+{
+    if (params.IsEmpty())
+        return;
+
+    typename TTransform::Pointer transform = TTransform::New();
+    if (params.fixedParameters.GetSize() != 0)
+        transform->SetFixedParameters(params.fixedParameters);
+    transform->SetParameters(params.parameters);
+
+    itk::TransformFileWriter::Pointer writer = itk::TransformFileWriter::New();
+    writer->SetFileName(path);
+    writer->SetInput(transform);
+    writer->Update();
+}
+
+template <class TField>
+static void WriteField(const std::string& path, typename TField::Pointer field)
+{
+    if (field.IsNull())
+        return;
+
+    typedef itk::ImageFileWriter<TField> WriterType;
+    typename WriterType::Pointer writer = WriterType::New();
+    writer->SetFileName(path);
+    writer->SetInput(field);
+    writer->UseCompressionOn();
+    writer->Update();
+}
+
+/**
+ * Write the transforms of one registration beside the output.
+ */
+static void WriteTransforms(const std::string& stem, unsigned imageIdx, unsigned sliceIdx,
+                            bool sliceWise, unsigned numSlices,
+                            const SeriesRegistration::ImageResult& result)
+{
+    std::ostringstream name;
+    name << stem << "-t" << std::setw(3) << std::setfill('0') << imageIdx + 1;
+    if (numSlices > 1)
+        name << "-s" << std::setw(3) << std::setfill('0') << sliceIdx + 1;
+
+    if (sliceWise)
+    {
+        WriteTransform<CenteredRigid2DTransform>(name.str() + "-rigid.tfm", result.transforms.rigid);
+        WriteTransform<BSplineTransform2D>(name.str() + "-bspline.tfm", result.transforms.deformable);
+        WriteField<DemonsDisplacementField2D>(name.str() + "-demons.mha", result.field2D);
+    }
+    else
+    {
+        WriteTransform<VersorTransform3D>(name.str() + "-rigid.tfm", result.transforms.rigid);
+        WriteTransform<BSplineTransform3D>(name.str() + "-bspline.tfm", result.transforms.deformable);
+        WriteField<DemonsDisplacementField3D>(name.str() + "-demons.mha", result.field3D);
+    }
+}
+
+/**
+ * The output path without its image extension.
+ */
+static std::string OutputStem(const std::string& path)
+{
+    const char* const extensions[] = {".nii.gz", ".nii", ".mha", ".mhd", ".nrrd", ".nhdr"};
+    for (unsigned idx = 0; idx < sizeof(extensions) / sizeof(extensions[0]); ++idx)
+    {
+        std::string ext = extensions[idx];
+        if ((path.size() > ext.size()) && (path.compare(path.size() - ext.size(), ext.size(), ext) == 0))
+            return path.substr(0, path.size() - ext.size());
+    }
+
+    return path;
+}
+
+/**
+ * Read the parameters and the series, and set the parameters which describe the series.
+ */
+static bool LoadSeries(const std::string& paramPath, const std::string& input,
+                       const std::string& seriesUID, ItkRegistrationParams& params,
+                       ImageSlicer& slicer)
+{
+    if (!params.ReadFile(paramPath))
+        return false;
+
+    unsigned numImages = 0;
+    try
+    {
+        bool ok = IsDirectory(input)
+                ? ReadDicomDirectory(input, seriesUID, slicer, numImages)
+                : ReadImageFile(input, slicer, numImages);
+        if (!ok)
+            return false;
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        LOG4CPLUS_ERROR(logger_, "Could not read " << input << ". " << ParseITKException(err));
+        return false;
+    }
+
+    if (numImages < 2)
+    {
+        LOG4CPLUS_ERROR(logger_, input << " must have at least two time points.");
+        return false;
+    }
+
+    params.numImages = numImages;
+    params.slicesPerImage = slicer.GetImage(0)->GetLargestPossibleRegion().GetSize(2);
+    params.flippedData = false;
+    if ((params.fixedImageNumber < 1) || (params.fixedImageNumber > numImages))
+    {
+        LOG4CPLUS_ERROR(logger_, "FixedImageNumber must be from 1 to " << numImages << ".");
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Register the whole series in this process.
+ */
+static int RegisterSeries(const std::string& paramPath, const std::string& input,
+                          const std::string& seriesUID, const std::string& output)
+{
+    ItkRegistrationParams params;
+    ImageSlicer slicer;
+    if (!LoadSeries(paramPath, input, seriesUID, params, slicer))
+        return 1;
+
+    LogProgress progress;
+    SeriesRegistration registration(params, &progress);
+    unsigned numSlices = registration.IsSliceWise() ? params.slicesPerImage : 1;
+    unsigned numFailed = 0;
+    try
+    {
+        numFailed = registration.Register(slicer);
+        WriteSeries(output, slicer, params.numImages);
+
+        for (unsigned imageIdx = 0; imageIdx < params.numImages; ++imageIdx)
+            if (imageIdx != params.fixedImageNumber - 1)
+                for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+                    WriteTransforms(OutputStem(output), imageIdx, sliceIdx,
+                                    registration.IsSliceWise(), numSlices,
+                                    registration.GetResult(imageIdx, sliceIdx));
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        LOG4CPLUS_ERROR(logger_, ParseITKException(err));
+        return 1;
+    }
+
+    LOG4CPLUS_INFO(logger_, "Registered series written to " << output);
+
+    // Images left unregistered are reported but the series is still usable.
+    return (numFailed == 0) ? 0 : 2;
+}
+
+/**
+ * Split the series into shards for worker processes.
+ */
+static int QueueShards(const std::string& queueDir, unsigned shardSize,
+                       const std::string& paramPath, const std::string& input,
+                       const std::string& seriesUID)
+{
+    ItkRegistrationParams params;
+    ImageSlicer slicer;
+    if (!LoadSeries(paramPath, input, seriesUID, params, slicer))
+        return 1;
+
+    ShardQueue queue(queueDir);
+    return queue.Create(paramPath, input, seriesUID, params.numImages, shardSize) ? 0 : 1;
+}
+
+/**
+ * Register shards from the queue until there are none left. The transforms of each
+ * shard are stored in the queue directory as a checkpoint named after the shard.
+ */
+static int RunWorker(const std::string& queueDir)
+{
+    ShardQueue queue(queueDir);
+    if (!queue.Open())
+        return 1;
+
+    ItkRegistrationParams params;
+    ImageSlicer slicer;
+    if (!LoadSeries(queue.GetParamPath(), queue.GetInput(), queue.GetSeriesUID(), params, slicer))
+        return 1;
+
+    if (params.numImages != queue.GetNumImages())
+    {
+        LOG4CPLUS_ERROR(logger_, queue.GetInput() << " has " << params.numImages
+                        << " time points but the queue was made for " << queue.GetNumImages());
+        return 1;
+    }
+
+    LogProgress progress;
+    SeriesRegistration registration(params, &progress);
+    unsigned numSlices = registration.IsSliceWise() ? params.slicesPerImage : 1;
+    std::string signature = params.Signature();
+
+    unsigned shard = 0;
+    while (queue.Claim(shard))
+    {
+        progress.SetClaim(&queue, shard);
+        std::vector<unsigned> images = queue.ShardImages(shard);
+        RegistrationCheckpoint transforms(queueDir, queue.ShardName(shard), signature);
+        try
+        {
+            registration.Register(slicer, images);
+        }
+        catch (itk::ExceptionObject& err)
+        {
+            // Left claimed so that it may be put back in the queue.
+            LOG4CPLUS_ERROR(logger_, "Shard " << shard + 1 << ": " << ParseITKException(err));
+            return 1;
+        }
+
+        // As with a checkpoint, images left unregistered are not stored.
+        for (unsigned idx = 0; idx < images.size(); ++idx)
+        {
+            for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+            {
+                unsigned imageIdx = images[idx];
+                const SeriesRegistration::ImageResult& result = registration.GetResult(imageIdx,
+                                                                                        sliceIdx);
+                if ((imageIdx == params.fixedImageNumber - 1) || (result.code == DISASTER))
+                    continue;
+
+                RegistrationCheckpoint::Record record;
+                record.rigid = result.transforms.rigid;
+                record.deformable = result.transforms.deformable;
+                if (result.field2D.IsNotNull())
+                    record.displacementField = transforms.StoreDisplacementField(imageIdx, sliceIdx,
+                                                                    result.field2D.GetPointer());
+                else if (result.field3D.IsNotNull())
+                    record.displacementField = transforms.StoreDisplacementField(imageIdx, sliceIdx,
+                                                                    result.field3D.GetPointer());
+                if ((result.field2D.IsNull() && result.field3D.IsNull())
+                    || !record.displacementField.empty())
+                    transforms.Store(imageIdx, sliceIdx, record);
+            }
+        }
+
+        if (!queue.Finish(shard))
+            return 1;
+    }
+
+    LOG4CPLUS_INFO(logger_, "No shards left in " << queueDir);
+    return 0;
+}
+
+/**
+ * Resample the series with the transforms of all of the shards and write it.
+ */
+static int MergeShards(const std::string& queueDir, const std::string& output)
+{
+    ShardQueue queue(queueDir);
+    if (!queue.Open())
+        return 1;
+
+    std::vector<unsigned> unfinished = queue.Unfinished();
+    if (!unfinished.empty())
+    {
+        LOG4CPLUS_ERROR(logger_, unfinished.size() << " shards are not yet registered. The first is "
+                        << queue.ShardName(unfinished[0]));
+        return 1;
+    }
+
+    ItkRegistrationParams params;
+    ImageSlicer slicer;
+    if (!LoadSeries(queue.GetParamPath(), queue.GetInput(), queue.GetSeriesUID(), params, slicer))
+        return 1;
+
+    // Registered slice by slice as SeriesRegistration does.
+    bool sliceWise = (params.slicesPerImage == 1) || params.sliceWise;
+    unsigned numSlices = sliceWise ? params.slicesPerImage : 1;
+    unsigned fixedImageIdx = params.fixedImageNumber - 1;
+    std::string signature = params.Signature();
+    unsigned numMissing = 0;
+
+    try
+    {
+        for (unsigned shard = 0; shard < queue.GetNumShards(); ++shard)
+        {
+            RegistrationCheckpoint transforms(queueDir, queue.ShardName(shard), signature);
+            std::vector<unsigned> images = queue.ShardImages(shard);
+            for (unsigned idx = 0; idx < images.size(); ++idx)
+            {
+                unsigned imageIdx = images[idx];
+                if (imageIdx == fixedImageIdx)
+                    continue;
+
+                for (unsigned sliceIdx = 0; sliceIdx < numSlices; ++sliceIdx)
+                {
+                    RegistrationCheckpoint::Record record;
+                    if (!transforms.Find(imageIdx, sliceIdx, record))
+                    {
+                        LOG4CPLUS_WARN(logger_, "Image " << imageIdx + 1 << ", slice " << sliceIdx + 1
+                                       << " was not registered. Left as it was.");
+                        ++numMissing;
+                        continue;
+                    }
+
+                    SeriesRegistration::ImageResult result;
+                    result.transforms.rigid = record.rigid;
+                    result.transforms.deformable = record.deformable;
+
+                    bool hasField = !record.displacementField.empty();
+                    if (hasField && !(sliceWise
+                                      ? transforms.LoadDisplacementField(record, result.field2D)
+                                      : transforms.LoadDisplacementField(record, result.field3D)))
+                    {
+                        ++numMissing;
+                        continue;
+                    }
+
+                    if (sliceWise)
+                    {
+                        Image2D::Pointer moving = slicer.GetSlice2D(imageIdx, sliceIdx);
+                        Image2D::Pointer regImage;
+                        if (hasField)
+                            regImage = WarpWithField<Image2D, DemonsDisplacementField2D>(moving,
+                                                                                 result.field2D);
+                        else
+                            regImage = ResampleWithTransforms<Image2D, CenteredRigid2DTransform>(
+                                                moving, slicer.GetSlice2D(fixedImageIdx, sliceIdx),
+                                                record.rigid, record.deformable);
+                        slicer.SetSlice2D(regImage, imageIdx, sliceIdx);
+                    }
+                    else
+                    {
+                        Image3D::Pointer moving = slicer.GetImage(imageIdx);
+                        Image3D::Pointer regImage;
+                        if (hasField)
+                            regImage = WarpWithField<Image3D, DemonsDisplacementField3D>(moving,
+                                                                                 result.field3D);
+                        else
+                            regImage = ResampleWithTransforms<Image3D, VersorTransform3D>(
+                                                moving, slicer.GetImage(fixedImageIdx),
+                                                record.rigid, record.deformable);
+                        slicer.SetImage(regImage, imageIdx);
+                    }
+
+                    WriteTransforms(OutputStem(output), imageIdx, sliceIdx, sliceWise, numSlices,
+                                    result);
+                }
+            }
+        }
+
+        WriteSeries(output, slicer, params.numImages);
+    }
+    catch (itk::ExceptionObject& err)
+    {
+        LOG4CPLUS_ERROR(logger_, ParseITKException(err));
+        return 1;
+    }
+
+    LOG4CPLUS_INFO(logger_, "Merged series written to " << output);
+
+    return (numMissing == 0) ? 0 : 2;
+}
+
+int main(int argc, char* argv[])
+{
+    bool verbose = false;
+    std::string seriesUID;
+    std::string queueDir;
+    std::string workerDir;
+    std::string mergeDir;
+    std::string requeueDir;
+    unsigned shardSize = 1;
+    unsigned leaseSeconds = DefaultLeaseSeconds;
+    std::vector<std::string> args;
+    for (int idx = 1; idx < argc; ++idx)
+    {
+        std::string arg = argv[idx];
+        bool hasValue = (idx + 1 < argc);
+        if (arg == "-v")
+            verbose = true;
+        else if ((arg == "-s") && hasValue)
+            seriesUID = argv[++idx];
+        else if ((arg == "--queue") && hasValue)
+            queueDir = argv[++idx];
+        else if ((arg == "--shard-size") && hasValue)
+            shardSize = std::atoi(argv[++idx]);
+        else if ((arg == "--worker") && hasValue)
+            workerDir = argv[++idx];
+        else if ((arg == "--merge") && hasValue)
+            mergeDir = argv[++idx];
+        else if ((arg == "--requeue") && hasValue)
+            requeueDir = argv[++idx];
+        else if ((arg == "--lease") && hasValue)
+            leaseSeconds = std::atoi(argv[++idx]);
+        else if ((arg == "-h") || (arg == "--help"))
+        {
+            Usage(argv[0]);
+            return 0;
+        }
+        else if (arg[0] == '-')
+        {
+            Usage(argv[0]);
+            return 1;
+        }
+        else
+            args.push_back(arg);
+    }
+
+    SetupLogger(LOGGER_NAME, verbose ? log4cplus::DEBUG_LOG_LEVEL : log4cplus::INFO_LOG_LEVEL);
+    logger_ = log4cplus::Logger::getInstance(std::string(LOGGER_NAME) + ".dcefit-register");
+
+    if (!workerDir.empty() && args.empty())
+        return RunWorker(workerDir);
+    else if (!mergeDir.empty() && (args.size() == 1))
+        return MergeShards(mergeDir, args[0]);
+    else if (!requeueDir.empty() && args.empty())
+    {
+        ShardQueue queue(requeueDir);
+        queue.Requeue(leaseSeconds);
+        return 0;
+    }
+    else if (!queueDir.empty() && (args.size() == 2))
+        return QueueShards(queueDir, shardSize, args[0], args[1], seriesUID);
+    else if (queueDir.empty() && (args.size() == 3))
+        return RegisterSeries(args[0], args[1], seriesUID, args[2]);
+
+    Usage(argv[0]);
+    return 1;
+}